@@ -0,0 +1,118 @@
+/*
+ * FileSearch library API
+ *
+ * Searches and tags a filesearch database in-process, without running
+ * the CLI or parsing its output. Results come back through an iterator
+ * one row at a time; nothing is printed.
+ *
+ *   fs_db *fs;
+ *   if (fs_open("/home/me/.filesearch/filesearch.db", 0, &fs) != FS_OK) ...
+ *
+ *   fs_search_options opts;
+ *   fs_search_options_init(&opts);
+ *   opts.match = FS_MATCH_FUZZY;
+ *   opts.query = "report";
+ *
+ *   fs_iter *it;
+ *   fs_result r;
+ *   if (fs_search(fs, &opts, &it) == FS_OK) {
+ *       while (fs_iter_next(it, &r) == FS_ROW) {
+ *           use(r.path, r.distance);
+ *       }
+ *       fs_iter_free(it);
+ *   }
+ *   fs_close(fs);
+ *
+ * The database must already exist (the CLI creates it). A handle is
+ * used by one thread at a time; open one per thread to search in
+ * parallel.
+ *
+ * Compile: gcc -c src/libfilesearch.c deps/sqlite3.c
+ */
+
+#ifndef FILESEARCH_H
+#define FILESEARCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sqlite3;
+
+typedef struct fs_db fs_db;
+typedef struct fs_iter fs_iter;
+
+/* Return codes */
+#define FS_OK         0
+#define FS_ROW        1    /* fs_iter_next stored a result */
+#define FS_DONE       2    /* fs_iter_next: no more results */
+#define FS_NOT_FOUND  3    /* fs_tag/fs_untag: path or tag not in the database */
+#define FS_ERROR     -1    /* see fs_errmsg */
+
+/* fs_open flags */
+#define FS_OPEN_READONLY 0x1
+
+typedef enum {
+    FS_MATCH_EXACT,        /* name equals query, ignoring case */
+    FS_MATCH_PREFIX,       /* name starts with query */
+    FS_MATCH_SUBSTRING,    /* name contains query */
+    FS_MATCH_FUZZY         /* Levenshtein distance to query <= max_distance */
+} fs_match;
+
+typedef enum {
+    FS_SORT_NONE,          /* table order (fuzzy: distance, then name) */
+    FS_SORT_PATH           /* by path */
+} fs_sort;
+
+typedef struct {
+    fs_match match;
+    const char *query;     /* NULL or "" matches every name (not for fuzzy) */
+    const char *category;  /* only paths in this category, or NULL */
+    const char *tag;       /* only paths with this tag, or NULL */
+    int max_distance;      /* FS_MATCH_FUZZY only */
+    int limit;             /* 0 for no limit */
+    fs_sort sort;
+} fs_search_options;
+
+/* One search result. The strings stay valid until the next fs_iter_next or fs_iter_free. */
+typedef struct {
+    const char *path;
+    const char *name;
+    int is_directory;
+    long long size;        /* 0 when not recorded */
+    int distance;          /* FS_MATCH_FUZZY only, otherwise 0 */
+} fs_result;
+
+/* On FS_ERROR *out may still be set, for fs_errmsg; fs_close it either way */
+int fs_open(const char *db_path, int flags, fs_db **out);
+
+/* Use a connection the caller already has; fs_close leaves it open */
+int fs_attach(struct sqlite3 *conn, fs_db **out);
+
+void fs_close(fs_db *fs);
+
+/* Message for the last FS_ERROR on this handle */
+const char *fs_errmsg(fs_db *fs);
+
+void fs_search_options_init(fs_search_options *opts);
+int fs_search(fs_db *fs, const fs_search_options *opts, fs_iter **out);
+int fs_iter_next(fs_iter *it, fs_result *result);
+void fs_iter_free(fs_iter *it);
+
+/* Tag or untag an indexed path. fs_tag creates the tag if needed; tagging twice is not an error. */
+int fs_tag(fs_db *fs, const char *path, const char *tag);
+int fs_untag(fs_db *fs, const char *path, const char *tag);
+
+/*
+ * Levenshtein distance (ASCII case-insensitive) when it is at most
+ * max_distance, otherwise max_distance + 1. Only the diagonal band is
+ * computed and the scan stops once a whole row is over the bound.
+ * Returns -1 if memory runs out.
+ */
+int fs_levenshtein_bounded(const char *s1, int len1, const char *s2, int len2, int max_distance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FILESEARCH_H */
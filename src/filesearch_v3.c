@@ -24,22 +24,73 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include "../deps/sqlite3.h"
+#include "filesearch.h"
 
 #ifdef _WIN32
     #include <windows.h>
     #include <direct.h>
+    #include <process.h>
+    #include <io.h>
     #define PATH_SEPARATOR '\\'
     #define PATH_SEPARATOR_STR "\\"
 #else
     #include <unistd.h>
     #include <pwd.h>
+    #include <pthread.h>
+    #include <time.h>
+    #include <utime.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/wait.h>
+    #include <sys/resource.h>
     #define PATH_SEPARATOR '/'
     #define PATH_SEPARATOR_STR "/"
 #endif
 
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+#endif
+
+#if defined(_MSC_VER)
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL _Thread_local
+#endif
+
+/*
+ * Where commands print: stdout, or a per-client buffer while the serve
+ * daemon runs a command on a worker thread. Command code prints with
+ * out() and reports errors on command_stderr, which is the same
+ * per-client buffer under serve, so the client sees both.
+ */
+THREAD_LOCAL FILE *command_output = NULL;
+THREAD_LOCAL FILE *command_errors = NULL;
+#define command_stdout (command_output ? command_output : stdout)
+#define command_stderr (command_errors ? command_errors : stderr)
+
+#ifdef __GNUC__
+__attribute__((format(printf, 1, 2)))
+#endif
+void out(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(command_stdout, format, args);
+    va_end(args);
+}
+
 #define MAX_PATH_LENGTH 4096
 #define MAX_INPUT_LENGTH 512
 #define MAX_TAG_LENGTH 256
@@ -47,11 +98,27 @@
 #define APP_DIRNAME ".filesearch"
 
 /* Default settings (used when creating new database) */
-#define DEFAULT_SCHEMA_VERSION 1
+#define DEFAULT_SCHEMA_VERSION 4
 #define DEFAULT_APP_VERSION 1
 #define DEFAULT_SIMILARITY_THRESHOLD 3
 #define DEFAULT_MAX_RESULTS 20
 #define DEFAULT_FUZZY_DISTANCE 3
+#define DEFAULT_PERSIST_INTERVAL 60
+#define DEFAULT_IMPORT_BATCH_SIZE 10000
+#define DEFAULT_SOFT_HEAP_LIMIT_KB 0
+#define DEFAULT_CACHE_SIZE_KB 2048
+#define DEFAULT_METRICS_BUDGET_KB 1024
+#define DEFAULT_GROUP_COMMIT_MS 5
+#define DEFAULT_GROUP_COMMIT_MAX 1000
+#define DEFAULT_MAINTENANCE_IDLE_MS 2000
+#define DEFAULT_MAINTENANCE_BUDGET 2000
+#define DEFAULT_MAINTENANCE_STALE_S 3600
+#define DEFAULT_MAINTENANCE_OPTIMIZE_S 3600
+#define DEFAULT_MAINTENANCE_REFRESH_S 86400
+#define DEFAULT_MAINTENANCE_INDEX_S 600
+#define DEFAULT_MAINTENANCE_CHECKPOINT_S 300
+#define SNAPSHOT_SUFFIX ".snapshot"
+#define SNAPSHOT_MMAP_SIZE (1LL << 30)
 
 /* ============================================
  * Utility Functions
@@ -84,9 +151,30 @@ void str_to_lower(char *str) {
     }
 }
 
+/* Set by replay, batch and serve modes: prompts are answered without reading stdin */
+int non_interactive = 0;
+
+/* The answer given when non_interactive; "no" unless asked for (--yes, replay --yes) */
+int assume_yes = 0;
+THREAD_LOCAL int confirmations_declined = 0;
+
+/* Defined with the output formats: stderr when stdout carries records */
+FILE *status_output();
+
+/* Set by -c and --batch: no banners, startup messages or prompt */
+int batch_mode = 0;
+
 int get_confirmation(const char *prompt) {
     char response[16];
-    printf("%s (y/n): ", prompt);
+    if (non_interactive) {
+        if (!assume_yes) {
+            confirmations_declined++;
+            fprintf(command_stderr, "%s Answered \"no\"; --yes accepts prompts.\n", prompt);
+        }
+        return assume_yes;
+    }
+
+    out("%s (y/n): ", prompt);
     fflush(stdout);
     
     if (!fgets(response, sizeof(response), stdin)) {
@@ -98,1946 +186,11386 @@ int get_confirmation(const char *prompt) {
 }
 
 /* ============================================
- * Cross-Platform Path Handling
+ * Timing and Threading Helpers
  * ============================================ */
 
-int get_home_directory(char *buffer, size_t size) {
+/* Monotonic clock in nanoseconds, for intervals only */
+long long monotonic_ns() {
 #ifdef _WIN32
-    const char *userprofile = getenv("USERPROFILE");
-    if (userprofile && strlen(userprofile) < size) {
-        strcpy(buffer, userprofile);
-        return 0;
-    }
-    return -1;
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (long long)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
 #else
-    const char *home = getenv("HOME");
-    if (home && strlen(home) < size) {
-        strcpy(buffer, home);
-        return 0;
-    }
-    
-    struct passwd *pw = getpwuid(getuid());
-    if (pw && pw->pw_dir && strlen(pw->pw_dir) < size) {
-        strcpy(buffer, pw->pw_dir);
-        return 0;
-    }
-    return -1;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 #endif
 }
 
-int get_default_db_path(char *buffer, size_t size) {
-    char home[MAX_PATH_LENGTH];
-    
-    if (get_home_directory(home, sizeof(home)) != 0) {
-        return -1;
-    }
-    
-    int written = snprintf(buffer, size, "%s%s%s%s%s", 
-                           home, PATH_SEPARATOR_STR, 
-                           APP_DIRNAME, PATH_SEPARATOR_STR, 
-                           DB_FILENAME);
-    
-    if (written < 0 || (size_t)written >= size) {
-        return -1;
-    }
-    
+/* Wall-clock time in milliseconds since the Unix epoch */
+long long wall_clock_ms() {
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    unsigned long long t = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (long long)(t / 10000ULL) - 11644473600000LL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+#endif
+}
+
+void sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+#ifdef _WIN32
+typedef HANDLE fs_thread_t;
+typedef CRITICAL_SECTION fs_mutex_t;
+
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+} thread_trampoline_t;
+
+static unsigned __stdcall thread_trampoline(void *p) {
+    thread_trampoline_t t = *(thread_trampoline_t *)p;
+    free(p);
+    t.fn(t.arg);
     return 0;
 }
 
-int directory_exists(const char *path) {
-    struct stat st;
-    if (stat(path, &st) == 0) {
-        return S_ISDIR(st.st_mode);
+int thread_start(fs_thread_t *thread, void *(*fn)(void *), void *arg) {
+    thread_trampoline_t *t = malloc(sizeof(*t));
+    if (!t) return -1;
+    t->fn = fn;
+    t->arg = arg;
+    *thread = (HANDLE)_beginthreadex(NULL, 0, thread_trampoline, t, 0, NULL);
+    if (!*thread) {
+        free(t);
+        return -1;
     }
     return 0;
 }
 
-int file_exists(const char *path) {
-    struct stat st;
-    return (stat(path, &st) == 0);
+void thread_join(fs_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
 }
 
-void get_directory_from_path(const char *filepath, char *dir_buffer, size_t size) {
-    strncpy(dir_buffer, filepath, size - 1);
-    dir_buffer[size - 1] = '\0';
-    
-    char *last_sep = strrchr(dir_buffer, PATH_SEPARATOR);
-    if (last_sep) {
-        *last_sep = '\0';
+void mutex_init(fs_mutex_t *m)    { InitializeCriticalSection(m); }
+void mutex_lock(fs_mutex_t *m)    { EnterCriticalSection(m); }
+void mutex_unlock(fs_mutex_t *m)  { LeaveCriticalSection(m); }
+void mutex_destroy(fs_mutex_t *m) { DeleteCriticalSection(m); }
+
+typedef CONDITION_VARIABLE fs_cond_t;
+
+void cond_init(fs_cond_t *c)                   { InitializeConditionVariable(c); }
+void cond_wait(fs_cond_t *c, fs_mutex_t *m)    { SleepConditionVariableCS(c, m, INFINITE); }
+void cond_wait_ms(fs_cond_t *c, fs_mutex_t *m, int ms) { SleepConditionVariableCS(c, m, (DWORD)ms); }
+void cond_broadcast(fs_cond_t *c)              { WakeAllConditionVariable(c); }
+#else
+typedef pthread_t fs_thread_t;
+typedef pthread_mutex_t fs_mutex_t;
+
+int thread_start(fs_thread_t *thread, void *(*fn)(void *), void *arg) {
+    return pthread_create(thread, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+void thread_join(fs_thread_t thread) {
+    pthread_join(thread, NULL);
+}
+
+void mutex_init(fs_mutex_t *m)    { pthread_mutex_init(m, NULL); }
+void mutex_lock(fs_mutex_t *m)    { pthread_mutex_lock(m); }
+void mutex_unlock(fs_mutex_t *m)  { pthread_mutex_unlock(m); }
+void mutex_destroy(fs_mutex_t *m) { pthread_mutex_destroy(m); }
+
+typedef pthread_cond_t fs_cond_t;
+
+void cond_init(fs_cond_t *c)                   { pthread_cond_init(c, NULL); }
+void cond_wait(fs_cond_t *c, fs_mutex_t *m)    { pthread_cond_wait(c, m); }
+void cond_broadcast(fs_cond_t *c)              { pthread_cond_broadcast(c); }
+
+/* Wait at most ms milliseconds; wakes spuriously like cond_wait */
+void cond_wait_ms(fs_cond_t *c, fs_mutex_t *m, int ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(c, m, &deadline);
+}
+#endif
+
+/*
+ * Run fn(index, ctx) for index in [0, count) on up to max_threads
+ * threads. Each thread claims the next index until none are left.
+ */
+typedef struct {
+    void (*fn)(int index, void *ctx);
+    void *ctx;
+    int count;
+    int next;
+    fs_mutex_t lock;
+} parallel_job_t;
+
+void *parallel_worker(void *arg) {
+    parallel_job_t *job = arg;
+    while (1) {
+        mutex_lock(&job->lock);
+        int index = job->next++;
+        mutex_unlock(&job->lock);
+        if (index >= job->count) break;
+        job->fn(index, job->ctx);
     }
+    return NULL;
 }
 
-const char *get_filename_from_path(const char *path) {
-    const char *last_sep = strrchr(path, PATH_SEPARATOR);
-#ifdef _WIN32
-    const char *last_fwd = strrchr(path, '/');
-    if (last_fwd && (!last_sep || last_fwd > last_sep)) {
-        last_sep = last_fwd;
+void run_parallel(int count, int max_threads, void (*fn)(int index, void *ctx), void *ctx) {
+    parallel_job_t job;
+    job.fn = fn;
+    job.ctx = ctx;
+    job.count = count;
+    job.next = 0;
+    mutex_init(&job.lock);
+    
+    int nthreads = count < max_threads ? count : max_threads;
+    fs_thread_t *threads = malloc((nthreads > 0 ? nthreads : 1) * sizeof(fs_thread_t));
+    int started = 0;
+    
+    if (threads) {
+        for (; started < nthreads; started++) {
+            if (thread_start(&threads[started], parallel_worker, &job) != 0) break;
+        }
     }
-#endif
-    return last_sep ? last_sep + 1 : path;
+    
+    /* Fall back to the calling thread if no worker could be started */
+    if (started == 0) {
+        parallel_worker(&job);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        thread_join(threads[i]);
+    }
+    free(threads);
+    mutex_destroy(&job.lock);
 }
 
 /* ============================================
- * Levenshtein Distance
+ * Hardware Performance Counters
  * ============================================ */
 
-int levenshtein(const char *s1, const char *s2) {
-    int len1 = strlen(s1);
-    int len2 = strlen(s2);
-    
-    if (len1 == 0) return len2;
-    if (len2 == 0) return len1;
-    
-    if (len1 > len2) {
-        const char *temp = s1;
-        s1 = s2;
-        s2 = temp;
-        int t = len1;
-        len1 = len2;
-        len2 = t;
+/*
+ * Optional perf_event_open counters (--hw-counters, Linux only). Each
+ * thread opens its own counter group on first use and reads all four
+ * values with one read(). Samples are deltas between two reads, so the
+ * counters are never reset. Totals are kept per named bucket (command
+ * name, scan phase, kernel) and shown by 'stats'.
+ */
+enum {
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_CACHE_MISSES,
+    HW_BRANCH_MISSES,
+    HW_COUNTER_COUNT
+};
+
+typedef struct {
+    unsigned long long value[HW_COUNTER_COUNT];
+} hw_sample_t;
+
+typedef struct {
+    char name[48];
+    long long calls;
+    hw_sample_t total;
+} hw_bucket_t;
+
+int hw_counters_enabled = 0;
+int hw_user_only = 0;
+hw_bucket_t *hw_buckets = NULL;
+int hw_bucket_count = 0;
+fs_mutex_t hw_lock;
+
+#ifdef __linux__
+THREAD_LOCAL int hw_group_fd = -1;
+THREAD_LOCAL int hw_opened = 0;
+/* Position of each counter in the group read, or -1 if unsupported */
+THREAD_LOCAL int hw_slot[HW_COUNTER_COUNT];
+THREAD_LOCAL int hw_members = 0;
+THREAD_LOCAL int hw_fds[HW_COUNTER_COUNT];
+/* Its destructor closes a thread's counter fds when the thread exits */
+pthread_key_t hw_thread_key;
+
+void hw_close_thread(void *unused) {
+    (void)unused;
+    for (int i = 0; i < hw_members; i++) {
+        close(hw_fds[i]);
     }
-    
-    int *prev = malloc((len1 + 1) * sizeof(int));
-    int *curr = malloc((len1 + 1) * sizeof(int));
-    
-    if (!prev || !curr) {
-        free(prev);
-        free(curr);
+    hw_members = 0;
+    hw_group_fd = -1;
+}
+
+int hw_open_event(uint64_t config, int group_fd, int exclude_kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* Open this thread's counter group. Returns 0 when cycles can be counted. */
+int hw_open_thread() {
+    const uint64_t configs[HW_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    
+    hw_opened = 1;
+    hw_members = 0;
+    hw_group_fd = hw_open_event(configs[0], -1, hw_user_only);
+    if (hw_group_fd < 0) {
         return -1;
     }
+    hw_fds[hw_members] = hw_group_fd;
+    hw_slot[0] = hw_members++;
     
-    for (int i = 0; i <= len1; i++) {
-        prev[i] = i;
+    for (int i = 1; i < HW_COUNTER_COUNT; i++) {
+        int fd = hw_open_event(configs[i], hw_group_fd, hw_user_only);
+        if (fd >= 0) hw_fds[hw_members] = fd;
+        hw_slot[i] = (fd >= 0) ? hw_members++ : -1;
+    }
+    /* Any non-NULL value makes the destructor run */
+    pthread_setspecific(hw_thread_key, &hw_opened);
+    return 0;
+}
+#endif
+
+/* Read the calling thread's counters. Returns 0 on success. */
+int hw_sample(hw_sample_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!hw_counters_enabled) {
+        return -1;
+    }
+#ifdef __linux__
+    if (!hw_opened && hw_open_thread() != 0) {
+        return -1;
+    }
+    if (hw_group_fd < 0) {
+        return -1;
     }
     
-    for (int j = 1; j <= len2; j++) {
-        curr[0] = j;
-        
-        for (int i = 1; i <= len1; i++) {
-            int cost = (tolower(s1[i-1]) == tolower(s2[j-1])) ? 0 : 1;
-            curr[i] = min3(prev[i] + 1, curr[i-1] + 1, prev[i-1] + cost);
+    uint64_t data[1 + HW_COUNTER_COUNT];
+    if (read(hw_group_fd, data, sizeof(data)) < (ssize_t)sizeof(uint64_t)) {
+        return -1;
+    }
+    for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+        if (hw_slot[i] >= 0 && (uint64_t)hw_slot[i] < data[0]) {
+            out->value[i] = data[1 + hw_slot[i]];
         }
-        
-        int *temp = prev;
-        prev = curr;
-        curr = temp;
     }
-    
-    int result = prev[len1];
-    free(prev);
-    free(curr);
-    
-    return result;
+    return 0;
+#else
+    return -1;
+#endif
 }
 
-void sqlite_levenshtein(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
-    if (argc != 2) {
-        sqlite3_result_error(ctx, "levenshtein requires 2 arguments", -1);
+/* Add the counts since 'start' to an accumulator */
+void hw_accumulate(hw_sample_t *acc, const hw_sample_t *start) {
+    hw_sample_t now;
+    if (hw_sample(&now) != 0) {
         return;
     }
-    
-    const char *s1 = (const char *)sqlite3_value_text(argv[0]);
-    const char *s2 = (const char *)sqlite3_value_text(argv[1]);
-    
-    if (!s1 || !s2) {
-        sqlite3_result_null(ctx);
-        return;
+    for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+        acc->value[i] += now.value[i] - start->value[i];
     }
-    
-    sqlite3_result_int(ctx, levenshtein(s1, s2));
+}
+
+/* Add a delta to the named bucket */
+void hw_record_delta(const char *name, long long calls, const hw_sample_t *delta) {
+    mutex_lock(&hw_lock);
+    int i;
+    for (i = 0; i < hw_bucket_count; i++) {
+        if (strcmp(hw_buckets[i].name, name) == 0) break;
+    }
+    if (i == hw_bucket_count) {
+        hw_bucket_t *grown = realloc(hw_buckets, (hw_bucket_count + 1) * sizeof(hw_bucket_t));
+        if (!grown) {
+            mutex_unlock(&hw_lock);
+            return;
+        }
+        hw_buckets = grown;
+        memset(&hw_buckets[i], 0, sizeof(hw_bucket_t));
+        strncpy(hw_buckets[i].name, name, sizeof(hw_buckets[i].name) - 1);
+        hw_bucket_count++;
+    }
+    hw_buckets[i].calls += calls;
+    for (int c = 0; c < HW_COUNTER_COUNT; c++) {
+        hw_buckets[i].total.value[c] += delta->value[c];
+    }
+    mutex_unlock(&hw_lock);
+}
+
+/* Record the counts since 'start' under 'name' */
+void hw_record(const char *name, const hw_sample_t *start) {
+    hw_sample_t delta = {{0}};
+    hw_accumulate(&delta, start);
+    hw_record_delta(name, 1, &delta);
 }
 
 /*
- * Case-insensitive substring check.
- * Returns 1 if needle is in haystack (or vice versa), 0 otherwise.
+ * Turn counters on for this run. Fails (with a note) when the kernel
+ * refuses, e.g. perf_event_paranoid too high or a VM without a PMU.
+ * Falls back to user-space-only counting when kernel counting is denied.
  */
-int is_substring_match(const char *s1, const char *s2) {
-    char lower1[MAX_TAG_LENGTH];
-    char lower2[MAX_TAG_LENGTH];
-    
-    strncpy(lower1, s1, sizeof(lower1) - 1);
-    lower1[sizeof(lower1) - 1] = '\0';
-    strncpy(lower2, s2, sizeof(lower2) - 1);
-    lower2[sizeof(lower2) - 1] = '\0';
+int hw_counters_init() {
+#ifdef __linux__
+    mutex_init(&hw_lock);
+    pthread_key_create(&hw_thread_key, hw_close_thread);
+    hw_counters_enabled = 1;
+    
+    int fd = hw_open_event(PERF_COUNT_HW_CPU_CYCLES, -1, 0);
+    if (fd < 0) {
+        hw_user_only = 1;
+        fd = hw_open_event(PERF_COUNT_HW_CPU_CYCLES, -1, 1);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Hardware counters unavailable: %s\n", strerror(errno));
+        hw_counters_enabled = 0;
+        return -1;
+    }
+    close(fd);
+    if (hw_user_only) {
+        out("Hardware counters enabled (user space only; kernel counting not permitted).\n");
+    }
+    return 0;
+#else
+    fprintf(stderr, "Hardware counters are only supported on Linux.\n");
+    return -1;
+#endif
+}
+
+void hw_print_sample(const char *indent, const hw_sample_t *s) {
+    out("%sCycles:        %llu\n", indent, s->value[HW_CYCLES]);
+    out("%sInstructions:  %llu", indent, s->value[HW_INSTRUCTIONS]);
+    if (s->value[HW_CYCLES]) {
+        out(" (IPC %.2f)", (double)s->value[HW_INSTRUCTIONS] / s->value[HW_CYCLES]);
+    }
+    out("\n%sCache misses:  %llu", indent, s->value[HW_CACHE_MISSES]);
+    if (s->value[HW_INSTRUCTIONS]) {
+        out(" (%.2f per 1k instructions)", 1000.0 * s->value[HW_CACHE_MISSES] / s->value[HW_INSTRUCTIONS]);
+    }
+    out("\n%sBranch misses: %llu\n", indent, s->value[HW_BRANCH_MISSES]);
+}
+
+void show_hw_counters() {
+    if (!hw_counters_enabled) {
+        return;
+    }
     
-    str_to_lower(lower1);
-    str_to_lower(lower2);
+    out("\n[Hardware Counters%s]\n", hw_user_only ? " - user space only" : "");
+    if (hw_bucket_count == 0) {
+        out("  (nothing recorded yet)\n");
+        return;
+    }
     
-    return (strstr(lower1, lower2) != NULL || strstr(lower2, lower1) != NULL);
+    out("  %-24s %8s %14s %14s %6s %12s %12s\n",
+        "operation", "calls", "cycles", "instructions", "IPC", "cache-miss", "branch-miss");
+    mutex_lock(&hw_lock);
+    for (int i = 0; i < hw_bucket_count; i++) {
+        const hw_bucket_t *b = &hw_buckets[i];
+        double ipc = b->total.value[HW_CYCLES]
+                   ? (double)b->total.value[HW_INSTRUCTIONS] / b->total.value[HW_CYCLES] : 0.0;
+        out("  %-24s %8lld %14llu %14llu %6.2f %12llu %12llu\n", b->name, b->calls,
+            b->total.value[HW_CYCLES], b->total.value[HW_INSTRUCTIONS], ipc,
+            b->total.value[HW_CACHE_MISSES], b->total.value[HW_BRANCH_MISSES]);
+    }
+    mutex_unlock(&hw_lock);
 }
 
 /* ============================================
- * Database Globals
+ * Chrome Trace Export
  * ============================================ */
 
-sqlite3 *db = NULL;
+/*
+ * --trace <file> writes Chrome trace events (JSON array format, open
+ * in chrome://tracing or Perfetto). Every event is a complete ("X")
+ * event with the thread id it ran on. When tracing is off, trace_clock()
+ * returns 0 and trace_event() returns at its first check.
+ *
+ * Events: each command, the scan stages per directory (traverse, batch
+ * build, stat, insert), commit, index maintenance, and SQL statements
+ * that take at least TRACE_SQL_MIN_US.
+ */
+#define TRACE_SQL_MIN_US 100
 
-/* ============================================
- * Settings Operations
- * ============================================ */
+FILE *trace_fp = NULL;
+fs_mutex_t trace_lock;
+long long trace_origin_ns = 0;
+int trace_pid = 0;
+int trace_events_written = 0;
+int trace_next_tid = 1;
+THREAD_LOCAL int trace_tid = 0;
 
-int get_int_setting(const char *key, int default_value) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT value FROM settings WHERE key = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return default_value;
-    }
-    
-    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
-    
-    int result = default_value;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        result = atoi((const char *)sqlite3_column_text(stmt, 0));
+int trace_thread_id() {
+    if (trace_tid == 0) {
+#if defined(_WIN32)
+        trace_tid = (int)GetCurrentThreadId();
+#elif defined(__linux__)
+        trace_tid = (int)syscall(SYS_gettid);
+#else
+        mutex_lock(&trace_lock);
+        trace_tid = trace_next_tid++;
+        mutex_unlock(&trace_lock);
+#endif
     }
-    
-    sqlite3_finalize(stmt);
-    return result;
+    return trace_tid;
 }
 
-int set_int_setting(const char *key, int value) {
-    sqlite3_stmt *stmt;
+long long trace_clock() {
+    return trace_fp ? monotonic_ns() : 0;
+}
+
+void write_json_string(FILE *fp, const char *s, int max_length) {
+    fputc('"', fp);
+    for (int i = 0; s[i] && i < max_length; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', fp);
+            fputc(c, fp);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/*
+ * Write one complete event from 'start_ns' (a trace_clock() value) to
+ * now. 'detail' becomes args.detail; 'count' (if >= 0) args.count.
+ */
+void trace_event(const char *name, const char *category, long long start_ns,
+                 const char *detail, long long count) {
+    if (!trace_fp || start_ns == 0) {
+        return;
+    }
+    long long end_ns = monotonic_ns();
+    int tid = trace_thread_id();
+    
+    mutex_lock(&trace_lock);
+    fprintf(trace_fp, "%s{\"name\":", trace_events_written++ ? ",\n" : "");
+    write_json_string(trace_fp, name, 200);
+    fprintf(trace_fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+            category, (start_ns - trace_origin_ns) / 1e3, (end_ns - start_ns) / 1e3, trace_pid, tid);
+    if (detail || count >= 0) {
+        fprintf(trace_fp, ",\"args\":{");
+        if (detail) {
+            fprintf(trace_fp, "\"detail\":");
+            write_json_string(trace_fp, detail, 1000);
+        }
+        if (count >= 0) {
+            fprintf(trace_fp, "%s\"count\":%lld", detail ? "," : "", count);
+        }
+        fputc('}', trace_fp);
+    }
+    fputc('}', trace_fp);
+    mutex_unlock(&trace_lock);
+}
+
+int trace_open(const char *path) {
+    trace_fp = fopen(path, "w");
+    if (!trace_fp) {
+        fprintf(stderr, "Cannot write trace file %s\n", path);
+        return -1;
+    }
+    mutex_init(&trace_lock);
+    trace_origin_ns = monotonic_ns();
+#ifdef _WIN32
+    trace_pid = (int)GetCurrentProcessId();
+#else
+    trace_pid = (int)getpid();
+#endif
+    fprintf(trace_fp, "[\n");
+    return 0;
+}
+
+void trace_close() {
+    if (!trace_fp) {
+        return;
+    }
+    mutex_lock(&trace_lock);
+    fprintf(trace_fp, "\n]\n");
+    fclose(trace_fp);
+    trace_fp = NULL;
+    mutex_unlock(&trace_lock);
+}
+
+/* Start times of running statements, for SQL events */
+typedef struct {
+    sqlite3_stmt *stmt;
+    long long start_ns;
+} trace_stmt_t;
+
+THREAD_LOCAL trace_stmt_t trace_stmts[16];
+THREAD_LOCAL int trace_stmt_count = 0;
+
+void trace_statement_start(sqlite3_stmt *stmt, const char *sql) {
+    /* Trigger programs report "-- name" under their parent statement */
+    if (!trace_fp || (sql && strncmp(sql, "--", 2) == 0) || trace_stmt_count == 16) {
+        return;
+    }
+    trace_stmts[trace_stmt_count].stmt = stmt;
+    trace_stmts[trace_stmt_count].start_ns = monotonic_ns();
+    trace_stmt_count++;
+}
+
+void trace_statement_end(sqlite3_stmt *stmt) {
+    for (int i = trace_stmt_count - 1; i >= 0; i--) {
+        if (trace_stmts[i].stmt != stmt) continue;
+        
+        long long start = trace_stmts[i].start_ns;
+        memmove(&trace_stmts[i], &trace_stmts[i + 1], (trace_stmt_count - i - 1) * sizeof(trace_stmt_t));
+        trace_stmt_count--;
+        
+        if (monotonic_ns() - start >= TRACE_SQL_MIN_US * 1000LL) {
+            const char *sql = sqlite3_sql(stmt);
+            trace_event("sql", "query", start, sql ? sql : "", -1);
+        }
+        return;
+    }
+}
+
+/* ============================================
+ * Latency Metrics
+ * ============================================ */
+
+/*
+ * Log-linear (HDR-style) latency histograms in nanoseconds. Values
+ * below 64 ns get one bucket each; above that, every power of two is
+ * split into 32 buckets, so any recorded value is within about 3% of
+ * its bucket bounds. The top octave ends around 73 minutes; larger
+ * values land in the last bucket.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXPONENT 42
+#define HIST_BUCKETS (2 * HIST_SUB_COUNT + (HIST_MAX_EXPONENT - HIST_SUB_BITS) * HIST_SUB_COUNT)
+
+typedef struct {
+    char name[48];
+    long long count;
+    long long sum_ns;
+    long long min_ns;
+    long long max_ns;
+    uint64_t buckets[HIST_BUCKETS];
+} latency_hist_t;
+
+/* Counters accumulated across commands */
+typedef struct {
+    long long statements;
+    long long rows_scanned;
+    long long udf_calls;
+    long long cache_hits;
+    long long cache_misses;
+    long long shared_scans;      /* passes over paths for shared searches */
+    long long shared_queries;    /* searches answered by those passes */
+    long long group_commits;     /* transactions shared by several commands */
+    long long group_commit_commands;
+} metrics_counters_t;
+
+/* Scan phases, shared by hardware counters and latency histograms */
+enum {
+    SCAN_PHASE_TRAVERSE,    /* opendir, readdir, closedir */
+    SCAN_PHASE_STAT,
+    SCAN_PHASE_INSERT,
+    SCAN_PHASE_COMMIT,
+    SCAN_PHASE_COUNT
+};
+
+const char *scan_phase_names[SCAN_PHASE_COUNT] = {
+    "scan:traverse", "scan:stat", "scan:insert", "scan:commit"
+};
+
+/*
+ * Command latencies are always recorded (one clock pair per command).
+ * Per-statement counters and scan-phase histograms cost a trace
+ * callback per statement and a clock pair per filesystem call, so
+ * they are kept only with --metrics.
+ */
+int metrics_enabled = 0;
+latency_hist_t **command_hists = NULL;
+int command_hist_count = 0;
+latency_hist_t scan_hists[SCAN_PHASE_COUNT];
+metrics_counters_t metrics_counters;
+fs_mutex_t metrics_lock;
+long long metrics_started_ns = 0;
+long long metrics_budget_bytes = DEFAULT_METRICS_BUDGET_KB * 1024LL;
+
+int hist_index(long long value) {
+    if (value < 0) value = 0;
+    if (value < 2 * HIST_SUB_COUNT) return (int)value;
+    
+    int exponent = HIST_SUB_BITS + 1;
+    while (exponent < 62 && (value >> (exponent + 1)) != 0) {
+        exponent++;
+    }
+    if (exponent > HIST_MAX_EXPONENT) {
+        return HIST_BUCKETS - 1;
+    }
+    int shift = exponent - HIST_SUB_BITS;
+    int sub = (int)(value >> shift) - HIST_SUB_COUNT;
+    return 2 * HIST_SUB_COUNT + (exponent - HIST_SUB_BITS - 1) * HIST_SUB_COUNT + sub;
+}
+
+/* Highest value that maps to a bucket */
+long long hist_bucket_upper(int index) {
+    if (index < 2 * HIST_SUB_COUNT) return index;
+    int octave = (index - 2 * HIST_SUB_COUNT) / HIST_SUB_COUNT;
+    int sub = (index - 2 * HIST_SUB_COUNT) % HIST_SUB_COUNT;
+    int shift = octave + 1;
+    return (((long long)(HIST_SUB_COUNT + sub + 1)) << shift) - 1;
+}
+
+void hist_record(latency_hist_t *h, long long value) {
+    if (value < 0) value = 0;
+    h->buckets[hist_index(value)]++;
+    if (h->count == 0 || value < h->min_ns) h->min_ns = value;
+    if (value > h->max_ns) h->max_ns = value;
+    h->count++;
+    h->sum_ns += value;
+}
+
+/* Value at quantile q (0..1), reported as the bucket's upper bound */
+long long hist_percentile(const latency_hist_t *h, double q) {
+    if (h->count == 0) return 0;
+    long long rank = (long long)ceil(q * h->count);
+    if (rank < 1) rank = 1;
+    
+    long long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            long long upper = hist_bucket_upper(i);
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+void metrics_init() {
+    mutex_init(&metrics_lock);
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        strncpy(scan_hists[i].name, scan_phase_names[i], sizeof(scan_hists[i].name) - 1);
+    }
+    metrics_started_ns = monotonic_ns();
+}
+
+/* Record one command's latency under its name */
+void metrics_record_command(const char *name, long long elapsed_ns) {
+    mutex_lock(&metrics_lock);
+    latency_hist_t *h = NULL;
+    for (int i = 0; i < command_hist_count; i++) {
+        if (strcmp(command_hists[i]->name, name) == 0) {
+            h = command_hists[i];
+            break;
+        }
+    }
+    /* Over budget: fold new names into "other" */
+    if (!h && (long long)(command_hist_count + 1) * (long long)sizeof(latency_hist_t) > metrics_budget_bytes) {
+        name = "other";
+        for (int i = 0; i < command_hist_count; i++) {
+            if (strcmp(command_hists[i]->name, name) == 0) {
+                h = command_hists[i];
+                break;
+            }
+        }
+    }
+    if (!h) {
+        latency_hist_t **grown = realloc(command_hists, (command_hist_count + 1) * sizeof(latency_hist_t *));
+        h = grown ? calloc(1, sizeof(latency_hist_t)) : NULL;
+        if (grown) command_hists = grown;
+        if (h) {
+            strncpy(h->name, name, sizeof(h->name) - 1);
+            command_hists[command_hist_count++] = h;
+        }
+    }
+    if (h) hist_record(h, elapsed_ns);
+    mutex_unlock(&metrics_lock);
+}
+
+void metrics_record_scan(int phase, long long elapsed_ns) {
+    mutex_lock(&metrics_lock);
+    hist_record(&scan_hists[phase], elapsed_ns);
+    mutex_unlock(&metrics_lock);
+}
+
+void metrics_add_counters(const metrics_counters_t *delta) {
+    mutex_lock(&metrics_lock);
+    metrics_counters.statements += delta->statements;
+    metrics_counters.rows_scanned += delta->rows_scanned;
+    metrics_counters.udf_calls += delta->udf_calls;
+    metrics_counters.cache_hits += delta->cache_hits;
+    metrics_counters.cache_misses += delta->cache_misses;
+    mutex_unlock(&metrics_lock);
+}
+
+void metrics_reset() {
+    mutex_lock(&metrics_lock);
+    for (int i = 0; i < command_hist_count; i++) {
+        free(command_hists[i]);
+    }
+    free(command_hists);
+    command_hists = NULL;
+    command_hist_count = 0;
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        memset(scan_hists[i].buckets, 0, sizeof(scan_hists[i].buckets));
+        scan_hists[i].count = scan_hists[i].sum_ns = scan_hists[i].min_ns = scan_hists[i].max_ns = 0;
+    }
+    memset(&metrics_counters, 0, sizeof(metrics_counters));
+    metrics_started_ns = monotonic_ns();
+    mutex_unlock(&metrics_lock);
+}
+
+/*
+ * Statement-level counters come from a trace callback on the main
+ * connection (with --metrics or --trace): each finished statement adds
+ * its full-scan steps (rows stepped through by full table or index
+ * scans). 'profile' replaces the callback while it runs and reinstalls
+ * this one, or none, afterwards.
+ */
+THREAD_LOCAL metrics_counters_t command_counters;
+
+int metrics_trace_callback(unsigned type, void *ctx, void *p, void *x) {
+    (void)ctx;
+    sqlite3_stmt *stmt = p;
+    if (type == SQLITE_TRACE_STMT) {
+        trace_statement_start(stmt, (const char *)x);
+    }
+    else if (type == SQLITE_TRACE_PROFILE) {
+        command_counters.statements++;
+        command_counters.rows_scanned += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        trace_statement_end(stmt);
+    }
+    return 0;
+}
+
+/* With --trace, statement start times are needed too */
+void metrics_install_trace(sqlite3 *conn) {
+    if (!conn) {
+        return;
+    }
+    if (metrics_enabled || trace_fp) {
+        unsigned mask = SQLITE_TRACE_PROFILE | (trace_fp ? SQLITE_TRACE_STMT : 0);
+        sqlite3_trace_v2(conn, mask, metrics_trace_callback, NULL);
+    } else {
+        sqlite3_trace_v2(conn, 0, NULL, NULL);
+    }
+}
+
+void print_hist_row(const latency_hist_t *h) {
+    out("  %-18s %8lld %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", h->name, h->count,
+        h->sum_ns / 1e6 / h->count, hist_percentile(h, 0.50) / 1e6, hist_percentile(h, 0.90) / 1e6,
+        hist_percentile(h, 0.99) / 1e6, hist_percentile(h, 0.999) / 1e6, h->max_ns / 1e6);
+}
+
+/* 'stats --perf' */
+void show_perf_stats() {
+    mutex_lock(&metrics_lock);
+    out("\n[Latency (ms) - last %.0f s]\n", (monotonic_ns() - metrics_started_ns) / 1e9);
+    out("  %-18s %8s %10s %10s %10s %10s %10s %10s\n",
+        "operation", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    int rows = 0;
+    for (int i = 0; i < command_hist_count; i++) {
+        print_hist_row(command_hists[i]);
+        rows++;
+    }
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        if (scan_hists[i].count) {
+            print_hist_row(&scan_hists[i]);
+            rows++;
+        }
+    }
+    if (!rows) {
+        out("  (no commands recorded yet)\n");
+    }
+    
+    long long lookups = metrics_counters.cache_hits + metrics_counters.cache_misses;
+    out("\n[Counters]\n");
+    if (!metrics_enabled && !trace_fp) {
+        out("  (statement counters and scan phases need --metrics)\n");
+    }
+    out("  Statements:         %lld\n", metrics_counters.statements);
+    out("  Rows scanned:       %lld\n", metrics_counters.rows_scanned);
+    out("  levenshtein calls:  %lld\n", metrics_counters.udf_calls);
+    out("  Page cache hits:    %lld", metrics_counters.cache_hits);
+    if (lookups) out(" (%.1f%%)", 100.0 * metrics_counters.cache_hits / lookups);
+    out("\n  Page cache misses:  %lld\n", metrics_counters.cache_misses);
+    if (metrics_counters.shared_scans) {
+        out("  Shared scans:       %lld (%.1f searches per pass)\n", metrics_counters.shared_scans,
+            (double)metrics_counters.shared_queries / metrics_counters.shared_scans);
+    }
+    if (metrics_counters.group_commits) {
+        out("  Group commits:      %lld (%.1f commands per commit)\n", metrics_counters.group_commits,
+            (double)metrics_counters.group_commit_commands / metrics_counters.group_commits);
+    }
+    mutex_unlock(&metrics_lock);
+    
+    show_hw_counters();
+    out("\n");
+}
+
+/* Write to a temporary file and rename, so collectors never see a partial file */
+FILE *open_metrics_file(const char *path, char *tmp_path, size_t size) {
+    snprintf(tmp_path, size, "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        fprintf(command_stderr, "Cannot write %s\n", tmp_path);
+    }
+    return fp;
+}
+
+int close_metrics_file(FILE *fp, const char *tmp_path, const char *path) {
+    if (fclose(fp) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(tmp_path, path) != 0) {
+        fprintf(command_stderr, "Cannot replace %s\n", path);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void write_prometheus_summary(FILE *fp, const char *metric, const char *label, const latency_hist_t *h) {
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (int q = 0; q < 4; q++) {
+        fprintf(fp, "%s{%s=\"%s\",quantile=\"%g\"} %.9f\n", metric, label, h->name, quantiles[q],
+                hist_percentile(h, quantiles[q]) / 1e9);
+    }
+    fprintf(fp, "%s_sum{%s=\"%s\"} %.9f\n", metric, label, h->name, h->sum_ns / 1e9);
+    fprintf(fp, "%s_count{%s=\"%s\"} %lld\n", metric, label, h->name, h->count);
+}
+
+/* Prometheus text exposition format, for the node_exporter textfile collector */
+int write_metrics_prometheus(const char *path) {
+    char tmp_path[MAX_PATH_LENGTH];
+    FILE *fp = open_metrics_file(path, tmp_path, sizeof(tmp_path));
+    if (!fp) return -1;
+    
+    mutex_lock(&metrics_lock);
+    fprintf(fp, "# HELP filesearch_command_duration_seconds Latency of CLI commands.\n");
+    fprintf(fp, "# TYPE filesearch_command_duration_seconds summary\n");
+    for (int i = 0; i < command_hist_count; i++) {
+        write_prometheus_summary(fp, "filesearch_command_duration_seconds", "command", command_hists[i]);
+    }
+    fprintf(fp, "# HELP filesearch_scan_phase_duration_seconds Latency of single scan operations.\n");
+    fprintf(fp, "# TYPE filesearch_scan_phase_duration_seconds summary\n");
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        if (scan_hists[i].count) {
+            write_prometheus_summary(fp, "filesearch_scan_phase_duration_seconds", "phase", &scan_hists[i]);
+        }
+    }
+    
+    const struct { const char *name; const char *help; long long value; } counters[] = {
+        { "filesearch_statements_total", "SQL statements run.", metrics_counters.statements },
+        { "filesearch_rows_scanned_total", "Rows stepped through by full scans.", metrics_counters.rows_scanned },
+        { "filesearch_levenshtein_calls_total", "Calls to the levenshtein() SQL function.", metrics_counters.udf_calls },
+        { "filesearch_page_cache_hits_total", "SQLite page cache hits.", metrics_counters.cache_hits },
+        { "filesearch_page_cache_misses_total", "SQLite page cache misses.", metrics_counters.cache_misses },
+        { "filesearch_shared_scans_total", "Passes over paths answering several searches.", metrics_counters.shared_scans },
+        { "filesearch_shared_scan_queries_total", "Searches answered by shared passes.", metrics_counters.shared_queries },
+        { "filesearch_group_commits_total", "Transactions committed for a group of commands.", metrics_counters.group_commits },
+        { "filesearch_group_commit_commands_total", "Commands committed by group commits.", metrics_counters.group_commit_commands }
+    };
+    for (int i = 0; i < (int)(sizeof(counters) / sizeof(counters[0])); i++) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n",
+                counters[i].name, counters[i].help, counters[i].name, counters[i].name, counters[i].value);
+    }
+    mutex_unlock(&metrics_lock);
+    
+    return close_metrics_file(fp, tmp_path, path);
+}
+
+void write_hist_json(FILE *fp, const latency_hist_t *h, int last) {
+    fprintf(fp, "    \"%s\": {\"count\": %lld, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+                "\"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}%s\n",
+            h->name, h->count, h->count ? h->sum_ns / 1e3 / h->count : 0.0,
+            hist_percentile(h, 0.50) / 1e3, hist_percentile(h, 0.90) / 1e3, hist_percentile(h, 0.99) / 1e3,
+            hist_percentile(h, 0.999) / 1e3, h->max_ns / 1e3, last ? "" : ",");
+}
+
+int write_metrics_json(const char *path) {
+    char tmp_path[MAX_PATH_LENGTH];
+    FILE *fp = open_metrics_file(path, tmp_path, sizeof(tmp_path));
+    if (!fp) return -1;
+    
+    mutex_lock(&metrics_lock);
+    int scan_count = 0;
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        if (scan_hists[i].count) scan_count++;
+    }
+    
+    fprintf(fp, "{\n  \"uptime_s\": %.1f,\n  \"latency\": {\n", (monotonic_ns() - metrics_started_ns) / 1e9);
+    int remaining = command_hist_count + scan_count;
+    for (int i = 0; i < command_hist_count; i++) {
+        write_hist_json(fp, command_hists[i], --remaining == 0);
+    }
+    for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+        if (scan_hists[i].count) write_hist_json(fp, &scan_hists[i], --remaining == 0);
+    }
+    fprintf(fp, "  },\n  \"counters\": {\"statements\": %lld, \"rows_scanned\": %lld, \"levenshtein_calls\": %lld, "
+                "\"page_cache_hits\": %lld, \"page_cache_misses\": %lld, "
+                "\"shared_scans\": %lld, \"shared_scan_queries\": %lld, "
+                "\"group_commits\": %lld, \"group_commit_commands\": %lld}\n}\n",
+            metrics_counters.statements, metrics_counters.rows_scanned, metrics_counters.udf_calls,
+            metrics_counters.cache_hits, metrics_counters.cache_misses,
+            metrics_counters.shared_scans, metrics_counters.shared_queries,
+            metrics_counters.group_commits, metrics_counters.group_commit_commands);
+    mutex_unlock(&metrics_lock);
+    
+    return close_metrics_file(fp, tmp_path, path);
+}
+
+void cmd_metrics(const char *argument) {
+    char format[32] = "", file[MAX_PATH_LENGTH] = "";
+    sscanf(argument, "%31s %4095s", format, file);
+    
+    if (strcmp(format, "reset") == 0) {
+        metrics_reset();
+        out("Metrics reset.\n");
+    }
+    else if (strcmp(format, "prometheus") == 0 && file[0]) {
+        if (write_metrics_prometheus(file) == 0) out("Metrics written to %s\n", file);
+    }
+    else if (strcmp(format, "json") == 0 && file[0]) {
+        if (write_metrics_json(file) == 0) out("Metrics written to %s\n", file);
+    }
+    else {
+        out("Usage: metrics prometheus|json <file>\n");
+        out("       metrics reset\n");
+    }
+}
+
+/* ============================================
+ * Cross-Platform Path Handling
+ * ============================================ */
+
+int get_home_directory(char *buffer, size_t size) {
+#ifdef _WIN32
+    const char *userprofile = getenv("USERPROFILE");
+    if (userprofile && strlen(userprofile) < size) {
+        strcpy(buffer, userprofile);
+        return 0;
+    }
+    return -1;
+#else
+    const char *home = getenv("HOME");
+    if (home && strlen(home) < size) {
+        strcpy(buffer, home);
+        return 0;
+    }
+    
+    struct passwd *pw = getpwuid(getuid());
+    if (pw && pw->pw_dir && strlen(pw->pw_dir) < size) {
+        strcpy(buffer, pw->pw_dir);
+        return 0;
+    }
+    return -1;
+#endif
+}
+
+int get_default_db_path(char *buffer, size_t size) {
+    char home[MAX_PATH_LENGTH];
+    
+    if (get_home_directory(home, sizeof(home)) != 0) {
+        return -1;
+    }
+    
+    int written = snprintf(buffer, size, "%s%s%s%s%s", 
+                           home, PATH_SEPARATOR_STR, 
+                           APP_DIRNAME, PATH_SEPARATOR_STR, 
+                           DB_FILENAME);
+    
+    if (written < 0 || (size_t)written >= size) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+int directory_exists(const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        return S_ISDIR(st.st_mode);
+    }
+    return 0;
+}
+
+int file_exists(const char *path) {
+    struct stat st;
+    return (stat(path, &st) == 0);
+}
+
+/*
+ * Ask the kernel to start reading a file into the page cache without
+ * waiting for it, so a session's first searches find the b-tree pages
+ * already resident. Best effort; a no-op where unsupported.
+ */
+void prefetch_file(const char *path) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    (void)path;
+#endif
+}
+
+void get_directory_from_path(const char *filepath, char *dir_buffer, size_t size) {
+    strncpy(dir_buffer, filepath, size - 1);
+    dir_buffer[size - 1] = '\0';
+    
+    char *last_sep = strrchr(dir_buffer, PATH_SEPARATOR);
+    if (last_sep) {
+        *last_sep = '\0';
+    }
+}
+
+const char *get_filename_from_path(const char *path) {
+    const char *last_sep = strrchr(path, PATH_SEPARATOR);
+#ifdef _WIN32
+    const char *last_fwd = strrchr(path, '/');
+    if (last_fwd && (!last_sep || last_fwd > last_sep)) {
+        last_sep = last_fwd;
+    }
+#endif
+    return last_sep ? last_sep + 1 : path;
+}
+
+/* ============================================
+ * Levenshtein Distance
+ * ============================================ */
+
+int levenshtein(const char *s1, const char *s2) {
+    int len1 = strlen(s1);
+    int len2 = strlen(s2);
+    
+    if (len1 == 0) return len2;
+    if (len2 == 0) return len1;
+    
+    if (len1 > len2) {
+        const char *temp = s1;
+        s1 = s2;
+        s2 = temp;
+        int t = len1;
+        len1 = len2;
+        len2 = t;
+    }
+    
+    int *prev = malloc((len1 + 1) * sizeof(int));
+    int *curr = malloc((len1 + 1) * sizeof(int));
+    
+    if (!prev || !curr) {
+        free(prev);
+        free(curr);
+        return -1;
+    }
+    
+    for (int i = 0; i <= len1; i++) {
+        prev[i] = i;
+    }
+    
+    for (int j = 1; j <= len2; j++) {
+        curr[0] = j;
+        
+        for (int i = 1; i <= len1; i++) {
+            int cost = (tolower(s1[i-1]) == tolower(s2[j-1])) ? 0 : 1;
+            curr[i] = min3(prev[i] + 1, curr[i-1] + 1, prev[i-1] + cost);
+        }
+        
+        int *temp = prev;
+        prev = curr;
+        curr = temp;
+    }
+    
+    int result = prev[len1];
+    free(prev);
+    free(curr);
+    
+    return result;
+}
+
+/* Calls to the SQL levenshtein() function on this thread, for 'profile' */
+THREAD_LOCAL long long levenshtein_udf_calls = 0;
+
+void sqlite_levenshtein(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    if (argc != 2) {
+        sqlite3_result_error(ctx, "levenshtein requires 2 arguments", -1);
+        return;
+    }
+    
+    const char *s1 = (const char *)sqlite3_value_text(argv[0]);
+    const char *s2 = (const char *)sqlite3_value_text(argv[1]);
+    
+    if (!s1 || !s2) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    
+    levenshtein_udf_calls++;
+    sqlite3_result_int(ctx, levenshtein(s1, s2));
+}
+
+/*
+ * Register levenshtein() on a connection the first time a statement
+ * needs it, instead of on every open: most launches never call it.
+ * The connection's client data remembers that it is done.
+ */
+int require_levenshtein(sqlite3 *conn) {
+    static char registered;
+    if (sqlite3_get_clientdata(conn, "levenshtein")) return 0;
+    if (sqlite3_create_function(conn, "levenshtein", 2, SQLITE_UTF8, NULL,
+                                sqlite_levenshtein, NULL, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Cannot register function: %s\n", sqlite3_errmsg(conn));
+        return -1;
+    }
+    sqlite3_set_clientdata(conn, "levenshtein", &registered, NULL);
+    return 0;
+}
+
+/*
+ * Case-insensitive substring check.
+ * Returns 1 if needle is in haystack (or vice versa), 0 otherwise.
+ */
+int is_substring_match(const char *s1, const char *s2) {
+    char lower1[MAX_TAG_LENGTH];
+    char lower2[MAX_TAG_LENGTH];
+    
+    strncpy(lower1, s1, sizeof(lower1) - 1);
+    lower1[sizeof(lower1) - 1] = '\0';
+    strncpy(lower2, s2, sizeof(lower2) - 1);
+    lower2[sizeof(lower2) - 1] = '\0';
+    
+    str_to_lower(lower1);
+    str_to_lower(lower2);
+    
+    return (strstr(lower1, lower2) != NULL || strstr(lower2, lower1) != NULL);
+}
+
+/* ============================================
+ * Database Globals
+ * ============================================ */
+
+/*
+ * The connection used by all database operations. It is thread-local so
+ * worker threads (shard fan-out and the like) can point it at their own
+ * connection and reuse the same functions.
+ */
+THREAD_LOCAL sqlite3 *db = NULL;
+char db_file_path[MAX_PATH_LENGTH];
+int read_only_mode = 0;
+
+/*
+ * Library handle (libfilesearch.c) on db, for searches and tagging.
+ * It is kept in the connection's client data, so it is freed when the
+ * connection closes and a new connection at a reused address starts
+ * without one. Threads sharing a connection share its handle.
+ */
+void library_handle_free(void *lib) {
+    fs_close(lib);
+}
+
+fs_db *library_handle() {
+    fs_db *lib = sqlite3_get_clientdata(db, "library_handle");
+    if (lib) {
+        return lib;
+    }
+    if (fs_attach(db, &lib) != FS_OK) {
+        return NULL;
+    }
+    if (sqlite3_set_clientdata(db, "library_handle", lib, library_handle_free) != SQLITE_OK) {
+        fs_close(lib);
+        return NULL;
+    }
+    return lib;
+}
+
+/* Page cache budget per connection, from the cache_size_kb setting */
+int cache_budget_kb = DEFAULT_CACHE_SIZE_KB;
+
+/* ============================================
+ * Settings Operations
+ * ============================================ */
+
+/*
+ * Settings are loaded with one statement and cached per thread, so a
+ * launch that reads schema_version, app_version, max_results and the
+ * rest pays for a single query instead of one prepare each. The cache
+ * belongs to one connection (marked through its client data, so a new
+ * connection at a reused address never matches) and lasts until that
+ * connection writes or the next command starts, so changes made by other
+ * processes between commands are still seen.
+ */
+#define SETTINGS_CACHE_SIZE 48
+
+typedef struct {
+    char key[64];
+    char value[256];
+} setting_entry_t;
+
+typedef struct {
+    sqlite3 *conn;
+    sqlite3_int64 total_changes;
+    int loaded;
+    int complete;                   /* every row fit in entries */
+    int count;
+    setting_entry_t entries[SETTINGS_CACHE_SIZE];
+} settings_cache_t;
+
+THREAD_LOCAL settings_cache_t settings_cache;
+
+int settings_cache_current(void) {
+    return settings_cache.loaded && settings_cache.conn == db &&
+           sqlite3_get_clientdata(db, "settings_cache") == &settings_cache &&
+           sqlite3_total_changes64(db) == settings_cache.total_changes;
+}
+
+void settings_cache_reset(void) {
+    settings_cache.loaded = 0;
+}
+
+int load_settings_cache(void) {
+    sqlite3_stmt *stmt;
+    settings_cache.loaded = 0;
+    if (sqlite3_prepare_v2(db, "SELECT key, value FROM settings;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    settings_cache.count = 0;
+    settings_cache.complete = 1;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *key = (const char *)sqlite3_column_text(stmt, 0);
+        const char *value = (const char *)sqlite3_column_text(stmt, 1);
+        if (!key || !value) continue;
+        if (settings_cache.count == SETTINGS_CACHE_SIZE ||
+            strlen(key) >= sizeof(settings_cache.entries[0].key) ||
+            strlen(value) >= sizeof(settings_cache.entries[0].value)) {
+            settings_cache.complete = 0;
+            continue;
+        }
+        setting_entry_t *entry = &settings_cache.entries[settings_cache.count++];
+        strcpy(entry->key, key);
+        strcpy(entry->value, value);
+    }
+    sqlite3_finalize(stmt);
+    
+    settings_cache.conn = db;
+    sqlite3_set_clientdata(db, "settings_cache", &settings_cache, NULL);
+    settings_cache.total_changes = sqlite3_total_changes64(db);
+    settings_cache.loaded = 1;
+    return 0;
+}
+
+/* Look up a setting: 1 with *value set, 0 if absent, -1 if the cache can't answer */
+int cached_setting(const char *key, const char **value) {
+    if (!settings_cache_current() && load_settings_cache() != 0) return -1;
+    for (int i = 0; i < settings_cache.count; i++) {
+        if (strcmp(settings_cache.entries[i].key, key) == 0) {
+            *value = settings_cache.entries[i].value;
+            return 1;
+        }
+    }
+    return settings_cache.complete ? 0 : -1;
+}
+
+int get_int_setting(const char *key, int default_value) {
+    const char *value;
+    int found = cached_setting(key, &value);
+    if (found == 1) return atoi(value);
+    if (found == 0) return default_value;
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT value FROM settings WHERE key = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return default_value;
+    }
+    
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    
+    int result = default_value;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        result = atoi((const char *)sqlite3_column_text(stmt, 0));
+    }
+    
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+int set_int_setting(const char *key, int value) {
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT OR REPLACE INTO settings (key, value) VALUES (?, ?);";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    char value_str[32];
+    snprintf(value_str, sizeof(value_str), "%d", value);
+    
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value_str, -1, SQLITE_STATIC);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+char *get_string_setting(const char *key, char *buffer, size_t size, const char *default_value) {
+    const char *value;
+    int found = cached_setting(key, &value);
+    if (found >= 0) {
+        strncpy(buffer, found ? value : default_value, size - 1);
+        buffer[size - 1] = '\0';
+        return buffer;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT value FROM settings WHERE key = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        strncpy(buffer, default_value, size - 1);
+        buffer[size - 1] = '\0';
+        return buffer;
+    }
+    
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *val = (const char *)sqlite3_column_text(stmt, 0);
+        strncpy(buffer, val ? val : default_value, size - 1);
+    } else {
+        strncpy(buffer, default_value, size - 1);
+    }
+    buffer[size - 1] = '\0';
+    
+    sqlite3_finalize(stmt);
+    return buffer;
+}
+
+int set_string_setting(const char *key, const char *value) {
+    sqlite3_stmt *stmt;
     const char *sql = "INSERT OR REPLACE INTO settings (key, value) VALUES (?, ?);";
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value, -1, SQLITE_STATIC);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+void show_all_settings() {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT key, value FROM settings ORDER BY key;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+    
+    out("\n[Settings]\n");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *key = (const char *)sqlite3_column_text(stmt, 0);
+        const char *value = (const char *)sqlite3_column_text(stmt, 1);
+        out("  %-25s %s\n", key, value ? value : "(null)");
+    }
+    out("\n");
+    
+    sqlite3_finalize(stmt);
+}
+
+void cmd_get_setting(const char *key) {
+    char buffer[256];
+    get_string_setting(key, buffer, sizeof(buffer), "(not set)");
+    out("%s = %s\n", key, buffer);
+}
+
+void cmd_set_setting(const char *key, const char *value) {
+    if (set_string_setting(key, value) == 0) {
+        fprintf(status_output(), "Updated: %s = %s\n", key, value);
+    } else {
+        fprintf(command_stderr, "Failed to update setting.\n");
+    }
+}
+
+/* ============================================
+ * Database Initialization
+ * ============================================ */
+
+int table_exists(const char *table_name) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM sqlite_master WHERE type='table' AND name=?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    
+    sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+    
+    int exists = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    
+    return exists;
+}
+
+int create_schema_v1() {
+    const char *schema = 
+        /* Paths table */
+        "CREATE TABLE IF NOT EXISTS paths ("
+        "  id INTEGER PRIMARY KEY,"
+        "  path TEXT UNIQUE NOT NULL,"
+        "  name TEXT NOT NULL,"
+        "  is_directory INTEGER NOT NULL,"
+        "  size INTEGER,"
+        "  parent_path TEXT"
+        ");"
+        
+        /* Categories table */
+        "CREATE TABLE IF NOT EXISTS categories ("
+        "  id INTEGER PRIMARY KEY,"
+        "  name TEXT UNIQUE NOT NULL"
+        ");"
+        
+        /* Path-Category junction table */
+        "CREATE TABLE IF NOT EXISTS path_categories ("
+        "  path_id INTEGER NOT NULL,"
+        "  category_id INTEGER NOT NULL,"
+        "  PRIMARY KEY (path_id, category_id),"
+        "  FOREIGN KEY (path_id) REFERENCES paths(id) ON DELETE CASCADE,"
+        "  FOREIGN KEY (category_id) REFERENCES categories(id) ON DELETE CASCADE"
+        ");"
+        
+        /* Tags table */
+        "CREATE TABLE IF NOT EXISTS tags ("
+        "  id INTEGER PRIMARY KEY,"
+        "  name TEXT UNIQUE NOT NULL"
+        ");"
+        
+        /* Path-Tag junction table */
+        "CREATE TABLE IF NOT EXISTS path_tags ("
+        "  path_id INTEGER NOT NULL,"
+        "  tag_id INTEGER NOT NULL,"
+        "  PRIMARY KEY (path_id, tag_id),"
+        "  FOREIGN KEY (path_id) REFERENCES paths(id) ON DELETE CASCADE,"
+        "  FOREIGN KEY (tag_id) REFERENCES tags(id) ON DELETE CASCADE"
+        ");"
+        
+        /* Settings table */
+        "CREATE TABLE IF NOT EXISTS settings ("
+        "  key TEXT PRIMARY KEY,"
+        "  value TEXT"
+        ");"
+        
+        /* Indexes */
+        "CREATE INDEX IF NOT EXISTS idx_path_name ON paths(name);"
+        "CREATE INDEX IF NOT EXISTS idx_path_parent ON paths(parent_path);"
+        "CREATE INDEX IF NOT EXISTS idx_path_is_dir ON paths(is_directory);"
+        "CREATE INDEX IF NOT EXISTS idx_category_name ON categories(name);"
+        "CREATE INDEX IF NOT EXISTS idx_tag_name ON tags(name);"
+        "CREATE INDEX IF NOT EXISTS idx_path_categories_path ON path_categories(path_id);"
+        "CREATE INDEX IF NOT EXISTS idx_path_categories_cat ON path_categories(category_id);"
+        "CREATE INDEX IF NOT EXISTS idx_path_tags_path ON path_tags(path_id);"
+        "CREATE INDEX IF NOT EXISTS idx_path_tags_tag ON path_tags(tag_id);";
+    
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, schema, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Schema error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int column_exists(const char *table_name, const char *column_name) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT 1 FROM pragma_table_info(?) WHERE name = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    
+    sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, column_name, -1, SQLITE_STATIC);
+    
+    int exists = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    
+    return exists;
+}
+
+/*
+ * Version 2: change log for exporting changesets, and a host column
+ * for rows imported from other machines (NULL for local paths).
+ */
+int create_schema_v2() {
+    const char *schema = 
+        "CREATE TABLE IF NOT EXISTS change_log ("
+        "  seq INTEGER PRIMARY KEY,"
+        "  generation INTEGER NOT NULL,"
+        "  op TEXT NOT NULL,"
+        "  path TEXT NOT NULL,"
+        "  name TEXT,"
+        "  is_directory INTEGER,"
+        "  size INTEGER,"
+        "  parent_path TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_change_log_gen ON change_log(generation);";
+    
+    if (!column_exists("paths", "host")) {
+        char *err_msg = NULL;
+        if (sqlite3_exec(db, "ALTER TABLE paths ADD COLUMN host TEXT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+            fprintf(stderr, "Schema error: %s\n", err_msg);
+            sqlite3_free(err_msg);
+            return -1;
+        }
+    }
+    
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, schema, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Schema error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * Version 3: file mtimes, and a hash per directory summarizing its
+ * subtree (see Directory Hashes), with dir_dirty queueing directories
+ * whose hashes need recomputing.
+ */
+int create_schema_v3() {
+    const char *schema = 
+        "CREATE TABLE IF NOT EXISTS dir_hashes ("
+        "  path TEXT PRIMARY KEY,"
+        "  hash INTEGER NOT NULL,"
+        "  entries INTEGER NOT NULL"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS dir_dirty ("
+        "  path TEXT PRIMARY KEY"
+        ") WITHOUT ROWID;";
+    
+    if (!column_exists("paths", "mtime")) {
+        char *err_msg = NULL;
+        if (sqlite3_exec(db, "ALTER TABLE paths ADD COLUMN mtime INTEGER;", NULL, NULL, &err_msg) != SQLITE_OK) {
+            fprintf(stderr, "Schema error: %s\n", err_msg);
+            sqlite3_free(err_msg);
+            return -1;
+        }
+    }
+    
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, schema, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Schema error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    
+    return 0;
+}
+
+extern const char *changelog_triggers_sql;
+int changelog_enabled();
+void changelog_close_generation();
+
+/*
+ * Version 4: mtime on change_log, so a change that only touches a
+ * file's mtime shows up between generations. Triggers installed by an
+ * older build do not log it and are replaced, and the generation they
+ * were logging is closed, since older builds only started a new one on
+ * export.
+ */
+int create_schema_v4() {
+    if (column_exists("change_log", "mtime")) {
+        return 0;
+    }
+    
+    int triggers = changelog_enabled();
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, "ALTER TABLE change_log ADD COLUMN mtime INTEGER;", NULL, NULL, &err_msg);
+    if (rc == SQLITE_OK && triggers) {
+        rc = sqlite3_exec(db,
+            "DROP TRIGGER IF EXISTS trg_change_log_insert;"
+            "DROP TRIGGER IF EXISTS trg_change_log_update;"
+            "DROP TRIGGER IF EXISTS trg_change_log_delete;", NULL, NULL, &err_msg);
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_exec(db, changelog_triggers_sql, NULL, NULL, &err_msg);
+        }
+        if (rc == SQLITE_OK) {
+            changelog_close_generation();
+        }
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Schema error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int rebuild_dir_hashes();
+
+/*
+ * Bring a versioned database up to DEFAULT_SCHEMA_VERSION.
+ */
+int migrate_schema(int from_version) {
+    if (from_version < 2 && create_schema_v2() != 0) {
+        return -1;
+    }
+    if (from_version < 3) {
+        if (create_schema_v3() != 0) {
+            return -1;
+        }
+        if (rebuild_dir_hashes() != 0) {
+            return -1;
+        }
+    }
+    if (from_version < 4 && create_schema_v4() != 0) {
+        return -1;
+    }
+    return set_int_setting("schema_version", DEFAULT_SCHEMA_VERSION);
+}
+
+void apply_cache_size(sqlite3 *conn) {
+    char pragma[64];
+    if (!conn) return;
+    snprintf(pragma, sizeof(pragma), "PRAGMA cache_size = -%d;", cache_budget_kb);
+    sqlite3_exec(conn, pragma, NULL, NULL, NULL);
+}
+
+int insert_default_settings() {
+    set_int_setting("schema_version", DEFAULT_SCHEMA_VERSION);
+    set_int_setting("app_version", DEFAULT_APP_VERSION);
+    set_int_setting("similarity_threshold", DEFAULT_SIMILARITY_THRESHOLD);
+    set_int_setting("max_results", DEFAULT_MAX_RESULTS);
+    set_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+    set_int_setting("persist_interval", DEFAULT_PERSIST_INTERVAL);
+    set_int_setting("soft_heap_limit_kb", DEFAULT_SOFT_HEAP_LIMIT_KB);
+    set_int_setting("cache_size_kb", DEFAULT_CACHE_SIZE_KB);
+    set_int_setting("metrics_budget_kb", DEFAULT_METRICS_BUDGET_KB);
+    set_int_setting("group_commit_ms", DEFAULT_GROUP_COMMIT_MS);
+    set_int_setting("group_commit_max", DEFAULT_GROUP_COMMIT_MAX);
+    set_int_setting("maintenance_idle_ms", DEFAULT_MAINTENANCE_IDLE_MS);
+    set_int_setting("maintenance_budget", DEFAULT_MAINTENANCE_BUDGET);
+    set_int_setting("maintenance_stale_s", DEFAULT_MAINTENANCE_STALE_S);
+    set_int_setting("maintenance_optimize_s", DEFAULT_MAINTENANCE_OPTIMIZE_S);
+    set_int_setting("maintenance_refresh_s", DEFAULT_MAINTENANCE_REFRESH_S);
+    set_int_setting("maintenance_index_s", DEFAULT_MAINTENANCE_INDEX_S);
+    set_int_setting("maintenance_checkpoint_s", DEFAULT_MAINTENANCE_CHECKPOINT_S);
+    return 0;
+}
+
+int insert_default_categories() {
+    const char *categories[] = {"Games", "Music", "Photos", "Documents", "Uncategorized"};
+    int count = sizeof(categories) / sizeof(categories[0]);
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT OR IGNORE INTO categories (name) VALUES (?);";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, 1, categories[i], -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int init_database(const char *db_path) {
+    /*
+     * Open straight away and check the directory only if that fails.
+     * The connection keeps SQLITE_OPEN_CREATE, since ATTACH inherits the
+     * flags and export-index and export-changes attach new files. A new
+     * database is recognized by its empty schema rather than by a stat.
+     */
+    int rc = sqlite3_open(db_path, &db);
+    if (rc == SQLITE_CANTOPEN) {
+        char dir_path[MAX_PATH_LENGTH];
+        get_directory_from_path(db_path, dir_path, sizeof(dir_path));
+        
+        if (!directory_exists(dir_path)) {
+            fprintf(stderr, "Error: Directory '%s' does not exist.\n", dir_path);
+#ifdef _WIN32
+            fprintf(stderr, "Please create it with: mkdir \"%s\"\n", dir_path);
+#else
+            fprintf(stderr, "Please create it with: mkdir -p %s\n", dir_path);
+#endif
+            return -1;
+        }
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database '%s': %s\n", db_path, sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    int is_new_db = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT EXISTS (SELECT 1 FROM sqlite_master);", -1, &stmt, NULL) == SQLITE_OK) {
+        is_new_db = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0;
+        sqlite3_finalize(stmt);
+    }
+    
+    /* Enable foreign keys */
+    sqlite3_exec(db, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
+    
+    if (is_new_db) {
+        if (!batch_mode) out("Creating new database: %s\n", db_path);
+        
+        if (create_schema_v1() != 0 || create_schema_v2() != 0 || create_schema_v3() != 0 ||
+            create_schema_v4() != 0) {
+            return -1;
+        }
+        
+        insert_default_settings();
+        insert_default_categories();
+        
+        if (!batch_mode) out("Database initialized with default settings and categories.\n");
+    } else {
+        if (!batch_mode) out("Database opened: %s\n", db_path);
+        
+        /* Check for schema migration */
+        int current_version = get_int_setting("schema_version", 0);
+        
+        if (current_version == 0 && !table_exists("settings")) {
+            /* Old database without versioning - needs migration */
+            fprintf(status_output(), "\nDatabase schema update required.\n");
+            fprintf(status_output(), "This will add category support and settings to your existing data.\n");
+            fprintf(status_output(), "Existing paths will be assigned to 'Uncategorized'.\n\n");
+            
+            if (!get_confirmation("Proceed with migration?")) {
+                fprintf(status_output(), "Migration cancelled. Exiting.\n");
+                sqlite3_close(db);
+                db = NULL;
+                return -1;
+            }
+            
+            /* Perform migration */
+            if (create_schema_v1() != 0 || create_schema_v2() != 0 || create_schema_v3() != 0 ||
+                create_schema_v4() != 0) {
+                return -1;
+            }
+            
+            insert_default_settings();
+            insert_default_categories();
+            
+            /* Assign existing paths to Uncategorized */
+            const char *migrate_sql = 
+                "INSERT OR IGNORE INTO path_categories (path_id, category_id) "
+                "SELECT p.id, c.id FROM paths p, categories c WHERE c.name = 'Uncategorized';";
+            
+            sqlite3_exec(db, migrate_sql, NULL, NULL, NULL);
+            rebuild_dir_hashes();
+            
+            fprintf(status_output(), "Migration complete.\n");
+        } else if (current_version < DEFAULT_SCHEMA_VERSION) {
+            if (migrate_schema(current_version) != 0) {
+                return -1;
+            }
+            out("Schema upgraded to version %d.\n", DEFAULT_SCHEMA_VERSION);
+        }
+    }
+    
+    return 0;
+}
+
+/* ============================================
+ * In-Memory Serving Mode
+ * ============================================ */
+
+/*
+ * With --in-memory the database file is copied into a private
+ * in-memory connection at startup and all queries are served from it.
+ * A background thread writes changes back with the online backup API
+ * every persist_interval seconds, and once more on exit.
+ */
+int in_memory_mode = 0;
+sqlite3 *memory_db = NULL;
+char persist_path[MAX_PATH_LENGTH];
+fs_mutex_t persist_lock;
+fs_thread_t persist_thread;
+volatile int persist_thread_running = 0;
+sqlite3_int64 persisted_changes = 0;
+
+int copy_database(sqlite3 *dest, sqlite3 *src) {
+    sqlite3_backup *backup = sqlite3_backup_init(dest, "main", src, "main");
+    if (!backup) {
+        fprintf(command_stderr, "Backup error: %s\n", sqlite3_errmsg(dest));
+        return -1;
+    }
+    
+    sqlite3_backup_step(backup, -1);
+    int rc = sqlite3_backup_finish(backup);
+    if (rc != SQLITE_OK) {
+        fprintf(command_stderr, "Backup error: %s\n", sqlite3_errmsg(dest));
+        return -1;
+    }
+    return 0;
+}
+
+int load_database_into_memory(const char *db_path) {
+    sqlite3 *mem = NULL;
+    
+    if (sqlite3_open(":memory:", &mem) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open in-memory database: %s\n", sqlite3_errmsg(mem));
+        sqlite3_close(mem);
+        return -1;
+    }
+    
+    if (copy_database(mem, db) != 0) {
+        sqlite3_close(mem);
+        return -1;
+    }
+    
+    sqlite3_exec(mem, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
+    
+    /* Serve from memory from now on; the file is only written back */
+    sqlite3_close(db);
+    db = mem;
+    memory_db = mem;
+    
+    strncpy(persist_path, db_path, sizeof(persist_path) - 1);
+    persist_path[sizeof(persist_path) - 1] = '\0';
+    mutex_init(&persist_lock);
+    persisted_changes = sqlite3_total_changes64(memory_db);
+    in_memory_mode = 1;
+    
+    if (!batch_mode) out("Loaded database into memory.\n");
+    return 0;
+}
+
+/*
+ * Write the in-memory database back to its file if it has changed.
+ * The source is copied into a staging database while holding
+ * persist_lock (a memory-to-memory copy), so the slow file write and
+ * fsync happen without blocking queries.
+ */
+int persist_in_memory_database() {
+    if (!in_memory_mode) {
+        return 0;
+    }
+    
+    sqlite3 *staging = NULL;
+    if (sqlite3_open(":memory:", &staging) != SQLITE_OK) {
+        sqlite3_close(staging);
+        return -1;
+    }
+    
+    mutex_lock(&persist_lock);
+    sqlite3_int64 changes = sqlite3_total_changes64(memory_db);
+    if (changes == persisted_changes) {
+        mutex_unlock(&persist_lock);
+        sqlite3_close(staging);
+        return 0;
+    }
+    int rc = copy_database(staging, memory_db);
+    mutex_unlock(&persist_lock);
+    
+    if (rc == 0) {
+        sqlite3 *file = NULL;
+        if (sqlite3_open(persist_path, &file) == SQLITE_OK) {
+            rc = copy_database(file, staging);
+        } else {
+            fprintf(stderr, "Cannot open database '%s': %s\n", persist_path, sqlite3_errmsg(file));
+            rc = -1;
+        }
+        sqlite3_close(file);
+    }
+    sqlite3_close(staging);
+    
+    if (rc == 0) {
+        persisted_changes = changes;
+    }
+    return rc;
+}
+
+void *persist_thread_main(void *arg) {
+    int interval_ms = *(int *)arg * 1000;
+    int waited_ms = 0;
+    
+    while (persist_thread_running) {
+        sleep_ms(100);
+        waited_ms += 100;
+        if (waited_ms >= interval_ms) {
+            persist_in_memory_database();
+            waited_ms = 0;
+        }
+    }
+    return NULL;
+}
+
+void start_persist_thread() {
+    static int interval;
+    interval = get_int_setting("persist_interval", DEFAULT_PERSIST_INTERVAL);
+    if (interval <= 0) {
+        return;
+    }
+    
+    persist_thread_running = 1;
+    if (thread_start(&persist_thread, persist_thread_main, &interval) != 0) {
+        fprintf(stderr, "Warning: Could not start persistence thread; "
+                        "changes are saved on exit only.\n");
+        persist_thread_running = 0;
+    }
+}
+
+void stop_in_memory_mode() {
+    if (!in_memory_mode) {
+        return;
+    }
+    
+    if (persist_thread_running) {
+        persist_thread_running = 0;
+        thread_join(persist_thread);
+    }
+    
+    if (persist_in_memory_database() != 0) {
+        fprintf(stderr, "Warning: Failed to write changes back to %s\n", persist_path);
+    }
+    mutex_destroy(&persist_lock);
+    in_memory_mode = 0;
+}
+
+/* ============================================
+ * Snapshots
+ * ============================================ */
+
+/*
+ * A snapshot is a read-only copy of the database published next to it
+ * as <db>.snapshot. It is built with VACUUM INTO under a temporary name
+ * and renamed into place, so readers only ever see a complete file.
+ * Because the file never changes after publication, --snapshot opens it
+ * with immutable=1: no locks, no change detection, and a large mmap.
+ */
+/* Returns -1 if the path does not fit in buffer */
+int get_snapshot_path(const char *db_path, char *buffer, size_t size) {
+    if (snprintf(buffer, size, "%s%s", db_path, SNAPSHOT_SUFFIX) >= (int)size) {
+        fprintf(command_stderr, "Snapshot path too long: %s%s\n", db_path, SNAPSHOT_SUFFIX);
+        return -1;
+    }
+    return 0;
+}
+
+int create_snapshot(const char *target) {
+    char tmp_path[MAX_PATH_LENGTH];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", target);
+    remove(tmp_path);
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "VACUUM INTO ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Snapshot error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, tmp_path, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (rc != SQLITE_DONE) {
+        fprintf(command_stderr, "Snapshot error: %s\n", sqlite3_errmsg(db));
+        remove(tmp_path);
+        return -1;
+    }
+    
+#ifdef _WIN32
+    /* rename() does not replace an existing file on Windows */
+    remove(target);
+#endif
+    if (rename(tmp_path, target) != 0) {
+        fprintf(command_stderr, "Cannot publish snapshot '%s'\n", target);
+        remove(tmp_path);
+        return -1;
+    }
+    
+    out("Snapshot published: %s\n", target);
+    return 0;
+}
+
+/*
+ * Build a "file:" URI for sqlite3_open_v2, escaping the characters
+ * that have a meaning in URIs.
+ */
+int build_file_uri(const char *path, const char *query, char *buffer, size_t size) {
+    size_t pos = 0;
+    const char *prefix = "file:";
+    
+#ifdef _WIN32
+    if (isalpha((unsigned char)path[0]) && path[1] == ':') {
+        prefix = "file:///";
+    }
+#endif
+    
+    for (const char *p = prefix; *p && pos + 1 < size; p++) {
+        buffer[pos++] = *p;
+    }
+    
+    for (const char *p = path; *p; p++) {
+        char c = *p;
+#ifdef _WIN32
+        if (c == '\\') c = '/';
+#endif
+        if (c == '?' || c == '#' || c == '%') {
+            if (pos + 3 >= size) return -1;
+            pos += snprintf(buffer + pos, size - pos, "%%%02X", (unsigned char)c);
+        } else {
+            if (pos + 1 >= size) return -1;
+            buffer[pos++] = c;
+        }
+    }
+    
+    int written = snprintf(buffer + pos, size - pos, "?%s", query);
+    if (written < 0 || (size_t)written >= size - pos) {
+        return -1;
+    }
+    return 0;
+}
+
+int open_snapshot(const char *snapshot_path) {
+    if (!file_exists(snapshot_path)) {
+        fprintf(stderr, "Error: No snapshot at '%s'.\n", snapshot_path);
+        fprintf(stderr, "Publish one with the 'snapshot' command first.\n");
+        return -1;
+    }
+    
+    char uri[MAX_PATH_LENGTH * 3 + 32];
+    if (build_file_uri(snapshot_path, "immutable=1", uri, sizeof(uri)) != 0) {
+        fprintf(stderr, "Error: Snapshot path too long.\n");
+        return -1;
+    }
+    
+    int rc = sqlite3_open_v2(uri, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Cannot open snapshot '%s': %s\n", snapshot_path, sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    char pragma[64];
+    snprintf(pragma, sizeof(pragma), "PRAGMA mmap_size = %lld;", SNAPSHOT_MMAP_SIZE);
+    sqlite3_exec(db, pragma, NULL, NULL, NULL);
+    
+    read_only_mode = 1;
+    if (!batch_mode) out("Snapshot opened (read-only): %s\n", snapshot_path);
+    return 0;
+}
+
+/*
+ * Commands that modify the database are refused on a read-only snapshot.
+ */
+int is_mutating_command(const char *command, const char *argument) {
+    /* bench scan indexes a generated tree and deletes it again; the other benchmarks only read */
+    if (strcmp(command, "bench") == 0) {
+        return strncmp(argument, "scan", 4) == 0 && (argument[4] == '\0' || argument[4] == ' ');
+    }
+    
+    const char *mutating[] = {
+        "add", "remove", "tag", "untag", "categorize", "uncategorize",
+        "create-category", "set", "generate", "changelog", "export-changes", "import-changes",
+        "verify"
+    };
+    int count = sizeof(mutating) / sizeof(mutating[0]);
+    
+    for (int i = 0; i < count; i++) {
+        if (strcmp(command, mutating[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* ============================================
+ * Directory Hashes
+ * ============================================ */
+
+/*
+ * Every directory with entries has a row in dir_hashes holding a hash
+ * of its whole subtree: each entry hashes its name with its size and
+ * mtime (files) or its own subtree hash (directories), and a directory
+ * combines its entries' hashes by addition, so order does not matter
+ * and the hash can be computed from the database or from a directory
+ * listing alike. Two directories with equal hashes hold the same tree,
+ * which lets diff skip identical subtrees and a rescan skip writing
+ * directories that have not changed, whatever their mtimes say.
+ *
+ * Code that writes paths queues the directories it changed in dir_dirty:
+ * queue_dir_hash() for inserts and updates, QUEUE_PATH_DELETE_SQL run
+ * before each delete. (Triggers would do this without help, but any
+ * trigger on paths makes every insert open a statement journal, and a
+ * fresh scan ran 40% slower.) update_dir_hashes() then recomputes them
+ * deepest first from their direct entries, and queues a parent only if
+ * the hash changed, so the cost follows the number of directories
+ * touched rather than the size of the index.
+ *
+ * A rescan writes new and changed entries but never deletes those that
+ * are gone from disk ('verify' and the stale maintenance job do). Until
+ * they are removed, a directory holding one never matches its stored
+ * hash, and every rescan lists it and its ancestors again, as it did
+ * before hashes.
+ */
+
+/* 64-bit FNV-1a */
+uint64_t fnv1a64(const void *data, size_t size, uint64_t hash) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#define FNV1A64_INIT 0xcbf29ce484222325ULL
+
+/* splitmix64 finalizer; maps 0 to 0, the hash of an empty directory */
+uint64_t hash_mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Size and mtime are -1 when not recorded; subtree is used for directories only */
+uint64_t dir_entry_hash(const char *name, int is_directory, long long size, long long mtime, uint64_t subtree) {
+    uint64_t h = fnv1a64(name, strlen(name), FNV1A64_INIT);
+    if (is_directory) {
+        h = hash_mix64(h ^ 0x9e3779b97f4a7c15ULL) ^ subtree;
+    } else {
+        h = hash_mix64(h ^ (uint64_t)size) ^ (uint64_t)mtime;
+    }
+    return hash_mix64(h);
+}
+
+uint64_t dir_hash_finish(uint64_t sum, long long entries) {
+    return hash_mix64(sum ^ (uint64_t)entries);
+}
+
+/* Stored subtree hash of a directory; returns 1 if it has one */
+int lookup_dir_hash(const char *path, uint64_t *hash) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT hash FROM dir_hashes WHERE path = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    int found = (sqlite3_step(stmt) == SQLITE_ROW);
+    if (found) *hash = (uint64_t)sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+/* Mark a directory's hash for recomputation by the next update_dir_hashes() */
+int queue_dir_hash(const char *dir_path) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO dir_dirty (path) VALUES (?);", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, dir_path, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+int store_dir_hash(const char *dir_path, uint64_t hash, long long entries) {
+    if (entries == 0) return 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO dir_hashes (path, hash, entries) VALUES (?, ?, ?);",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, dir_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)hash);
+    sqlite3_bind_int64(stmt, 3, entries);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+/* Run with ?1 = id before deleting the row: its directory changes, and so does its own hash */
+#define QUEUE_PATH_DELETE_SQL \
+    "INSERT OR IGNORE INTO dir_dirty (path) " \
+    "SELECT parent_path FROM paths WHERE id = ?1 AND parent_path IS NOT NULL " \
+    "UNION ALL SELECT path FROM paths WHERE id = ?1 AND is_directory;"
+
+void queue_path_delete(sqlite3_stmt *queue, sqlite3_int64 id) {
+    if (!queue) return;
+    sqlite3_bind_int64(queue, 1, id);
+    sqlite3_step(queue);
+    sqlite3_reset(queue);
+}
+
+/* Queued directories, deepest first (a binary max-heap on depth) */
+typedef struct {
+    char *path;
+    int depth;
+} dir_queue_item_t;
+
+typedef struct {
+    dir_queue_item_t *items;
+    size_t count;
+    size_t capacity;
+} dir_queue_t;
+
+int dir_queue_push(dir_queue_t *queue, const char *path) {
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 256;
+        dir_queue_item_t *grown = realloc(queue->items, capacity * sizeof(dir_queue_item_t));
+        if (!grown) return -1;
+        queue->items = grown;
+        queue->capacity = capacity;
+    }
+    
+    dir_queue_item_t item = { strdup(path), 0 };
+    if (!item.path) return -1;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') item.depth++;
+    }
+    
+    size_t i = queue->count++;
+    while (i > 0 && queue->items[(i - 1) / 2].depth < item.depth) {
+        queue->items[i] = queue->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->items[i] = item;
+    return 0;
+}
+
+/* Caller frees the returned path */
+char *dir_queue_pop(dir_queue_t *queue) {
+    char *top = queue->items[0].path;
+    dir_queue_item_t last = queue->items[--queue->count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= queue->count) break;
+        if (child + 1 < queue->count && queue->items[child + 1].depth > queue->items[child].depth) child++;
+        if (queue->items[child].depth <= last.depth) break;
+        queue->items[i] = queue->items[child];
+        i = child;
+    }
+    if (queue->count > 0) queue->items[i] = last;
+    return top;
+}
+
+void dir_queue_free(dir_queue_t *queue) {
+    for (size_t i = 0; i < queue->count; i++) {
+        free(queue->items[i].path);
+    }
+    free(queue->items);
+}
+
+/*
+ * Fold the directories queued in dir_dirty into dir_hashes. Runs in the
+ * caller's transaction if there is one. Cheap when nothing is queued;
+ * a database without directory hashes is left alone.
+ */
+int update_dir_hashes() {
+    sqlite3_stmt *load;
+    if (sqlite3_prepare_v2(db, "SELECT path FROM dir_dirty;", -1, &load, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    
+    dir_queue_t queue;
+    memset(&queue, 0, sizeof(queue));
+    int failed = 0;
+    while (!failed && sqlite3_step(load) == SQLITE_ROW) {
+        failed = dir_queue_push(&queue, (const char *)sqlite3_column_text(load, 0)) != 0;
+    }
+    sqlite3_finalize(load);
+    if (failed || queue.count == 0) {
+        dir_queue_free(&queue);
+        return failed ? -1 : 0;
+    }
+    
+    int own_transaction = sqlite3_get_autocommit(db);
+    if (own_transaction) sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    
+    sqlite3_stmt *children = NULL, *stored = NULL, *store = NULL, *drop = NULL;
+    sqlite3_stmt *parent = NULL, *enqueue = NULL, *dequeue = NULL;
+    failed =
+        sqlite3_prepare_v2(db, "SELECT p.name, p.is_directory, p.size, p.mtime, h.hash FROM paths p "
+                               "LEFT JOIN dir_hashes h ON p.is_directory AND h.path = p.path "
+                               "WHERE p.parent_path = ?;", -1, &children, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "SELECT hash, entries FROM dir_hashes WHERE path = ?;", -1, &stored, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO dir_hashes (path, hash, entries) VALUES (?, ?, ?);",
+                           -1, &store, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "DELETE FROM dir_hashes WHERE path = ?;", -1, &drop, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "SELECT parent_path FROM paths WHERE path = ?;", -1, &parent, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO dir_dirty (path) VALUES (?);", -1, &enqueue, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "DELETE FROM dir_dirty WHERE path = ?;", -1, &dequeue, NULL) != SQLITE_OK;
+    
+    while (!failed && queue.count > 0) {
+        char *path = dir_queue_pop(&queue);
+        
+        uint64_t sum = 0;
+        long long entries = 0;
+        sqlite3_bind_text(children, 1, path, -1, SQLITE_STATIC);
+        while (sqlite3_step(children) == SQLITE_ROW) {
+            const char *name = (const char *)sqlite3_column_text(children, 0);
+            sum += dir_entry_hash(name ? name : "", sqlite3_column_int(children, 1),
+                                  sqlite3_column_type(children, 2) == SQLITE_NULL ? -1 : sqlite3_column_int64(children, 2),
+                                  sqlite3_column_type(children, 3) == SQLITE_NULL ? -1 : sqlite3_column_int64(children, 3),
+                                  (uint64_t)sqlite3_column_int64(children, 4));
+            entries++;
+        }
+        sqlite3_reset(children);
+        uint64_t hash = entries ? dir_hash_finish(sum, entries) : 0;
+        
+        uint64_t old_hash = 0;
+        long long old_entries = 0;
+        sqlite3_bind_text(stored, 1, path, -1, SQLITE_STATIC);
+        if (sqlite3_step(stored) == SQLITE_ROW) {
+            old_hash = (uint64_t)sqlite3_column_int64(stored, 0);
+            old_entries = sqlite3_column_int64(stored, 1);
+        }
+        sqlite3_reset(stored);
+        
+        if (hash != old_hash || entries != old_entries) {
+            sqlite3_stmt *write = entries ? store : drop;
+            sqlite3_bind_text(write, 1, path, -1, SQLITE_STATIC);
+            if (entries) {
+                sqlite3_bind_int64(write, 2, (sqlite3_int64)hash);
+                sqlite3_bind_int64(write, 3, entries);
+            }
+            failed = sqlite3_step(write) != SQLITE_DONE;
+            sqlite3_reset(write);
+        }
+        
+        /* A changed hash changes the parent's entry for this directory */
+        if (!failed && hash != old_hash) {
+            sqlite3_bind_text(parent, 1, path, -1, SQLITE_STATIC);
+            if (sqlite3_step(parent) == SQLITE_ROW && sqlite3_column_type(parent, 0) != SQLITE_NULL) {
+                const char *parent_path = (const char *)sqlite3_column_text(parent, 0);
+                sqlite3_bind_text(enqueue, 1, parent_path, -1, SQLITE_STATIC);
+                failed = sqlite3_step(enqueue) != SQLITE_DONE;
+                if (!failed && sqlite3_changes(db) > 0) {
+                    failed = dir_queue_push(&queue, parent_path) != 0;
+                }
+                sqlite3_reset(enqueue);
+            }
+            sqlite3_reset(parent);
+        }
+        
+        sqlite3_bind_text(dequeue, 1, path, -1, SQLITE_STATIC);
+        failed = failed || sqlite3_step(dequeue) != SQLITE_DONE;
+        sqlite3_reset(dequeue);
+        free(path);
+    }
+    
+    sqlite3_finalize(children);
+    sqlite3_finalize(stored);
+    sqlite3_finalize(store);
+    sqlite3_finalize(drop);
+    sqlite3_finalize(parent);
+    sqlite3_finalize(enqueue);
+    sqlite3_finalize(dequeue);
+    dir_queue_free(&queue);
+    
+    if (failed) {
+        fprintf(command_stderr, "Cannot update directory hashes: %s\n", sqlite3_errmsg(db));
+    }
+    if (own_transaction) sqlite3_exec(db, failed ? "ROLLBACK;" : "COMMIT;", NULL, NULL, NULL);
+    return failed ? -1 : 0;
+}
+
+/* Recompute every directory hash, for databases upgraded to schema 3 */
+int rebuild_dir_hashes() {
+    if (sqlite3_exec(db, "DELETE FROM dir_hashes;"
+                         "INSERT OR IGNORE INTO dir_dirty (path) "
+                         "SELECT DISTINCT parent_path FROM paths WHERE parent_path IS NOT NULL;",
+                     NULL, NULL, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    return update_dir_hashes();
+}
+
+/* ============================================
+ * Path Operations
+ * ============================================ */
+
+int get_path_id(const char *path) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id FROM paths WHERE path = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    
+    int id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int(stmt, 0);
+    }
+    
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+/* A path seen again keeps its row (and id) and takes the new size and mtime */
+#define INSERT_PATH_SQL \
+    "INSERT INTO paths (path, name, is_directory, size, parent_path, mtime) " \
+    "VALUES (?, ?, ?, ?, ?, ?) " \
+    "ON CONFLICT(path) DO UPDATE SET is_directory = excluded.is_directory, " \
+    "size = excluded.size, mtime = excluded.mtime " \
+    "WHERE is_directory IS NOT excluded.is_directory OR size IS NOT excluded.size " \
+    "OR mtime IS NOT excluded.mtime;"
+
+/* Bind and run a prepared INSERT_PATH_SQL statement, leaving it reset */
+int insert_path_row(sqlite3_stmt *stmt, const char *path, const char *name, int is_directory,
+                    long long size, const char *parent_path, long long mtime) {
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, is_directory);
+    
+    if (size >= 0) {
+        sqlite3_bind_int64(stmt, 4, size);
+    } else {
+        sqlite3_bind_null(stmt, 4);
+    }
+    
+    if (parent_path) {
+        sqlite3_bind_text(stmt, 5, parent_path, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_null(stmt, 5);
+    }
+    
+    if (mtime >= 0) {
+        sqlite3_bind_int64(stmt, 6, mtime);
+    } else {
+        sqlite3_bind_null(stmt, 6);
+    }
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+int add_path_to_db(const char *path, const char *name, int is_directory, 
+                   long long size, const char *parent_path) {
+    sqlite3_stmt *stmt;
+    
+    if (sqlite3_prepare_v2(db, INSERT_PATH_SQL, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Prepare error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    int rc = insert_path_row(stmt, path, name, is_directory, size, parent_path, -1);
+    if (rc == 0 && parent_path && sqlite3_changes(db) > 0) {
+        rc = queue_dir_hash(parent_path);
+    }
+    sqlite3_finalize(stmt);
+    
+    return rc;
+}
+
+int remove_path_from_db(const char *path) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "DELETE FROM paths WHERE id = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_stmt *queue = NULL;
+    sqlite3_prepare_v2(db, QUEUE_PATH_DELETE_SQL, -1, &queue, NULL);
+    queue_path_delete(queue, path_id);
+    sqlite3_finalize(queue);
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (rc == SQLITE_DONE) {
+        fprintf(status_output(), "Removed: %s\n", path);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Scan wrappers count every filesystem call. With --metrics, or while
+ * 'bench scan' sets scan_stats_enabled, each call and insert is also
+ * timed into the scan latency histograms and the filesystem/database
+ * split; a plain 'add' reads no clocks and takes no locks here.
+ */
+typedef struct {
+    long long opendir_calls;
+    long long readdir_calls;
+    long long stat_calls;
+    long long closedir_calls;
+    long long fs_ns;
+    long long db_ns;
+    long long unchanged_dirs;   /* confirmed by hash, not written */
+} scan_stats_t;
+
+/* Per thread: replay clients and maintenance jobs scan alongside the CLI */
+THREAD_LOCAL scan_stats_t scan_stats;
+THREAD_LOCAL int scan_stats_enabled = 0;
+THREAD_LOCAL hw_sample_t scan_hw[SCAN_PHASE_COUNT];
+
+long long scan_clock() {
+    return (scan_stats_enabled || metrics_enabled) ? monotonic_ns() : 0;
+}
+
+/* Close out one scan operation started at t0 (0 when untimed) */
+void scan_phase_end(int phase, long long t0, const hw_sample_t *hw0, int hw) {
+    if (t0) {
+        long long elapsed = monotonic_ns() - t0;
+        if (phase == SCAN_PHASE_INSERT || phase == SCAN_PHASE_COMMIT) {
+            scan_stats.db_ns += elapsed;
+        } else {
+            scan_stats.fs_ns += elapsed;
+        }
+        if (metrics_enabled) metrics_record_scan(phase, elapsed);
+    }
+    if (hw) hw_accumulate(&scan_hw[phase], hw0);
+}
+
+DIR *scan_opendir(const char *path) {
+    hw_sample_t hw0;
+    int hw = (hw_sample(&hw0) == 0);
+    long long t0 = scan_clock();
+    DIR *dir = opendir(path);
+    scan_phase_end(SCAN_PHASE_TRAVERSE, t0, &hw0, hw);
+    scan_stats.opendir_calls++;
+    return dir;
+}
+
+struct dirent *scan_readdir(DIR *dir) {
+    hw_sample_t hw0;
+    int hw = (hw_sample(&hw0) == 0);
+    long long t0 = scan_clock();
+    struct dirent *entry = readdir(dir);
+    scan_phase_end(SCAN_PHASE_TRAVERSE, t0, &hw0, hw);
+    scan_stats.readdir_calls++;
+    return entry;
+}
+
+int scan_stat(const char *path, struct stat *st) {
+    hw_sample_t hw0;
+    int hw = (hw_sample(&hw0) == 0);
+    long long t0 = scan_clock();
+    int rc = stat(path, st);
+    scan_phase_end(SCAN_PHASE_STAT, t0, &hw0, hw);
+    scan_stats.stat_calls++;
+    return rc;
+}
+
+void scan_closedir(DIR *dir) {
+    hw_sample_t hw0;
+    int hw = (hw_sample(&hw0) == 0);
+    long long t0 = scan_clock();
+    closedir(dir);
+    scan_phase_end(SCAN_PHASE_TRAVERSE, t0, &hw0, hw);
+    scan_stats.closedir_calls++;
+}
+
+/*
+ * One directory's entries. Names and full paths live in a single
+ * string pool and are referenced by offset, since the pool moves as it
+ * grows.
+ */
+typedef struct {
+    size_t name;
+    size_t path;
+    int is_directory;
+    long long size;
+    long long mtime;        /* files only, -1 otherwise */
+    uint64_t hash;          /* directories: subtree hash from the scan */
+    int valid;
+} scan_entry_t;
+
+typedef struct {
+    scan_entry_t *entries;
+    int count;
+    int capacity;
+    char *pool;
+    size_t pool_size;
+    size_t pool_capacity;
+} scan_batch_t;
+
+/* Append a string to the pool; returns its offset or (size_t)-1 */
+size_t scan_batch_string(scan_batch_t *batch, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (batch->pool_size + len > batch->pool_capacity) {
+        size_t capacity = batch->pool_capacity ? batch->pool_capacity : 4096;
+        while (capacity < batch->pool_size + len) {
+            capacity *= 2;
+        }
+        char *grown = realloc(batch->pool, capacity);
+        if (!grown) return (size_t)-1;
+        batch->pool = grown;
+        batch->pool_capacity = capacity;
+    }
+    memcpy(batch->pool + batch->pool_size, str, len);
+    batch->pool_size += len;
+    return batch->pool_size - len;
+}
+
+void scan_batch_free(scan_batch_t *batch) {
+    free(batch->entries);
+    free(batch->pool);
+}
+
+/*
+ * Insert or update one directory's entries. Returns the number of rows
+ * changed, or -1; *inserted counts the rows that are new.
+ */
+int scan_insert_batch(const scan_batch_t *batch, const char *dir_path, int *inserted) {
+    long long stage = trace_clock();
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, INSERT_PATH_SQL, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Prepare error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    int changed = 0;
+    *inserted = 0;
+    for (int i = 0; i < batch->count; i++) {
+        const scan_entry_t *e = &batch->entries[i];
+        if (!e->valid) continue;
+        
+        hw_sample_t hw0;
+        int hw = (hw_sample(&hw0) == 0);
+        long long t0 = scan_clock();
+        sqlite3_int64 last_rowid = sqlite3_last_insert_rowid(db);
+        if (insert_path_row(stmt, batch->pool + e->path, batch->pool + e->name, e->is_directory, e->size,
+                            dir_path, e->mtime) == 0 && sqlite3_changes(db) > 0) {
+            changed++;
+            *inserted += sqlite3_last_insert_rowid(db) != last_rowid;
+        }
+        scan_phase_end(SCAN_PHASE_INSERT, t0, &hw0, hw);
+    }
+    sqlite3_finalize(stmt);
+    trace_event("insert", "scan", stage, dir_path, batch->count);
+    return changed;
+}
+
+/*
+ * Read one directory in stages: read all names (traverse), build the
+ * batch of full paths, then stat every entry. The caller frees the
+ * batch, also on failure.
+ */
+int scan_read_directory(const char *dir_path, scan_batch_t *batch) {
+    long long stage = trace_clock();
+    DIR *dir = scan_opendir(dir_path);
+    if (!dir) {
+        fprintf(command_stderr, "Cannot open directory: %s\n", dir_path);
+        return -1;
+    }
+    
+    struct dirent *entry;
+    int failed = 0;
+    
+    while (!failed && (entry = scan_readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (batch->count == batch->capacity) {
+            int capacity = batch->capacity ? batch->capacity * 2 : 64;
+            scan_entry_t *grown = realloc(batch->entries, capacity * sizeof(scan_entry_t));
+            if (!grown) {
+                failed = 1;
+                break;
+            }
+            batch->entries = grown;
+            batch->capacity = capacity;
+        }
+        scan_entry_t *e = &batch->entries[batch->count];
+        e->name = scan_batch_string(batch, entry->d_name);
+        if (e->name == (size_t)-1) {
+            failed = 1;
+            break;
+        }
+        batch->count++;
+    }
+    scan_closedir(dir);
+    trace_event("traverse", "scan", stage, dir_path, batch->count);
+    
+    if (failed) {
+        fprintf(command_stderr, "Out of memory reading directory: %s\n", dir_path);
+        return -1;
+    }
+    
+    /* Batch build */
+    stage = trace_clock();
+    char full_path[MAX_PATH_LENGTH];
+    for (int i = 0; i < batch->count; i++) {
+        snprintf(full_path, sizeof(full_path), "%s%s%s", 
+                 dir_path, PATH_SEPARATOR_STR, batch->pool + batch->entries[i].name);
+        batch->entries[i].path = scan_batch_string(batch, full_path);
+        batch->entries[i].valid = (batch->entries[i].path != (size_t)-1);
+    }
+    trace_event("batch build", "scan", stage, dir_path, batch->count);
+    
+    stage = trace_clock();
+    struct stat st;
+    for (int i = 0; i < batch->count; i++) {
+        scan_entry_t *e = &batch->entries[i];
+        if (!e->valid) continue;
+        
+        if (scan_stat(batch->pool + e->path, &st) != 0) {
+            fprintf(command_stderr, "Cannot stat: %s\n", batch->pool + e->path);
+            e->valid = 0;
+            continue;
+        }
+        e->is_directory = S_ISDIR(st.st_mode);
+        e->size = e->is_directory ? -1 : (long long)st.st_size;
+        e->mtime = e->is_directory ? -1 : (long long)st.st_mtime;
+        e->hash = 0;
+    }
+    trace_event("stat", "scan", stage, dir_path, batch->count);
+    return 0;
+}
+
+/*
+ * Scan one directory and everything under it, and return the subtree
+ * hash of what is on disk. A directory without a stored hash (new to
+ * the index) has its entries inserted before descending, as they are
+ * read. One that has a stored hash is compared after its subdirectories
+ * are scanned: if the hashes match, the subtree is unchanged and
+ * nothing is written for it; otherwise its entries are written, which
+ * updates changed sizes and mtimes and adds new entries.
+ */
+int scan_directory_recursive(const char *dir_path, int *file_count, int *dir_count, int depth,
+                             uint64_t *subtree_hash) {
+    uint64_t stored_hash = 0;
+    int has_stored = lookup_dir_hash(dir_path, &stored_hash);
+    *subtree_hash = stored_hash;      /* if it cannot be read, assume unchanged */
+    
+    if (depth > 100) {
+        fprintf(command_stderr, "Warning: Maximum depth reached at %s\n", dir_path);
+        return 0;
+    }
+    
+    scan_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (scan_read_directory(dir_path, &batch) != 0) {
+        scan_batch_free(&batch);
+        return -1;
+    }
+    
+    int inserted = 0;
+    if (!has_stored && scan_insert_batch(&batch, dir_path, &inserted) < 0) {
+        scan_batch_free(&batch);
+        return -1;
+    }
+    
+    uint64_t sum = 0;
+    long long entries = 0;
+    for (int i = 0; i < batch.count; i++) {
+        scan_entry_t *e = &batch.entries[i];
+        if (!e->valid) continue;
+        
+        if (e->is_directory) {
+            (*dir_count)++;
+            scan_directory_recursive(batch.pool + e->path, file_count, dir_count, depth + 1, &e->hash);
+        } else {
+            (*file_count)++;
+        }
+        sum += dir_entry_hash(batch.pool + e->name, e->is_directory, e->size, e->mtime, e->hash);
+        entries++;
+    }
+    *subtree_hash = entries ? dir_hash_finish(sum, entries) : 0;
+    
+    int failed = 0;
+    if (has_stored && *subtree_hash == stored_hash) {
+        scan_stats.unchanged_dirs++;
+    } else if (has_stored) {
+        int changed = scan_insert_batch(&batch, dir_path, &inserted);
+        failed = changed < 0 || (changed > 0 && queue_dir_hash(dir_path) != 0);
+    } else if (inserted == entries) {
+        /* New directory, and its rows are exactly what was hashed */
+        failed = store_dir_hash(dir_path, *subtree_hash, entries) != 0;
+    } else {
+        failed = queue_dir_hash(dir_path) != 0;
+    }
+    
+    scan_batch_free(&batch);
+    return failed ? -1 : 0;
+}
+
+void add_directory(const char *path) {
+    char normalized[MAX_PATH_LENGTH];
+    strncpy(normalized, path, sizeof(normalized) - 1);
+    normalized[sizeof(normalized) - 1] = '\0';
+    
+    size_t len = strlen(normalized);
+    while (len > 1 && (normalized[len-1] == '/' || normalized[len-1] == '\\')) {
+        normalized[--len] = '\0';
+    }
+    
+    if (!directory_exists(normalized)) {
+        fprintf(command_stderr, "Error: '%s' is not a valid directory.\n", normalized);
+        return;
+    }
+    
+    fprintf(status_output(), "Scanning directory: %s\n", normalized);
+    
+    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    
+    /* Stored hashes must be current before the scan trusts them */
+    update_dir_hashes();
+    
+    const char *name = get_filename_from_path(normalized);
+    add_path_to_db(normalized, name, 1, -1, NULL);
+    
+    int file_count = 0;
+    int dir_count = 1;
+    long long unchanged_before = scan_stats.unchanged_dirs;
+    uint64_t subtree_hash;
+    
+    scan_directory_recursive(normalized, &file_count, &dir_count, 0, &subtree_hash);
+    update_dir_hashes();
+    changelog_close_generation();
+    
+    hw_sample_t hw0;
+    int hw = (hw_sample(&hw0) == 0);
+    long long t0 = scan_clock();
+    long long stage = trace_clock();
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    trace_event("commit", "scan", stage, normalized, -1);
+    scan_phase_end(SCAN_PHASE_COMMIT, t0, &hw0, hw);
+    
+    if (hw) {
+        for (int i = 0; i < SCAN_PHASE_COUNT; i++) {
+            hw_record_delta(scan_phase_names[i], 1, &scan_hw[i]);
+        }
+    }
+    memset(scan_hw, 0, sizeof(scan_hw));
+    
+    long long unchanged = scan_stats.unchanged_dirs - unchanged_before;
+    if (unchanged > 0) {
+        fprintf(status_output(), "Added %d files and %d directories (%lld unchanged directories skipped).\n\n",
+                file_count, dir_count, unchanged);
+    } else {
+        fprintf(status_output(), "Added %d files and %d directories.\n\n", file_count, dir_count);
+    }
+}
+
+/* ============================================
+ * Stale Entry Verification
+ * ============================================ */
+
+/*
+ * 'verify [root]' checks that stored paths still exist without a full
+ * rescan. Rows are read in parent_path order and grouped by directory;
+ * each directory is listed once with readdir and its stored children
+ * looked up in the listing, instead of one stat per path. Directories
+ * are checked on several threads, a chunk at a time, and the missing
+ * rows are deleted in batched transactions at the end.
+ *
+ * Only paths under a root that still exists are checked: a missing root
+ * (an unmounted disk, the synthetic corpus) is reported and skipped,
+ * never emptied.
+ */
+#define VERIFY_CHUNK_ENTRIES 65536
+#define VERIFY_MAX_THREADS 8
+#define VERIFY_DELETE_BATCH 10000
+
+typedef struct {
+    sqlite3_int64 id;
+    uint32_t name;          /* offset into the chunk's pool */
+    unsigned char missing;
+} verify_entry_t;
+
+typedef struct {
+    uint32_t path;          /* offset into the chunk's pool */
+    int first;
+    int count;
+    int unreadable;
+    long long listed;
+} verify_dir_t;
+
+typedef struct {
+    verify_entry_t *entries;
+    int entry_count, entry_capacity;
+    verify_dir_t *dirs;
+    int dir_count, dir_capacity;
+    char *pool;
+    size_t pool_used, pool_capacity;
+} verify_chunk_t;
+
+typedef struct {
+    sqlite3_int64 *ids;
+    size_t count, capacity;
+} id_list_t;
+
+int id_list_add(id_list_t *list, sqlite3_int64 id) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        sqlite3_int64 *grown = realloc(list->ids, capacity * sizeof(sqlite3_int64));
+        if (!grown) return -1;
+        list->ids = grown;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+    return 0;
+}
+
+/* Copy a string into the chunk's pool; returns its offset or -1 */
+long long verify_pool_add(verify_chunk_t *chunk, const char *s) {
+    size_t length = strlen(s) + 1;
+    if (chunk->pool_used + length > chunk->pool_capacity) {
+        size_t capacity = chunk->pool_capacity ? chunk->pool_capacity * 2 : 1 << 20;
+        while (capacity < chunk->pool_used + length) capacity *= 2;
+        char *grown = realloc(chunk->pool, capacity);
+        if (!grown) return -1;
+        chunk->pool = grown;
+        chunk->pool_capacity = capacity;
+    }
+    memcpy(chunk->pool + chunk->pool_used, s, length);
+    chunk->pool_used += length;
+    return (long long)(chunk->pool_used - length);
+}
+
+int verify_add_entry(verify_chunk_t *chunk, const char *parent, sqlite3_int64 id, const char *name) {
+    verify_dir_t *dir = chunk->dir_count ? &chunk->dirs[chunk->dir_count - 1] : NULL;
+    if (!dir || strcmp(chunk->pool + dir->path, parent) != 0) {
+        if (chunk->dir_count == chunk->dir_capacity) {
+            int capacity = chunk->dir_capacity ? chunk->dir_capacity * 2 : 1024;
+            verify_dir_t *grown = realloc(chunk->dirs, capacity * sizeof(verify_dir_t));
+            if (!grown) return -1;
+            chunk->dirs = grown;
+            chunk->dir_capacity = capacity;
+        }
+        long long offset = verify_pool_add(chunk, parent);
+        if (offset < 0) return -1;
+        dir = &chunk->dirs[chunk->dir_count++];
+        memset(dir, 0, sizeof(*dir));
+        dir->path = (uint32_t)offset;
+        dir->first = chunk->entry_count;
+    }
+    
+    if (chunk->entry_count == chunk->entry_capacity) {
+        int capacity = chunk->entry_capacity ? chunk->entry_capacity * 2 : 4096;
+        verify_entry_t *grown = realloc(chunk->entries, capacity * sizeof(verify_entry_t));
+        if (!grown) return -1;
+        chunk->entries = grown;
+        chunk->entry_capacity = capacity;
+    }
+    long long offset = verify_pool_add(chunk, name);
+    if (offset < 0) return -1;
+    verify_entry_t *entry = &chunk->entries[chunk->entry_count++];
+    entry->id = id;
+    entry->name = (uint32_t)offset;
+    entry->missing = 0;
+    dir->count++;
+    return 0;
+}
+
+int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* One directory: list it once, then look up each stored child */
+void verify_dir_worker(int index, void *ctx) {
+    verify_chunk_t *chunk = ctx;
+    verify_dir_t *dir = &chunk->dirs[index];
+    verify_entry_t *entries = chunk->entries + dir->first;
+    
+    DIR *handle = opendir(chunk->pool + dir->path);
+    if (!handle) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            for (int i = 0; i < dir->count; i++) entries[i].missing = 1;
+        } else {
+            dir->unreadable = 1;
+        }
+        return;
+    }
+    
+    char **names = NULL;
+    int count = 0, capacity = 0, failed = 0;
+    struct dirent *ent;
+    while ((ent = readdir(handle)) != NULL) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            char **grown = realloc(names, capacity * sizeof(char *));
+            if (!grown) { failed = 1; break; }
+            names = grown;
+        }
+        if (!(names[count] = strdup(ent->d_name))) { failed = 1; break; }
+        count++;
+    }
+    closedir(handle);
+    dir->listed = count;
+    
+    if (failed) {
+        dir->unreadable = 1;
+    } else {
+        qsort(names, count, sizeof(char *), compare_strings);
+        for (int i = 0; i < dir->count; i++) {
+            const char *name = chunk->pool + entries[i].name;
+            entries[i].missing = !bsearch(&name, names, count, sizeof(char *), compare_strings);
+        }
+    }
+    for (int i = 0; i < count; i++) free(names[i]);
+    free(names);
+}
+
+typedef struct {
+    long long checked;
+    long long dirs;
+    long long unreadable;
+    long long missing;
+    int shown;
+    int show_limit;
+} verify_stats_t;
+
+/* Check one chunk's directories in parallel and collect the missing ids */
+int verify_run_chunk(verify_chunk_t *chunk, id_list_t *missing, verify_stats_t *stats) {
+    if (chunk->dir_count > 0) {
+        run_parallel(chunk->dir_count, VERIFY_MAX_THREADS, verify_dir_worker, chunk);
+    }
+    
+    int rc = 0;
+    for (int d = 0; d < chunk->dir_count; d++) {
+        const verify_dir_t *dir = &chunk->dirs[d];
+        stats->dirs++;
+        if (dir->unreadable) {
+            stats->unreadable += dir->count;
+            continue;
+        }
+        stats->checked += dir->count;
+        for (int i = dir->first; i < dir->first + dir->count; i++) {
+            if (!chunk->entries[i].missing) continue;
+            stats->missing++;
+            if (id_list_add(missing, chunk->entries[i].id) != 0) rc = -1;
+            if (stats->shown < stats->show_limit) {
+                out("  missing: %s%s%s\n", chunk->pool + dir->path, PATH_SEPARATOR_STR,
+                    chunk->pool + chunk->entries[i].name);
+                stats->shown++;
+            }
+        }
+    }
+    chunk->entry_count = 0;
+    chunk->dir_count = 0;
+    chunk->pool_used = 0;
+    return rc;
+}
+
+/* Delete rows by id, committing every VERIFY_DELETE_BATCH; returns rows deleted or -1 */
+long long delete_path_ids(const id_list_t *ids) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "DELETE FROM paths WHERE id = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_stmt *queue = NULL;
+    sqlite3_prepare_v2(db, QUEUE_PATH_DELETE_SQL, -1, &queue, NULL);
+    long long deleted = 0;
+    int failed = 0;
+    for (size_t start = 0; start < ids->count && !failed; start += VERIFY_DELETE_BATCH) {
+        size_t end = start + VERIFY_DELETE_BATCH < ids->count ? start + VERIFY_DELETE_BATCH : ids->count;
+        sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        for (size_t i = start; i < end && !failed; i++) {
+            queue_path_delete(queue, ids->ids[i]);
+            sqlite3_bind_int64(stmt, 1, ids->ids[i]);
+            failed = sqlite3_step(stmt) != SQLITE_DONE;
+            sqlite3_reset(stmt);
+            deleted += sqlite3_changes(db);
+        }
+        if (failed || sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+            fprintf(command_stderr, "Delete error: %s\n", sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            failed = 1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(queue);
+    if (deleted > 0) update_dir_hashes();
+    return failed ? -1 : deleted;
+}
+
+void verify_paths(const char *argument) {
+    char root[MAX_PATH_LENGTH] = "";
+    strncpy(root, argument, sizeof(root) - 1);
+    size_t len = strlen(root);
+    while (len > 1 && (root[len-1] == '/' || root[len-1] == '\\')) {
+        root[--len] = '\0';
+    }
+    if (root[0] && !directory_exists(root)) {
+        out("'%s' is not an existing directory; use 'remove' to drop it from the index.\n", root);
+        return;
+    }
+    
+    out("\n[Verify%s%s]\n", root[0] ? " - " : "", root);
+    
+    /* Indexed roots that still exist (just the argument, if one was given) */
+    sqlite3_stmt *stmt;
+    char **roots = NULL;
+    int root_count = 0;
+    if (root[0]) {
+        roots = malloc(sizeof(char *));
+        if (roots && (roots[0] = strdup(root))) root_count = 1;
+    } else if (sqlite3_prepare_v2(db, "SELECT path FROM paths WHERE parent_path IS NULL ORDER BY path;",
+                                  -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *path = (const char *)sqlite3_column_text(stmt, 0);
+            if (!directory_exists(path)) {
+                out("  root missing, skipped: %s\n", path);
+                continue;
+            }
+            
+            /* A root inside another (it sorts after it) is already in that root's range */
+            int outer = -1;
+            for (int i = 0; i < root_count && outer < 0; i++) {
+                size_t root_len = strlen(roots[i]);
+                if (strncmp(path, roots[i], root_len) == 0 &&
+                    (path[root_len] == '/' || path[root_len] == '\\' || roots[i][root_len - 1] == PATH_SEPARATOR)) {
+                    outer = i;
+                }
+            }
+            if (outer >= 0) {
+                out("  root inside %s, checked with it: %s\n", roots[outer], path);
+                continue;
+            }
+            char **grown = realloc(roots, (root_count + 1) * sizeof(char *));
+            if (!grown) break;
+            roots = grown;
+            if ((roots[root_count] = strdup(path))) root_count++;
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    long long t0 = monotonic_ns();
+    verify_chunk_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    id_list_t missing = {0};
+    verify_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.show_limit = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+    int failed = 0;
+    
+    /*
+     * Each root's subtree in directory order, as one range of the
+     * parent_path index: [root, root0) ('0' sorts right after '/'). The
+     * range also holds siblings such as root-old/..., skipped below.
+     */
+    const char *sql =
+        "SELECT id, name, parent_path FROM paths "
+        "WHERE parent_path >= ?1 AND parent_path < ?2 "
+        "ORDER BY parent_path;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        stmt = NULL;
+        failed = 1;
+    }
+    for (int r = 0; r < root_count && !failed; r++) {
+        char lower[MAX_PATH_LENGTH + 1], upper[MAX_PATH_LENGTH + 1];
+        size_t root_len = strlen(roots[r]);
+        int has_separator = root_len > 0 && roots[r][root_len - 1] == PATH_SEPARATOR;
+        snprintf(lower, sizeof(lower), "%s%s", roots[r], has_separator ? "" : PATH_SEPARATOR_STR);
+        strcpy(upper, lower);
+        upper[strlen(upper) - 1]++;
+        size_t lower_len = strlen(lower);
+        sqlite3_bind_text(stmt, 1, roots[r], -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, upper, -1, SQLITE_STATIC);
+        
+        while (!failed && sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *name = (const char *)sqlite3_column_text(stmt, 1);
+            const char *parent = (const char *)sqlite3_column_text(stmt, 2);
+            if (strcmp(parent, roots[r]) != 0 && strncmp(parent, lower, lower_len) != 0) {
+                continue;
+            }
+            
+            /* Cut chunks at directory boundaries so each directory is listed once */
+            if (chunk.entry_count >= VERIFY_CHUNK_ENTRIES &&
+                strcmp(chunk.pool + chunk.dirs[chunk.dir_count - 1].path, parent) != 0) {
+                failed = verify_run_chunk(&chunk, &missing, &stats) != 0;
+            }
+            if (!failed) {
+                failed = verify_add_entry(&chunk, parent, sqlite3_column_int64(stmt, 0), name) != 0;
+            }
+        }
+        sqlite3_reset(stmt);
+        if (!failed) {
+            failed = verify_run_chunk(&chunk, &missing, &stats) != 0;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (stats.missing > stats.shown) {
+        out("  ... and %lld more\n", stats.missing - stats.shown);
+    }
+    
+    long long deleted = failed ? -1 : delete_path_ids(&missing);
+    double ms = (monotonic_ns() - t0) / 1e6;
+    
+    out("  Roots:             %d\n", root_count);
+    out("  Paths checked:     %lld\n", stats.checked);
+    out("  Directories read:  %lld\n", stats.dirs);
+    if (stats.unreadable) out("  Unreadable:        %lld paths (directory could not be listed)\n", stats.unreadable);
+    out("  Missing:           %lld\n", stats.missing);
+    if (deleted >= 0) out("  Removed:           %lld\n", deleted);
+    else out("  Removed:           none (failed; see above)\n");
+    out("  Time:              %.1f ms\n\n", ms);
+    
+    for (int r = 0; r < root_count; r++) free(roots[r]);
+    free(roots);
+    free(chunk.entries);
+    free(chunk.dirs);
+    free(chunk.pool);
+    free(missing.ids);
+}
+
+/* ============================================
+ * Category Operations
+ * ============================================ */
+
+int get_category_id(const char *name) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id FROM categories WHERE name = ? COLLATE NOCASE;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    
+    int id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int(stmt, 0);
+    }
+    
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+int create_category(const char *name) {
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO categories (name) VALUES (?);";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (rc == SQLITE_DONE) {
+        fprintf(status_output(), "Created category: %s\n", name);
+        return (int)sqlite3_last_insert_rowid(db);
+    }
+    
+    fprintf(command_stderr, "Failed to create category (may already exist).\n");
+    return -1;
+}
+
+void list_all_categories() {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM categories ORDER BY name;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+    
+    out("\n[All Categories]\n");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  %s\n", sqlite3_column_text(stmt, 0));
+    }
+    out("\n");
+    
+    sqlite3_finalize(stmt);
+}
+
+void list_path_categories(const char *path) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = 
+        "SELECT c.name FROM categories c "
+        "JOIN path_categories pc ON c.id = pc.category_id "
+        "WHERE pc.path_id = ? ORDER BY c.name;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    
+    out("\n[Categories for %s]\n", path);
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  %s\n", sqlite3_column_text(stmt, 0));
+        count++;
+    }
+    
+    if (count == 0) {
+        out("  (no categories)\n");
+    }
+    out("\n");
+    
+    sqlite3_finalize(stmt);
+}
+
+int categorize_path(const char *path, const char *category_name) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return -1;
+    }
+    
+    int category_id = get_category_id(category_name);
+    if (category_id < 0) {
+        fprintf(command_stderr, "Category not found: %s\n", category_name);
+        fprintf(command_stderr, "Use 'create-category %s' to create it first.\n", category_name);
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT OR IGNORE INTO path_categories (path_id, category_id) VALUES (?, ?);";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    sqlite3_bind_int(stmt, 2, category_id);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (rc == SQLITE_DONE) {
+        fprintf(status_output(), "Categorized: %s [%s]\n", path, category_name);
+        return 0;
+    }
+    return -1;
+}
+
+int uncategorize_path(const char *path, const char *category_name) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return -1;
+    }
+    
+    int category_id = get_category_id(category_name);
+    if (category_id < 0) {
+        fprintf(command_stderr, "Category not found: %s\n", category_name);
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "DELETE FROM path_categories WHERE path_id = ? AND category_id = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    sqlite3_bind_int(stmt, 2, category_id);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (rc == SQLITE_DONE) {
+        fprintf(status_output(), "Uncategorized: %s [%s]\n", path, category_name);
+        return 0;
+    }
+    return -1;
+}
+
+/* ============================================
+ * Tag Operations
+ * ============================================ */
+
+int get_tag_id(const char *name) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id FROM tags WHERE name = ? COLLATE NOCASE;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    
+    int id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int(stmt, 0);
+    }
+    
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+/*
+ * Find similar tags using both substring and Levenshtein matching.
+ * Returns the number of similar tags found.
+ * If found, populates similar_name and similar_distance with the closest match.
+ */
+int find_similar_tags(const char *new_tag, char *similar_name, size_t name_size, 
+                      int *similar_distance, int *is_substring) {
+    int threshold = get_int_setting("similarity_threshold", DEFAULT_SIMILARITY_THRESHOLD);
+    
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM tags;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    
+    int found_count = 0;
+    int best_distance = threshold + 1;
+    similar_name[0] = '\0';
+    *is_substring = 0;
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *existing = (const char *)sqlite3_column_text(stmt, 0);
+        
+        /* Check substring match first */
+        if (is_substring_match(new_tag, existing)) {
+            if (found_count == 0 || *is_substring == 0) {
+                strncpy(similar_name, existing, name_size - 1);
+                similar_name[name_size - 1] = '\0';
+                *similar_distance = abs((int)strlen(new_tag) - (int)strlen(existing));
+                *is_substring = 1;
+                found_count++;
+            }
+            continue;
+        }
+        
+        /* Check Levenshtein distance */
+        int dist = levenshtein(new_tag, existing);
+        if (dist > 0 && dist <= threshold && dist < best_distance) {
+            strncpy(similar_name, existing, name_size - 1);
+            similar_name[name_size - 1] = '\0';
+            *similar_distance = dist;
+            *is_substring = 0;
+            best_distance = dist;
+            found_count++;
+        }
+    }
+    
+    sqlite3_finalize(stmt);
+    return found_count;
+}
+
+/*
+ * Pick the tag to use for tag_name, with a similarity warning: the
+ * stored spelling of an existing tag, tag_name itself (to be created,
+ * *is_new set), or a similar tag the user chose instead.
+ * Returns 0 on success, -1 on failure/cancellation.
+ */
+int resolve_tag_with_check(const char *tag_name, char *resolved, size_t size, int *is_new) {
+    *is_new = 0;
+    
+    /* Check if exact tag exists */
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM tags WHERE name = ? COLLATE NOCASE;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, tag_name, -1, SQLITE_STATIC);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        snprintf(resolved, size, "%s", (const char *)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    if (found) {
+        return 0;
+    }
+    
+    /* Check for similar existing tags */
+    char similar_name[MAX_TAG_LENGTH];
+    int similar_distance;
+    int is_substring;
+    
+    if (find_similar_tags(tag_name, similar_name, sizeof(similar_name), 
+                          &similar_distance, &is_substring) > 0) {
+        if (is_substring) {
+            fprintf(status_output(), "Warning: Similar tag exists: '%s' (substring match)\n", similar_name);
+        } else {
+            fprintf(status_output(), "Warning: Similar tag exists: '%s' (distance: %d)\n",
+                    similar_name, similar_distance);
+        }
+        
+        char prompt[MAX_TAG_LENGTH + 32];
+        snprintf(prompt, sizeof(prompt), "Create new tag '%s' anyway?", tag_name);
+        
+        if (!get_confirmation(prompt)) {
+            snprintf(prompt, sizeof(prompt), "Use '%s' instead?", similar_name);
+            
+            if (get_confirmation(prompt)) {
+                snprintf(resolved, size, "%s", similar_name);
+                return 0;
+            }
+            
+            fprintf(status_output(), "Cancelled.\n");
+            return -1;
+        }
+    }
+    
+    snprintf(resolved, size, "%s", tag_name);
+    *is_new = 1;
+    return 0;
+}
+
+/* Tagging itself is the library's fs_tag/fs_untag; this adds the prompts and messages */
+int tag_path(const char *path, const char *tag_name) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return -1;
+    }
+    
+    char name[MAX_TAG_LENGTH];
+    int is_new;
+    if (resolve_tag_with_check(tag_name, name, sizeof(name), &is_new) != 0) {
+        return -1;
+    }
+    
+    fs_db *lib = library_handle();
+    int rc = lib ? fs_tag(lib, path, name) : FS_ERROR;
+    if (rc != FS_OK) {
+        fprintf(command_stderr, "Cannot tag %s: %s\n", path, fs_errmsg(lib));
+        return -1;
+    }
+    if (is_new) {
+        fprintf(status_output(), "Created tag: %s\n", name);
+    }
+    
+    /* fs_tag's INSERT OR IGNORE changed nothing: the tag was already there */
+    if (sqlite3_changes(db) == 0) {
+        out("Path already has tag '%s'.\n", name);
+        return 0;
+    }
+    fprintf(status_output(), "Tagged: %s [%s]\n", path, name);
+    return 0;
+}
+
+int untag_path(const char *path, const char *tag_name) {
+    fs_db *lib = library_handle();
+    int rc = lib ? fs_untag(lib, path, tag_name) : FS_ERROR;
+    
+    if (rc == FS_NOT_FOUND && get_path_id(path) < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return -1;
+    }
+    if (rc == FS_NOT_FOUND) {
+        fprintf(command_stderr, "Tag not found: %s\n", tag_name);
+        return -1;
+    }
+    if (rc != FS_OK) {
+        fprintf(command_stderr, "Cannot untag %s: %s\n", path, fs_errmsg(lib));
+        return -1;
+    }
+    fprintf(status_output(), "Untagged: %s [%s]\n", path, tag_name);
+    return 0;
+}
+
+void list_all_tags() {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM tags ORDER BY name;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+    
+    out("\n[All Tags]\n");
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  %s\n", sqlite3_column_text(stmt, 0));
+        count++;
+    }
+    
+    if (count == 0) {
+        out("  (no tags)\n");
+    }
+    out("\nTotal: %d tags\n", count);
+    
+    sqlite3_finalize(stmt);
+}
+
+void list_path_tags(const char *path) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return;
+    }
+    
+    sqlite3_stmt *stmt;
+    const char *sql = 
+        "SELECT t.name FROM tags t "
+        "JOIN path_tags pt ON t.id = pt.tag_id "
+        "WHERE pt.path_id = ? ORDER BY t.name;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    
+    out("\n[Tags for %s]\n", path);
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  %s\n", sqlite3_column_text(stmt, 0));
+        count++;
+    }
+    
+    if (count == 0) {
+        out("  (no tags)\n");
+    }
+    out("\n");
+    
+    sqlite3_finalize(stmt);
+}
+
+void search_tags_fuzzy(const char *query) {
+    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+    int fuzzy_dist = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+    
+    /* Exact match */
+    sqlite3_stmt *stmt;
+    const char *sql_exact = "SELECT name FROM tags WHERE name = ? COLLATE NOCASE;";
+    
+    if (sqlite3_prepare_v2(db, sql_exact, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+        
+        out("\n[Exact Match - Tags]\n");
+        int found = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            out("  %s\n", sqlite3_column_text(stmt, 0));
+            found++;
+        }
+        if (!found) {
+            out("  (no exact match)\n");
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    /* Substring match */
+    const char *sql_substr = "SELECT name FROM tags WHERE name LIKE '%' || ? || '%' COLLATE NOCASE LIMIT ?;";
+    
+    if (sqlite3_prepare_v2(db, sql_substr, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, max_results);
+        
+        out("\n[Substring Match - Tags]\n");
+        int found = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            out("  %s\n", sqlite3_column_text(stmt, 0));
+            found++;
+        }
+        if (!found) {
+            out("  (no substring matches)\n");
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    /* Fuzzy match */
+    const char *sql_fuzzy = 
+        "SELECT name, levenshtein(name, ?) as dist FROM tags "
+        "WHERE dist <= ? ORDER BY dist, name LIMIT ?;";
+    
+    if (require_levenshtein(db) == 0 && sqlite3_prepare_v2(db, sql_fuzzy, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, fuzzy_dist);
+        sqlite3_bind_int(stmt, 3, max_results);
+        
+        out("\n[Fuzzy Match - Tags (distance <= %d)]\n", fuzzy_dist);
+        int found = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *name = (const char *)sqlite3_column_text(stmt, 0);
+            int dist = sqlite3_column_int(stmt, 1);
+            out("  %s (distance: %d)\n", name, dist);
+            found++;
+        }
+        if (!found) {
+            out("  (no fuzzy matches)\n");
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    out("\n");
+}
+
+/* ============================================
+ * Path Info
+ * ============================================ */
+
+void show_path_info(const char *path) {
+    int path_id = get_path_id(path);
+    if (path_id < 0) {
+        fprintf(command_stderr, "Path not found in database: %s\n", path);
+        return;
+    }
+    
+    sqlite3_stmt *stmt;
+    
+    /* Get basic path info */
+    const char *sql = "SELECT path, name, is_directory, size FROM paths WHERE id = ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return;
+    }
+    
+    sqlite3_bind_int(stmt, 1, path_id);
+    
+    out("\n[Path Info]\n");
+    
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *full_path = (const char *)sqlite3_column_text(stmt, 0);
+        const char *name = (const char *)sqlite3_column_text(stmt, 1);
+        int is_dir = sqlite3_column_int(stmt, 2);
+        
+        out("  Path:        %s\n", full_path);
+        out("  Name:        %s\n", name);
+        out("  Type:        %s\n", is_dir ? "Directory" : "File");
+        
+        if (!is_dir && sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+            long long size = sqlite3_column_int64(stmt, 3);
+            out("  Size:        %lld bytes\n", size);
+        }
+    }
+    sqlite3_finalize(stmt);
+    
+    /* Get categories */
+    const char *cat_sql = 
+        "SELECT c.name FROM categories c "
+        "JOIN path_categories pc ON c.id = pc.category_id "
+        "WHERE pc.path_id = ? ORDER BY c.name;";
+    
+    if (sqlite3_prepare_v2(db, cat_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, path_id);
+        
+        char categories[512] = "";
+        int first = 1;
+        
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *cat = (const char *)sqlite3_column_text(stmt, 0);
+            if (!first) {
+                strncat(categories, ", ", sizeof(categories) - strlen(categories) - 1);
+            }
+            strncat(categories, cat, sizeof(categories) - strlen(categories) - 1);
+            first = 0;
+        }
+        
+        out("  Categories:  %s\n", strlen(categories) > 0 ? categories : "(none)");
+        sqlite3_finalize(stmt);
+    }
+    
+    /* Get tags */
+    const char *tag_sql = 
+        "SELECT t.name FROM tags t "
+        "JOIN path_tags pt ON t.id = pt.tag_id "
+        "WHERE pt.path_id = ? ORDER BY t.name;";
+    
+    if (sqlite3_prepare_v2(db, tag_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, path_id);
+        
+        char tags[512] = "";
+        int first = 1;
+        
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *tag = (const char *)sqlite3_column_text(stmt, 0);
+            if (!first) {
+                strncat(tags, ", ", sizeof(tags) - strlen(tags) - 1);
+            }
+            strncat(tags, tag, sizeof(tags) - strlen(tags) - 1);
+            first = 0;
+        }
+        
+        out("  Tags:        %s\n", strlen(tags) > 0 ? tags : "(none)");
+        sqlite3_finalize(stmt);
+    }
+    
+    out("\n");
+}
+
+/* ============================================
+ * Output Formats
+ * ============================================ */
+
+/*
+ * Path results are printed as text unless -c or --batch selects a
+ * machine-readable format:
+ *   ndjson  one JSON object per result
+ *   tsv     match, path, is_directory, size, distance; tab, newline and
+ *           backslash in paths are written as \t, \n and \\
+ *   nul     the path alone, terminated by NUL (for xargs -0)
+ * Section headers and "(no matches)" lines only appear as text.
+ */
+typedef enum {
+    OUTPUT_TEXT,
+    OUTPUT_NDJSON,
+    OUTPUT_TSV,
+    OUTPUT_NUL
+} output_format_t;
+
+/* Per thread: each serve connection picks its own */
+THREAD_LOCAL output_format_t output_format = OUTPUT_TEXT;
+
+/*
+ * Status lines and warnings ("Tagged: ...", "Removed: ...") are not
+ * results: in the machine-readable formats they go to stderr, so
+ * stdout holds only records and end markers.
+ */
+FILE *status_output() {
+    return output_format == OUTPUT_TEXT ? command_stdout : command_stderr;
+}
+
+/* Match kind of the section being printed, and results printed so far */
+THREAD_LOCAL const char *result_match = "";
+THREAD_LOCAL long long result_count = 0;
+
+/*
+ * Result rows are the bulk of large outputs, so they skip out(): each
+ * row is formatted by hand straight from the caller's strings (SQLite
+ * column text, mmap'd index entries) into a per-thread buffer that is
+ * written with one fwrite when full. Anything else printed must come
+ * after result_flush(); section headers, "(no matches)" lines, end
+ * markers and the end of every command flush.
+ */
+#define RESULT_BUFFER_SIZE 65536
+
+typedef struct {
+    char data[RESULT_BUFFER_SIZE];
+    size_t used;
+    FILE *fp;
+} result_buffer_t;
+
+THREAD_LOCAL result_buffer_t result_buffer;
+
+void result_flush() {
+    if (result_buffer.used > 0) {
+        fwrite(result_buffer.data, 1, result_buffer.used, result_buffer.fp);
+        result_buffer.used = 0;
+    }
+}
+
+/* Make room for at least 'size' more bytes (size <= RESULT_BUFFER_SIZE) */
+void result_reserve(size_t size) {
+    if (result_buffer.fp != command_stdout) {
+        result_flush();
+        result_buffer.fp = command_stdout;
+    }
+    if (result_buffer.used + size > RESULT_BUFFER_SIZE) {
+        result_flush();
+    }
+}
+
+/*
+ * Paths are short, and a word-at-a-time copy beats a call to memcpy
+ * for them; longer strings go to memcpy.
+ */
+void result_put(const char *s, size_t length) {
+    char *out = result_buffer.data + result_buffer.used;
+    result_buffer.used += length;
+    
+    if (length > 256) {
+        memcpy(out, s, length);
+        return;
+    }
+    for (; length >= 8; length -= 8, out += 8, s += 8) {
+        memcpy(out, s, 8);
+    }
+    while (length--) *out++ = *s++;
+}
+
+/* Constant length, so the compiler turns the copy into a few moves */
+#define result_put_literal(s) \
+    (memcpy(result_buffer.data + result_buffer.used, s, sizeof(s) - 1), \
+     result_buffer.used += sizeof(s) - 1)
+
+void result_putc(char c) {
+    result_buffer.data[result_buffer.used++] = c;
+}
+
+void result_put_int(long long value) {
+    char digits[24];
+    int n = 0;
+    unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0) digits[n++] = '-';
+    
+    char *out = result_buffer.data + result_buffer.used;
+    result_buffer.used += n;
+    while (n > 0) *out++ = digits[--n];
+}
+
+/*
+ * The escaping writers keep the write position in a local: every byte
+ * store could alias result_buffer.used otherwise, forcing a reload.
+ */
+
+/* Same escaping as write_json_string */
+void result_put_json_string(const char *s, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    char *out = result_buffer.data + result_buffer.used;
+    
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)c;
+        } else if (c < 0x20) {
+            memcpy(out, "\\u00", 4);
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 15];
+            out += 6;
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '"';
+    result_buffer.used = out - result_buffer.data;
+}
+
+void result_put_tsv_field(const char *s, size_t length) {
+    char *out = result_buffer.data + result_buffer.used;
+    
+    for (size_t i = 0; i < length; i++) {
+        char c = s[i];
+        if (c == '\t' || c == '\n' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (c == '\t') ? 't' : (c == '\n') ? 'n' : '\\';
+        } else {
+            *out++ = c;
+        }
+    }
+    result_buffer.used = out - result_buffer.data;
+}
+
+int parse_output_format(const char *name, output_format_t *format) {
+    if (strcmp(name, "text") == 0)        *format = OUTPUT_TEXT;
+    else if (strcmp(name, "ndjson") == 0) *format = OUTPUT_NDJSON;
+    else if (strcmp(name, "tsv") == 0)    *format = OUTPUT_TSV;
+    else if (strcmp(name, "nul") == 0)    *format = OUTPUT_NUL;
+    else return -1;
+    return 0;
+}
+
+void print_results_header(const char *match, const char *title, ...) {
+    result_flush();
+    result_match = match;
+    if (output_format != OUTPUT_TEXT) return;
+    
+    va_list args;
+    va_start(args, title);
+    out("\n[");
+    vfprintf(command_stdout, title, args);
+    out("]\n");
+    va_end(args);
+}
+
+void print_no_results(const char *message, ...) {
+    result_flush();
+    if (output_format != OUTPUT_TEXT) return;
+    
+    va_list args;
+    va_start(args, message);
+    out("  (");
+    vfprintf(command_stdout, message, args);
+    out(")\n");
+    va_end(args);
+}
+
+void print_path_row(const char *path, int is_dir, long long size, int show_distance, int dist) {
+    size_t length = strnlen(path, MAX_PATH_LENGTH);
+    size_t match_length = strlen(result_match);
+    
+    /* Worst case: every path byte escaped as \u00XX, plus the fixed fields */
+    result_reserve(6 * length + match_length + 128);
+    result_count++;
+    
+    switch (output_format) {
+    case OUTPUT_NDJSON:
+        result_put_literal("{\"match\":\"");
+        result_put(result_match, match_length);
+        result_put_literal("\",\"path\":");
+        result_put_json_string(path, length);
+        if (is_dir) result_put_literal(",\"directory\":true,\"size\":");
+        else        result_put_literal(",\"directory\":false,\"size\":");
+        result_put_int(size);
+        if (show_distance) {
+            result_put_literal(",\"distance\":");
+            result_put_int(dist);
+        }
+        result_put_literal("}\n");
+        return;
+    case OUTPUT_TSV:
+        result_put(result_match, match_length);
+        result_putc('\t');
+        result_put_tsv_field(path, length);
+        result_putc('\t');
+        result_putc(is_dir ? '1' : '0');
+        result_putc('\t');
+        result_put_int(size);
+        result_putc('\t');
+        if (show_distance) result_put_int(dist);
+        result_putc('\n');
+        return;
+    case OUTPUT_NUL:
+        result_put(path, length);
+        result_putc('\0');
+        return;
+    case OUTPUT_TEXT:
+        break;
+    }
+    
+    if (is_dir) {
+        result_put_literal("  [DIR]  ");
+        result_put(path, length);
+    } else {
+        result_put_literal("  [FILE] ");
+        result_put(path, length);
+        result_put_literal(" (");
+        result_put_int(size);
+        result_put_literal(" bytes)");
+    }
+    
+    if (show_distance) {
+        result_put_literal(" (distance: ");
+        result_put_int(dist);
+        result_putc(')');
+    }
+    
+    result_putc('\n');
+}
+
+/* ============================================
+ * Shared Scans
+ * ============================================ */
+
+/*
+ * Substring and fuzzy path searches both read every row of paths.
+ * When several arrive together (serve workers, or a run of them in a
+ * --batch file) one pass evaluates each row against all of them while
+ * the row is in cache. The first query to arrive scans for everything
+ * pending; queries that arrive during a pass wait and go in the next
+ * one, so under load each pass carries more queries and an idle
+ * server adds no delay. Queries are served in arrival order. Results
+ * match the SQL searches: substring matches in table order up to
+ * max_results, fuzzy matches ordered by distance and name. A fuzzy
+ * query keeps only its max_results best matches while scanning (a heap
+ * with the worst on top), and once that is full a row must beat the
+ * worst distance, which also tightens the Levenshtein bound.
+ */
+#define SHARED_SCAN_MAX_BATCH 64
+
+enum {
+    SHARED_SUBSTRING,
+    SHARED_FUZZY
+};
+
+typedef struct {
+    char *path;
+    char *name;
+    int is_directory;
+    long long size;
+    int distance;
+} shared_match_t;
+
+typedef struct shared_query {
+    int kind;
+    char query[MAX_INPUT_LENGTH];
+    char pattern[MAX_INPUT_LENGTH + 3];    /* '%query%' for sqlite3_strlike */
+    int query_length;
+    int max_distance;
+    int max_results;
+    
+    shared_match_t *matches;
+    int count;
+    int capacity;
+    int failed;
+    int done;
+    struct shared_query *next;
+} shared_query_t;
+
+typedef struct {
+    fs_mutex_t lock;
+    fs_cond_t finished;
+    shared_query_t *pending;    /* oldest first */
+    shared_query_t *pending_tail;
+    int scanning;
+} shared_scan_t;
+
+int shared_scans_enabled = 0;
+shared_scan_t shared_scan;
+
+/* Results computed ahead of time for this thread (--batch files) */
+THREAD_LOCAL shared_query_t *shared_prefetched = NULL;
+
+void shared_scan_init() {
+    mutex_init(&shared_scan.lock);
+    cond_init(&shared_scan.finished);
+    shared_scans_enabled = 1;
+}
+
+void shared_query_init(shared_query_t *q, int kind, const char *query, int max_distance, int max_results) {
+    memset(q, 0, sizeof(*q));
+    q->kind = kind;
+    snprintf(q->query, sizeof(q->query), "%s", query);
+    q->query_length = (int)strlen(q->query);
+    snprintf(q->pattern, sizeof(q->pattern), "%%%s%%", q->query);
+    q->max_distance = max_distance;
+    q->max_results = max_results;
+}
+
+void shared_query_free(shared_query_t *q) {
+    for (int i = 0; i < q->count; i++) {
+        free(q->matches[i].path);
+        free(q->matches[i].name);
+    }
+    free(q->matches);
+    q->matches = NULL;
+    q->count = q->capacity = 0;
+}
+
+int shared_query_add(shared_query_t *q, sqlite3_stmt *stmt, const char *name, int distance) {
+    if (q->count == q->capacity) {
+        int capacity = q->capacity ? q->capacity * 2 : 16;
+        shared_match_t *grown = realloc(q->matches, capacity * sizeof(shared_match_t));
+        if (!grown) return -1;
+        q->matches = grown;
+        q->capacity = capacity;
+    }
+    shared_match_t *m = &q->matches[q->count];
+    m->path = strdup((const char *)sqlite3_column_text(stmt, 0));
+    m->name = strdup(name);
+    m->is_directory = sqlite3_column_int(stmt, 1);
+    m->size = sqlite3_column_int64(stmt, 2);
+    m->distance = distance;
+    if (!m->path || !m->name) {
+        free(m->path);
+        free(m->name);
+        return -1;
+    }
+    q->count++;
+    return 0;
+}
+
+int compare_shared_matches(const void *a, const void *b) {
+    const shared_match_t *x = a, *y = b;
+    if (x->distance != y->distance) return x->distance - y->distance;
+    int cmp = strcmp(x->name, y->name);
+    return cmp ? cmp : strcmp(x->path, y->path);
+}
+
+/* ---- Fuzzy top-k heap (worst match at index 0) ---- */
+
+void shared_heap_swap(shared_match_t *heap, int i, int j) {
+    shared_match_t swap = heap[i];
+    heap[i] = heap[j];
+    heap[j] = swap;
+}
+
+void shared_heap_sift_up(shared_match_t *heap, int i) {
+    while (i > 0 && compare_shared_matches(&heap[(i - 1) / 2], &heap[i]) < 0) {
+        shared_heap_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void shared_heap_sift_down(shared_match_t *heap, int count, int i) {
+    for (;;) {
+        int worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && compare_shared_matches(&heap[left], &heap[worst]) > 0) worst = left;
+        if (right < count && compare_shared_matches(&heap[right], &heap[worst]) > 0) worst = right;
+        if (worst == i) return;
+        shared_heap_swap(heap, i, worst);
+        i = worst;
+    }
+}
+
+/* Largest distance still worth computing for q */
+int shared_fuzzy_bound(const shared_query_t *q) {
+    return q->count >= q->max_results ? q->matches[0].distance : q->max_distance;
+}
+
+/* Keep the row if it is among q's max_results best so far */
+int shared_fuzzy_offer(shared_query_t *q, sqlite3_stmt *stmt, const char *name, int distance) {
+    if (q->count < q->max_results) {
+        if (shared_query_add(q, stmt, name, distance) != 0) return -1;
+        shared_heap_sift_up(q->matches, q->count - 1);
+        return 0;
+    }
+    
+    shared_match_t candidate;
+    candidate.path = (char *)sqlite3_column_text(stmt, 0);
+    candidate.name = (char *)name;
+    candidate.distance = distance;
+    if (compare_shared_matches(&candidate, &q->matches[0]) >= 0) return 0;
+    
+    shared_match_t *worst = &q->matches[0];
+    char *path = strdup(candidate.path);
+    char *copy = strdup(name);
+    if (!path || !copy) {
+        free(path);
+        free(copy);
+        return -1;
+    }
+    free(worst->path);
+    free(worst->name);
+    worst->path = path;
+    worst->name = copy;
+    worst->is_directory = sqlite3_column_int(stmt, 1);
+    worst->size = sqlite3_column_int64(stmt, 2);
+    worst->distance = distance;
+    shared_heap_sift_down(q->matches, q->count, 0);
+    return 0;
+}
+
+/* One pass over paths for every query in the list, on this thread's connection */
+void shared_scan_batch(shared_query_t *batch) {
+    long long traced = trace_clock();
+    int queries = 0;
+    int open_substrings = 0;
+    for (shared_query_t *q = batch; q; q = q->next) {
+        queries++;
+        if (q->kind == SHARED_SUBSTRING && q->max_results > 0) open_substrings++;
+    }
+    int fuzzy = queries - open_substrings;
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT path, is_directory, size, name FROM paths;", -1, &stmt, NULL) != SQLITE_OK) {
+        for (shared_query_t *q = batch; q; q = q->next) q->failed = 1;
+        return;
+    }
+    
+    /* Substring-only batches stop once every query has its results */
+    while ((fuzzy > 0 || open_substrings > 0) && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 3);
+        int name_length = sqlite3_column_bytes(stmt, 3);
+        
+        for (shared_query_t *q = batch; q; q = q->next) {
+            if (q->failed) continue;
+            if (q->kind == SHARED_SUBSTRING) {
+                if (q->count >= q->max_results || sqlite3_strlike(q->pattern, name, 0) != 0) continue;
+                if (shared_query_add(q, stmt, name, 0) != 0) q->failed = 1;
+                if (q->failed || q->count >= q->max_results) open_substrings--;
+            } else {
+                if (q->max_results <= 0) continue;
+                int bound = shared_fuzzy_bound(q);
+                int distance = fs_levenshtein_bounded(q->query, q->query_length, name, name_length, bound);
+                if (distance < 0 || distance > bound) continue;
+                if (shared_fuzzy_offer(q, stmt, name, distance) != 0) q->failed = 1;
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    
+    for (shared_query_t *q = batch; q; q = q->next) {
+        if (q->kind != SHARED_FUZZY || q->failed) continue;
+        qsort(q->matches, q->count, sizeof(shared_match_t), compare_shared_matches);
+    }
+    
+    trace_event("shared scan", "search", traced, NULL, queries);
+    mutex_lock(&metrics_lock);
+    metrics_counters.shared_scans++;
+    metrics_counters.shared_queries += queries;
+    mutex_unlock(&metrics_lock);
+}
+
+/* Take a matching prefetched result into q; 0 if there was one */
+int shared_take_prefetched(shared_query_t *q) {
+    for (shared_query_t **link = &shared_prefetched; *link; link = &(*link)->next) {
+        shared_query_t *p = *link;
+        if (p->kind == q->kind && p->max_distance == q->max_distance &&
+            p->max_results == q->max_results && strcmp(p->query, q->query) == 0) {
+            *link = p->next;
+            q->matches = p->matches;
+            q->count = p->count;
+            q->capacity = p->capacity;
+            q->failed = p->failed;
+            free(p);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Run q in a shared pass, leading one if no pass is running */
+void shared_scan_run(shared_query_t *q) {
+    if (shared_take_prefetched(q) == 0) return;
+    
+    mutex_lock(&shared_scan.lock);
+    q->next = NULL;
+    if (shared_scan.pending_tail) shared_scan.pending_tail->next = q;
+    else shared_scan.pending = q;
+    shared_scan.pending_tail = q;
+    
+    while (!q->done) {
+        if (shared_scan.scanning) {
+            cond_wait(&shared_scan.finished, &shared_scan.lock);
+            continue;
+        }
+        
+        /* Lead a pass over up to SHARED_SCAN_MAX_BATCH pending queries */
+        shared_query_t *batch = shared_scan.pending;
+        shared_query_t *last = batch;
+        for (int i = 1; i < SHARED_SCAN_MAX_BATCH && last->next; i++) last = last->next;
+        shared_scan.pending = last->next;
+        if (!shared_scan.pending) shared_scan.pending_tail = NULL;
+        last->next = NULL;
+        shared_scan.scanning = 1;
+        mutex_unlock(&shared_scan.lock);
+        
+        shared_scan_batch(batch);
+        
+        mutex_lock(&shared_scan.lock);
+        for (shared_query_t *b = batch; b; ) {
+            shared_query_t *next = b->next;
+            b->done = 1;
+            b = next;
+        }
+        shared_scan.scanning = 0;
+        cond_broadcast(&shared_scan.finished);
+    }
+    mutex_unlock(&shared_scan.lock);
+}
+
+/*
+ * Print a substring or fuzzy search through a shared pass. Returns -1
+ * if shared scans are off or the pass failed, to fall back to SQL.
+ */
+int search_paths_shared(int kind, const char *query, int max_distance, int max_results) {
+    if (!shared_scans_enabled) return -1;
+    
+    shared_query_t q;
+    shared_query_init(&q, kind, query, max_distance, max_results);
+    shared_scan_run(&q);
+    if (q.failed) {
+        shared_query_free(&q);
+        return -1;
+    }
+    
+    if (kind == SHARED_FUZZY) {
+        print_results_header("fuzzy", "Fuzzy Match - Paths (distance <= %d)", max_distance);
+    } else {
+        print_results_header("substring", "Substring Match - Paths");
+    }
+    for (int i = 0; i < q.count; i++) {
+        shared_match_t *m = &q.matches[i];
+        print_path_row(m->path, m->is_directory, m->size, kind == SHARED_FUZZY, m->distance);
+    }
+    if (!q.count && kind == SHARED_FUZZY) {
+        print_no_results("no fuzzy matches within distance %d", max_distance);
+    } else if (!q.count) {
+        print_no_results("no substring matches");
+    }
+    
+    result_flush();
+    shared_query_free(&q);
+    return 0;
+}
+
+/*
+ * The substring and fuzzy searches a command line will run, as the
+ * dispatcher parses it. Returns how many were written to out (0-2).
+ */
+int shared_queries_for_line(const char *line, shared_query_t *out) {
+    char command[64] = "";
+    char argument[MAX_INPUT_LENGTH] = "";
+    const char *space = strchr(line, ' ');
+    if (!space || space - line >= (int)sizeof(command)) return 0;
+    
+    memcpy(command, line, space - line);
+    command[space - line] = '\0';
+    str_to_lower(command);
+    strncpy(argument, space + 1, sizeof(argument) - 1);
+    trim_whitespace(argument);
+    if (strlen(argument) == 0) return 0;
+    
+    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+    int default_distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+    
+    if (strcmp(command, "substring") == 0) {
+        shared_query_init(&out[0], SHARED_SUBSTRING, argument, 0, max_results);
+        return 1;
+    }
+    if (strcmp(command, "search") == 0) {
+        shared_query_init(&out[0], SHARED_SUBSTRING, argument, 0, max_results);
+        shared_query_init(&out[1], SHARED_FUZZY, argument, default_distance, max_results);
+        return 2;
+    }
+    if (strcmp(command, "fuzzy") == 0) {
+        char term[256];
+        int distance = -1;
+        if (sscanf(argument, "%255s %d", term, &distance) < 1) return 0;
+        shared_query_init(&out[0], SHARED_FUZZY, term, distance < 0 ? default_distance : distance, max_results);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Run the searches of lines[0..count) in one pass and keep the results
+ * for this thread; the commands then pick them up as they execute.
+ */
+void shared_prefetch(const char **lines, int count) {
+    if (!shared_scans_enabled) return;
+    
+    shared_query_t *batch = NULL;
+    int queries = 0;
+    for (int i = 0; i < count; i++) {
+        shared_query_t found[2];
+        int n = shared_queries_for_line(lines[i], found);
+        for (int j = 0; j < n; j++) {
+            shared_query_t *q = malloc(sizeof(shared_query_t));
+            if (!q) break;
+            *q = found[j];
+            q->next = batch;
+            batch = q;
+            queries++;
+        }
+    }
+    
+    /* A single search gains nothing from going ahead of its command */
+    if (queries < 2) {
+        while (batch) {
+            shared_query_t *next = batch->next;
+            free(batch);
+            batch = next;
+        }
+        return;
+    }
+    
+    shared_scan_batch(batch);
+    shared_prefetched = batch;
+}
+
+/* Drop prefetched results no command used */
+void shared_prefetch_clear() {
+    while (shared_prefetched) {
+        shared_query_t *next = shared_prefetched->next;
+        shared_query_free(shared_prefetched);
+        free(shared_prefetched);
+        shared_prefetched = next;
+    }
+}
+
+/* ============================================
+ * Search Functions - Paths
+ * ============================================ */
+
+/*
+ * Path searches run through the library (libfilesearch.c) on this
+ * thread's connection; this side only prints the rows it returns.
+ */
+void search_options_init(fs_search_options *opts, fs_match match, const char *query) {
+    fs_search_options_init(opts);
+    opts->match = match;
+    opts->query = query;
+    opts->limit = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+}
+
+void print_search(const fs_search_options *opts, const char *match, const char *title, const char *no_results) {
+    fs_db *lib = library_handle();
+    fs_iter *it = NULL;
+    
+    if (!lib || fs_search(lib, opts, &it) != FS_OK) {
+        fprintf(command_stderr, "Query error: %s\n", fs_errmsg(lib));
+        return;
+    }
+    
+    print_results_header(match, "%s", title);
+    fs_result row;
+    int found = 0;
+    int rc;
+    while ((rc = fs_iter_next(it, &row)) == FS_ROW) {
+        print_path_row(row.path, row.is_directory, row.size, opts->match == FS_MATCH_FUZZY, row.distance);
+        found++;
+    }
+    if (rc == FS_ERROR) {
+        fprintf(command_stderr, "Query error: %s\n", fs_errmsg(lib));
+    }
+    
+    if (!found) {
+        print_no_results("%s", no_results);
+    }
+    
+    result_flush();
+    fs_iter_free(it);
+}
+
+void search_paths_exact(const char *query) {
+    fs_search_options opts;
+    search_options_init(&opts, FS_MATCH_EXACT, query);
+    print_search(&opts, "exact", "Exact Match - Paths", "no exact matches");
+}
+
+void search_paths_prefix(const char *query) {
+    fs_search_options opts;
+    search_options_init(&opts, FS_MATCH_PREFIX, query);
+    print_search(&opts, "prefix", "Prefix Match - Paths", "no prefix matches");
+}
+
+void search_paths_substring(const char *query) {
+    fs_search_options opts;
+    search_options_init(&opts, FS_MATCH_SUBSTRING, query);
+    
+    if (search_paths_shared(SHARED_SUBSTRING, query, 0, opts.limit) == 0) {
+        return;
+    }
+    print_search(&opts, "substring", "Substring Match - Paths", "no substring matches");
+}
+
+void search_paths_fuzzy(const char *query, int max_distance) {
+    fs_search_options opts;
+    search_options_init(&opts, FS_MATCH_FUZZY, query);
+    
+    if (max_distance < 0) {
+        max_distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+    }
+    opts.max_distance = max_distance;
+    
+    if (search_paths_shared(SHARED_FUZZY, query, max_distance, opts.limit) == 0) {
+        return;
+    }
+    
+    char title[64];
+    char no_results[64];
+    snprintf(title, sizeof(title), "Fuzzy Match - Paths (distance <= %d)", max_distance);
+    snprintf(no_results, sizeof(no_results), "no fuzzy matches within distance %d", max_distance);
+    print_search(&opts, "fuzzy", title, no_results);
+}
+
+void search_paths_all(const char *query) {
+    search_paths_exact(query);
+    search_paths_prefix(query);
+    search_paths_substring(query);
+    search_paths_fuzzy(query, -1);
+}
+
+/* ============================================
+ * Structured Search (find command)
+ * ============================================ */
+
+/* Options for find: any of the three filters may be empty, results sorted by path */
+void find_options_init(fs_search_options *opts, const char *category, const char *tag, const char *name) {
+    search_options_init(opts, FS_MATCH_SUBSTRING, name);
+    opts->category = category;
+    opts->tag = tag;
+    opts->sort = FS_SORT_PATH;
+}
+
+void structured_search(const char *category, const char *tag, const char *name) {
+    fs_search_options opts;
+    find_options_init(&opts, category, tag, name);
+    print_search(&opts, "find", "Search Results", "no matches");
+    if (output_format == OUTPUT_TEXT) out("\n");
+}
+
+/* ============================================
+ * Statistics
+ * ============================================ */
+
+void show_stats() {
+    sqlite3_stmt *stmt;
+    
+    out("\n[Database Statistics]\n");
+    
+    /* Count paths */
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  Total paths:  %d\n", sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    
+    /* Count directories */
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths WHERE is_directory = 1;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  Directories:  %d\n", sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    
+    /* Count files */
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths WHERE is_directory = 0;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  Files:        %d\n", sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    
+    /* Count tags */
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM tags;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out("  Tags:         %d\n", sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    
+    /* Count categories (total and in use) */
+    int total_cats = 0, used_cats = 0;
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM categories;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        total_cats = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    
+    sqlite3_prepare_v2(db, "SELECT COUNT(DISTINCT category_id) FROM path_categories;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        used_cats = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    
+    out("  Categories:   %d (%d in use)\n", total_cats, used_cats);
+    
+    show_hw_counters();
+    out("\n");
+}
+
+/* ============================================
+ * Binary Index File
+ * ============================================ */
+
+/*
+ * export-index writes a self-contained, memory-mappable index that
+ * --index can search without SQLite. Every section is used in place
+ * from the mapping, so opening the file only validates the header and
+ * pages are faulted in as queries touch them.
+ *
+ * Layout (native byte order, sections 8-byte aligned):
+ *   header       index_header_t, with per-section checksums
+ *   paths        NUL-terminated full paths
+ *   names        NUL-terminated names, ASCII-lowercased
+ *   entries      index_entry_t per path
+ *   sorted       uint32 entry ids ordered by name (exact/prefix search)
+ *   by_length    uint32 entry ids ordered by name length (fuzzy search)
+ *   length_start uint32 offsets into by_length for each name length
+ */
+
+#define INDEX_MAGIC "FSINDEX"
+#define INDEX_FORMAT_VERSION 1
+#define INDEX_BYTE_ORDER 0x01020304u
+#define INDEX_SUFFIX ".fsidx"
+
+enum {
+    INDEX_SECTION_PATHS,
+    INDEX_SECTION_NAMES,
+    INDEX_SECTION_ENTRIES,
+    INDEX_SECTION_SORTED,
+    INDEX_SECTION_BY_LENGTH,
+    INDEX_SECTION_LENGTH_START,
+    INDEX_SECTION_COUNT
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+} index_section_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t entry_count;
+    uint32_t max_name_length;
+    uint32_t max_results;
+    uint32_t fuzzy_distance;
+    uint32_t reserved;
+    index_section_t sections[INDEX_SECTION_COUNT];
+    uint64_t header_checksum;
+} index_header_t;
+
+typedef struct {
+    uint64_t path_offset;
+    uint32_t name_offset;
+    uint16_t name_length;
+    uint8_t is_directory;
+    uint8_t has_size;
+    int64_t size;
+} index_entry_t;
+
+uint64_t index_header_checksum(const index_header_t *header) {
+    return fnv1a64(header, offsetof(index_header_t, header_checksum), FNV1A64_INIT);
+}
+
+/* Growable byte buffer used while building the index */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} byte_buffer_t;
+
+int buffer_append(byte_buffer_t *buf, const void *data, size_t size) {
+    if (buf->size + size > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + size) {
+            capacity *= 2;
+        }
+        char *grown = realloc(buf->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return 0;
+}
+
+/* qsort has no context argument, so the comparators read these */
+static const char *sort_names;
+static const index_entry_t *sort_entries;
+
+int compare_entries_by_name(const void *a, const void *b) {
+    const index_entry_t *ea = &sort_entries[*(const uint32_t *)a];
+    const index_entry_t *eb = &sort_entries[*(const uint32_t *)b];
+    int cmp = strcmp(sort_names + ea->name_offset, sort_names + eb->name_offset);
+    if (cmp != 0) return cmp;
+    return (*(const uint32_t *)a > *(const uint32_t *)b) - (*(const uint32_t *)a < *(const uint32_t *)b);
+}
+
+/*
+ * Write one section at the current end of the file, padded to 8 bytes,
+ * and record its location and checksum in the header.
+ */
+int write_index_section(FILE *fp, index_header_t *header, int section,
+                        const void *data, size_t size) {
+    static const char padding[8] = {0};
+    long pos = ftell(fp);
+    size_t pad = (8 - (size_t)pos % 8) % 8;
+    
+    if (pad && fwrite(padding, 1, pad, fp) != pad) {
+        return -1;
+    }
+    
+    header->sections[section].offset = (uint64_t)pos + pad;
+    header->sections[section].size = size;
+    header->sections[section].checksum = fnv1a64(data, size, FNV1A64_INIT);
+    
+    if (size && fwrite(data, 1, size, fp) != size) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * An index being built: the rows read so far, in id order. Rows can be
+ * read in chunks (the maintenance job spreads a rebuild over several
+ * steps); sorting and writing happen once all are read.
+ */
+typedef struct {
+    byte_buffer_t paths, names, entries;
+    uint32_t max_name_length;
+    uint64_t count;
+    sqlite3_int64 last_id;
+    int complete;           /* every row has been read */
+} index_build_t;
+
+void index_build_free(index_build_t *build) {
+    free(build->paths.data);
+    free(build->names.data);
+    free(build->entries.data);
+    memset(build, 0, sizeof(*build));
+}
+
+/* Read up to limit more rows (-1: all of them); returns the number read, or -1 */
+long long index_build_read(index_build_t *build, long long limit) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id, path, name, is_directory, size FROM paths WHERE id > ? ORDER BY id LIMIT ?;";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, build->last_id);
+    sqlite3_bind_int64(stmt, 2, limit);
+    
+    long long rows = 0;
+    int failed = 0;
+    
+    while (!failed && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *path = (const char *)sqlite3_column_text(stmt, 1);
+        const char *name = (const char *)sqlite3_column_text(stmt, 2);
+        size_t name_len = strlen(name);
+        
+        if (name_len > UINT16_MAX || build->names.size + name_len + 1 > UINT32_MAX || build->count >= UINT32_MAX) {
+            fprintf(command_stderr, "Error: Database too large for index format v%d.\n", INDEX_FORMAT_VERSION);
+            failed = 1;
+            break;
+        }
+        
+        index_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.path_offset = build->paths.size;
+        entry.name_offset = (uint32_t)build->names.size;
+        entry.name_length = (uint16_t)name_len;
+        entry.is_directory = (uint8_t)sqlite3_column_int(stmt, 3);
+        entry.has_size = sqlite3_column_type(stmt, 4) != SQLITE_NULL;
+        entry.size = sqlite3_column_int64(stmt, 4);
+        
+        if (buffer_append(&build->paths, path, strlen(path) + 1) != 0 ||
+            buffer_append(&build->names, name, name_len + 1) != 0 ||
+            buffer_append(&build->entries, &entry, sizeof(entry)) != 0) {
+            fprintf(command_stderr, "Error: Out of memory while building index.\n");
+            failed = 1;
+            break;
+        }
+        str_to_lower(build->names.data + entry.name_offset);
+        
+        if (name_len > build->max_name_length) {
+            build->max_name_length = (uint32_t)name_len;
+        }
+        build->last_id = sqlite3_column_int64(stmt, 0);
+        build->count++;
+        rows++;
+    }
+    sqlite3_finalize(stmt);
+    
+    if (failed) {
+        return -1;
+    }
+    build->complete = limit < 0 || rows < limit;
+    return rows;
+}
+
+/* Sort the rows read, write them to target.tmp and rename it over target */
+int index_build_write(index_build_t *build, const char *target) {
+    uint64_t count = build->count;
+    uint32_t max_name_length = build->max_name_length;
+    uint32_t *sorted = NULL, *by_length = NULL, *length_start = NULL;
+    int failed = 0;
+    
+    sorted = malloc((count ? count : 1) * sizeof(uint32_t));
+    by_length = malloc((count ? count : 1) * sizeof(uint32_t));
+    length_start = calloc(max_name_length + 2, sizeof(uint32_t));
+    if (!sorted || !by_length || !length_start) {
+        fprintf(command_stderr, "Error: Out of memory while building index.\n");
+        failed = 1;
+    }
+    
+    if (!failed) {
+        const index_entry_t *ent = (const index_entry_t *)build->entries.data;
+        
+        for (uint32_t i = 0; i < count; i++) {
+            sorted[i] = i;
+        }
+        sort_names = build->names.data;
+        sort_entries = ent;
+        qsort(sorted, count, sizeof(uint32_t), compare_entries_by_name);
+        
+        /* Counting sort by name length keeps entry order within a length */
+        for (uint32_t i = 0; i < count; i++) {
+            length_start[ent[i].name_length + 1]++;
+        }
+        for (uint32_t len = 1; len <= max_name_length + 1; len++) {
+            length_start[len] += length_start[len - 1];
+        }
+        uint32_t *fill = malloc((max_name_length + 1) * sizeof(uint32_t));
+        if (!fill) {
+            failed = 1;
+        } else {
+            memcpy(fill, length_start, (max_name_length + 1) * sizeof(uint32_t));
+            for (uint32_t i = 0; i < count; i++) {
+                by_length[fill[ent[i].name_length]++] = i;
+            }
+            free(fill);
+        }
+    }
+    
+    char tmp_path[MAX_PATH_LENGTH];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", target) >= (int)sizeof(tmp_path)) {
+        fprintf(command_stderr, "Index path too long: %s\n", target);
+        failed = 1;
+    }
+    FILE *fp = NULL;
+    
+    if (!failed) {
+        fp = fopen(tmp_path, "wb");
+        if (!fp) {
+            fprintf(command_stderr, "Cannot create index file: %s\n", tmp_path);
+            failed = 1;
+        }
+    }
+    
+    if (!failed) {
+        index_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header.version = INDEX_FORMAT_VERSION;
+        header.byte_order = INDEX_BYTE_ORDER;
+        header.entry_count = count;
+        header.max_name_length = max_name_length;
+        header.max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+        header.fuzzy_distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+        
+        /* Placeholder header, rewritten once section offsets are known */
+        failed = fwrite(&header, sizeof(header), 1, fp) != 1
+            || write_index_section(fp, &header, INDEX_SECTION_PATHS, build->paths.data, build->paths.size)
+            || write_index_section(fp, &header, INDEX_SECTION_NAMES, build->names.data, build->names.size)
+            || write_index_section(fp, &header, INDEX_SECTION_ENTRIES, build->entries.data, build->entries.size)
+            || write_index_section(fp, &header, INDEX_SECTION_SORTED, sorted, count * sizeof(uint32_t))
+            || write_index_section(fp, &header, INDEX_SECTION_BY_LENGTH, by_length, count * sizeof(uint32_t))
+            || write_index_section(fp, &header, INDEX_SECTION_LENGTH_START, length_start,
+                                   (max_name_length + 2) * sizeof(uint32_t));
+        
+        header.header_checksum = index_header_checksum(&header);
+        if (!failed) {
+            failed = fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1;
+        }
+        if (fclose(fp) != 0) {
+            failed = 1;
+        }
+        
+        if (failed) {
+            fprintf(command_stderr, "Error writing index file: %s\n", tmp_path);
+            remove(tmp_path);
+        } else {
+#ifdef _WIN32
+            remove(target);
+#endif
+            if (rename(tmp_path, target) != 0) {
+                fprintf(command_stderr, "Cannot publish index '%s'\n", target);
+                remove(tmp_path);
+                failed = 1;
+            }
+        }
+    }
+    
+    free(sorted);
+    free(by_length);
+    free(length_start);
+    return failed ? -1 : 0;
+}
+
+int export_index(const char *target) {
+    index_build_t build;
+    memset(&build, 0, sizeof(build));
+    int failed = index_build_read(&build, -1) < 0 || index_build_write(&build, target) != 0;
+    uint64_t count = build.count;
+    index_build_free(&build);
+    
+    if (failed) {
+        return -1;
+    }
+    
+    out("Exported %llu entries to %s\n", (unsigned long long)count, target);
+    return 0;
+}
+
+/* A read-only mapping of an index file */
+typedef struct {
+    const char *base;
+    size_t size;
+    const index_header_t *header;
+    const char *paths;
+    const char *names;
+    const index_entry_t *entries;
+    const uint32_t *sorted;
+    const uint32_t *by_length;
+    const uint32_t *length_start;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} mapped_index_t;
+
+mapped_index_t mapped_index;
+
+int map_file_readonly(const char *path, mapped_index_t *idx) {
+#ifdef _WIN32
+    idx->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (idx->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(idx->file, &size);
+    idx->size = (size_t)size.QuadPart;
+    idx->mapping = CreateFileMappingA(idx->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!idx->mapping) {
+        CloseHandle(idx->file);
+        return -1;
+    }
+    idx->base = MapViewOfFile(idx->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!idx->base) {
+        CloseHandle(idx->mapping);
+        CloseHandle(idx->file);
+        return -1;
+    }
+    return 0;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    /* Fault the index in from the background instead of on first lookup */
+    madvise(base, (size_t)st.st_size, MADV_WILLNEED);
+    idx->base = base;
+    idx->size = (size_t)st.st_size;
+    return 0;
+#endif
+}
+
+void close_index(mapped_index_t *idx) {
+    if (!idx->base) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(idx->base);
+    CloseHandle(idx->mapping);
+    CloseHandle(idx->file);
+#else
+    munmap((void *)idx->base, idx->size);
+#endif
+    memset(idx, 0, sizeof(*idx));
+}
+
+/*
+ * Map an index file and validate its header. Only the header is read
+ * here; section contents are checked on demand by check-index.
+ */
+int open_index(const char *path, mapped_index_t *idx) {
+    memset(idx, 0, sizeof(*idx));
+    
+    if (map_file_readonly(path, idx) != 0) {
+        fprintf(command_stderr, "Cannot open index file: %s\n", path);
+        return -1;
+    }
+    
+    const index_header_t *header = (const index_header_t *)idx->base;
+    const char *error = NULL;
+    
+    if (idx->size < sizeof(index_header_t) || memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        error = "not a FileSearch index";
+    } else if (header->byte_order != INDEX_BYTE_ORDER) {
+        error = "index was written on a machine with a different byte order";
+    } else if (header->version != INDEX_FORMAT_VERSION) {
+        error = "unsupported index format version";
+    } else if (header->header_checksum != index_header_checksum(header)) {
+        error = "header checksum mismatch";
+    } else {
+        for (int i = 0; i < INDEX_SECTION_COUNT; i++) {
+            const index_section_t *sec = &header->sections[i];
+            if (sec->offset % 8 != 0 || sec->offset > idx->size || sec->size > idx->size - sec->offset) {
+                error = "section extends past end of file";
+                break;
+            }
+        }
+    }
+    
+    if (!error) {
+        uint64_t n = header->entry_count;
+        const index_section_t *sec = header->sections;
+        if (sec[INDEX_SECTION_ENTRIES].size != n * sizeof(index_entry_t) ||
+            sec[INDEX_SECTION_SORTED].size != n * sizeof(uint32_t) ||
+            sec[INDEX_SECTION_BY_LENGTH].size != n * sizeof(uint32_t) ||
+            sec[INDEX_SECTION_LENGTH_START].size != (header->max_name_length + 2) * sizeof(uint32_t)) {
+            error = "section sizes do not match entry count";
+        }
+    }
+    
+    if (error) {
+        fprintf(command_stderr, "Invalid index file '%s': %s\n", path, error);
+        close_index(idx);
+        return -1;
+    }
+    
+    idx->header = header;
+    idx->paths = idx->base + header->sections[INDEX_SECTION_PATHS].offset;
+    idx->names = idx->base + header->sections[INDEX_SECTION_NAMES].offset;
+    idx->entries = (const index_entry_t *)(idx->base + header->sections[INDEX_SECTION_ENTRIES].offset);
+    idx->sorted = (const uint32_t *)(idx->base + header->sections[INDEX_SECTION_SORTED].offset);
+    idx->by_length = (const uint32_t *)(idx->base + header->sections[INDEX_SECTION_BY_LENGTH].offset);
+    idx->length_start = (const uint32_t *)(idx->base + header->sections[INDEX_SECTION_LENGTH_START].offset);
+    return 0;
+}
+
+/* Verify every section checksum; this touches the whole file */
+int check_index(const mapped_index_t *idx) {
+    const char *section_names[INDEX_SECTION_COUNT] = {
+        "paths", "names", "entries", "sorted", "by_length", "length_start"
+    };
+    int bad = 0;
+    
+    out("\n[Index Check]\n");
+    for (int i = 0; i < INDEX_SECTION_COUNT; i++) {
+        const index_section_t *sec = &idx->header->sections[i];
+        uint64_t sum = fnv1a64(idx->base + sec->offset, sec->size, FNV1A64_INIT);
+        int ok = (sum == sec->checksum);
+        out("  %-14s %12llu bytes  %s\n", section_names[i],
+            (unsigned long long)sec->size, ok ? "ok" : "CHECKSUM MISMATCH");
+        if (!ok) bad++;
+    }
+    out("\n");
+    return bad ? -1 : 0;
+}
+
+const char *index_name(const mapped_index_t *idx, uint32_t id) {
+    return idx->names + idx->entries[id].name_offset;
+}
+
+void print_index_result(const mapped_index_t *idx, uint32_t id, int show_distance, int dist) {
+    const index_entry_t *e = &idx->entries[id];
+    print_path_row(idx->paths + e->path_offset, e->is_directory, e->size, show_distance, dist);
+}
+
+/* First position in the sorted table whose name is >= key */
+uint64_t index_lower_bound(const mapped_index_t *idx, const char *key) {
+    uint64_t lo = 0, hi = idx->header->entry_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (strcmp(index_name(idx, idx->sorted[mid]), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * LIKE matching as the SQL prefix and substring searches do it: '%'
+ * matches any run of characters and '_' any one (UTF-8) character,
+ * with no escape character. Both strings are already lowercased.
+ */
+const char *utf8_next(const char *s) {
+    s++;
+    while ((*s & 0xC0) == 0x80) s++;
+    return s;
+}
+
+int index_like(const char *s, const char *p) {
+    while (*p) {
+        if (*p == '%') {
+            while (*p == '%' || *p == '_') {
+                if (*p == '_') {
+                    if (!*s) return 0;
+                    s = utf8_next(s);
+                }
+                p++;
+            }
+            if (!*p) return 1;
+            for (; *s; s = utf8_next(s)) {
+                if (index_like(s, p)) return 1;
+            }
+            return 0;
+        }
+        if (!*s) return 0;
+        if (*p == '_') {
+            s = utf8_next(s);
+            p++;
+            continue;
+        }
+        if (*s != *p) return 0;
+        s++;
+        p++;
+    }
+    return *s == '\0';
+}
+
+void index_search_exact(const mapped_index_t *idx, const char *query) {
+    char key[MAX_INPUT_LENGTH];
+    strncpy(key, query, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    str_to_lower(key);
+    
+    print_results_header("exact", "Exact Match - Paths");
+    uint32_t found = 0;
+    uint64_t n = idx->header->entry_count;
+    for (uint64_t i = index_lower_bound(idx, key);
+         i < n && found < idx->header->max_results; i++) {
+        if (strcmp(index_name(idx, idx->sorted[i]), key) != 0) break;
+        print_index_result(idx, idx->sorted[i], 0, 0);
+        found++;
+    }
+    if (!found) {
+        print_no_results("no exact matches");
+    }
+}
+
+void index_search_prefix(const mapped_index_t *idx, const char *query) {
+    char key[MAX_INPUT_LENGTH];
+    strncpy(key, query, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    str_to_lower(key);
+    
+    /* The sorted range covers the literal part; wildcards after it are matched per name */
+    char pattern[MAX_INPUT_LENGTH + 1];
+    snprintf(pattern, sizeof(pattern), "%s%%", key);
+    size_t literal_len = strcspn(key, "%_");
+    int wildcards = key[literal_len] != '\0';
+    key[literal_len] = '\0';
+    
+    print_results_header("prefix", "Prefix Match - Paths");
+    uint32_t found = 0;
+    uint64_t n = idx->header->entry_count;
+    for (uint64_t i = index_lower_bound(idx, key);
+         i < n && found < idx->header->max_results; i++) {
+        const char *name = index_name(idx, idx->sorted[i]);
+        if (strncmp(name, key, literal_len) != 0) break;
+        if (wildcards && !index_like(name, pattern)) continue;
+        print_index_result(idx, idx->sorted[i], 0, 0);
+        found++;
+    }
+    if (!found) {
+        print_no_results("no prefix matches");
+    }
+}
+
+void index_search_substring(const mapped_index_t *idx, const char *query) {
+    char key[MAX_INPUT_LENGTH];
+    strncpy(key, query, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    str_to_lower(key);
+    
+    char pattern[MAX_INPUT_LENGTH + 2];
+    snprintf(pattern, sizeof(pattern), "%%%s%%", key);
+    int wildcards = key[strcspn(key, "%_")] != '\0';
+    
+    print_results_header("substring", "Substring Match - Paths");
+    uint32_t found = 0;
+    uint64_t n = idx->header->entry_count;
+    for (uint64_t i = 0; i < n && found < idx->header->max_results; i++) {
+        const char *name = index_name(idx, (uint32_t)i);
+        if (wildcards ? index_like(name, pattern) : strstr(name, key) != NULL) {
+            print_index_result(idx, (uint32_t)i, 0, 0);
+            found++;
+        }
+    }
+    if (!found) {
+        print_no_results("no substring matches");
+    }
+}
+
+typedef struct {
+    uint32_t id;
+    int dist;
+} index_match_t;
+
+/*
+ * Fuzzy search only visits names whose length is within max_distance
+ * of the query, using the by_length table, and keeps the best
+ * max_results matches ordered by (distance, name). 'best' must hold
+ * max_results + 1 entries. Returns the number of matches.
+ */
+uint32_t index_fuzzy_matches(const mapped_index_t *idx, const char *query, int max_distance,
+                             index_match_t *best) {
+    uint32_t max_results = idx->header->max_results;
+    uint32_t count = 0;
+    
+    char key[MAX_INPUT_LENGTH];
+    strncpy(key, query, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    str_to_lower(key);
+    int key_len = (int)strlen(key);
+    
+    int min_len = key_len - max_distance;
+    int max_len = key_len + max_distance;
+    if (min_len < 0) min_len = 0;
+    if (max_len > (int)idx->header->max_name_length) max_len = (int)idx->header->max_name_length;
+    
+    for (int len = min_len; len <= max_len; len++) {
+        for (uint32_t k = idx->length_start[len]; k < idx->length_start[len + 1]; k++) {
+            uint32_t id = idx->by_length[k];
+            int limit = max_distance;
+            /* Once the result list is full, only strictly better matches count */
+            if (count == max_results && max_results > 0) {
+                limit = best[count - 1].dist;
+            }
+            int dist = fs_levenshtein_bounded(key, key_len, index_name(idx, id), len, limit);
+            if (dist > limit) continue;
+            
+            /* Insertion into the small sorted result list */
+            uint32_t pos = count;
+            while (pos > 0) {
+                const index_match_t *prev = &best[pos - 1];
+                if (prev->dist < dist ||
+                    (prev->dist == dist && strcmp(index_name(idx, prev->id), index_name(idx, id)) <= 0)) {
+                    break;
+                }
+                pos--;
+            }
+            if (pos >= max_results) continue;
+            memmove(&best[pos + 1], &best[pos], (count - pos) * sizeof(index_match_t));
+            best[pos].id = id;
+            best[pos].dist = dist;
+            if (count < max_results) count++;
+        }
+    }
+    return count;
+}
+
+void index_search_fuzzy(const mapped_index_t *idx, const char *query, int max_distance) {
+    if (max_distance < 0) {
+        max_distance = (int)idx->header->fuzzy_distance;
+    }
+    
+    index_match_t *best = malloc((idx->header->max_results + 1) * sizeof(index_match_t));
+    if (!best) {
+        return;
+    }
+    uint32_t count = index_fuzzy_matches(idx, query, max_distance, best);
+    
+    print_results_header("fuzzy", "Fuzzy Match - Paths (distance <= %d)", max_distance);
+    for (uint32_t i = 0; i < count; i++) {
+        print_index_result(idx, best[i].id, 1, best[i].dist);
+    }
+    if (!count) {
+        print_no_results("no fuzzy matches within distance %d", max_distance);
+    }
+    free(best);
+}
+
+void index_search_all(const mapped_index_t *idx, const char *query) {
+    index_search_exact(idx, query);
+    index_search_prefix(idx, query);
+    index_search_substring(idx, query);
+    index_search_fuzzy(idx, query, -1);
+}
+
+void show_index_stats(const mapped_index_t *idx) {
+    uint64_t dirs = 0;
+    uint64_t n = idx->header->entry_count;
+    for (uint64_t i = 0; i < n; i++) {
+        dirs += idx->entries[i].is_directory;
+    }
+    
+    out("\n[Index Statistics]\n");
+    out("  Format:       v%u\n", idx->header->version);
+    out("  Total paths:  %llu\n", (unsigned long long)n);
+    out("  Directories:  %llu\n", (unsigned long long)dirs);
+    out("  Files:        %llu\n", (unsigned long long)(n - dirs));
+    out("  File size:    %llu bytes\n", (unsigned long long)idx->size);
+    out("\n");
+}
+
+/* ============================================
+ * Changesets (Multi-Host Merging)
+ * ============================================ */
+
+/*
+ * 'changelog on' installs triggers that record every change to local
+ * paths in change_log, stamped with the current generation. Each
+ * 'export-changes' copies the changes after a given generation into a
+ * standalone changeset file and starts a new generation. A central
+ * database applies changesets with 'import-changes', storing the rows
+ * as "<host>:<path>" with the host column set, so paths from different
+ * machines never collide.
+ */
+
+const char *changelog_triggers_sql =
+    "CREATE TRIGGER IF NOT EXISTS trg_change_log_insert AFTER INSERT ON paths "
+    "WHEN NEW.host IS NULL BEGIN "
+    "  INSERT INTO change_log (generation, op, path, name, is_directory, size, parent_path, mtime) "
+    "  VALUES ((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'generation'), "
+    "          'U', NEW.path, NEW.name, NEW.is_directory, NEW.size, NEW.parent_path, NEW.mtime); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS trg_change_log_update AFTER UPDATE ON paths "
+    "WHEN NEW.host IS NULL BEGIN "
+    "  INSERT INTO change_log (generation, op, path) "
+    "  SELECT (SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'generation'), 'D', OLD.path "
+    "  WHERE OLD.path <> NEW.path; "
+    "  INSERT INTO change_log (generation, op, path, name, is_directory, size, parent_path, mtime) "
+    "  VALUES ((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'generation'), "
+    "          'U', NEW.path, NEW.name, NEW.is_directory, NEW.size, NEW.parent_path, NEW.mtime); "
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS trg_change_log_delete AFTER DELETE ON paths "
+    "WHEN OLD.host IS NULL BEGIN "
+    "  INSERT INTO change_log (generation, op, path) "
+    "  VALUES ((SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'generation'), 'D', OLD.path); "
+    "END;";
+
+int changelog_enabled() {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = 'trg_change_log_insert';";
+    
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int enabled = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return enabled;
+}
+
+/*
+ * End the current generation if anything was logged in it, so each scan
+ * (and the baseline written by 'changelog on') is a generation of its
+ * own that 'diff --gen' can compare against. Runs inside the caller's
+ * transaction.
+ */
+void changelog_close_generation() {
+    if (!changelog_enabled()) {
+        return;
+    }
+    
+    sqlite3_stmt *stmt;
+    int generation = get_int_setting("generation", 1);
+    int logged = 0;
+    if (sqlite3_prepare_v2(db, "SELECT EXISTS (SELECT 1 FROM change_log WHERE generation = ?);",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, generation);
+        logged = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (logged) {
+        set_int_setting("generation", generation + 1);
+    }
+}
+
+void get_host_name(char *buffer, size_t size) {
+    get_string_setting("host_name", buffer, size, "");
+    if (buffer[0]) {
+        return;
+    }
+#ifdef _WIN32
+    const char *name = getenv("COMPUTERNAME");
+    strncpy(buffer, name ? name : "localhost", size - 1);
+    buffer[size - 1] = '\0';
+#else
+    if (gethostname(buffer, size) != 0) {
+        strncpy(buffer, "localhost", size - 1);
+    }
+    buffer[size - 1] = '\0';
+#endif
+}
+
+void cmd_changelog(const char *argument) {
+    if (strcmp(argument, "on") == 0) {
+        if (changelog_enabled()) {
+            out("Change log is already on.\n");
+            return;
+        }
+        
+        int generation = get_int_setting("generation", 1);
+        set_int_setting("generation", generation);
+        
+        /* Seed the log with existing paths so the first export is complete */
+        char *err_msg = NULL;
+        sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        int rc = sqlite3_exec(db, changelog_triggers_sql, NULL, NULL, &err_msg);
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_exec(db,
+                "INSERT INTO change_log (generation, op, path, name, is_directory, size, parent_path, mtime) "
+                "SELECT (SELECT CAST(value AS INTEGER) FROM settings WHERE key = 'generation'), "
+                "       'U', path, name, is_directory, size, parent_path, mtime "
+                "FROM paths WHERE host IS NULL ORDER BY id;", NULL, NULL, &err_msg);
+        }
+        if (rc == SQLITE_OK) {
+            changelog_close_generation();
+        }
+        
+        if (rc != SQLITE_OK) {
+            fprintf(command_stderr, "Cannot enable change log: %s\n", err_msg);
+            sqlite3_free(err_msg);
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            return;
+        }
+        sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+        out("Change log on (generation %d).\n", generation);
+    }
+    else if (strcmp(argument, "off") == 0) {
+        sqlite3_exec(db,
+            "DROP TRIGGER IF EXISTS trg_change_log_insert;"
+            "DROP TRIGGER IF EXISTS trg_change_log_update;"
+            "DROP TRIGGER IF EXISTS trg_change_log_delete;"
+            "DELETE FROM change_log;", NULL, NULL, NULL);
+        out("Change log off.\n");
+    }
+    else {
+        sqlite3_stmt *stmt;
+        int pending = 0;
+        if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM change_log;", -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) pending = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        out("Change log: %s, generation %d, %d logged changes\n",
+            changelog_enabled() ? "on" : "off", get_int_setting("generation", 1), pending);
+    }
+}
+
+/*
+ * Write all changes with generation > since into a new changeset file,
+ * then advance the generation so later changes land in the next export.
+ */
+int export_changes(const char *target, int since) {
+    if (!changelog_enabled()) {
+        fprintf(command_stderr, "Change log is off. Enable it with 'changelog on'.\n");
+        return -1;
+    }
+    
+    remove(target);
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS changeset;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, target, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(command_stderr, "Cannot create changeset '%s': %s\n", target, sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    char host[256];
+    get_host_name(host, sizeof(host));
+    int generation = get_int_setting("generation", 1);
+    
+    char sql[1024];
+    snprintf(sql, sizeof(sql),
+        "BEGIN TRANSACTION;"
+        "CREATE TABLE changeset.changes ("
+        "  seq INTEGER PRIMARY KEY, generation INTEGER, op TEXT, path TEXT,"
+        "  name TEXT, is_directory INTEGER, size INTEGER, parent_path TEXT);"
+        "CREATE TABLE changeset.meta (key TEXT PRIMARY KEY, value TEXT);"
+        "INSERT INTO changeset.changes SELECT seq, generation, op, path, name, is_directory, size, parent_path "
+        "  FROM change_log WHERE generation > %d ORDER BY seq;"
+        "INSERT INTO changeset.meta VALUES ('from_generation', %d), ('to_generation', %d);"
+        "UPDATE settings SET value = %d WHERE key = 'generation';",
+        since, since, generation, generation + 1);
+    
+    char *err_msg = NULL;
+    rc = sqlite3_exec(db, sql, NULL, NULL, &err_msg);
+    
+    if (rc == SQLITE_OK && sqlite3_prepare_v2(db, "INSERT INTO changeset.meta VALUES ('host', ?);",
+                                              -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, host, -1, SQLITE_STATIC);
+        rc = (sqlite3_step(stmt) == SQLITE_DONE) ? SQLITE_OK : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+    }
+    
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg);
+    }
+    
+    if (rc != SQLITE_OK) {
+        fprintf(command_stderr, "Export error: %s\n", err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+    }
+    sqlite3_exec(db, "DETACH DATABASE changeset;", NULL, NULL, NULL);
+    
+    if (rc != SQLITE_OK) {
+        remove(target);
+        return -1;
+    }
+    
+    int count = 0;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM change_log WHERE generation > ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, since);
+        if (sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    
+    out("Exported %d changes from %s (generations %d..%d) to %s\n",
+        count, host, since + 1, generation, target);
+    out("Next incremental export: export-changes <file> %d\n", generation);
+    return 0;
+}
+
+/*
+ * Apply a changeset file as rows of the given host. Changes are applied
+ * in order, committing every import_batch_size rows.
+ */
+int import_changes(const char *source, const char *host_override) {
+    if (!file_exists(source)) {
+        fprintf(command_stderr, "Changeset not found: %s\n", source);
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS changeset;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, source, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(command_stderr, "Cannot open changeset '%s': %s\n", source, sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    char host[256] = "";
+    int to_generation = 0;
+    if (sqlite3_prepare_v2(db, "SELECT key, value FROM changeset.meta;", -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *key = (const char *)sqlite3_column_text(stmt, 0);
+            const char *value = (const char *)sqlite3_column_text(stmt, 1);
+            if (strcmp(key, "host") == 0 && value) {
+                strncpy(host, value, sizeof(host) - 1);
+            } else if (strcmp(key, "to_generation") == 0 && value) {
+                to_generation = atoi(value);
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (host_override && host_override[0]) {
+        strncpy(host, host_override, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+    }
+    if (!host[0]) {
+        fprintf(command_stderr, "Not a changeset file (no host): %s\n", source);
+        sqlite3_exec(db, "DETACH DATABASE changeset;", NULL, NULL, NULL);
+        return -1;
+    }
+    
+    sqlite3_stmt *read_stmt, *upsert_stmt, *delete_stmt, *queue_stmt, *queue_delete_stmt;
+    const char *read_sql = 
+        "SELECT op, path, name, is_directory, size, parent_path FROM changeset.changes ORDER BY seq;";
+    const char *upsert_sql = 
+        "INSERT INTO paths (path, name, is_directory, size, parent_path, host) "
+        "VALUES (?1 || ':' || ?2, ?3, ?4, ?5, CASE WHEN ?6 IS NULL THEN NULL ELSE ?1 || ':' || ?6 END, ?1) "
+        "ON CONFLICT(path) DO UPDATE SET name = excluded.name, is_directory = excluded.is_directory, "
+        "size = excluded.size, parent_path = excluded.parent_path, host = excluded.host;";
+    const char *delete_sql = "DELETE FROM paths WHERE path = ?1 || ':' || ?2;";
+    const char *queue_sql = "INSERT OR IGNORE INTO dir_dirty (path) SELECT ?1 || ':' || ?2 WHERE ?2 IS NOT NULL;";
+    const char *queue_delete_sql =
+        "INSERT OR IGNORE INTO dir_dirty (path) "
+        "SELECT parent_path FROM paths WHERE path = ?1 || ':' || ?2 AND parent_path IS NOT NULL "
+        "UNION ALL SELECT path FROM paths WHERE path = ?1 || ':' || ?2 AND is_directory;";
+    
+    if (sqlite3_prepare_v2(db, read_sql, -1, &read_stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Not a changeset file: %s\n", source);
+        sqlite3_exec(db, "DETACH DATABASE changeset;", NULL, NULL, NULL);
+        return -1;
+    }
+    sqlite3_prepare_v2(db, upsert_sql, -1, &upsert_stmt, NULL);
+    sqlite3_prepare_v2(db, delete_sql, -1, &delete_stmt, NULL);
+    sqlite3_prepare_v2(db, queue_sql, -1, &queue_stmt, NULL);
+    sqlite3_prepare_v2(db, queue_delete_sql, -1, &queue_delete_stmt, NULL);
+    
+    int batch_size = get_int_setting("import_batch_size", DEFAULT_IMPORT_BATCH_SIZE);
+    if (batch_size < 1) batch_size = 1;
+    int applied = 0, in_batch = 0, failed = 0;
+    
+    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    while (sqlite3_step(read_stmt) == SQLITE_ROW) {
+        const char *op = (const char *)sqlite3_column_text(read_stmt, 0);
+        sqlite3_stmt *apply = (op && op[0] == 'D') ? delete_stmt : upsert_stmt;
+        
+        sqlite3_bind_text(apply, 1, host, -1, SQLITE_STATIC);
+        sqlite3_bind_value(apply, 2, sqlite3_column_value(read_stmt, 1));
+        if (apply == upsert_stmt) {
+            for (int col = 2; col <= 5; col++) {
+                sqlite3_bind_value(apply, col + 1, sqlite3_column_value(read_stmt, col));
+            }
+        } else if (queue_delete_stmt) {
+            sqlite3_bind_text(queue_delete_stmt, 1, host, -1, SQLITE_STATIC);
+            sqlite3_bind_value(queue_delete_stmt, 2, sqlite3_column_value(read_stmt, 1));
+            sqlite3_step(queue_delete_stmt);
+            sqlite3_reset(queue_delete_stmt);
+        }
+        
+        if (sqlite3_step(apply) != SQLITE_DONE) {
+            fprintf(command_stderr, "Import error: %s\n", sqlite3_errmsg(db));
+            failed = 1;
+        }
+        sqlite3_reset(apply);
+        sqlite3_clear_bindings(apply);
+        
+        if (!failed && apply == upsert_stmt && queue_stmt) {
+            sqlite3_bind_text(queue_stmt, 1, host, -1, SQLITE_STATIC);
+            sqlite3_bind_value(queue_stmt, 2, sqlite3_column_value(read_stmt, 5));
+            sqlite3_step(queue_stmt);
+            sqlite3_reset(queue_stmt);
+        }
+        if (failed) break;
+        
+        applied++;
+        if (++in_batch >= batch_size) {
+            sqlite3_exec(db, "COMMIT; BEGIN TRANSACTION;", NULL, NULL, NULL);
+            in_batch = 0;
+        }
+    }
+    sqlite3_exec(db, failed ? "ROLLBACK;" : "COMMIT;", NULL, NULL, NULL);
+    
+    sqlite3_finalize(read_stmt);
+    sqlite3_finalize(upsert_stmt);
+    sqlite3_finalize(delete_stmt);
+    sqlite3_finalize(queue_stmt);
+    sqlite3_finalize(queue_delete_stmt);
+    sqlite3_exec(db, "DETACH DATABASE changeset;", NULL, NULL, NULL);
+    
+    if (!failed && to_generation > 0) {
+        char key[300];
+        snprintf(key, sizeof(key), "imported_generation:%s", host);
+        set_int_setting(key, to_generation);
+    }
+    
+    out("Imported %d changes from host '%s'%s\n", applied, host,
+        failed ? " (stopped on error; last batch rolled back)" : "");
+    return failed ? -1 : 0;
+}
+
+/* ============================================
+ * Index Diff
+ * ============================================ */
+
+/*
+ * 'diff <dbA> <dbB>' lists paths added, removed and changed (size,
+ * mtime or type) from A to B; 'diff --gen <from> [to]' does the same
+ * between two generations of the open database's change log. Both sides
+ * are read in path order and merged like a sorted merge join, so memory
+ * stays constant however many rows there are: only the current row of
+ * each side is held, and rows go out through the result buffer as they
+ * are found. With --format, rows are printed as results whose match is
+ * "added", "removed" or "changed".
+ *
+ * When both databases have up-to-date directory hashes, the merge walks
+ * the two trees instead, one directory's entries at a time, and skips
+ * every directory whose subtree hash is the same on both sides, so the
+ * cost follows what changed rather than the size of the index. Rows then
+ * come out grouped by directory rather than in strict path order.
+ */
+typedef struct {
+    sqlite3_stmt *stmt;
+    int live;               /* stmt is on a row */
+} diff_side_t;
+
+typedef struct {
+    long long compared;
+    long long added;
+    long long removed;
+    long long changed;
+    long long skipped_dirs;     /* identical subtrees (tree walk only) */
+} diff_stats_t;
+
+int diff_side_next(diff_side_t *side) {
+    int rc = sqlite3_step(side->stmt);
+    side->live = (rc == SQLITE_ROW);
+    return (rc == SQLITE_ROW || rc == SQLITE_DONE) ? 0 : -1;
+}
+
+void print_diff_row(char change, const char *path, int is_dir, long long size, int old_dir, long long old_size) {
+    if (output_format != OUTPUT_TEXT) {
+        result_match = change == '+' ? "added" : change == '-' ? "removed" : "changed";
+        print_path_row(path, is_dir, size, 0, 0);
+        return;
+    }
+    
+    size_t length = strnlen(path, MAX_PATH_LENGTH);
+    result_reserve(length + 96);
+    result_count++;
+    result_putc(' ');
+    result_putc(' ');
+    result_putc(change);
+    result_putc(' ');
+    result_put(path, length);
+    if (is_dir) result_putc('/');
+    if (change == '~') {
+        if (is_dir != old_dir) {
+            result_put_literal(is_dir ? " (file -> directory)" : " (directory -> file)");
+        } else if (size == old_size) {
+            result_put_literal(" (modified)");
+        } else {
+            result_put_literal(" (");
+            result_put_int(old_size);
+            result_put_literal(" -> ");
+            result_put_int(size);
+            result_put_literal(" bytes)");
+        }
+    }
+    result_putc('\n');
+}
+
+/* Print a path that is only on one side */
+void print_diff_side(char change, sqlite3_stmt *row, diff_stats_t *stats) {
+    print_diff_row(change, (const char *)sqlite3_column_text(row, 0),
+                   sqlite3_column_int(row, 1), sqlite3_column_int64(row, 2), 0, 0);
+    if (change == '+') stats->added++;
+    else stats->removed++;
+}
+
+/* Compare the current rows of two statements returning (path, is_directory, size, mtime) */
+void diff_compare_rows(sqlite3_stmt *a, sqlite3_stmt *b, diff_stats_t *stats) {
+    int a_dir = sqlite3_column_int(a, 1), b_dir = sqlite3_column_int(b, 1);
+    long long a_size = sqlite3_column_int64(a, 2), b_size = sqlite3_column_int64(b, 2);
+    int mtime_changed = sqlite3_column_type(a, 3) != SQLITE_NULL && sqlite3_column_type(b, 3) != SQLITE_NULL &&
+                        sqlite3_column_int64(a, 3) != sqlite3_column_int64(b, 3);
+    if (a_dir != b_dir || (!b_dir && (a_size != b_size || mtime_changed))) {
+        print_diff_row('~', (const char *)sqlite3_column_text(b, 0), b_dir, b_size, a_dir, a_size);
+        stats->changed++;
+    }
+}
+
+/*
+ * Merge two statements that return (path, is_directory, size, mtime[, op])
+ * ordered by path. With ops (generation diffs) side B holds only the
+ * paths touched in the range, and op 'D' means the path is gone.
+ */
+int diff_merge(diff_side_t *a, diff_side_t *b, int with_ops, diff_stats_t *stats) {
+    if (diff_side_next(a) != 0 || diff_side_next(b) != 0) {
+        return -1;
+    }
+    
+    while (a->live || b->live) {
+        int cmp;
+        if (!a->live) cmp = 1;
+        else if (!b->live) cmp = -1;
+        else cmp = strcmp((const char *)sqlite3_column_text(a->stmt, 0),
+                          (const char *)sqlite3_column_text(b->stmt, 0));
+        
+        int a_present = a->live && cmp <= 0 && (!with_ops || sqlite3_column_text(a->stmt, 4)[0] == 'U');
+        int b_present = b->live && cmp >= 0 && (!with_ops || sqlite3_column_text(b->stmt, 4)[0] == 'U');
+        
+        /* A generation diff only looks at paths touched in the range */
+        if (with_ops && cmp < 0) {
+            if (diff_side_next(a) != 0) return -1;
+            continue;
+        }
+        stats->compared++;
+        
+        if (a_present && !b_present) {
+            print_diff_side('-', a->stmt, stats);
+        } else if (!a_present && b_present) {
+            print_diff_side('+', b->stmt, stats);
+        } else if (a_present && b_present) {
+            diff_compare_rows(a->stmt, b->stmt, stats);
+        }
+        
+        if (cmp <= 0 && diff_side_next(a) != 0) return -1;
+        if (cmp >= 0 && diff_side_next(b) != 0) return -1;
+    }
+    return 0;
+}
+
+void print_diff_summary(const diff_stats_t *stats, long long t0) {
+    result_flush();
+    if (output_format != OUTPUT_TEXT) return;
+    if (stats->added + stats->removed + stats->changed == 0) {
+        out("  (no differences)\n");
+    }
+    out("\n  %lld added, %lld removed, %lld changed (%lld paths compared", 
+        stats->added, stats->removed, stats->changed, stats->compared);
+    if (stats->skipped_dirs > 0) {
+        out(", %lld identical subtrees skipped", stats->skipped_dirs);
+    }
+    out(" in %.1f ms)\n\n", (monotonic_ns() - t0) / 1e6);
+}
+
+/* ---- Tree walk over directory hashes ---- */
+
+#define DIFF_CHILDREN_SQL \
+    "SELECT p.path, p.is_directory, p.size, p.mtime, h.hash, h.entries FROM paths p " \
+    "LEFT JOIN dir_hashes h ON p.is_directory AND h.path = p.path "
+
+/* Hashes are usable if nothing is waiting in dir_dirty */
+int diff_hashes_current(sqlite3 *conn) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT EXISTS (SELECT 1 FROM dir_dirty);", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int current = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0;
+    sqlite3_finalize(stmt);
+    return current;
+}
+
+/* Merge everything under a directory on both sides, in path order */
+int diff_range(sqlite3 *conn_a, sqlite3 *conn_b, const char *dir_path, diff_stats_t *stats) {
+    char low[MAX_PATH_LENGTH], high[MAX_PATH_LENGTH];
+    size_t len = strlen(dir_path);
+    int has_separator = len > 0 && dir_path[len - 1] == PATH_SEPARATOR;     /* the "/" root */
+    if (snprintf(low, sizeof(low), "%s%s", dir_path, has_separator ? "" : PATH_SEPARATOR_STR) >= (int)sizeof(low)) {
+        return -1;
+    }
+    strcpy(high, low);
+    high[strlen(high) - 1]++;
+    
+    const char *sql = "SELECT path, is_directory, size, mtime FROM paths "
+                      "WHERE path >= ?1 AND path < ?2 ORDER BY path;";
+    diff_side_t a = { NULL, 0 }, b = { NULL, 0 };
+    int failed = sqlite3_prepare_v2(conn_a, sql, -1, &a.stmt, NULL) != SQLITE_OK ||
+                 sqlite3_prepare_v2(conn_b, sql, -1, &b.stmt, NULL) != SQLITE_OK;
+    if (!failed) {
+        sqlite3_bind_text(a.stmt, 1, low, -1, SQLITE_STATIC);
+        sqlite3_bind_text(a.stmt, 2, high, -1, SQLITE_STATIC);
+        sqlite3_bind_text(b.stmt, 1, low, -1, SQLITE_STATIC);
+        sqlite3_bind_text(b.stmt, 2, high, -1, SQLITE_STATIC);
+        failed = diff_merge(&a, &b, 0, stats) != 0;
+    }
+    sqlite3_finalize(a.stmt);
+    sqlite3_finalize(b.stmt);
+    return failed ? -1 : 0;
+}
+
+int diff_has_path(sqlite3 *conn, const char *path) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT 1 FROM paths WHERE path = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+/*
+ * Merge the entries of one directory and descend where the hashes
+ * differ. At the top (dir_path NULL) the entries are the roots, plus
+ * any hashed directory that has no row of its own: 'remove' deletes a
+ * directory's row but not its contents, and those rows are reachable
+ * only from their parent_path. Such entries have is_directory 2 and
+ * are not printed themselves.
+ */
+int diff_walk(sqlite3 *conn_a, sqlite3 *conn_b, const char *dir_path, diff_stats_t *stats) {
+    const char *sql = dir_path
+        ? DIFF_CHILDREN_SQL "WHERE p.parent_path = ?1 ORDER BY p.path;"
+        : DIFF_CHILDREN_SQL "WHERE p.parent_path IS NULL "
+          "UNION ALL SELECT h.path, 2, NULL, NULL, h.hash, h.entries FROM dir_hashes h "
+          "WHERE NOT EXISTS (SELECT 1 FROM paths WHERE path = h.path) ORDER BY 1;";
+    diff_side_t a = { NULL, 0 }, b = { NULL, 0 };
+    int failed = sqlite3_prepare_v2(conn_a, sql, -1, &a.stmt, NULL) != SQLITE_OK ||
+                 sqlite3_prepare_v2(conn_b, sql, -1, &b.stmt, NULL) != SQLITE_OK;
+    if (!failed && dir_path) {
+        sqlite3_bind_text(a.stmt, 1, dir_path, -1, SQLITE_STATIC);
+        sqlite3_bind_text(b.stmt, 1, dir_path, -1, SQLITE_STATIC);
+    }
+    failed = failed || diff_side_next(&a) != 0 || diff_side_next(&b) != 0;
+    
+    while (!failed && (a.live || b.live)) {
+        int cmp;
+        if (!a.live) cmp = 1;
+        else if (!b.live) cmp = -1;
+        else cmp = strcmp((const char *)sqlite3_column_text(a.stmt, 0),
+                          (const char *)sqlite3_column_text(b.stmt, 0));
+        
+        const char *path = (const char *)sqlite3_column_text(cmp <= 0 ? a.stmt : b.stmt, 0);
+        int a_type = cmp <= 0 ? sqlite3_column_int(a.stmt, 1) : -1;
+        int b_type = cmp >= 0 ? sqlite3_column_int(b.stmt, 1) : -1;
+        int a_dir = a_type >= 1, b_dir = b_type >= 1;
+        if ((a_type >= 0 && a_type != 2) || (b_type >= 0 && b_type != 2)) stats->compared++;
+        
+        /* A row on one side over contents on both ('remove' on one side): print the row, then compare under it */
+        if (cmp == 0 && (a_type == 2) != (b_type == 2)) {
+            if (a_type == 2) print_diff_side('+', b.stmt, stats);
+            else print_diff_side('-', a.stmt, stats);
+        }
+        
+        if (a_dir && b_dir) {
+            if (sqlite3_column_int64(a.stmt, 4) == sqlite3_column_int64(b.stmt, 4) &&
+                sqlite3_column_int64(a.stmt, 5) == sqlite3_column_int64(b.stmt, 5)) {
+                stats->skipped_dirs++;
+            } else {
+                failed = diff_walk(conn_a, conn_b, path, stats) != 0;
+            }
+        } else if (a_type == 2 || b_type == 2) {
+            /* Contents with no directory row on one side: under a file row here, or with the other side's
+               row elsewhere in the walk, which covers them */
+            if (cmp == 0 || !diff_has_path(a_type == 2 ? conn_b : conn_a, path)) {
+                failed = diff_range(conn_a, conn_b, path, stats) != 0;
+            }
+        } else {
+            if (cmp < 0) print_diff_side('-', a.stmt, stats);
+            else if (cmp > 0) print_diff_side('+', b.stmt, stats);
+            else diff_compare_rows(a.stmt, b.stmt, stats);
+            
+            /* A directory on one side only, or replaced by a file: compare what is under it */
+            if (a_dir || b_dir) failed = diff_range(conn_a, conn_b, path, stats) != 0;
+        }
+        
+        if (!failed && cmp <= 0) failed = diff_side_next(&a) != 0;
+        if (!failed && cmp >= 0) failed = diff_side_next(&b) != 0;
+    }
+    
+    sqlite3_finalize(a.stmt);
+    sqlite3_finalize(b.stmt);
+    return failed ? -1 : 0;
+}
+
+sqlite3 *open_diff_database(const char *path) {
+    sqlite3 *conn;
+    if (sqlite3_open_v2(path, &conn, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Cannot open database '%s': %s\n", path, sqlite3_errmsg(conn));
+        sqlite3_close(conn);
+        return NULL;
+    }
+    char pragma[64];
+    snprintf(pragma, sizeof(pragma), "PRAGMA mmap_size = %lld;", SNAPSHOT_MMAP_SIZE);
+    sqlite3_exec(conn, pragma, NULL, NULL, NULL);
+    apply_cache_size(conn);
+    return conn;
+}
+
+/* The unique index on path returns rows in path order without a sort */
+#define DIFF_PATHS_SQL "SELECT path, is_directory, size, mtime FROM paths ORDER BY path;"
+#define DIFF_PATHS_NO_MTIME_SQL "SELECT path, is_directory, size, NULL FROM paths ORDER BY path;"
+
+/* Databases older than schema 3 have no mtime column */
+int prepare_diff_paths(sqlite3 *conn, sqlite3_stmt **stmt) {
+    if (sqlite3_prepare_v2(conn, DIFF_PATHS_SQL, -1, stmt, NULL) == SQLITE_OK) {
+        return SQLITE_OK;
+    }
+    return sqlite3_prepare_v2(conn, DIFF_PATHS_NO_MTIME_SQL, -1, stmt, NULL);
+}
+
+void diff_databases(const char *path_a, const char *path_b) {
+    sqlite3 *conn_a = open_diff_database(path_a);
+    sqlite3 *conn_b = conn_a ? open_diff_database(path_b) : NULL;
+    diff_side_t a = { NULL, 0 }, b = { NULL, 0 };
+    
+    if (conn_b && diff_hashes_current(conn_a) && diff_hashes_current(conn_b)) {
+        diff_stats_t stats;
+        memset(&stats, 0, sizeof(stats));
+        long long t0 = monotonic_ns();
+        print_results_header("diff", "Diff - %s -> %s", path_a, path_b);
+        /* One read transaction per side, so neither changes mid-walk */
+        sqlite3_exec(conn_a, "BEGIN;", NULL, NULL, NULL);
+        sqlite3_exec(conn_b, "BEGIN;", NULL, NULL, NULL);
+        if (diff_walk(conn_a, conn_b, NULL, &stats) != 0) {
+            result_flush();
+            fprintf(command_stderr, "Read error: %s / %s\n", sqlite3_errmsg(conn_a), sqlite3_errmsg(conn_b));
+        }
+        sqlite3_exec(conn_a, "COMMIT;", NULL, NULL, NULL);
+        sqlite3_exec(conn_b, "COMMIT;", NULL, NULL, NULL);
+        print_diff_summary(&stats, t0);
+    } else if (conn_b) {
+        if (prepare_diff_paths(conn_a, &a.stmt) != SQLITE_OK) {
+            fprintf(command_stderr, "Cannot read '%s': %s\n", path_a, sqlite3_errmsg(conn_a));
+        } else if (prepare_diff_paths(conn_b, &b.stmt) != SQLITE_OK) {
+            fprintf(command_stderr, "Cannot read '%s': %s\n", path_b, sqlite3_errmsg(conn_b));
+        } else {
+            diff_stats_t stats;
+            memset(&stats, 0, sizeof(stats));
+            long long t0 = monotonic_ns();
+            print_results_header("diff", "Diff - %s -> %s", path_a, path_b);
+            if (diff_merge(&a, &b, 0, &stats) != 0) {
+                result_flush();
+                fprintf(command_stderr, "Read error: %s\n", sqlite3_errmsg(a.live ? conn_b : conn_a));
+            }
+            print_diff_summary(&stats, t0);
+        }
+    }
+    
+    sqlite3_finalize(a.stmt);
+    sqlite3_finalize(b.stmt);
+    sqlite3_close(conn_a);
+    sqlite3_close(conn_b);
+}
+
+/*
+ * Between generations: the state at 'from' is each path's last change
+ * with generation <= from; only the paths changed in (from, to] can
+ * differ, and their last change there is their state at 'to'. SQLite
+ * takes the bare columns of a max() aggregate from the row holding the
+ * maximum, and sorts with its external sorter, so memory stays bounded.
+ */
+void diff_generations(int from, int to) {
+    if (!table_exists("change_log") || !changelog_enabled()) {
+        out("Change log is off. Enable it with 'changelog on'; generations are recorded from then on.\n");
+        return;
+    }
+    int current = get_int_setting("generation", 1);
+    if (to < 0) {
+        to = current;
+    }
+    if (to > current) {
+        out("Generation %d does not exist yet: the current generation is %d.\n", to, current);
+        out("A new generation starts with each scan and each export-changes.\n");
+        return;
+    }
+    if (from >= to) {
+        out("Usage: diff --gen <from> [to] with from < to <= %d (the current generation)\n", current);
+        return;
+    }
+    
+    const char *sql =
+        "SELECT path, is_directory, size, mtime, op, max(seq) FROM change_log "
+        "WHERE generation > ?1 AND generation <= ?2 GROUP BY path ORDER BY path;";
+    diff_side_t a = { NULL, 0 }, b = { NULL, 0 };
+    if (sqlite3_prepare_v2(db, sql, -1, &a.stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, sql, -1, &b.stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+    } else {
+        sqlite3_bind_int(a.stmt, 1, INT32_MIN);
+        sqlite3_bind_int(a.stmt, 2, from);
+        sqlite3_bind_int(b.stmt, 1, from);
+        sqlite3_bind_int(b.stmt, 2, to);
+        
+        diff_stats_t stats;
+        memset(&stats, 0, sizeof(stats));
+        long long t0 = monotonic_ns();
+        print_results_header("diff", "Diff - generation %d -> %d", from, to);
+        if (diff_merge(&a, &b, 1, &stats) != 0) {
+            result_flush();
+            fprintf(command_stderr, "Read error: %s\n", sqlite3_errmsg(db));
+        }
+        print_diff_summary(&stats, t0);
+    }
+    sqlite3_finalize(a.stmt);
+    sqlite3_finalize(b.stmt);
+}
+
+void cmd_diff(const char *argument) {
+    char first[MAX_PATH_LENGTH] = "", second[MAX_PATH_LENGTH] = "", third[32] = "";
+    int count = sscanf(argument, "%4095s %4095s %31s", first, second, third);
+    
+    if (count >= 2 && strcmp(first, "--gen") == 0) {
+        int from = atoi(second);
+        int to = count == 3 ? atoi(third) : -1;
+        diff_generations(from, to);
+    } else if (count == 2) {
+        diff_databases(first, second);
+    } else {
+        out("Usage: diff <dbA> <dbB>\n");
+        out("       diff --gen <from> [to]\n");
+    }
+}
+
+/* ============================================
+ * Benchmarks
+ * ============================================ */
+
+/* splitmix64: small, fast and good enough for synthetic data */
+typedef struct {
+    uint64_t state;
+} bench_rng_t;
+
+uint64_t rng_next(bench_rng_t *rng) {
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+double rng_uniform(bench_rng_t *rng) {
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint32_t rng_below(bench_rng_t *rng, uint32_t n) {
+    return n ? (uint32_t)(rng_next(rng) % n) : 0;
+}
+
+/* Sampler for Zipf-distributed ranks in [0, n) */
+typedef struct {
+    double *cdf;
+    uint32_t n;
+} zipf_t;
+
+int zipf_init(zipf_t *z, uint32_t n, double exponent) {
+    z->n = n;
+    z->cdf = malloc(n * sizeof(double));
+    if (!z->cdf) return -1;
+    
+    double total = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        total += 1.0 / pow(i + 1, exponent);
+        z->cdf[i] = total;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        z->cdf[i] /= total;
+    }
+    return 0;
+}
+
+uint32_t zipf_sample(const zipf_t *z, bench_rng_t *rng) {
+    double u = rng_uniform(rng);
+    uint32_t lo = 0, hi = z->n - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (z->cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void zipf_free(zipf_t *z) {
+    free(z->cdf);
+    z->cdf = NULL;
+}
+
+/* Growable array of strings */
+typedef struct {
+    char **items;
+    uint32_t count;
+    uint32_t capacity;
+} string_list_t;
+
+int string_list_add(string_list_t *list, const char *s) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        char **grown = realloc(list->items, capacity * sizeof(char *));
+        if (!grown) return -1;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count] = strdup(s);
+    return list->items[list->count++] ? 0 : -1;
+}
+
+void string_list_free(string_list_t *list) {
+    for (uint32_t i = 0; i < list->count; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+/* Growable array of uint32 */
+typedef struct {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} u32_list_t;
+
+int u32_list_add(u32_list_t *list, uint32_t v) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+        uint32_t *grown = realloc(list->items, capacity * sizeof(uint32_t));
+        if (!grown) return -1;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = v;
+    return 0;
+}
+
+#define BENCH_ROOT "/synthetic"
+#define BENCH_VOCABULARY_SIZE 50000
+#define BENCH_TAG_COUNT 300
+#define BENCH_MAX_DEPTH 16
+
+/* Share of paths at each depth below the root, roughly as seen on real trees */
+static const double bench_depth_weights[BENCH_MAX_DEPTH] = {
+    2, 5, 9, 13, 15, 14, 12, 9, 7, 5, 3, 2, 1.5, 1, 0.7, 0.5
+};
+
+static const char *bench_extensions[] = {
+    "txt", "jpg", "c", "h", "png", "md", "json", "pdf", "mp3", "log",
+    "py", "js", "html", "csv", "xml", "cfg", "zip", "doc", "o", "flac"
+};
+
+static const char *bench_common_words[] = {
+    "src", "lib", "test", "data", "docs", "build", "config", "assets", "images", "music",
+    "photos", "backup", "report", "notes", "readme", "index", "main", "util", "include", "vendor",
+    "archive", "projects", "games", "video", "scripts", "cache", "tmp", "old", "new", "final"
+};
+
+void bench_make_word(bench_rng_t *rng, char *buffer, size_t size) {
+    static const char *consonants = "bcdfghjklmnprstvwz";
+    static const char *vowels = "aeiou";
+    int syllables = 2 + rng_below(rng, 3);
+    size_t pos = 0;
+    
+    for (int i = 0; i < syllables && pos + 3 < size; i++) {
+        buffer[pos++] = consonants[rng_below(rng, 18)];
+        buffer[pos++] = vowels[rng_below(rng, 5)];
+        if (rng_below(rng, 4) == 0) {
+            buffer[pos++] = consonants[rng_below(rng, 18)];
+        }
+    }
+    buffer[pos] = '\0';
+}
+
+int bench_pick_depth(bench_rng_t *rng) {
+    double total = 0;
+    for (int i = 0; i < BENCH_MAX_DEPTH; i++) total += bench_depth_weights[i];
+    
+    double u = rng_uniform(rng) * total;
+    for (int i = 0; i < BENCH_MAX_DEPTH; i++) {
+        u -= bench_depth_weights[i];
+        if (u <= 0) return i + 1;
+    }
+    return BENCH_MAX_DEPTH;
+}
+
+/*
+ * Build a file or directory name from Zipf-chosen vocabulary, so
+ * popular names repeat across the tree the way they do on real disks.
+ */
+void bench_make_name(bench_rng_t *rng, const string_list_t *vocab, const zipf_t *word_zipf,
+                     const zipf_t *ext_zipf, int is_dir, char *buffer, size_t size) {
+    const char *w1 = vocab->items[zipf_sample(word_zipf, rng)];
+    const char *w2 = vocab->items[zipf_sample(word_zipf, rng)];
+    const char *ext = bench_extensions[zipf_sample(ext_zipf, rng)];
+    int style = rng_below(rng, 100);
+    
+    if (is_dir) {
+        if (style < 70) snprintf(buffer, size, "%s", w1);
+        else if (style < 90) snprintf(buffer, size, "%s_%s", w1, w2);
+        else snprintf(buffer, size, "%c%s", toupper((unsigned char)w1[0]), w1 + 1);
+        return;
+    }
+    
+    if (style < 40) snprintf(buffer, size, "%s.%s", w1, ext);
+    else if (style < 65) snprintf(buffer, size, "%s_%s.%s", w1, w2, ext);
+    else if (style < 80) snprintf(buffer, size, "%s-%04u.%s", w1, rng_below(rng, 10000), ext);
+    else if (style < 90) snprintf(buffer, size, "%c%s%c%s.%s", toupper((unsigned char)w1[0]), w1 + 1,
+                                  toupper((unsigned char)w2[0]), w2 + 1, ext);
+    else snprintf(buffer, size, "%s", w1);
+}
+
+long long bench_file_size(bench_rng_t *rng) {
+    /* Log-normal: most files are small, a few are very large */
+    double u1 = rng_uniform(rng), u2 = rng_uniform(rng);
+    double normal = sqrt(-2.0 * log(u1 + 1e-300)) * cos(2 * 3.14159265358979 * u2);
+    return (long long)exp(8.0 + 2.5 * normal);
+}
+
+/*
+ * Insert one generated path, appending a unique suffix if the name is
+ * already taken in that directory. Returns the row id.
+ */
+sqlite3_int64 bench_insert_path(sqlite3_stmt *stmt, const char *parent, const char *name,
+                                int is_dir, long long size, uint64_t *unique, char *path_out) {
+    char unique_name[MAX_PATH_LENGTH];
+    strncpy(unique_name, name, sizeof(unique_name) - 1);
+    unique_name[sizeof(unique_name) - 1] = '\0';
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (snprintf(path_out, MAX_PATH_LENGTH, "%s/%s", parent, unique_name) >= MAX_PATH_LENGTH) {
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, path_out, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, unique_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, is_dir);
+        if (is_dir) sqlite3_bind_null(stmt, 4);
+        else sqlite3_bind_int64(stmt, 4, size);
+        sqlite3_bind_text(stmt, 5, parent, -1, SQLITE_STATIC);
+        
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc == SQLITE_DONE && sqlite3_changes(db) > 0) {
+            return sqlite3_last_insert_rowid(db);
+        }
+        if (snprintf(unique_name, sizeof(unique_name), "%s~%llu", name,
+                     (unsigned long long)++*unique) >= (int)sizeof(unique_name)) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Generate a synthetic corpus of count paths under /synthetic, with
+ * Zipfian name reuse, a realistic depth distribution, and tag and
+ * category assignments.
+ */
+int generate_corpus(long long count, uint64_t seed) {
+    /* The corpus would mix with indexed paths and skew every benchmark */
+    sqlite3_stmt *stmt;
+    int has_paths = 0;
+    if (sqlite3_prepare_v2(db, "SELECT EXISTS (SELECT 1 FROM paths);", -1, &stmt, NULL) == SQLITE_OK) {
+        has_paths = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (has_paths) {
+        fprintf(command_stderr, "Error: generate needs an empty database; start one with --db <new file>.\n");
+        return -1;
+    }
+    
+    bench_rng_t rng = { seed };
+    string_list_t vocab = {0}, dirs = {0};
+    u32_list_t by_depth[BENCH_MAX_DEPTH + 1];
+    zipf_t word_zipf = {0}, ext_zipf = {0}, tag_zipf = {0}, cat_zipf = {0};
+    char word[64];
+    int failed = 0;
+    
+    memset(by_depth, 0, sizeof(by_depth));
+    
+    /* Vocabulary: common words first so they get the highest ranks */
+    for (size_t i = 0; i < sizeof(bench_common_words) / sizeof(bench_common_words[0]); i++) {
+        failed |= string_list_add(&vocab, bench_common_words[i]);
+    }
+    while (!failed && vocab.count < BENCH_VOCABULARY_SIZE) {
+        bench_make_word(&rng, word, sizeof(word));
+        failed |= string_list_add(&vocab, word);
+    }
+    
+    int ext_count = sizeof(bench_extensions) / sizeof(bench_extensions[0]);
+    if (failed || zipf_init(&word_zipf, vocab.count, 1.1) || zipf_init(&ext_zipf, ext_count, 1.0)
+        || zipf_init(&tag_zipf, BENCH_TAG_COUNT, 1.0)) {
+        fprintf(command_stderr, "Error: Out of memory while generating corpus.\n");
+        string_list_free(&vocab);
+        zipf_free(&word_zipf);
+        zipf_free(&ext_zipf);
+        return -1;
+    }
+    
+    /* Bulk load: the corpus can be regenerated, so durability is not needed */
+    int synchronous = 2;
+    if (sqlite3_prepare_v2(db, "PRAGMA synchronous;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) synchronous = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_exec(db, "PRAGMA synchronous = OFF;", NULL, NULL, NULL);
+    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    
+    /* Tags and extra categories */
+    sqlite3_stmt *tag_stmt, *cat_stmt, *path_stmt, *path_tag_stmt, *path_cat_stmt;
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO tags (name) VALUES (?);", -1, &tag_stmt, NULL);
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO categories (name) VALUES (?);", -1, &cat_stmt, NULL);
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO paths (path, name, is_directory, size, parent_path) "
+                           "VALUES (?, ?, ?, ?, ?);", -1, &path_stmt, NULL);
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO path_tags (path_id, tag_id) "
+                           "SELECT ?, id FROM tags WHERE name = ?;", -1, &path_tag_stmt, NULL);
+    sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO path_categories (path_id, category_id) "
+                           "SELECT ?, id FROM categories WHERE name = ?;", -1, &path_cat_stmt, NULL);
+    
+    for (int i = 0; i < BENCH_TAG_COUNT; i++) {
+        sqlite3_bind_text(tag_stmt, 1, vocab.items[(i * 7 + 3) % vocab.count], -1, SQLITE_STATIC);
+        sqlite3_step(tag_stmt);
+        sqlite3_reset(tag_stmt);
+    }
+    
+    static const char *bench_categories[] = {
+        "Documents", "Photos", "Music", "Games", "Uncategorized",
+        "Projects", "Archive", "Work", "Personal", "Media"
+    };
+    int cat_count = sizeof(bench_categories) / sizeof(bench_categories[0]);
+    zipf_init(&cat_zipf, cat_count, 1.0);
+    for (int i = 0; i < cat_count; i++) {
+        sqlite3_bind_text(cat_stmt, 1, bench_categories[i], -1, SQLITE_STATIC);
+        sqlite3_step(cat_stmt);
+        sqlite3_reset(cat_stmt);
+    }
+    
+    /* Root */
+    add_path_to_db(BENCH_ROOT, get_filename_from_path(BENCH_ROOT), 1, -1, NULL);
+    string_list_add(&dirs, BENCH_ROOT);
+    u32_list_add(&by_depth[0], 0);
+    
+    long long dir_target = count / 10 > 0 ? count / 10 : 1;
+    uint64_t unique = 0;
+    char name[MAX_PATH_LENGTH], path[MAX_PATH_LENGTH];
+    long long inserted = 1;
+    long long start = monotonic_ns();
+    
+    for (long long i = 1; i < count && !failed; i++) {
+        int is_dir = i <= dir_target;
+        int depth = bench_pick_depth(&rng);
+        while (depth > 1 && by_depth[depth - 1].count == 0) depth--;
+        
+        u32_list_t *parents = &by_depth[depth - 1];
+        const char *parent = dirs.items[parents->items[rng_below(&rng, parents->count)]];
+        
+        bench_make_name(&rng, &vocab, &word_zipf, &ext_zipf, is_dir, name, sizeof(name));
+        sqlite3_int64 id = bench_insert_path(path_stmt, parent, name, is_dir,
+                                             is_dir ? -1 : bench_file_size(&rng), &unique, path);
+        if (id < 0) continue;
+        inserted++;
+        
+        if (is_dir) {
+            failed |= u32_list_add(&by_depth[depth], dirs.count);
+            failed |= string_list_add(&dirs, path);
+        }
+        
+        /* About 5% of paths carry 1-3 tags, about 20% have a category */
+        if (rng_below(&rng, 100) < 5) {
+            int ntags = 1 + rng_below(&rng, 3);
+            for (int t = 0; t < ntags; t++) {
+                uint32_t tag = zipf_sample(&tag_zipf, &rng);
+                sqlite3_bind_int64(path_tag_stmt, 1, id);
+                sqlite3_bind_text(path_tag_stmt, 2, vocab.items[(tag * 7 + 3) % vocab.count], -1, SQLITE_STATIC);
+                sqlite3_step(path_tag_stmt);
+                sqlite3_reset(path_tag_stmt);
+            }
+        }
+        if (rng_below(&rng, 100) < 20) {
+            sqlite3_bind_int64(path_cat_stmt, 1, id);
+            sqlite3_bind_text(path_cat_stmt, 2, bench_categories[zipf_sample(&cat_zipf, &rng)], -1, SQLITE_STATIC);
+            sqlite3_step(path_cat_stmt);
+            sqlite3_reset(path_cat_stmt);
+        }
+        
+        if (i % 1000000 == 0) {
+            sqlite3_exec(db, "COMMIT; BEGIN TRANSACTION;", NULL, NULL, NULL);
+            out("  %lld paths...\n", i);
+            fflush(stdout);
+        }
+    }
+    
+    for (uint32_t d = 0; d < dirs.count; d++) {
+        queue_dir_hash(dirs.items[d]);
+    }
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    
+    char pragma[64];
+    snprintf(pragma, sizeof(pragma), "PRAGMA synchronous = %d;", synchronous);
+    sqlite3_exec(db, pragma, NULL, NULL, NULL);
+    
+    sqlite3_finalize(tag_stmt);
+    sqlite3_finalize(cat_stmt);
+    sqlite3_finalize(path_stmt);
+    sqlite3_finalize(path_tag_stmt);
+    sqlite3_finalize(path_cat_stmt);
+    
+    double secs = (monotonic_ns() - start) / 1e9;
+    out("Generated %lld paths (%u directories) under %s in %.1f s\n",
+        inserted, dirs.count, BENCH_ROOT, secs);
+    
+    for (int d = 0; d <= BENCH_MAX_DEPTH; d++) free(by_depth[d].items);
+    string_list_free(&vocab);
+    string_list_free(&dirs);
+    zipf_free(&word_zipf);
+    zipf_free(&ext_zipf);
+    zipf_free(&tag_zipf);
+    zipf_free(&cat_zipf);
+    return failed ? -1 : 0;
+}
+
+/* ---- Latency measurement ---- */
+
+/*
+ * The benchmarks call the same functions the CLI does; their printed
+ * results go to the null device so terminal speed is not measured.
+ */
+int saved_stdout_fd = -1;
+
+void suppress_stdout() {
+    fflush(stdout);
+#ifdef _WIN32
+    saved_stdout_fd = _dup(1);
+    FILE *null_file = freopen("NUL", "w", stdout);
+#else
+    saved_stdout_fd = dup(1);
+    FILE *null_file = freopen("/dev/null", "w", stdout);
+#endif
+    (void)null_file;
+}
+
+void restore_stdout() {
+    if (saved_stdout_fd < 0) return;
+    fflush(stdout);
+#ifdef _WIN32
+    _dup2(saved_stdout_fd, 1);
+    _close(saved_stdout_fd);
+#else
+    dup2(saved_stdout_fd, 1);
+    close(saved_stdout_fd);
+#endif
+    saved_stdout_fd = -1;
+    clearerr(stdout);
+}
+
+typedef struct {
+    const char *name;
+    long long *samples_ns;
+    int count;
+    long long total_ns;
+} latency_series_t;
+
+int compare_long_long(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+double series_percentile_us(const latency_series_t *s, double p) {
+    if (s->count == 0) return 0;
+    int index = (int)(p / 100.0 * (s->count - 1) + 0.5);
+    return s->samples_ns[index] / 1000.0;
+}
+
+void write_series_json(FILE *fp, const latency_series_t *s, int last) {
+    qsort(s->samples_ns, s->count, sizeof(long long), compare_long_long);
+    fprintf(fp, "    \"%s\": {\"count\": %d, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+                "\"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"qps\": %.1f}%s\n",
+            s->name, s->count,
+            s->count ? s->total_ns / 1000.0 / s->count : 0,
+            series_percentile_us(s, 50), series_percentile_us(s, 90), series_percentile_us(s, 99),
+            series_percentile_us(s, 100),
+            s->total_ns ? s->count / (s->total_ns / 1e9) : 0,
+            last ? "" : ",");
+}
+
+void print_series_table(const latency_series_t *series, int count) {
+    out("\n  %-10s %8s %10s %10s %10s %10s %10s\n", "mode", "queries", "p50 us", "p90 us", "p99 us", "max us", "qps");
+    for (int i = 0; i < count; i++) {
+        const latency_series_t *s = &series[i];
+        out("  %-10s %8d %10.1f %10.1f %10.1f %10.1f %10.1f\n", s->name, s->count,
+            series_percentile_us(s, 50), series_percentile_us(s, 90), series_percentile_us(s, 99),
+            series_percentile_us(s, 100), s->total_ns ? s->count / (s->total_ns / 1e9) : 0);
+    }
+    out("\n");
+}
+
+/* Pick a random stored name, for building realistic queries */
+int bench_random_name(bench_rng_t *rng, sqlite3_int64 max_id, char *buffer, size_t size) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT name FROM paths WHERE id >= ? ORDER BY id LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, 1 + (sqlite3_int64)(rng_next(rng) % (uint64_t)max_id));
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        strncpy(buffer, (const char *)sqlite3_column_text(stmt, 0), size - 1);
+        buffer[size - 1] = '\0';
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+int bench_random_tag(bench_rng_t *rng, char *buffer, size_t size) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT name FROM tags ORDER BY id LIMIT 1 OFFSET ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    int tag_count = 0;
+    sqlite3_stmt *count_stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM tags;", -1, &count_stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(count_stmt) == SQLITE_ROW) tag_count = sqlite3_column_int(count_stmt, 0);
+        sqlite3_finalize(count_stmt);
+    }
+    sqlite3_bind_int(stmt, 1, rng_below(rng, tag_count));
+    int rc = -1;
+    if (tag_count > 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+        strncpy(buffer, (const char *)sqlite3_column_text(stmt, 0), size - 1);
+        buffer[size - 1] = '\0';
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* Apply up to edits random single-character edits */
+void bench_mutate(bench_rng_t *rng, char *s, size_t size, int edits) {
+    for (int e = 0; e < edits; e++) {
+        size_t len = strlen(s);
+        if (len == 0) return;
+        size_t pos = rng_below(rng, (uint32_t)len);
+        int kind = rng_below(rng, 3);
+        char c = 'a' + rng_below(rng, 26);
+        if (kind == 0) {
+            s[pos] = c;
+        } else if (kind == 1 && len > 1) {
+            memmove(s + pos, s + pos + 1, len - pos);
+        } else if (len + 1 < size) {
+            memmove(s + pos + 1, s + pos, len - pos + 1);
+            s[pos] = c;
+        }
+    }
+}
+
+enum {
+    BENCH_EXACT, BENCH_PREFIX, BENCH_SUBSTRING, BENCH_FUZZY, BENCH_FIND, BENCH_TAGSEARCH, BENCH_MODE_COUNT
+};
+
+/*
+ * Run iterations queries of each search mode against the current
+ * database and report latency percentiles and throughput, as a table
+ * and as JSON (to json_path, or stdout if none is given).
+ */
+void bench_search(int iterations, const char *json_path) {
+    static const char *mode_names[BENCH_MODE_COUNT] = {
+        "exact", "prefix", "substring", "fuzzy", "find", "tagsearch"
+    };
+    latency_series_t series[BENCH_MODE_COUNT];
+    bench_rng_t rng = { 42 };
+    
+    sqlite3_int64 max_id = 0, path_count = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT MAX(id), COUNT(*) FROM paths;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            max_id = sqlite3_column_int64(stmt, 0);
+            path_count = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (max_id <= 0) {
+        out("Database is empty; run 'generate <count>' or 'add <directory>' first.\n");
+        return;
+    }
+    
+    out("Benchmarking %d queries per mode on %lld paths...\n", iterations, (long long)path_count);
+    fflush(stdout);
+    
+    for (int m = 0; m < BENCH_MODE_COUNT; m++) {
+        series[m].name = mode_names[m];
+        series[m].samples_ns = calloc(iterations > 0 ? iterations : 1, sizeof(long long));
+        series[m].count = 0;
+        series[m].total_ns = 0;
+        if (!series[m].samples_ns) {
+            for (int k = 0; k < m; k++) free(series[k].samples_ns);
+            return;
+        }
+        
+        for (int i = 0; i < iterations; i++) {
+            char name[MAX_PATH_LENGTH], term[MAX_PATH_LENGTH];
+            if (m == BENCH_TAGSEARCH ? bench_random_tag(&rng, name, sizeof(name))
+                                     : bench_random_name(&rng, max_id, name, sizeof(name))) {
+                continue;
+            }
+            size_t len = strlen(name);
+            
+            /* Queries derived from stored names: a prefix, an inner substring, a typo */
+            strcpy(term, name);
+            if (m == BENCH_PREFIX) {
+                term[len < 3 ? len : 3] = '\0';
+            } else if (m == BENCH_SUBSTRING || m == BENCH_FIND) {
+                size_t start = len > 4 ? 1 + rng_below(&rng, (uint32_t)(len - 4)) : 0;
+                memmove(term, name + start, len - start + 1);
+                term[4] = '\0';
+            } else if (m == BENCH_FUZZY || m == BENCH_TAGSEARCH) {
+                bench_mutate(&rng, term, sizeof(term), 1 + rng_below(&rng, 2));
+            }
+            
+            suppress_stdout();
+            long long t0 = monotonic_ns();
+            switch (m) {
+            case BENCH_EXACT:     search_paths_exact(term); break;
+            case BENCH_PREFIX:    search_paths_prefix(term); break;
+            case BENCH_SUBSTRING: search_paths_substring(term); break;
+            case BENCH_FUZZY:     search_paths_fuzzy(term, 2); break;
+            case BENCH_FIND:      structured_search(i % 2 ? "Documents" : NULL, NULL, term); break;
+            case BENCH_TAGSEARCH: search_tags_fuzzy(term); break;
+            }
+            long long elapsed = monotonic_ns() - t0;
+            restore_stdout();
+            
+            series[m].samples_ns[series[m].count++] = elapsed;
+            series[m].total_ns += elapsed;
+        }
+    }
+    
+    FILE *fp = stdout;
+    if (json_path && json_path[0]) {
+        fp = fopen(json_path, "w");
+        if (!fp) {
+            fprintf(command_stderr, "Cannot write %s\n", json_path);
+            fp = stdout;
+        }
+    }
+    
+    fprintf(fp, "{\n  \"benchmark\": \"search\",\n  \"sqlite_version\": \"%s\",\n"
+                "  \"paths\": %lld,\n  \"iterations\": %d,\n  \"modes\": {\n",
+            sqlite3_libversion(), (long long)path_count, iterations);
+    for (int m = 0; m < BENCH_MODE_COUNT; m++) {
+        write_series_json(fp, &series[m], m == BENCH_MODE_COUNT - 1);
+    }
+    fprintf(fp, "  }\n}\n");
+    
+    if (fp != stdout) {
+        fclose(fp);
+        print_series_table(series, BENCH_MODE_COUNT);
+        out("Results written to %s\n", json_path);
+    }
+    
+    for (int m = 0; m < BENCH_MODE_COUNT; m++) {
+        free(series[m].samples_ns);
+    }
+}
+
+/* ---- Filesystem scan benchmark ---- */
+
+typedef struct {
+    int fanout;
+    int depth;
+    int files;
+    int symlinks;
+    long long dirs_created;
+    long long files_created;
+    long long links_created;
+} bench_tree_t;
+
+int make_directory(const char *path) {
+#ifdef _WIN32
+    return _mkdir(path);
+#else
+    return mkdir(path, 0755);
+#endif
+}
+
+/*
+ * Build a tree where every directory holds tree->files files and
+ * tree->symlinks symlinks to them, and every directory above the last
+ * level has tree->fanout subdirectories.
+ */
+int bench_build_tree(const char *path, int level, bench_tree_t *tree) {
+    if (make_directory(path) != 0) {
+        fprintf(command_stderr, "Cannot create directory: %s\n", path);
         return -1;
     }
+    tree->dirs_created++;
+    
+    char child[MAX_PATH_LENGTH];
+    for (int f = 0; f < tree->files; f++) {
+        snprintf(child, sizeof(child), "%s%sfile_%04d.dat", path, PATH_SEPARATOR_STR, f);
+        FILE *fp = fopen(child, "wb");
+        if (!fp) return -1;
+        /* Small varied sizes so stat results differ */
+        for (int b = 0; b < (f * 37) % 512; b++) fputc('x', fp);
+        fclose(fp);
+        tree->files_created++;
+    }
+    
+#ifndef _WIN32
+    for (int l = 0; l < tree->symlinks && tree->files > 0; l++) {
+        char target[64];
+        snprintf(target, sizeof(target), "file_%04d.dat", l % tree->files);
+        snprintf(child, sizeof(child), "%s/link_%04d", path, l);
+        if (symlink(target, child) == 0) {
+            tree->links_created++;
+        }
+    }
+#endif
     
-    char value_str[32];
-    snprintf(value_str, sizeof(value_str), "%d", value);
+    if (level < tree->depth) {
+        for (int d = 0; d < tree->fanout; d++) {
+            snprintf(child, sizeof(child), "%s%sdir_%03d", path, PATH_SEPARATOR_STR, d);
+            if (bench_build_tree(child, level + 1, tree) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+/* Delete a tree without following symlinks */
+void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        char child[MAX_PATH_LENGTH];
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            snprintf(child, sizeof(child), "%s%s%s", path, PATH_SEPARATOR_STR, entry->d_name);
+            struct stat st;
+#ifdef _WIN32
+            int is_dir = stat(child, &st) == 0 && S_ISDIR(st.st_mode);
+#else
+            int is_dir = lstat(child, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+            if (is_dir) remove_tree(child);
+            else remove(child);
+        }
+        closedir(dir);
+    }
+#ifdef _WIN32
+    _rmdir(path);
+#else
+    rmdir(path);
+#endif
+}
+
+/* Drop the OS page, dentry and inode caches. Needs root on Linux. */
+int drop_caches() {
+#ifdef __linux__
+    sync();
+    FILE *fp = fopen("/proc/sys/vm/drop_caches", "w");
+    if (!fp) return -1;
+    int ok = fputs("3\n", fp) >= 0;
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+void delete_paths_under(const char *root) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id FROM paths WHERE path = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, root, -1, SQLITE_STATIC);
+        sqlite3_int64 id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        /* The root's parent, if indexed, loses an entry */
+        if (id && sqlite3_prepare_v2(db, QUEUE_PATH_DELETE_SQL, -1, &stmt, NULL) == SQLITE_OK) {
+            queue_path_delete(stmt, id);
+            sqlite3_finalize(stmt);
+        }
+    }
     
-    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, value_str, -1, SQLITE_STATIC);
+    /* The half-open range [root/, root0) holds exactly the paths below root; LIKE would fold case and match _ and % */
+    char low[MAX_PATH_LENGTH], high[MAX_PATH_LENGTH];
+    size_t len = strlen(root);
+    int has_separator = len > 0 && root[len - 1] == PATH_SEPARATOR;
+    if (snprintf(low, sizeof(low), "%s%s", root, has_separator ? "" : PATH_SEPARATOR_STR) >= (int)sizeof(low)) {
+        return;
+    }
+    strcpy(high, low);
+    high[strlen(high) - 1]++;
     
-    int rc = sqlite3_step(stmt);
+    const char *sql = "DELETE FROM paths WHERE path = ?1 OR (path >= ?2 AND path < ?3);"
+                      "DELETE FROM dir_hashes WHERE path = ?1 OR (path >= ?2 AND path < ?3);";
+    const char *tail = sql;
+    while (*tail && sqlite3_prepare_v2(db, tail, -1, &stmt, &tail) == SQLITE_OK && stmt) {
+        sqlite3_bind_text(stmt, 1, root, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, low, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, high, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+}
+
+typedef struct {
+    const char *name;
+    int ran;
+    long long entries;
+    long long wall_ns;
+    scan_stats_t stats;
+} scan_run_t;
+
+void bench_scan_run(scan_run_t *run, const char *root, long long entries) {
+    memset(&scan_stats, 0, sizeof(scan_stats));
+    
+    suppress_stdout();
+    scan_stats_enabled = 1;
+    long long t0 = monotonic_ns();
+    add_directory(root);
+    run->wall_ns = monotonic_ns() - t0;
+    scan_stats_enabled = 0;
+    restore_stdout();
+    
+    run->stats = scan_stats;
+    run->entries = entries;
+    run->ran = 1;
+}
+
+/*
+ * Build a synthetic tree under base_dir, then time 'add' (first scan)
+ * and refresh (re-adding the same root) with warm caches, and with
+ * cold caches where drop_caches is permitted.
+ */
+void bench_scan(const char *base_dir, bench_tree_t *tree, const char *json_path) {
+    char root[MAX_PATH_LENGTH];
+    snprintf(root, sizeof(root), "%s%sfilesearch-scan-bench", base_dir, PATH_SEPARATOR_STR);
+    
+    if (!directory_exists(base_dir)) {
+        fprintf(command_stderr, "Error: '%s' is not a valid directory.\n", base_dir);
+        return;
+    }
+    if (file_exists(root)) {
+        remove_tree(root);
+    }
+    
+    out("Building tree under %s (fan-out %d, depth %d, %d files and %d symlinks per directory)...\n",
+        root, tree->fanout, tree->depth, tree->files, tree->symlinks);
+    fflush(stdout);
+    long long t0 = monotonic_ns();
+    if (bench_build_tree(root, 0, tree) != 0) {
+        remove_tree(root);
+        return;
+    }
+    long long entries = tree->dirs_created + tree->files_created + tree->links_created;
+    out("Created %lld entries in %.2f s\n", entries, (monotonic_ns() - t0) / 1e9);
+    
+    int can_drop = (drop_caches() == 0);
+    if (!can_drop) {
+        out("Note: cannot drop caches (needs root on Linux); cold-cache runs skipped.\n");
+    }
+    
+    enum { COLD_ADD, WARM_ADD, WARM_REFRESH, COLD_REFRESH, RUN_COUNT };
+    scan_run_t runs[RUN_COUNT] = {
+        { "cold_add", 0, 0, 0, {0} },
+        { "warm_add", 0, 0, 0, {0} },
+        { "warm_refresh", 0, 0, 0, {0} },
+        { "cold_refresh", 0, 0, 0, {0} }
+    };
+    
+    delete_paths_under(root);
+    if (can_drop) {
+        drop_caches();
+        bench_scan_run(&runs[COLD_ADD], root, entries);
+        delete_paths_under(root);
+    }
+    
+    bench_scan_run(&runs[WARM_ADD], root, entries);
+    bench_scan_run(&runs[WARM_REFRESH], root, entries);
+    
+    if (can_drop) {
+        drop_caches();
+        bench_scan_run(&runs[COLD_REFRESH], root, entries);
+    }
+    
+    delete_paths_under(root);
+    remove_tree(root);
+    
+    out("\n  %-14s %12s %10s %12s %10s %10s\n", "run", "entries/s", "wall ms", "libc fs/ent", "fs ms", "db ms");
+    for (int i = 0; i < RUN_COUNT; i++) {
+        const scan_run_t *r = &runs[i];
+        if (!r->ran) continue;
+        long long calls = r->stats.opendir_calls + r->stats.readdir_calls + r->stats.stat_calls + r->stats.closedir_calls;
+        out("  %-14s %12.0f %10.1f %12.2f %10.1f %10.1f\n", r->name,
+            r->entries / (r->wall_ns / 1e9), r->wall_ns / 1e6, (double)calls / r->entries,
+            r->stats.fs_ns / 1e6, r->stats.db_ns / 1e6);
+    }
+    out("\n");
+    
+    FILE *fp = stdout;
+    if (json_path && json_path[0]) {
+        fp = fopen(json_path, "w");
+        if (!fp) {
+            fprintf(command_stderr, "Cannot write %s\n", json_path);
+            fp = stdout;
+        }
+    }
+    
+    fprintf(fp, "{\n  \"benchmark\": \"scan\",\n  \"tree\": {\"fanout\": %d, \"depth\": %d, "
+                "\"files_per_dir\": %d, \"symlinks_per_dir\": %d, \"entries\": %lld},\n"
+                "  \"caches_dropped\": %s,\n  \"runs\": {\n",
+            tree->fanout, tree->depth, tree->files, tree->symlinks, entries, can_drop ? "true" : "false");
+    int first = 1;
+    for (int i = 0; i < RUN_COUNT; i++) {
+        const scan_run_t *r = &runs[i];
+        if (!r->ran) continue;
+        fprintf(fp, "%s    \"%s\": {\"entries_per_sec\": %.0f, \"wall_ms\": %.2f, \"fs_ms\": %.2f, "
+                    "\"db_ms\": %.2f, \"opendir\": %lld, \"readdir\": %lld, \"stat\": %lld, "
+                    "\"closedir\": %lld, \"libc_fs_calls_per_entry\": %.3f}",
+                first ? "" : ",\n", r->name, r->entries / (r->wall_ns / 1e9), r->wall_ns / 1e6,
+                r->stats.fs_ns / 1e6, r->stats.db_ns / 1e6, r->stats.opendir_calls,
+                r->stats.readdir_calls, r->stats.stat_calls, r->stats.closedir_calls,
+                (double)(r->stats.opendir_calls + r->stats.readdir_calls + r->stats.stat_calls +
+                         r->stats.closedir_calls) / r->entries);
+        first = 0;
+    }
+    fprintf(fp, "\n  }\n}\n");
+    
+    if (fp != stdout) {
+        fclose(fp);
+        out("Results written to %s\n", json_path);
+    }
+}
+
+/* ---- Distance kernels: microbenchmarks and differential fuzzing ---- */
+
+/*
+ * Reference Levenshtein: the textbook full-matrix DP, kept deliberately
+ * simple so the optimized kernels can be checked against it.
+ */
+int reference_levenshtein(const char *s1, const char *s2) {
+    int len1 = strlen(s1);
+    int len2 = strlen(s2);
+    int *d = malloc((size_t)(len1 + 1) * (len2 + 1) * sizeof(int));
+    if (!d) return -1;
+    
+    for (int i = 0; i <= len1; i++) d[i * (len2 + 1)] = i;
+    for (int j = 0; j <= len2; j++) d[j] = j;
+    
+    for (int i = 1; i <= len1; i++) {
+        for (int j = 1; j <= len2; j++) {
+            int cost = (tolower((unsigned char)s1[i-1]) == tolower((unsigned char)s2[j-1])) ? 0 : 1;
+            d[i * (len2 + 1) + j] = min3(d[(i-1) * (len2 + 1) + j] + 1,
+                                         d[i * (len2 + 1) + j - 1] + 1,
+                                         d[(i-1) * (len2 + 1) + j - 1] + cost);
+        }
+    }
+    
+    int result = d[len1 * (len2 + 1) + len2];
+    free(d);
+    return result;
+}
+
+/* Multi-byte pieces for UTF-8 inputs, including case pairs tolower() cannot fold */
+const char *fuzz_utf8_pieces[] = {
+    "a", "b", "A", "B", "e", "\xc3\xa9", "\xc3\x89", "\xc3\x9f", "\xc3\xbc", "\xc3\xb1",
+    "\xe6\x97\xa5", "\xe6\x9c\xac", "\xe8\xaa\x9e", "\xf0\x9f\x98\x80", "\xd0\xb4", "\xd0\x94"
+};
+
+enum {
+    FUZZ_SMALL_ALPHABET,    /* "ab": many near ties */
+    FUZZ_MIXED_CASE,        /* case folding */
+    FUZZ_PRINTABLE,         /* random printable ASCII */
+    FUZZ_UTF8,              /* valid multi-byte UTF-8 */
+    FUZZ_RAW_BYTES,         /* invalid UTF-8, high bytes */
+    FUZZ_REPEATED,          /* long runs of one character */
+    FUZZ_STYLE_COUNT
+};
+
+/* Append one character of the given style; returns bytes written */
+int fuzz_append_char(bench_rng_t *rng, char *buffer, int pos, int size, int style) {
+    const char *piece = NULL;
+    char one[2] = { 0, 0 };
+    
+    switch (style) {
+        case FUZZ_SMALL_ALPHABET: one[0] = "ab"[rng_below(rng, 2)]; break;
+        case FUZZ_MIXED_CASE:     one[0] = "abcABC"[rng_below(rng, 6)]; break;
+        case FUZZ_PRINTABLE:      one[0] = (char)(32 + rng_below(rng, 95)); break;
+        case FUZZ_UTF8:
+            piece = fuzz_utf8_pieces[rng_below(rng, sizeof(fuzz_utf8_pieces) / sizeof(fuzz_utf8_pieces[0]))];
+            break;
+        case FUZZ_RAW_BYTES:      one[0] = (char)(1 + rng_below(rng, 255)); break;
+        default:                  one[0] = 'z'; break;
+    }
+    if (!piece) piece = one;
+    
+    int len = (int)strlen(piece);
+    if (pos + len >= size) return 0;
+    memcpy(buffer + pos, piece, len);
+    buffer[pos + len] = '\0';
+    return len;
+}
+
+void fuzz_make_string(bench_rng_t *rng, char *buffer, int size, int length, int style) {
+    int pos = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < length; i++) {
+        int n = fuzz_append_char(rng, buffer, pos, size, style);
+        if (n == 0) break;
+        pos += n;
+    }
+}
+
+/* Apply 'edits' random byte-level insertions, deletions and substitutions */
+void fuzz_mutate(bench_rng_t *rng, const char *source, char *buffer, int size, int edits, int style) {
+    strncpy(buffer, source, size - 1);
+    buffer[size - 1] = '\0';
+    
+    for (int e = 0; e < edits; e++) {
+        int len = (int)strlen(buffer);
+        int op = (int)rng_below(rng, 3);
+        int pos = len ? (int)rng_below(rng, (uint32_t)len + 1) : 0;
+        char c[8];
+        int n = fuzz_append_char(rng, c, 0, sizeof(c), style);
+        
+        if (op == 0 && len + n < size) {
+            memmove(buffer + pos + n, buffer + pos, len - pos + 1);
+            memcpy(buffer + pos, c, n);
+        } else if (op == 1 && pos < len) {
+            memmove(buffer + pos, buffer + pos + 1, len - pos);
+        } else if (pos < len) {
+            buffer[pos] = c[0];
+        }
+    }
+}
+
+/* Print a fuzz input with non-printable bytes escaped */
+void fuzz_print_string(const char *label, const char *s) {
+    out("    %s \"", label);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p >= 32 && *p < 127 && *p != '"' && *p != '\\') fputc(*p, command_stdout);
+        else out("\\x%02x", *p);
+    }
+    out("\" (%d bytes)\n", (int)strlen(s));
+}
+
+typedef struct {
+    int dist;
+    const char *name;
+} fuzz_expected_t;
+
+int compare_fuzz_expected(const void *a, const void *b) {
+    const fuzz_expected_t *x = a;
+    const fuzz_expected_t *y = b;
+    if (x->dist != y->dist) return x->dist < y->dist ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+/* ---- Expected top-k heap (worst match at index 0) ---- */
+
+void fuzz_heap_swap(fuzz_expected_t *heap, uint32_t i, uint32_t j) {
+    fuzz_expected_t swap = heap[i];
+    heap[i] = heap[j];
+    heap[j] = swap;
+}
+
+void fuzz_heap_sift_up(fuzz_expected_t *heap, uint32_t i) {
+    while (i > 0 && compare_fuzz_expected(&heap[(i - 1) / 2], &heap[i]) < 0) {
+        fuzz_heap_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void fuzz_heap_sift_down(fuzz_expected_t *heap, uint32_t count, uint32_t i) {
+    for (;;) {
+        uint32_t worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && compare_fuzz_expected(&heap[left], &heap[worst]) > 0) worst = left;
+        if (right < count && compare_fuzz_expected(&heap[right], &heap[worst]) > 0) worst = right;
+        if (worst == i) return;
+        fuzz_heap_swap(heap, i, worst);
+        i = worst;
+    }
+}
+
+/* Keep candidate if it is among the limit best so far */
+void fuzz_expected_offer(fuzz_expected_t *heap, uint32_t *count, uint32_t limit, fuzz_expected_t candidate) {
+    if (*count < limit) {
+        heap[*count] = candidate;
+        fuzz_heap_sift_up(heap, (*count)++);
+    } else if (limit > 0 && compare_fuzz_expected(&candidate, &heap[0]) < 0) {
+        heap[0] = candidate;
+        fuzz_heap_sift_down(heap, *count, 0);
+    }
+}
+
+/*
+ * Compare index fuzzy search against a brute-force pass of the reference
+ * DP over every name. Results must agree on (distance, name) in order.
+ * The brute force keeps only the max_results best names, so memory does
+ * not grow with the index.
+ */
+int fuzz_index(const mapped_index_t *idx, bench_rng_t *rng, int queries) {
+    uint64_t count = idx->header->entry_count;
+    uint32_t max_results = idx->header->max_results;
+    int failures = 0;
+    
+    index_match_t *got = malloc((max_results + 1) * sizeof(index_match_t));
+    fuzz_expected_t *expected = malloc((max_results + 1) * sizeof(fuzz_expected_t));
+    if (!got || !expected) {
+        free(got);
+        free(expected);
+        return 0;
+    }
+    
+    for (int q = 0; q < queries; q++) {
+        char query[MAX_INPUT_LENGTH];
+        int style = (int)rng_below(rng, FUZZ_STYLE_COUNT);
+        if (q % 4 != 3) {
+            /* Mostly typos of stored names, so results are not empty */
+            const char *name = index_name(idx, rng_below(rng, (uint32_t)count));
+            fuzz_mutate(rng, name, query, sizeof(query), (int)rng_below(rng, 4), style);
+        } else {
+            fuzz_make_string(rng, query, sizeof(query), 1 + (int)rng_below(rng, 12), style);
+        }
+        
+        char key[MAX_INPUT_LENGTH];
+        strcpy(key, query);
+        str_to_lower(key);
+        
+        for (int k = 0; k <= (int)idx->header->fuzzy_distance; k++) {
+            uint32_t got_count = index_fuzzy_matches(idx, query, k, got);
+            
+            uint32_t expected_count = 0;
+            for (uint64_t id = 0; id < count; id++) {
+                fuzz_expected_t candidate;
+                candidate.name = index_name(idx, (uint32_t)id);
+                candidate.dist = reference_levenshtein(key, candidate.name);
+                if (candidate.dist <= k) {
+                    fuzz_expected_offer(expected, &expected_count, max_results, candidate);
+                }
+            }
+            qsort(expected, expected_count, sizeof(fuzz_expected_t), compare_fuzz_expected);
+            
+            int ok = (got_count == expected_count);
+            for (uint32_t i = 0; ok && i < got_count; i++) {
+                ok = got[i].dist == expected[i].dist &&
+                     strcmp(index_name(idx, got[i].id), expected[i].name) == 0;
+            }
+            if (!ok) {
+                if (failures < 10) {
+                    out("  MISMATCH index fuzzy k=%d: %u results, expected %u\n",
+                        k, got_count, expected_count);
+                    fuzz_print_string("query", query);
+                }
+                failures++;
+            }
+        }
+    }
+    
+    free(got);
+    free(expected);
+    return failures;
+}
+
+/* Count a failure if value is outside the bounds of the histogram bucket it is counted in */
+void fuzz_histogram_value(long long value, int *failures) {
+    int i = hist_index(value);
+    if (value <= hist_bucket_upper(i) && (i == 0 || value > hist_bucket_upper(i - 1))) {
+        return;
+    }
+    if (*failures < 10) {
+        out("  MISMATCH histogram: %lld ns in bucket %d (%lld..%lld ns)\n", value, i,
+            i > 0 ? hist_bucket_upper(i - 1) + 1 : 0, hist_bucket_upper(i));
+    }
+    (*failures)++;
+}
+
+/*
+ * Check every value below 1 us, and each power of two up to the top
+ * octave with its neighbours, against its bucket's bounds. Returns the
+ * number of values outside them.
+ */
+int fuzz_histogram(long long *checks) {
+    int failures = 0;
+    for (long long value = 0; value < 1000; value++) {
+        fuzz_histogram_value(value, &failures);
+        (*checks)++;
+    }
+    for (int exponent = 10; exponent <= HIST_MAX_EXPONENT; exponent++) {
+        long long power = 1LL << exponent;
+        fuzz_histogram_value(power - 1, &failures);
+        fuzz_histogram_value(power, &failures);
+        fuzz_histogram_value(power + 1, &failures);
+        *checks += 3;
+    }
+    fuzz_histogram_value((2LL << HIST_MAX_EXPONENT) - 1, &failures);
+    (*checks)++;
+    return failures;
+}
+
+/*
+ * delete_paths_under() on a scratch in-memory database: only the root
+ * and the paths below it go, not siblings whose names differ by case,
+ * by a character where the root has '_', or that extend its name.
+ * Returns the number of rows deleted or kept wrongly.
+ */
+int fuzz_subtree_delete(long long *checks) {
+    static const char *rows[][2] = {
+        { "/fuzz/a_b", "delete" }, { "/fuzz/a_b/x", "delete" }, { "/fuzz/a_b/c/y", "delete" },
+        { "/fuzz/aXb", "keep" }, { "/fuzz/aXb/x", "keep" }, { "/FUZZ/A_B", "keep" },
+        { "/FUZZ/A_B/x", "keep" }, { "/fuzz/a_b2/x", "keep" }, { "/fuzz/a_b%/x", "keep" },
+    };
+    int count = (int)(sizeof(rows) / sizeof(rows[0]));
+    sqlite3 *saved = db;
+    int failures = 0;
+    
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || create_schema_v1() != 0 || create_schema_v3() != 0) {
+        out("  MISMATCH subtree delete: cannot create a scratch database\n");
+        sqlite3_close(db);
+        db = saved;
+        return 1;
+    }
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "INSERT INTO paths (path, name, is_directory) VALUES (?, 'x', 0);", -1, &stmt, NULL);
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, 1, rows[i][0], -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    
+    delete_paths_under("/fuzz/a_b");
+    
+    sqlite3_prepare_v2(db, "SELECT EXISTS (SELECT 1 FROM paths WHERE path = ?);", -1, &stmt, NULL);
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, 1, rows[i][0], -1, SQLITE_STATIC);
+        int kept = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+        sqlite3_reset(stmt);
+        (*checks)++;
+        if (kept != (strcmp(rows[i][1], "keep") == 0)) {
+            out("  MISMATCH subtree delete of /fuzz/a_b: %s was %s\n", rows[i][0], kept ? "kept" : "deleted");
+            failures++;
+        }
+    }
     sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    db = saved;
+    return failures;
+}
+
+/*
+ * Differential fuzzing: levenshtein(), the SQL levenshtein() function as
+ * fuzzy tag search calls it, fs_levenshtein_bounded() for a range of
+ * bounds, and (when the database has paths) the binary index's fuzzy
+ * search, all checked against reference_levenshtein().
+ */
+int fuzz_kernels(int iterations, uint64_t seed) {
+    bench_rng_t rng = { seed };
+    char s1[512], s2[512];
+    long long checks = 0;
+    int failures = 0;
+    
+    sqlite3_stmt *sql_stmt = NULL;
+    if (require_levenshtein(db) != 0 ||
+        sqlite3_prepare_v2(db, "SELECT levenshtein(?1, ?2), levenshtein(?2, ?1);", -1, &sql_stmt, NULL) != SQLITE_OK) {
+        fprintf(command_stderr, "Query error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    
+    out("Fuzzing distance kernels: %d pairs, seed %llu\n", iterations, (unsigned long long)seed);
+    
+    for (int it = 0; it < iterations; it++) {
+        int style = (int)rng_below(&rng, FUZZ_STYLE_COUNT);
+        /* Mostly short names, with some past the 127-byte stack rows */
+        int length = (rng_below(&rng, 10) == 0) ? 100 + (int)rng_below(&rng, 200) : (int)rng_below(&rng, 24);
+        fuzz_make_string(&rng, s1, sizeof(s1), length, style);
+        
+        switch (rng_below(&rng, 4)) {
+            case 0:  /* unrelated string */
+                fuzz_make_string(&rng, s2, sizeof(s2), (int)rng_below(&rng, 24), (int)rng_below(&rng, FUZZ_STYLE_COUNT));
+                break;
+            case 1:  /* identical up to case */
+                strcpy(s2, s1);
+                for (char *p = s2; *p; p++) if (rng_below(&rng, 2)) *p = (char)toupper((unsigned char)*p);
+                break;
+            default: /* a few edits away */
+                fuzz_mutate(&rng, s1, s2, sizeof(s2), 1 + (int)rng_below(&rng, 5), style);
+                break;
+        }
+        
+        int ref = reference_levenshtein(s1, s2);
+        int got = levenshtein(s1, s2);
+        int swapped = levenshtein(s2, s1);
+        checks += 2;
+        int ok = (got == ref && swapped == ref);
+        
+        sqlite3_bind_text(sql_stmt, 1, s1, -1, SQLITE_STATIC);
+        sqlite3_bind_text(sql_stmt, 2, s2, -1, SQLITE_STATIC);
+        int sql_got = -1, sql_swapped = -1;
+        if (sqlite3_step(sql_stmt) == SQLITE_ROW) {
+            sql_got = sqlite3_column_int(sql_stmt, 0);
+            sql_swapped = sqlite3_column_int(sql_stmt, 1);
+        }
+        sqlite3_reset(sql_stmt);
+        checks += 2;
+        if (ok && (sql_got != ref || sql_swapped != ref)) {
+            if (failures < 10) {
+                out("  MISMATCH SQL levenshtein() %d / %d (swapped), expected %d\n", sql_got, sql_swapped, ref);
+            }
+            ok = 0;
+        }
+        
+        int bounds[] = { 0, 1, 2, 3, 5, ref - 1, ref, ref + 1 };
+        for (int b = 0; ok && b < (int)(sizeof(bounds) / sizeof(bounds[0])); b++) {
+            int k = bounds[b];
+            if (k < 0) continue;
+            int expected = ref <= k ? ref : k + 1;
+            int bounded = fs_levenshtein_bounded(s1, (int)strlen(s1), s2, (int)strlen(s2), k);
+            checks++;
+            if (bounded != expected) {
+                if (failures < 10) {
+                    out("  MISMATCH levenshtein_bounded k=%d: %d, expected %d\n", k, bounded, expected);
+                }
+                ok = 0;
+            }
+        }
+        
+        if (!ok) {
+            if (failures < 10) {
+                out("  MISMATCH reference %d, levenshtein %d / %d (swapped)\n", ref, got, swapped);
+                fuzz_print_string("s1", s1);
+                fuzz_print_string("s2", s2);
+            }
+            failures++;
+        }
+    }
+    sqlite3_finalize(sql_stmt);
+    out("  kernels: %lld checks, %d failing pairs\n", checks, failures);
+    
+    long long hist_checks = 0;
+    int hist_failures = fuzz_histogram(&hist_checks);
+    out("  histogram: %lld values, %d outside their bucket\n", hist_checks, hist_failures);
+    failures += hist_failures;
+    
+    long long delete_checks = 0;
+    int delete_failures = fuzz_subtree_delete(&delete_checks);
+    out("  subtree delete: %lld paths, %d wrong\n", delete_checks, delete_failures);
+    failures += delete_failures;
+    
+    /* Index fuzzy search over the current database */
+    sqlite3_stmt *stmt;
+    int has_paths = 0;
+    if (sqlite3_prepare_v2(db, "SELECT EXISTS (SELECT 1 FROM paths);", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) has_paths = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (has_paths) {
+        char index_path[MAX_PATH_LENGTH];
+        int too_long = snprintf(index_path, sizeof(index_path), "%s.fuzz%s", db_file_path,
+                                INDEX_SUFFIX) >= (int)sizeof(index_path);
+        mapped_index_t idx;
+        
+        suppress_stdout();
+        int exported = too_long ? -1 : export_index(index_path);
+        restore_stdout();
+        
+        if (exported == 0 && open_index(index_path, &idx) == 0) {
+            int queries = iterations / 100 < 20 ? 20 : iterations / 100;
+            int index_failures = fuzz_index(&idx, &rng, queries);
+            out("  index:   %d queries x %u bounds over %llu names, %d mismatches\n",
+                queries, idx.header->fuzzy_distance + 1,
+                (unsigned long long)idx.header->entry_count, index_failures);
+            failures += index_failures;
+            close_index(&idx);
+        } else {
+            out("  index:   skipped (could not build %s)\n", index_path);
+        }
+        if (!too_long) remove(index_path);
+    } else {
+        out("  index:   skipped (database has no paths)\n");
+    }
     
-    return (rc == SQLITE_DONE) ? 0 : -1;
+    out("%s\n", failures ? "FAILED" : "OK");
+    return failures ? -1 : 0;
 }
 
-char *get_string_setting(const char *key, char *buffer, size_t size, const char *default_value) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT value FROM settings WHERE key = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        strncpy(buffer, default_value, size - 1);
-        buffer[size - 1] = '\0';
-        return buffer;
+/* Time one kernel over a set of pairs; returns ns per call */
+double time_kernel(int kernel, char (*a)[512], char (*b)[512], int pairs, int k, int rounds) {
+    volatile int sink = 0;
+    long long t0 = monotonic_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int p = 0; p < pairs; p++) {
+            switch (kernel) {
+                case 0: sink += reference_levenshtein(a[p], b[p]); break;
+                case 1: sink += levenshtein(a[p], b[p]); break;
+                default:
+                    sink += fs_levenshtein_bounded(a[p], (int)strlen(a[p]), b[p], (int)strlen(b[p]), k);
+                    break;
+            }
+        }
+    }
+    (void)sink;
+    return (double)(monotonic_ns() - t0) / ((double)rounds * pairs);
+}
+
+/*
+ * Microbenchmark each distance kernel across string lengths and bounds.
+ * "near" pairs are a couple of edits apart (typical fuzzy hits), "far"
+ * pairs are unrelated strings of the same length (typical misses, where
+ * the bounded kernel can stop early).
+ */
+void bench_kernels(int rounds, const char *json_path) {
+    enum { PAIRS = 64 };
+    static char near_a[PAIRS][512], near_b[PAIRS][512], far_b[PAIRS][512];
+    int lengths[] = { 4, 8, 16, 32, 64, 128, 256 };
+    int bounds[] = { 1, 2, 3, 5 };
+    int length_count = sizeof(lengths) / sizeof(lengths[0]);
+    int bound_count = sizeof(bounds) / sizeof(bounds[0]);
+    bench_rng_t rng = { 42 };
+    
+    FILE *fp = NULL;
+    if (json_path && json_path[0]) {
+        fp = fopen(json_path, "w");
+        if (!fp) {
+            fprintf(command_stderr, "Cannot write %s\n", json_path);
+        } else {
+            fprintf(fp, "{\n  \"benchmark\": \"kernels\",\n  \"rounds\": %d,\n  \"results\": [\n", rounds);
+        }
     }
     
-    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
-    
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *val = (const char *)sqlite3_column_text(stmt, 0);
-        strncpy(buffer, val ? val : default_value, size - 1);
-    } else {
-        strncpy(buffer, default_value, size - 1);
+    out("\n  %-6s %-5s %-22s %12s %12s\n", "length", "k", "kernel", "near ns", "far ns");
+    int first = 1;
+    for (int l = 0; l < length_count; l++) {
+        int length = lengths[l];
+        for (int p = 0; p < PAIRS; p++) {
+            fuzz_make_string(&rng, near_a[p], 512, length, FUZZ_PRINTABLE);
+            fuzz_mutate(&rng, near_a[p], near_b[p], 512, 2, FUZZ_PRINTABLE);
+            fuzz_make_string(&rng, far_b[p], 512, length, FUZZ_PRINTABLE);
+        }
+        /* Keep total work per row roughly constant across lengths */
+        int scaled = rounds * 16 / length;
+        if (scaled < 1) scaled = 1;
+        
+        for (int kernel = 0; kernel < 2 + bound_count; kernel++) {
+            int k = kernel >= 2 ? bounds[kernel - 2] : -1;
+            const char *name = kernel == 0 ? "reference (full DP)" : kernel == 1 ? "levenshtein" : "levenshtein_bounded";
+            hw_sample_t hw0;
+            int hw = (hw_sample(&hw0) == 0);
+            double near_ns = time_kernel(kernel < 2 ? kernel : 2, near_a, near_b, PAIRS, k, scaled);
+            if (hw) {
+                hw_sample_t delta = {{0}};
+                hw_accumulate(&delta, &hw0);
+                char bucket[48];
+                snprintf(bucket, sizeof(bucket), "kernel:%s", kernel == 0 ? "reference" : name);
+                hw_record_delta(bucket, (long long)scaled * PAIRS, &delta);
+            }
+            double far_ns = time_kernel(kernel < 2 ? kernel : 2, near_a, far_b, PAIRS, k, scaled);
+            
+            char k_label[12] = "-";
+            if (k >= 0) snprintf(k_label, sizeof(k_label), "%d", k);
+            out("  %-6d %-5s %-22s %12.1f %12.1f\n", length, k_label, name, near_ns, far_ns);
+            
+            if (fp) {
+                fprintf(fp, "%s    {\"length\": %d, \"k\": %d, \"kernel\": \"%s\", \"near_ns\": %.1f, \"far_ns\": %.1f}",
+                        first ? "" : ",\n", length, k, name, near_ns, far_ns);
+                first = 0;
+            }
+        }
     }
-    buffer[size - 1] = '\0';
+    out("\n");
     
-    sqlite3_finalize(stmt);
-    return buffer;
+    if (fp) {
+        fprintf(fp, "\n  ]\n}\n");
+        fclose(fp);
+        out("Results written to %s\n", json_path);
+    }
 }
 
-int set_string_setting(const char *key, const char *value) {
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT OR REPLACE INTO settings (key, value) VALUES (?, ?);";
+/*
+ * Shared scan benchmark: 'queries' searches (alternately fuzzy and
+ * substring) run one statement at a time, then in shared passes of up
+ * to SHARED_SCAN_MAX_BATCH. Terms are names from the database, fuzzy
+ * ones with one character changed.
+ */
+void bench_shared(int queries) {
+    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
+    int distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+    shared_query_t *q = calloc(queries, sizeof(shared_query_t));
+    if (!q) return;
+    
+    sqlite3_stmt *stmt;
+    int count = 0;
+    if (sqlite3_prepare_v2(db, "SELECT name FROM paths ORDER BY random() LIMIT ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, queries);
+        while (count < queries && sqlite3_step(stmt) == SQLITE_ROW) {
+            char term[MAX_INPUT_LENGTH];
+            strncpy(term, (const char *)sqlite3_column_text(stmt, 0), sizeof(term) - 1);
+            term[sizeof(term) - 1] = '\0';
+            int length = (int)strlen(term);
+            
+            if (count % 2 == 0) {
+                if (length > 1) term[length / 2] = (term[length / 2] == 'x') ? 'y' : 'x';
+                shared_query_init(&q[count], SHARED_FUZZY, term, distance, max_results);
+            } else {
+                if (length > 4) memmove(term, term + length / 2 - 2, 5);
+                term[length > 4 ? 4 : length] = '\0';
+                shared_query_init(&q[count], SHARED_SUBSTRING, term, 0, max_results);
+            }
+            count++;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (count == 0) {
+        out("Database is empty; run 'generate <count>' or 'add <directory>' first.\n");
+        free(q);
+        return;
+    }
+    if (require_levenshtein(db) != 0) {
+        free(q);
+        return;
     }
     
-    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, value, -1, SQLITE_STATIC);
+    /* One statement per query, as the interactive CLI runs them */
+    long long separate_rows = 0;
+    long long t0 = monotonic_ns();
+    for (int i = 0; i < count; i++) {
+        const char *sql = q[i].kind == SHARED_FUZZY
+            ? "SELECT path, is_directory, size, levenshtein(name, ?) as dist "
+              "FROM paths WHERE dist <= ? ORDER BY dist, name LIMIT ?;"
+            : "SELECT path, is_directory, size FROM paths "
+              "WHERE name LIKE '%' || ? || '%' COLLATE NOCASE LIMIT ?;";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) continue;
+        sqlite3_bind_text(stmt, 1, q[i].query, -1, SQLITE_STATIC);
+        if (q[i].kind == SHARED_FUZZY) {
+            sqlite3_bind_int(stmt, 2, distance);
+            sqlite3_bind_int(stmt, 3, max_results);
+        } else {
+            sqlite3_bind_int(stmt, 2, max_results);
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) separate_rows++;
+        sqlite3_finalize(stmt);
+    }
+    double separate_ms = (monotonic_ns() - t0) / 1e6;
     
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    long long shared_rows = 0;
+    int passes = 0;
+    t0 = monotonic_ns();
+    for (int start = 0; start < count; start += SHARED_SCAN_MAX_BATCH) {
+        int end = start + SHARED_SCAN_MAX_BATCH < count ? start + SHARED_SCAN_MAX_BATCH : count;
+        for (int i = start; i < end; i++) {
+            q[i].next = (i + 1 < end) ? &q[i + 1] : NULL;
+        }
+        shared_scan_batch(&q[start]);
+        passes++;
+    }
+    double shared_ms = (monotonic_ns() - t0) / 1e6;
+    for (int i = 0; i < count; i++) {
+        shared_rows += q[i].count;
+        shared_query_free(&q[i]);
+    }
+    free(q);
     
-    return (rc == SQLITE_DONE) ? 0 : -1;
+    out("\n[Shared Scan Benchmark - %d queries]\n", count);
+    out("  %-10s %10s %12s %10s\n", "mode", "total ms", "queries/s", "results");
+    out("  %-10s %10.1f %12.0f %10lld\n", "separate", separate_ms, count / (separate_ms / 1000), separate_rows);
+    out("  %-10s %10.1f %12.0f %10lld\n", "shared", shared_ms, count / (shared_ms / 1000), shared_rows);
+    out("  %d pass%s, %.1fx faster\n\n", passes, passes == 1 ? "" : "es", separate_ms / shared_ms);
 }
 
-void show_all_settings() {
+/*
+ * Format 'rows' results in each output format to the null device, with
+ * one fprintf per row (the old text output) as the baseline. Paths are
+ * loaded first so only formatting and writing are timed.
+ */
+void bench_output(long long rows) {
+    int capacity = 100000;
+    char **paths = malloc(capacity * sizeof(char *));
+    long long *sizes = malloc(capacity * sizeof(long long));
+    int *dirs = malloc(capacity * sizeof(int));
+    int loaded = 0;
+    
     sqlite3_stmt *stmt;
-    const char *sql = "SELECT key, value FROM settings ORDER BY key;";
+    if (paths && sizes && dirs &&
+        sqlite3_prepare_v2(db, "SELECT path, is_directory, size FROM paths LIMIT ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, capacity);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            paths[loaded] = strdup((const char *)sqlite3_column_text(stmt, 0));
+            if (!paths[loaded]) break;
+            dirs[loaded] = sqlite3_column_int(stmt, 1);
+            sizes[loaded] = sqlite3_column_int64(stmt, 2);
+            loaded++;
+        }
+        sqlite3_finalize(stmt);
+    }
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
+#ifdef _WIN32
+    FILE *null_file = fopen("NUL", "wb");
+#else
+    FILE *null_file = fopen("/dev/null", "wb");
+#endif
+    if (loaded == 0 || !null_file) {
+        if (loaded == 0) out("Database is empty; run 'generate <count>' or 'add <directory>' first.\n");
+        if (null_file) fclose(null_file);
+        for (int i = 0; i < loaded; i++) free(paths[i]);
+        free(paths);
+        free(sizes);
+        free(dirs);
         return;
     }
     
-    printf("\n[Settings]\n");
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *key = (const char *)sqlite3_column_text(stmt, 0);
-        const char *value = (const char *)sqlite3_column_text(stmt, 1);
-        printf("  %-25s %s\n", key, value ? value : "(null)");
+    const char *names[] = { "fprintf", "text", "ndjson", "tsv", "nul" };
+    const output_format_t formats[] = { OUTPUT_TEXT, OUTPUT_TEXT, OUTPUT_NDJSON, OUTPUT_TSV, OUTPUT_NUL };
+    double ms[5];
+    
+    FILE *saved_output = command_output;
+    output_format_t saved_format = output_format;
+    long long saved_count = result_count;
+    command_output = null_file;
+    result_match = "bench";
+    
+    for (int f = 0; f < 5; f++) {
+        output_format = formats[f];
+        long long t0 = monotonic_ns();
+        for (long long i = 0; i < rows; i++) {
+            int r = (int)(i % loaded);
+            if (f == 0) {
+                if (dirs[r]) fprintf(null_file, "  [DIR]  %s\n", paths[r]);
+                else fprintf(null_file, "  [FILE] %s (%lld bytes)\n", paths[r], sizes[r]);
+            } else {
+                print_path_row(paths[r], dirs[r], sizes[r], 0, 0);
+            }
+        }
+        result_flush();
+        fflush(null_file);
+        ms[f] = (monotonic_ns() - t0) / 1e6;
     }
-    printf("\n");
     
-    sqlite3_finalize(stmt);
+    command_output = saved_output;
+    output_format = saved_format;
+    result_count = saved_count;
+    fclose(null_file);
+    
+    out("\n[Output Benchmark - %lld rows, %d distinct paths]\n", rows, loaded);
+    out("  %-10s %10s %14s %10s\n", "format", "total ms", "rows/s", "ns/row");
+    for (int f = 0; f < 5; f++) {
+        out("  %-10s %10.1f %14.0f %10.1f\n", names[f], ms[f],
+            rows / (ms[f] / 1000), ms[f] * 1e6 / rows);
+    }
+    out("  text is %.1fx the fprintf rate\n\n", ms[0] / ms[1]);
+    
+    for (int i = 0; i < loaded; i++) free(paths[i]);
+    free(paths);
+    free(sizes);
+    free(dirs);
 }
 
-void cmd_get_setting(const char *key) {
-    char buffer[256];
-    get_string_setting(key, buffer, sizeof(buffer), "(not set)");
-    printf("%s = %s\n", key, buffer);
+/* How this process was started, so 'bench startup' can launch it again */
+const char *program_path = NULL;
+
+#ifndef _WIN32
+/*
+ * Launch this program once with the given arguments and time it from
+ * fork to the first byte on its stdout and to its exit. Returns -1 if it
+ * could not run or did not exit cleanly.
+ */
+int time_launch(char *const args[], long long *first_ns, long long *exit_ns) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    
+    long long t0 = monotonic_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) dup2(null_fd, STDERR_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(args[0], args);
+        _exit(127);
+    }
+    close(fds[1]);
+    
+    char buffer[4096];
+    ssize_t n;
+    *first_ns = -1;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (*first_ns < 0) *first_ns = monotonic_ns() - t0;
+    }
+    close(fds[0]);
+    
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    *exit_ns = monotonic_ns() - t0;
+    if (*first_ns < 0) *first_ns = *exit_ns;
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
 }
+#endif
 
-void cmd_set_setting(const char *key, const char *value) {
-    if (set_string_setting(key, value) == 0) {
-        printf("Updated: %s = %s\n", key, value);
+/*
+ * Time to first result for a one-shot query: launch 'filesearch -c
+ * <command>' repeatedly against the current database file and report
+ * when its first output byte arrives and when it exits, next to a
+ * '--help' launch that only pays for process start. With root on Linux
+ * a few more runs follow with the page cache dropped first.
+ */
+void bench_startup(int runs, const char *command) {
+#ifdef _WIN32
+    (void)runs;
+    (void)command;
+    out("bench startup needs fork/exec; not available on Windows.\n");
+#else
+    char query[MAX_INPUT_LENGTH];
+    if (command[0]) {
+        strncpy(query, command, sizeof(query) - 1);
+        query[sizeof(query) - 1] = '\0';
     } else {
-        fprintf(stderr, "Failed to update setting.\n");
+        sqlite3_stmt *stmt;
+        query[0] = '\0';
+        if (sqlite3_prepare_v2(db, "SELECT name FROM paths ORDER BY random() LIMIT 1;", -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                snprintf(query, sizeof(query), "exact %s", (const char *)sqlite3_column_text(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+        }
+        if (!query[0]) {
+            out("Database is empty; run 'generate <count>' or 'add <directory>' first.\n");
+            return;
+        }
+    }
+    
+    const char *self = program_path;
+#ifdef __linux__
+    if (access("/proc/self/exe", X_OK) == 0) self = "/proc/self/exe";
+#endif
+    char *help_args[] = { (char *)self, "--help", NULL };
+    char *query_args[] = { (char *)self, "--db", db_file_path, "-c", query, NULL };
+    
+    int cold_runs = runs < 5 ? runs : 5;
+    long long *samples = malloc(sizeof(long long) * (runs * 3 + cold_runs * 2));
+    if (!samples) {
+        out("Out of memory.\n");
+        return;
+    }
+    latency_series_t series[5] = {
+        { "process", samples, 0, 0 },
+        { "first", samples + runs, 0, 0 },
+        { "exit", samples + runs * 2, 0, 0 },
+        { "cold first", samples + runs * 3, 0, 0 },
+        { "cold exit", samples + runs * 3 + cold_runs, 0, 0 },
+    };
+    
+    int failed = 0;
+    long long first, done;
+    if (time_launch(query_args, &first, &done) != 0) {
+        out("'%s --db %s -c \"%s\"' failed; run it directly to see why.\n", program_path, db_file_path, query);
+        free(samples);
+        return;
+    }
+    for (int i = 0; i < runs; i++) {
+        if (time_launch(help_args, &first, &done) == 0) {
+            series[0].samples_ns[series[0].count++] = done;
+            series[0].total_ns += done;
+        }
+        if (time_launch(query_args, &first, &done) != 0) {
+            failed++;
+            continue;
+        }
+        series[1].samples_ns[series[1].count++] = first;
+        series[1].total_ns += first;
+        series[2].samples_ns[series[2].count++] = done;
+        series[2].total_ns += done;
+    }
+    for (int i = 0; i < cold_runs && drop_caches() == 0; i++) {
+        if (time_launch(query_args, &first, &done) != 0) {
+            failed++;
+            continue;
+        }
+        series[3].samples_ns[series[3].count++] = first;
+        series[3].total_ns += first;
+        series[4].samples_ns[series[4].count++] = done;
+        series[4].total_ns += done;
+    }
+    
+    out("\n[Startup Benchmark - %d runs of -c \"%s\"]\n", runs, query);
+    out("  database: %s\n", db_file_path);
+    out("\n  %-12s %6s %10s %10s %10s %10s\n", "phase", "runs", "mean ms", "p50 ms", "p90 ms", "max ms");
+    for (int i = 0; i < 5; i++) {
+        latency_series_t *s = &series[i];
+        if (s->count == 0) continue;
+        qsort(s->samples_ns, s->count, sizeof(long long), compare_long_long);
+        out("  %-12s %6d %10.2f %10.2f %10.2f %10.2f\n", s->name, s->count,
+            s->total_ns / 1e6 / s->count, series_percentile_us(s, 50) / 1000,
+            series_percentile_us(s, 90) / 1000, series_percentile_us(s, 100) / 1000);
+    }
+    if (series[3].count == 0) {
+        out("  (cold runs skipped: dropping the page cache needs root on Linux)\n");
+    }
+    if (series[0].count > 0 && series[1].count > 0) {
+        out("  first result is %.2f ms after process start\n",
+            (series_percentile_us(&series[1], 50) - series_percentile_us(&series[0], 50)) / 1000);
+    }
+    if (failed > 0) {
+        out("  %d runs failed or exited non-zero\n", failed);
+    }
+    out("\n");
+    free(samples);
+#endif
+}
+
+void cmd_bench(const char *argument) {
+    char kind[32] = "";
+    char rest[MAX_INPUT_LENGTH] = "";
+    sscanf(argument, "%31s %511[^\n]", kind, rest);
+    
+    if (strcmp(kind, "search") == 0) {
+        int iterations = 100;
+        char json_path[MAX_PATH_LENGTH] = "";
+        sscanf(rest, "%d %4095s", &iterations, json_path);
+        bench_search(iterations, json_path);
+    }
+    else if (strcmp(kind, "scan") == 0) {
+        char base_dir[MAX_PATH_LENGTH] = "";
+        char json_path[MAX_PATH_LENGTH] = "";
+        bench_tree_t tree;
+        memset(&tree, 0, sizeof(tree));
+        tree.fanout = 8;
+        tree.depth = 3;
+        tree.files = 20;
+        tree.symlinks = 2;
+        
+        if (sscanf(rest, "%4095s %d %d %d %d %4095s", base_dir, &tree.fanout, &tree.depth,
+                   &tree.files, &tree.symlinks, json_path) < 1) {
+            out("Usage: bench scan <dir> [fanout] [depth] [files] [symlinks] [json_file]\n");
+        } else {
+            bench_scan(base_dir, &tree, json_path);
+        }
+    }
+    else if (strcmp(kind, "kernels") == 0) {
+        int rounds = 200;
+        char json_path[MAX_PATH_LENGTH] = "";
+        sscanf(rest, "%d %4095s", &rounds, json_path);
+        bench_kernels(rounds > 0 ? rounds : 1, json_path);
+    }
+    else if (strcmp(kind, "shared") == 0) {
+        int queries = 256;
+        sscanf(rest, "%d", &queries);
+        bench_shared(queries > 0 ? queries : 1);
+    }
+    else if (strcmp(kind, "output") == 0) {
+        long long rows = 1000000;
+        sscanf(rest, "%lld", &rows);
+        bench_output(rows > 0 ? rows : 1);
+    }
+    else if (strcmp(kind, "startup") == 0) {
+        int runs = 20;
+        char command[MAX_INPUT_LENGTH] = "";
+        if (sscanf(rest, "%d %511[^\n]", &runs, command) == 0) {
+            snprintf(command, sizeof(command), "%s", rest);
+        }
+        bench_startup(runs > 0 ? runs : 1, command);
+    }
+    else if (strcmp(kind, "fuzz") == 0) {
+        int iterations = 100000;
+        unsigned long long seed = 1;
+        sscanf(rest, "%d %llu", &iterations, &seed);
+        fuzz_kernels(iterations, seed);
+    }
+    else {
+        out("Usage: bench search [iterations] [json_file]\n");
+        out("       bench scan <dir> [fanout] [depth] [files] [symlinks] [json_file]\n");
+        out("       bench kernels [rounds] [json_file]\n");
+        out("       bench fuzz [iterations] [seed]\n");
+        out("       bench shared [queries]\n");
+        out("       bench output [rows]\n");
+        out("       bench startup [runs] [command]\n");
     }
 }
 
 /* ============================================
- * Database Initialization
+ * CLI Parsing Helpers
  * ============================================ */
 
-int table_exists(const char *table_name) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT name FROM sqlite_master WHERE type='table' AND name=?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return 0;
-    }
-    
-    sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+/*
+ * Parse arguments for 'find' command.
+ * Format: find --category X --tag Y --name Z
+ */
+void parse_find_args(const char *args, char *category, char *tag, char *name, size_t size) {
+    category[0] = '\0';
+    tag[0] = '\0';
+    name[0] = '\0';
     
-    int exists = (sqlite3_step(stmt) == SQLITE_ROW);
-    sqlite3_finalize(stmt);
+    char args_copy[MAX_INPUT_LENGTH];
+    strncpy(args_copy, args, sizeof(args_copy) - 1);
+    args_copy[sizeof(args_copy) - 1] = '\0';
     
-    return exists;
+    char *token = strtok(args_copy, " ");
+    while (token) {
+        if (strcmp(token, "--category") == 0 || strcmp(token, "-c") == 0) {
+            token = strtok(NULL, " ");
+            if (token) {
+                strncpy(category, token, size - 1);
+                category[size - 1] = '\0';
+            }
+        } else if (strcmp(token, "--tag") == 0 || strcmp(token, "-t") == 0) {
+            token = strtok(NULL, " ");
+            if (token) {
+                strncpy(tag, token, size - 1);
+                tag[size - 1] = '\0';
+            }
+        } else if (strcmp(token, "--name") == 0 || strcmp(token, "-n") == 0) {
+            token = strtok(NULL, " ");
+            if (token) {
+                strncpy(name, token, size - 1);
+                name[size - 1] = '\0';
+            }
+        }
+        token = strtok(NULL, " ");
+    }
 }
 
-int create_schema_v1() {
-    const char *schema = 
-        /* Paths table */
-        "CREATE TABLE IF NOT EXISTS paths ("
-        "  id INTEGER PRIMARY KEY,"
-        "  path TEXT UNIQUE NOT NULL,"
-        "  name TEXT NOT NULL,"
-        "  is_directory INTEGER NOT NULL,"
-        "  size INTEGER,"
-        "  parent_path TEXT"
-        ");"
-        
-        /* Categories table */
-        "CREATE TABLE IF NOT EXISTS categories ("
-        "  id INTEGER PRIMARY KEY,"
-        "  name TEXT UNIQUE NOT NULL"
-        ");"
-        
-        /* Path-Category junction table */
-        "CREATE TABLE IF NOT EXISTS path_categories ("
-        "  path_id INTEGER NOT NULL,"
-        "  category_id INTEGER NOT NULL,"
-        "  PRIMARY KEY (path_id, category_id),"
-        "  FOREIGN KEY (path_id) REFERENCES paths(id) ON DELETE CASCADE,"
-        "  FOREIGN KEY (category_id) REFERENCES categories(id) ON DELETE CASCADE"
-        ");"
-        
-        /* Tags table */
-        "CREATE TABLE IF NOT EXISTS tags ("
-        "  id INTEGER PRIMARY KEY,"
-        "  name TEXT UNIQUE NOT NULL"
-        ");"
-        
-        /* Path-Tag junction table */
-        "CREATE TABLE IF NOT EXISTS path_tags ("
-        "  path_id INTEGER NOT NULL,"
-        "  tag_id INTEGER NOT NULL,"
-        "  PRIMARY KEY (path_id, tag_id),"
-        "  FOREIGN KEY (path_id) REFERENCES paths(id) ON DELETE CASCADE,"
-        "  FOREIGN KEY (tag_id) REFERENCES tags(id) ON DELETE CASCADE"
-        ");"
-        
-        /* Settings table */
-        "CREATE TABLE IF NOT EXISTS settings ("
-        "  key TEXT PRIMARY KEY,"
-        "  value TEXT"
-        ");"
-        
-        /* Indexes */
-        "CREATE INDEX IF NOT EXISTS idx_path_name ON paths(name);"
-        "CREATE INDEX IF NOT EXISTS idx_path_parent ON paths(parent_path);"
-        "CREATE INDEX IF NOT EXISTS idx_path_is_dir ON paths(is_directory);"
-        "CREATE INDEX IF NOT EXISTS idx_category_name ON categories(name);"
-        "CREATE INDEX IF NOT EXISTS idx_tag_name ON tags(name);"
-        "CREATE INDEX IF NOT EXISTS idx_path_categories_path ON path_categories(path_id);"
-        "CREATE INDEX IF NOT EXISTS idx_path_categories_cat ON path_categories(category_id);"
-        "CREATE INDEX IF NOT EXISTS idx_path_tags_path ON path_tags(path_id);"
-        "CREATE INDEX IF NOT EXISTS idx_path_tags_tag ON path_tags(tag_id);";
+/*
+ * Parse two space-separated arguments.
+ */
+void parse_two_args(const char *input, char *arg1, size_t size1, char *arg2, size_t size2) {
+    arg1[0] = '\0';
+    arg2[0] = '\0';
+    
+    /* Find last space - everything before is path, after is tag/category */
+    const char *last_space = strrchr(input, ' ');
+    
+    if (last_space) {
+        size_t path_len = last_space - input;
+        if (path_len >= size1) path_len = size1 - 1;
+        strncpy(arg1, input, path_len);
+        arg1[path_len] = '\0';
+        trim_whitespace(arg1);
+        
+        strncpy(arg2, last_space + 1, size2 - 1);
+        arg2[size2 - 1] = '\0';
+        trim_whitespace(arg2);
+    }
+}
+
+/* ============================================
+ * Sharded Databases
+ * ============================================ */
+
+/*
+ * With --shards <dir>, each indexed root lives in its own database file
+ * (shard-<hash>.db) and catalog.db holds settings. Commands that name a
+ * path are routed to the shard whose root contains it; searches run on
+ * all shards in parallel and the per-shard ordered results are combined
+ * with a k-way merge. Re-adding or dropping a root touches only its own
+ * file.
+ */
+
+#define SHARD_CATALOG_FILENAME "catalog.db"
+#define SHARD_FILE_PREFIX "shard-"
+#define SHARD_MAX_THREADS 16
+
+typedef struct {
+    char file[MAX_PATH_LENGTH];
+    char root[MAX_PATH_LENGTH];
+    sqlite3 *conn;
+    fs_db *lib;     /* library handle on conn, for searches */
+    int failed;
+} shard_t;
+
+int shard_mode = 0;
+char shard_dir[MAX_PATH_LENGTH];
+shard_t *shards = NULL;
+int shard_count = 0;
+sqlite3 *shard_catalog = NULL;
+
+/*
+ * Open (or create) one shard file on the calling thread. Uses the
+ * thread-local db so the regular schema functions can be reused.
+ */
+int open_shard_connection(shard_t *shard) {
+    int is_new = !file_exists(shard->file);
     
-    char *err_msg = NULL;
-    int rc = sqlite3_exec(db, schema, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Schema error: %s\n", err_msg);
-        sqlite3_free(err_msg);
+    if (sqlite3_open(shard->file, &shard->conn) != SQLITE_OK) {
         return -1;
     }
     
-    return 0;
+    sqlite3_exec(shard->conn, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
+    apply_cache_size(shard->conn);
+    
+    sqlite3 *saved = db;
+    db = shard->conn;
+    int rc = 0;
+    if (is_new) {
+        rc = (create_schema_v1() == 0 && create_schema_v2() == 0 && create_schema_v3() == 0 &&
+              create_schema_v4() == 0) ? 0 : -1;
+        if (rc == 0) {
+            insert_default_settings();
+            insert_default_categories();
+            set_string_setting("shard_root", shard->root);
+        }
+    } else if (!table_exists("paths")) {
+        rc = -1;
+    } else {
+        get_string_setting("shard_root", shard->root, sizeof(shard->root), "");
+        if (get_int_setting("schema_version", DEFAULT_SCHEMA_VERSION) < DEFAULT_SCHEMA_VERSION) {
+            rc = migrate_schema(get_int_setting("schema_version", 1));
+        }
+    }
+    db = saved;
+    if (rc == 0 && fs_attach(shard->conn, &shard->lib) != FS_OK) {
+        rc = -1;
+    }
+    return rc;
 }
 
-int insert_default_settings() {
-    set_int_setting("schema_version", DEFAULT_SCHEMA_VERSION);
-    set_int_setting("app_version", DEFAULT_APP_VERSION);
-    set_int_setting("similarity_threshold", DEFAULT_SIMILARITY_THRESHOLD);
-    set_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    set_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
-    return 0;
+void open_shard_worker(int index, void *ctx) {
+    (void)ctx;
+    shards[index].failed = (open_shard_connection(&shards[index]) != 0);
 }
 
-int insert_default_categories() {
-    const char *categories[] = {"Games", "Music", "Photos", "Documents", "Uncategorized"};
-    int count = sizeof(categories) / sizeof(categories[0]);
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT OR IGNORE INTO categories (name) VALUES (?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+int is_shard_file(const char *name) {
+    size_t len = strlen(name);
+    return strncmp(name, SHARD_FILE_PREFIX, strlen(SHARD_FILE_PREFIX)) == 0
+        && len > 3 && strcmp(name + len - 3, ".db") == 0;
+}
+
+void close_shards() {
+    for (int i = 0; i < shard_count; i++) {
+        fs_close(shards[i].lib);
+        sqlite3_close(shards[i].conn);
     }
+    free(shards);
+    shards = NULL;
+    shard_count = 0;
+    shard_mode = 0;
     
-    for (int i = 0; i < count; i++) {
-        sqlite3_bind_text(stmt, 1, categories[i], -1, SQLITE_STATIC);
-        sqlite3_step(stmt);
-        sqlite3_reset(stmt);
+    if (shard_catalog) {
+        if (db == shard_catalog) db = NULL;
+        sqlite3_close(shard_catalog);
+        shard_catalog = NULL;
     }
-    
-    sqlite3_finalize(stmt);
-    return 0;
 }
 
-int init_database(const char *db_path) {
-    /* Check if parent directory exists */
-    char dir_path[MAX_PATH_LENGTH];
-    get_directory_from_path(db_path, dir_path, sizeof(dir_path));
+int open_shards(const char *dir) {
+    strncpy(shard_dir, dir, sizeof(shard_dir) - 1);
+    shard_dir[sizeof(shard_dir) - 1] = '\0';
     
-    if (!directory_exists(dir_path)) {
-        fprintf(stderr, "Error: Directory '%s' does not exist.\n", dir_path);
-#ifdef _WIN32
-        fprintf(stderr, "Please create it with: mkdir \"%s\"\n", dir_path);
-#else
-        fprintf(stderr, "Please create it with: mkdir -p %s\n", dir_path);
-#endif
+    if (!directory_exists(shard_dir)) {
+        fprintf(stderr, "Error: Shard directory '%s' does not exist.\n", shard_dir);
         return -1;
     }
     
-    int is_new_db = !file_exists(db_path);
-    
-    int rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Cannot open database '%s': %s\n", db_path, sqlite3_errmsg(db));
+    char catalog_path[MAX_PATH_LENGTH];
+    if (snprintf(catalog_path, sizeof(catalog_path), "%s%s%s", shard_dir, PATH_SEPARATOR_STR,
+                 SHARD_CATALOG_FILENAME) >= (int)sizeof(catalog_path)) {
+        fprintf(stderr, "Error: Shard directory path too long.\n");
         return -1;
     }
+    if (init_database(catalog_path) != 0) {
+        return -1;
+    }
+    shard_catalog = db;
     
-    /* Enable foreign keys */
-    sqlite3_exec(db, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
-    
-    /* Register Levenshtein function */
-    rc = sqlite3_create_function(db, "levenshtein", 2, SQLITE_UTF8, NULL,
-                                  sqlite_levenshtein, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Cannot register function: %s\n", sqlite3_errmsg(db));
+    DIR *d = opendir(shard_dir);
+    if (!d) {
+        fprintf(stderr, "Cannot open directory: %s\n", shard_dir);
+        close_shards();
         return -1;
     }
     
-    if (is_new_db) {
-        printf("Creating new database: %s\n", db_path);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (!is_shard_file(entry->d_name)) continue;
         
-        if (create_schema_v1() != 0) {
+        shard_t *grown = realloc(shards, (shard_count + 1) * sizeof(shard_t));
+        if (!grown) break;
+        shards = grown;
+        
+        shard_t *shard = &shards[shard_count];
+        memset(shard, 0, sizeof(*shard));
+        if (snprintf(shard->file, sizeof(shard->file), "%s%s%s", shard_dir, PATH_SEPARATOR_STR,
+                     entry->d_name) >= (int)sizeof(shard->file)) {
+            continue;
+        }
+        shard_count++;
+    }
+    closedir(d);
+    
+    run_parallel(shard_count, SHARD_MAX_THREADS, open_shard_worker, NULL);
+    
+    for (int i = 0; i < shard_count; i++) {
+        if (shards[i].failed) {
+            fprintf(stderr, "Cannot open shard '%s': %s\n", shards[i].file,
+                    shards[i].conn ? sqlite3_errmsg(shards[i].conn) : "out of memory");
+            close_shards();
             return -1;
         }
+    }
+    
+    shard_mode = 1;
+    if (!batch_mode) out("Opened %d shard%s in %s\n", shard_count, shard_count == 1 ? "" : "s", shard_dir);
+    return 0;
+}
+
+/*
+ * Find the shard whose root is the longest prefix of text, where the
+ * prefix must end at a path boundary. text may continue with further
+ * arguments after the path (e.g. "tag <path> <tag>").
+ */
+shard_t *find_shard_for_path(const char *text) {
+    shard_t *best = NULL;
+    size_t best_len = 0;
+    
+    for (int i = 0; i < shard_count; i++) {
+        size_t len = strlen(shards[i].root);
+        if (len == 0 || len < best_len || strncmp(text, shards[i].root, len) != 0) continue;
         
-        insert_default_settings();
-        insert_default_categories();
+        char next = text[len];
+        if (next == '\0' || next == ' ' || next == '/' || next == '\\' ||
+            shards[i].root[len - 1] == PATH_SEPARATOR) {
+            best = &shards[i];
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+void add_directory_sharded(const char *path) {
+    char normalized[MAX_PATH_LENGTH];
+    strncpy(normalized, path, sizeof(normalized) - 1);
+    normalized[sizeof(normalized) - 1] = '\0';
+    
+    size_t len = strlen(normalized);
+    while (len > 1 && (normalized[len-1] == '/' || normalized[len-1] == '\\')) {
+        normalized[--len] = '\0';
+    }
+    
+    shard_t *shard = find_shard_for_path(normalized);
+    
+    if (!shard) {
+        if (!directory_exists(normalized)) {
+            fprintf(command_stderr, "Error: '%s' is not a valid directory.\n", normalized);
+            return;
+        }
         
-        printf("Database initialized with default settings and categories.\n");
-    } else {
-        printf("Database opened: %s\n", db_path);
+        /* A root above an existing one would index its paths twice */
+        for (int i = 0; i < shard_count; i++) {
+            if (strncmp(shards[i].root, normalized, len) == 0 &&
+                (shards[i].root[len] == '/' || shards[i].root[len] == '\\' ||
+                 normalized[len - 1] == PATH_SEPARATOR)) {
+                fprintf(command_stderr, "Error: '%s' contains the shard root '%s'; drop-shard it first.\n",
+                        normalized, shards[i].root);
+                return;
+            }
+        }
         
-        /* Check for schema migration */
-        int current_version = get_int_setting("schema_version", 0);
+        shard_t *grown = realloc(shards, (shard_count + 1) * sizeof(shard_t));
+        if (!grown) return;
+        shards = grown;
         
-        if (current_version == 0 && !table_exists("settings")) {
-            /* Old database without versioning - needs migration */
-            printf("\nDatabase schema update required.\n");
-            printf("This will add category support and settings to your existing data.\n");
-            printf("Existing paths will be assigned to 'Uncategorized'.\n\n");
-            
-            if (!get_confirmation("Proceed with migration?")) {
-                printf("Migration cancelled. Exiting.\n");
-                sqlite3_close(db);
-                db = NULL;
-                return -1;
-            }
-            
-            /* Perform migration */
-            if (create_schema_v1() != 0) {
-                return -1;
-            }
-            
-            insert_default_settings();
-            insert_default_categories();
-            
-            /* Assign existing paths to Uncategorized */
-            const char *migrate_sql = 
-                "INSERT OR IGNORE INTO path_categories (path_id, category_id) "
-                "SELECT p.id, c.id FROM paths p, categories c WHERE c.name = 'Uncategorized';";
-            
-            sqlite3_exec(db, migrate_sql, NULL, NULL, NULL);
-            
-            printf("Migration complete.\n");
-        } else if (current_version < DEFAULT_SCHEMA_VERSION) {
-            /* Future migrations would go here */
-            printf("Schema is up to date (version %d).\n", current_version);
+        shard = &shards[shard_count];
+        memset(shard, 0, sizeof(*shard));
+        memcpy(shard->root, normalized, len + 1);
+        if (snprintf(shard->file, sizeof(shard->file), "%s%s%s%016llx.db", shard_dir, PATH_SEPARATOR_STR,
+                     SHARD_FILE_PREFIX, (unsigned long long)fnv1a64(normalized, len, FNV1A64_INIT))
+            >= (int)sizeof(shard->file)) {
+            fprintf(command_stderr, "Error: Shard directory path too long.\n");
+            return;
         }
+        
+        if (open_shard_connection(shard) != 0) {
+            fprintf(command_stderr, "Cannot create shard '%s'\n", shard->file);
+            sqlite3_close(shard->conn);
+            return;
+        }
+        shard_count++;
+        fprintf(status_output(), "Created shard for %s\n", normalized);
     }
     
-    return 0;
+    db = shard->conn;
+    add_directory(normalized);
+    db = shard_catalog;
 }
 
-/* ============================================
- * Path Operations
- * ============================================ */
+void drop_shard(const char *root) {
+    for (int i = 0; i < shard_count; i++) {
+        if (strcmp(shards[i].root, root) != 0) continue;
+        
+        fs_close(shards[i].lib);
+        sqlite3_close(shards[i].conn);
+        if (remove(shards[i].file) != 0) {
+            fprintf(command_stderr, "Cannot delete shard file: %s\n", shards[i].file);
+        } else {
+            fprintf(status_output(), "Dropped shard for %s\n", root);
+        }
+        
+        /* A journal or WAL left next to the file would be applied to a new shard of the same name */
+        static const char *suffixes[] = { "-wal", "-shm", "-journal" };
+        for (int j = 0; j < (int)(sizeof(suffixes) / sizeof(suffixes[0])); j++) {
+            char sidecar[MAX_PATH_LENGTH + 16];
+            snprintf(sidecar, sizeof(sidecar), "%s%s", shards[i].file, suffixes[j]);
+            if (file_exists(sidecar) && remove(sidecar) != 0) {
+                fprintf(command_stderr, "Cannot delete shard file: %s\n", sidecar);
+            }
+        }
+        shards[i] = shards[--shard_count];
+        return;
+    }
+    fprintf(command_stderr, "No shard with root: %s\n", root);
+}
 
-int get_path_id(const char *path) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id FROM paths WHERE path = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+void list_shards() {
+    out("\n[Shards in %s]\n", shard_dir);
+    for (int i = 0; i < shard_count; i++) {
+        sqlite3_stmt *stmt;
+        int paths = 0;
+        if (sqlite3_prepare_v2(shards[i].conn, "SELECT COUNT(*) FROM paths;", -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) paths = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        out("  %-40s %8d paths  %s\n", shards[i].root, paths,
+            get_filename_from_path(shards[i].file));
     }
+    if (shard_count == 0) {
+        out("  (no shards; use 'add <directory>')\n");
+    }
+    out("\n");
+}
+
+/* ---- Parallel fan-out search ---- */
+
+typedef struct {
+    char *path;
+    char *name;
+    int is_dir;
+    long long size;
+    int dist;
+} shard_row_t;
+
+typedef struct {
+    shard_row_t *rows;
+    int count;
+} shard_result_t;
+
+/*
+ * Every shard runs the same library search, sorted by the merge key
+ * (path, or distance, name and path for fuzzy) so each returns a
+ * sorted run for the k-way merge.
+ */
+typedef struct {
+    fs_search_options opts;
+    shard_result_t *results;
+} shard_search_t;
+
+void shard_search_worker(int index, void *ctx) {
+    shard_search_t *search = ctx;
+    shard_result_t *result = &search->results[index];
+    long long stage = trace_clock();
+    fs_iter *it = NULL;
     
-    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    if (fs_search(shards[index].lib, &search->opts, &it) != FS_OK) {
+        return;
+    }
     
-    int id = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        id = sqlite3_column_int(stmt, 0);
+    int max_results = search->opts.limit;
+    fs_result r;
+    result->rows = calloc(max_results > 0 ? max_results : 1, sizeof(shard_row_t));
+    while (result->rows && result->count < max_results && fs_iter_next(it, &r) == FS_ROW) {
+        shard_row_t *row = &result->rows[result->count++];
+        row->path = strdup(r.path);
+        row->name = strdup(r.name ? r.name : "");
+        row->is_dir = r.is_directory;
+        row->size = r.size;
+        row->dist = r.distance;
     }
     
-    sqlite3_finalize(stmt);
-    return id;
+    fs_iter_free(it);
+    trace_event("shard search", "query", stage, shards[index].root, result->count);
 }
 
-int add_path_to_db(const char *path, const char *name, int is_directory, 
-                   long long size, const char *parent_path) {
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "INSERT OR IGNORE INTO paths (path, name, is_directory, size, parent_path) "
-        "VALUES (?, ?, ?, ?, ?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(db));
-        return -1;
+int compare_shard_rows(const shard_row_t *a, const shard_row_t *b, int fuzzy) {
+    if (fuzzy) {
+        if (a->dist != b->dist) return a->dist < b->dist ? -1 : 1;
+        int cmp = strcmp(a->name, b->name);
+        if (cmp != 0) return cmp;
+    }
+    return strcmp(a->path, b->path);
+}
+
+/*
+ * Run one search on every shard in parallel, then merge the sorted
+ * per-shard runs. The merge picks the smallest head among the shards,
+ * so it stops after max_results rows without touching the rest.
+ */
+int search_shards(shard_search_t *search) {
+    int fuzzy = search->opts.match == FS_MATCH_FUZZY;
+    search->results = calloc(shard_count > 0 ? shard_count : 1, sizeof(shard_result_t));
+    if (!search->results) {
+        return 0;
     }
     
-    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 3, is_directory);
+    run_parallel(shard_count, SHARD_MAX_THREADS, shard_search_worker, search);
     
-    if (size >= 0) {
-        sqlite3_bind_int64(stmt, 4, size);
-    } else {
-        sqlite3_bind_null(stmt, 4);
-    }
+    int *heads = calloc(shard_count > 0 ? shard_count : 1, sizeof(int));
+    int found = 0;
     
-    if (parent_path) {
-        sqlite3_bind_text(stmt, 5, parent_path, -1, SQLITE_STATIC);
-    } else {
-        sqlite3_bind_null(stmt, 5);
+    while (heads && found < search->opts.limit) {
+        int best = -1;
+        for (int i = 0; i < shard_count; i++) {
+            if (heads[i] >= search->results[i].count) continue;
+            if (best < 0 || compare_shard_rows(&search->results[i].rows[heads[i]],
+                                               &search->results[best].rows[heads[best]],
+                                               fuzzy) < 0) {
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        
+        shard_row_t *row = &search->results[best].rows[heads[best]++];
+        print_path_row(row->path, row->is_dir, row->size, fuzzy, row->dist);
+        found++;
     }
+    result_flush();
     
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    return (rc == SQLITE_DONE) ? 0 : -1;
+    for (int i = 0; i < shard_count; i++) {
+        for (int j = 0; j < search->results[i].count; j++) {
+            free(search->results[i].rows[j].path);
+            free(search->results[i].rows[j].name);
+        }
+        free(search->results[i].rows);
+    }
+    free(search->results);
+    free(heads);
+    return found;
 }
 
-int remove_path_from_db(const char *path) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return -1;
+void search_shards_simple(fs_match match, const char *query, int max_distance) {
+    shard_search_t search;
+    memset(&search, 0, sizeof(search));
+    search_options_init(&search.opts, match, query);
+    if (match != FS_MATCH_FUZZY) {
+        search.opts.sort = FS_SORT_PATH;
     }
     
-    sqlite3_stmt *stmt;
-    const char *sql = "DELETE FROM paths WHERE id = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+    if (match == FS_MATCH_FUZZY && max_distance < 0) {
+        max_distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+    }
+    search.opts.max_distance = max_distance;
+    
+    switch (match) {
+    case FS_MATCH_EXACT:
+        print_results_header("exact", "Exact Match - Paths");
+        if (!search_shards(&search)) print_no_results("no exact matches");
+        break;
+    case FS_MATCH_PREFIX:
+        print_results_header("prefix", "Prefix Match - Paths");
+        if (!search_shards(&search)) print_no_results("no prefix matches");
+        break;
+    case FS_MATCH_SUBSTRING:
+        print_results_header("substring", "Substring Match - Paths");
+        if (!search_shards(&search)) print_no_results("no substring matches");
+        break;
+    case FS_MATCH_FUZZY:
+        print_results_header("fuzzy", "Fuzzy Match - Paths (distance <= %d)", max_distance);
+        if (!search_shards(&search)) {
+            print_no_results("no fuzzy matches within distance %d", max_distance);
+        }
+        break;
     }
+}
+
+void structured_search_shards(const char *category, const char *tag, const char *name) {
+    shard_search_t search;
+    memset(&search, 0, sizeof(search));
+    find_options_init(&search.opts, category, tag, name);
     
-    sqlite3_bind_int(stmt, 1, path_id);
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    print_results_header("find", "Search Results");
+    if (!search_shards(&search)) {
+        print_no_results("no matches");
+    }
+    if (output_format == OUTPUT_TEXT) out("\n");
+}
+
+/*
+ * Run a command once per shard, with db pointing at that shard.
+ */
+void for_each_shard(void (*fn)(const char *arg), const char *arg) {
+    for (int i = 0; i < shard_count; i++) {
+        out("\n== Shard: %s ==", shards[i].root);
+        db = shards[i].conn;
+        fn(arg);
+    }
+    db = shard_catalog;
+}
+
+void shard_list_all_tags(const char *arg)       { (void)arg; list_all_tags(); }
+void shard_list_all_categories(const char *arg) { (void)arg; list_all_categories(); }
+void shard_show_stats(const char *arg)          { (void)arg; show_stats(); }
+void shard_search_tags(const char *arg)         { search_tags_fuzzy(arg); }
+void shard_create_category(const char *arg)     { create_category(arg); }
+void shard_verify_paths(const char *arg)        { verify_paths(arg); }
+
+/*
+ * Commands that need shard-aware handling. Returns 1 if the command was
+ * handled here; otherwise the caller runs it normally, after routing db
+ * to the shard that owns the path in the argument (if any).
+ */
+int execute_shard_command(const char *command, const char *argument) {
+    int has_arg = strlen(argument) > 0;
     
-    if (rc == SQLITE_DONE) {
-        printf("Removed: %s\n", path);
+    if (strcmp(command, "add") == 0 && has_arg) {
+        add_directory_sharded(argument);
+    }
+    else if (strcmp(command, "shards") == 0) {
+        list_shards();
+    }
+    else if (strcmp(command, "drop-shard") == 0) {
+        if (!has_arg) out("Usage: drop-shard <root>\n");
+        else drop_shard(argument);
+    }
+    else if (strcmp(command, "search") == 0 && has_arg) {
+        search_shards_simple(FS_MATCH_EXACT, argument, -1);
+        search_shards_simple(FS_MATCH_PREFIX, argument, -1);
+        search_shards_simple(FS_MATCH_SUBSTRING, argument, -1);
+        search_shards_simple(FS_MATCH_FUZZY, argument, -1);
+    }
+    else if (strcmp(command, "exact") == 0 && has_arg) {
+        search_shards_simple(FS_MATCH_EXACT, argument, -1);
+    }
+    else if (strcmp(command, "prefix") == 0 && has_arg) {
+        search_shards_simple(FS_MATCH_PREFIX, argument, -1);
+    }
+    else if (strcmp(command, "substring") == 0 && has_arg) {
+        search_shards_simple(FS_MATCH_SUBSTRING, argument, -1);
+    }
+    else if (strcmp(command, "fuzzy") == 0 && has_arg) {
+        char term[256];
+        int distance = -1;
+        if (sscanf(argument, "%255s %d", term, &distance) < 1) return 0;
+        search_shards_simple(FS_MATCH_FUZZY, term, distance);
+    }
+    else if (strcmp(command, "find") == 0 && has_arg) {
+        char category[256], tag[256], name[256];
+        parse_find_args(argument, category, tag, name, sizeof(category));
+        if (strlen(category) == 0 && strlen(tag) == 0 && strlen(name) == 0) return 0;
+        structured_search_shards(category, tag, name);
+    }
+    else if (strcmp(command, "tags") == 0 && !has_arg) {
+        for_each_shard(shard_list_all_tags, argument);
+    }
+    else if (strcmp(command, "categories") == 0 && !has_arg) {
+        for_each_shard(shard_list_all_categories, argument);
+    }
+    else if (strcmp(command, "stats") == 0 && !has_arg) {
+        for_each_shard(shard_show_stats, argument);
+    }
+    else if (strcmp(command, "tagsearch") == 0 && has_arg) {
+        for_each_shard(shard_search_tags, argument);
+    }
+    else if (strcmp(command, "create-category") == 0 && has_arg) {
+        for_each_shard(shard_create_category, argument);
+    }
+    else if (strcmp(command, "verify") == 0 && !has_arg) {
+        for_each_shard(shard_verify_paths, argument);
+    }
+    else {
+        shard_t *shard = find_shard_for_path(argument);
+        if (shard) {
+            db = shard->conn;
+        }
         return 0;
     }
-    return -1;
+    return 1;
 }
 
-int scan_directory_recursive(const char *dir_path, int *file_count, int *dir_count, int depth) {
-    if (depth > 100) {
-        fprintf(stderr, "Warning: Maximum depth reached at %s\n", dir_path);
-        return 0;
-    }
-    
-    DIR *dir = opendir(dir_path);
-    if (!dir) {
-        fprintf(stderr, "Cannot open directory: %s\n", dir_path);
-        return -1;
-    }
-    
-    struct dirent *entry;
-    char full_path[MAX_PATH_LENGTH];
-    struct stat st;
+/* ============================================
+ * Memory Accounting and Limits
+ * ============================================ */
+
+/*
+ * Limits come from settings and are applied at startup and whenever
+ * one of them is changed with 'set':
+ *   soft_heap_limit_kb  sqlite3_soft_heap_limit64 for the whole process
+ *                       (0 = no limit); SQLite frees cache pages to
+ *                       stay under it
+ *   cache_size_kb       page cache budget per connection (PRAGMA cache_size)
+ *   metrics_budget_kb   memory for per-command latency histograms; new
+ *                       command names beyond it are folded into "other"
+ */
+int is_memory_setting(const char *key) {
+    return strcmp(key, "soft_heap_limit_kb") == 0 || strcmp(key, "cache_size_kb") == 0 ||
+           strcmp(key, "metrics_budget_kb") == 0;
+}
+
+void apply_memory_limits() {
+    int soft_kb = get_int_setting("soft_heap_limit_kb", DEFAULT_SOFT_HEAP_LIMIT_KB);
+    sqlite3_soft_heap_limit64(soft_kb > 0 ? (sqlite3_int64)soft_kb * 1024 : 0);
     
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        snprintf(full_path, sizeof(full_path), "%s%s%s", 
-                 dir_path, PATH_SEPARATOR_STR, entry->d_name);
-        
-        if (stat(full_path, &st) != 0) {
-            fprintf(stderr, "Cannot stat: %s\n", full_path);
-            continue;
-        }
-        
-        int is_dir = S_ISDIR(st.st_mode);
-        long long size = is_dir ? -1 : (long long)st.st_size;
-        
-        add_path_to_db(full_path, entry->d_name, is_dir, size, dir_path);
-        
-        if (is_dir) {
-            (*dir_count)++;
-            scan_directory_recursive(full_path, file_count, dir_count, depth + 1);
-        } else {
-            (*file_count)++;
-        }
+    cache_budget_kb = get_int_setting("cache_size_kb", DEFAULT_CACHE_SIZE_KB);
+    if (cache_budget_kb < 64) cache_budget_kb = 64;
+    apply_cache_size(db);
+    for (int i = 0; i < shard_count; i++) {
+        apply_cache_size(shards[i].conn);
     }
     
-    closedir(dir);
-    return 0;
+    int metrics_kb = get_int_setting("metrics_budget_kb", DEFAULT_METRICS_BUDGET_KB);
+    metrics_budget_bytes = (long long)(metrics_kb > 0 ? metrics_kb : 1) * 1024;
 }
 
-void add_directory(const char *path) {
-    char normalized[MAX_PATH_LENGTH];
-    strncpy(normalized, path, sizeof(normalized) - 1);
-    normalized[sizeof(normalized) - 1] = '\0';
-    
-    size_t len = strlen(normalized);
-    while (len > 1 && (normalized[len-1] == '/' || normalized[len-1] == '\\')) {
-        normalized[--len] = '\0';
+void format_bytes(long long bytes, char *buffer, size_t size) {
+    if (bytes >= 1024LL * 1024 * 1024) snprintf(buffer, size, "%.2f GB", bytes / (1024.0 * 1024 * 1024));
+    else if (bytes >= 1024 * 1024)     snprintf(buffer, size, "%.2f MB", bytes / (1024.0 * 1024));
+    else if (bytes >= 1024)            snprintf(buffer, size, "%.1f KB", bytes / 1024.0);
+    else                               snprintf(buffer, size, "%lld B", bytes);
+}
+
+void print_memory_line(const char *label, long long bytes) {
+    char formatted[32];
+    format_bytes(bytes, formatted, sizeof(formatted));
+    out("  %-24s %s\n", label, formatted);
+}
+
+void print_sqlite_status(const char *label, int op) {
+    sqlite3_int64 current = 0, highwater = 0;
+    sqlite3_status64(op, &current, &highwater, 0);
+    char cur[32], high[32];
+    format_bytes(current, cur, sizeof(cur));
+    format_bytes(highwater, high, sizeof(high));
+    out("  %-24s %s (high water %s)\n", label, cur, high);
+}
+
+void print_connection_memory(const char *label, sqlite3 *conn) {
+    if (!conn) return;
+    int cache = 0, schema = 0, stmts = 0, lookaside = 0, highwater = 0;
+    sqlite3_db_status(conn, SQLITE_DBSTATUS_CACHE_USED, &cache, &highwater, 0);
+    sqlite3_db_status(conn, SQLITE_DBSTATUS_SCHEMA_USED, &schema, &highwater, 0);
+    sqlite3_db_status(conn, SQLITE_DBSTATUS_STMT_USED, &stmts, &highwater, 0);
+    sqlite3_db_status(conn, SQLITE_DBSTATUS_LOOKASIDE_USED, &lookaside, &highwater, 0);
+    
+    char c[32], s[32], st[32];
+    format_bytes(cache, c, sizeof(c));
+    format_bytes(schema, s, sizeof(s));
+    format_bytes(stmts, st, sizeof(st));
+    out("  %-24s cache %s, schema %s, statements %s, lookaside slots %d\n", label, c, s, st, lookaside);
+}
+
+/* 'mem': SQLite's own accounting plus the in-process structures */
+void show_memory() {
+    out("\n[SQLite Memory]\n");
+    print_sqlite_status("Heap in use:", SQLITE_STATUS_MEMORY_USED);
+    print_sqlite_status("Page cache overflow:", SQLITE_STATUS_PAGECACHE_OVERFLOW);
+    print_sqlite_status("Largest allocation:", SQLITE_STATUS_MALLOC_SIZE);
+    sqlite3_int64 count = 0, highwater = 0;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_COUNT, &count, &highwater, 0);
+    out("  %-24s %lld\n", "Outstanding allocations:", (long long)count);
+    
+    sqlite3_int64 soft = sqlite3_soft_heap_limit64(-1);
+    if (soft > 0) print_memory_line("Soft heap limit:", soft);
+    else out("  %-24s none\n", "Soft heap limit:");
+    out("  %-24s %d KB per connection\n", "Page cache budget:", cache_budget_kb);
+    
+    out("\n[Connections]\n");
+    if (shard_mode) {
+        print_connection_memory("catalog", shard_catalog);
+        for (int i = 0; i < shard_count; i++) {
+            print_connection_memory(shards[i].root, shards[i].conn);
+        }
+    } else {
+        print_connection_memory(in_memory_mode ? "main (in-memory)" : read_only_mode ? "main (snapshot)" : "main", db);
     }
     
-    if (!directory_exists(normalized)) {
-        fprintf(stderr, "Error: '%s' is not a valid directory.\n", normalized);
-        return;
+    out("\n[In-Process]\n");
+    if (in_memory_mode && memory_db) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(memory_db, "SELECT page_count * page_size FROM pragma_page_count, pragma_page_size;",
+                               -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                print_memory_line("In-memory database:", sqlite3_column_int64(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+        }
     }
     
-    printf("Scanning directory: %s\n", normalized);
-    
-    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
-    
-    const char *name = get_filename_from_path(normalized);
-    add_path_to_db(normalized, name, 1, -1, NULL);
-    
-    int file_count = 0;
-    int dir_count = 1;
-    
-    scan_directory_recursive(normalized, &file_count, &dir_count, 0);
+    mutex_lock(&metrics_lock);
+    long long hist_bytes = (long long)(command_hist_count + SCAN_PHASE_COUNT) * (long long)sizeof(latency_hist_t);
+    int hist_count = command_hist_count;
+    mutex_unlock(&metrics_lock);
+    char used[32], budget[32];
+    format_bytes(hist_bytes, used, sizeof(used));
+    format_bytes(metrics_budget_bytes, budget, sizeof(budget));
+    out("  %-24s %s for %d commands + %d scan phases (budget %s)\n",
+        "Latency histograms:", used, hist_count, SCAN_PHASE_COUNT, budget);
     
-    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
-    
-    printf("Added %d files and %d directories.\n\n", file_count, dir_count);
+    if (hw_counters_enabled) {
+        print_memory_line("Hardware counter totals:", (long long)hw_bucket_count * (long long)sizeof(hw_bucket_t));
+    }
+    if (shard_mode) {
+        print_memory_line("Shard table:", (long long)shard_count * (long long)sizeof(shard_t));
+    }
+    out("\n");
 }
 
 /* ============================================
- * Category Operations
+ * Profiling
  * ============================================ */
 
-int get_category_id(const char *name) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id FROM categories WHERE name = ? COLLATE NOCASE;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+/*
+ * 'profile <command>' runs one command with a trace callback on the
+ * main connection. Every statement run is grouped by its SQL text; the
+ * sqlite3_stmt_status counters are read (and reset) each time a
+ * statement finishes, so statements stepped in a loop add up correctly.
+ * With --shards the catalog and every shard connection are traced; shard
+ * searches run on worker threads, so the callback takes profile_lock.
+ */
+typedef struct {
+    char *sql;
+    sqlite3 *conn;          /* the first connection that ran it, for its plan */
+    int runs;
+    long long ns;
+    long long vm_steps;
+    long long fullscan_steps;
+    long long sorts;
+    long long autoindexes;
+    long long rows_returned;
+    long long rows_examined;
+    long long started_ns;
+} profile_stmt_t;
+
+typedef struct {
+    profile_stmt_t *stmts;
+    int count;
+    int capacity;
+    sqlite3_stmt *last_stmt;
+    int last_index;
+} profile_t;
+
+profile_t profile_data;
+int profile_active = 0;
+fs_mutex_t profile_lock;
+sqlite3 *profile_conn = NULL;
+hw_sample_t profile_hw_start;
+long long profile_udf_start;
+
+int profile_find(profile_t *p, sqlite3_stmt *stmt) {
+    if (stmt == p->last_stmt && p->last_index < p->count) {
+        return p->last_index;
+    }
+    
+    const char *sql = sqlite3_sql(stmt);
+    if (!sql) sql = "";
+    for (int i = 0; i < p->count; i++) {
+        if (strcmp(p->stmts[i].sql, sql) == 0) {
+            p->last_stmt = stmt;
+            p->last_index = i;
+            return i;
+        }
     }
     
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
-    
-    int id = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        id = sqlite3_column_int(stmt, 0);
+    if (p->count == p->capacity) {
+        int capacity = p->capacity ? p->capacity * 2 : 16;
+        profile_stmt_t *grown = realloc(p->stmts, capacity * sizeof(profile_stmt_t));
+        if (!grown) return -1;
+        p->stmts = grown;
+        p->capacity = capacity;
     }
     
-    sqlite3_finalize(stmt);
-    return id;
+    profile_stmt_t *entry = &p->stmts[p->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->sql = strdup(sql);
+    if (!entry->sql) return -1;
+    entry->conn = sqlite3_db_handle(stmt);
+    p->last_stmt = stmt;
+    p->last_index = p->count;
+    return p->count++;
 }
 
-int create_category(const char *name) {
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO categories (name) VALUES (?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+/* Rows visited by all loops of the statement; needs SQLITE_ENABLE_STMT_SCANSTATUS */
+long long profile_rows_examined(sqlite3_stmt *stmt) {
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+    long long total = 0;
+    for (int loop = 0; ; loop++) {
+        sqlite3_int64 visited = 0;
+        if (sqlite3_stmt_scanstatus(stmt, loop, SQLITE_SCANSTAT_NVISIT, &visited) != 0) break;
+        total += visited;
+    }
+    sqlite3_stmt_scanstatus_reset(stmt);
+    return total;
+#else
+    (void)stmt;
+    return -1;
+#endif
+}
+
+int profile_trace_callback(unsigned type, void *ctx, void *p, void *x) {
+    profile_t *prof = ctx;
+    sqlite3_stmt *stmt = p;
+    mutex_lock(&profile_lock);
+    int i = profile_find(prof, stmt);
+    if (i < 0) {
+        mutex_unlock(&profile_lock);
+        return 0;
     }
+    profile_stmt_t *entry = &prof->stmts[i];
     
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    (void)x;
     
-    if (rc == SQLITE_DONE) {
-        printf("Created category: %s\n", name);
-        return (int)sqlite3_last_insert_rowid(db);
+    if (type == SQLITE_TRACE_STMT) {
+        /* SQLite's own profile time has millisecond resolution here */
+        if (!entry->started_ns) entry->started_ns = monotonic_ns();
     }
-    
-    fprintf(stderr, "Failed to create category (may already exist).\n");
-    return -1;
+    else if (type == SQLITE_TRACE_ROW) {
+        entry->rows_returned++;
+    }
+    else if (type == SQLITE_TRACE_PROFILE) {
+        entry->runs++;
+        if (entry->started_ns) entry->ns += monotonic_ns() - entry->started_ns;
+        entry->started_ns = 0;
+        /* The statement may be finalized next and its address reused */
+        prof->last_stmt = NULL;
+        entry->vm_steps += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+        entry->fullscan_steps += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        entry->sorts += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+        entry->autoindexes += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        long long examined = profile_rows_examined(stmt);
+        entry->rows_examined = (examined < 0) ? -1 : entry->rows_examined + examined;
+    }
+    mutex_unlock(&profile_lock);
+    return 0;
 }
 
-void list_all_categories() {
+/*
+ * The profiled command may point db at a shard, so the connections are
+ * named explicitly: the main (or catalog) connection, then each shard.
+ */
+void profile_begin() {
+    memset(&profile_data, 0, sizeof(profile_data));
+    mutex_init(&profile_lock);
+    profile_udf_start = levenshtein_udf_calls;
+    profile_active = 1;
+    hw_sample(&profile_hw_start);
+    
+    profile_conn = shard_mode ? shard_catalog : db;
+    unsigned mask = SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW;
+    sqlite3_trace_v2(profile_conn, mask, profile_trace_callback, &profile_data);
+    for (int i = 0; i < shard_count; i++) {
+        sqlite3_trace_v2(shards[i].conn, mask, profile_trace_callback, &profile_data);
+    }
+}
+
+/* Print EXPLAIN QUERY PLAN, on the connection that ran sql, as an indented tree */
+void profile_print_plan(sqlite3 *conn, const char *sql) {
+    char explain[MAX_INPUT_LENGTH * 8];
     sqlite3_stmt *stmt;
-    const char *sql = "SELECT name FROM categories ORDER BY name;";
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
+    if (strncmp(sql, "SELECT", 6) != 0 && strncmp(sql, "INSERT", 6) != 0 &&
+        strncmp(sql, "UPDATE", 6) != 0 && strncmp(sql, "DELETE", 6) != 0 &&
+        strncmp(sql, "WITH", 4) != 0) {
+        return;
+    }
+    snprintf(explain, sizeof(explain), "EXPLAIN QUERY PLAN %s", sql);
+    if (sqlite3_prepare_v2(conn, explain, -1, &stmt, NULL) != SQLITE_OK) {
         return;
     }
     
-    printf("\n[All Categories]\n");
+    /* Parent ids map to depths; plans are small */
+    int ids[64], depths[64], known = 0;
+    out("      QUERY PLAN\n");
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  %s\n", sqlite3_column_text(stmt, 0));
+        int id = sqlite3_column_int(stmt, 0);
+        int parent = sqlite3_column_int(stmt, 1);
+        int depth = 0;
+        for (int i = 0; i < known; i++) {
+            if (ids[i] == parent) depth = depths[i] + 1;
+        }
+        if (known < 64) {
+            ids[known] = id;
+            depths[known] = depth;
+            known++;
+        }
+        out("      %*s`--%s\n", depth * 3, "", sqlite3_column_text(stmt, 3));
     }
-    printf("\n");
-    
     sqlite3_finalize(stmt);
 }
 
-void list_path_categories(const char *path) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return;
-    }
-    
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT c.name FROM categories c "
-        "JOIN path_categories pc ON c.id = pc.category_id "
-        "WHERE pc.path_id = ? ORDER BY c.name;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+/* Print SQL on one line, collapsing runs of whitespace */
+void profile_print_sql(const char *sql) {
+    int space = 0, printed = 0;
+    out("      ");
+    for (const char *c = sql; *c && printed < 300; c++) {
+        if (isspace((unsigned char)*c)) {
+            space = 1;
+            continue;
+        }
+        if (space && printed) {
+            fputc(' ', command_stdout);
+            printed++;
+        }
+        space = 0;
+        fputc(*c, command_stdout);
+        printed++;
     }
-    
-    sqlite3_bind_int(stmt, 1, path_id);
-    
-    printf("\n[Categories for %s]\n", path);
-    int count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  %s\n", sqlite3_column_text(stmt, 0));
-        count++;
+    out("%s\n", *sql && printed >= 300 ? " ..." : "");
+}
+
+void profile_end(const char *command, long long wall_ns) {
+    hw_sample_t hw = {{0}};
+    hw_accumulate(&hw, &profile_hw_start);
+    metrics_install_trace(profile_conn);
+    for (int i = 0; i < shard_count; i++) {
+        sqlite3_trace_v2(shards[i].conn, 0, NULL, NULL);
+    }
+    mutex_destroy(&profile_lock);
+    profile_active = 0;
+    profile_t *p = &profile_data;
+    
+    long long db_ns = 0;
+    for (int i = 0; i < p->count; i++) {
+        db_ns += p->stmts[i].ns;
+    }
+    
+    out("\n[Profile: %s]\n", command);
+    out("  Wall time:          %.3f ms\n", wall_ns / 1e6);
+    out("  Statement time:     %.3f ms (%d distinct statements)\n", db_ns / 1e6, p->count);
+    out("  levenshtein calls:  %lld\n", levenshtein_udf_calls - profile_udf_start);
+    if (hw_counters_enabled) {
+        hw_print_sample("  ", &hw);
+    }
+    
+    for (int i = 0; i < p->count; i++) {
+        const profile_stmt_t *s = &p->stmts[i];
+        out("\n  #%d  runs %d, %.3f ms, VM steps %lld, full-scan steps %lld, sorts %lld, auto-indexes %lld\n",
+            i + 1, s->runs, s->ns / 1e6, s->vm_steps, s->fullscan_steps, s->sorts, s->autoindexes);
+        if (s->rows_examined >= 0) {
+            out("      rows examined %lld, returned %lld\n", s->rows_examined, s->rows_returned);
+        } else {
+            out("      rows returned %lld (rows examined needs SQLITE_ENABLE_STMT_SCANSTATUS)\n",
+                s->rows_returned);
+        }
+        profile_print_sql(s->sql);
+        
+        /* drop-shard may have closed the connection the statement ran on */
+        int open = s->conn == profile_conn;
+        for (int j = 0; j < shard_count && !open; j++) {
+            open = s->conn == shards[j].conn;
+        }
+        if (open) profile_print_plan(s->conn, s->sql);
     }
+    out("\n");
     
-    if (count == 0) {
-        printf("  (no categories)\n");
+    for (int i = 0; i < p->count; i++) {
+        free(p->stmts[i].sql);
     }
-    printf("\n");
-    
-    sqlite3_finalize(stmt);
+    free(p->stmts);
+    memset(p, 0, sizeof(*p));
 }
 
-int categorize_path(const char *path, const char *category_name) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
+/* ============================================
+ * Workload Capture and Replay
+ * ============================================ */
+
+/* Defined with the interactive CLI; replay runs logged commands through it */
+int execute_command(const char *line);
+
+/*
+ * --log-workload <file> appends every command line with its wall-clock
+ * time: "<unix_ms>\t<command line>". 'replay' reads the same format.
+ */
+FILE *workload_fp = NULL;
+fs_mutex_t workload_lock;
+int replay_running = 0;
+
+int workload_open(const char *path) {
+    workload_fp = fopen(path, "a");
+    if (!workload_fp) {
+        fprintf(stderr, "Cannot open workload log %s\n", path);
         return -1;
     }
-    
-    int category_id = get_category_id(category_name);
-    if (category_id < 0) {
-        fprintf(stderr, "Category not found: %s\n", category_name);
-        fprintf(stderr, "Use 'create-category %s' to create it first.\n", category_name);
-        return -1;
+    mutex_init(&workload_lock);
+    return 0;
+}
+
+void workload_close() {
+    if (workload_fp) {
+        fclose(workload_fp);
+        workload_fp = NULL;
     }
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT OR IGNORE INTO path_categories (path_id, category_id) VALUES (?, ?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+}
+
+void workload_log_command(const char *line) {
+    /* Replayed commands are not logged again */
+    if (!workload_fp || replay_running) {
+        return;
+    }
+    mutex_lock(&workload_lock);
+    fprintf(workload_fp, "%lld\t%s\n", wall_clock_ms(), line);
+    fflush(workload_fp);
+    mutex_unlock(&workload_lock);
+}
+
+typedef struct {
+    long long offset_ms;    /* since the first logged command */
+    char *line;
+    char name[32];
+} replay_entry_t;
+
+typedef struct {
+    replay_entry_t *entries;
+    int count;
+    double speed;           /* 0 = as fast as possible */
+    int clients;
+    long long start_ns;
+    fs_mutex_t lock;
+    latency_hist_t **hists; /* per command name */
+    int hist_count;
+    latency_hist_t all;
+    latency_hist_t lag;     /* how late commands started versus the schedule */
+    int failed_clients;
+    int declined;           /* confirmation prompts answered "no" */
+} replay_t;
+
+/* Commands that make no sense to replay */
+int replay_skips(const char *name) {
+    return strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0 || strcmp(name, "replay") == 0;
+}
+
+int load_workload(const char *path, replay_t *replay) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(command_stderr, "Cannot open workload log %s\n", path);
         return -1;
     }
     
-    sqlite3_bind_int(stmt, 1, path_id);
-    sqlite3_bind_int(stmt, 2, category_id);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    char line[MAX_INPUT_LENGTH + 32];
+    long long first_ms = -1;
+    int capacity = 0;
     
-    if (rc == SQLITE_DONE) {
-        printf("Categorized: %s [%s]\n", path, category_name);
-        return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char *tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = '\0';
+        char *command = tab + 1;
+        trim_whitespace(command);
+        
+        replay_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        sscanf(command, "%31s", entry.name);
+        str_to_lower(entry.name);
+        if (!command[0] || replay_skips(entry.name)) continue;
+        
+        long long ms = atoll(line);
+        if (first_ms < 0) first_ms = ms;
+        entry.offset_ms = ms - first_ms;
+        entry.line = strdup(command);
+        if (!entry.line) break;
+        
+        if (replay->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            replay_entry_t *grown = realloc(replay->entries, capacity * sizeof(replay_entry_t));
+            if (!grown) {
+                free(entry.line);
+                break;
+            }
+            replay->entries = grown;
+        }
+        replay->entries[replay->count++] = entry;
     }
-    return -1;
+    fclose(fp);
+    return 0;
 }
 
-int uncategorize_path(const char *path, const char *category_name) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return -1;
+void replay_record(replay_t *replay, const char *name, long long latency_ns, long long lag_ns) {
+    mutex_lock(&replay->lock);
+    latency_hist_t *h = NULL;
+    for (int i = 0; i < replay->hist_count; i++) {
+        if (strcmp(replay->hists[i]->name, name) == 0) {
+            h = replay->hists[i];
+            break;
+        }
     }
-    
-    int category_id = get_category_id(category_name);
-    if (category_id < 0) {
-        fprintf(stderr, "Category not found: %s\n", category_name);
-        return -1;
+    if (!h) {
+        latency_hist_t **grown = realloc(replay->hists, (replay->hist_count + 1) * sizeof(latency_hist_t *));
+        h = grown ? calloc(1, sizeof(latency_hist_t)) : NULL;
+        if (grown) replay->hists = grown;
+        if (h) {
+            strncpy(h->name, name, sizeof(h->name) - 1);
+            replay->hists[replay->hist_count++] = h;
+        }
     }
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "DELETE FROM path_categories WHERE path_id = ? AND category_id = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+    if (h) hist_record(h, latency_ns);
+    hist_record(&replay->all, latency_ns);
+    hist_record(&replay->lag, lag_ns);
+    mutex_unlock(&replay->lock);
+}
+
+/* Connection for one replay client, like the main one */
+sqlite3 *open_client_connection(const char *path) {
+    sqlite3 *conn;
+    if (sqlite3_open(path, &conn) != SQLITE_OK) {
+        sqlite3_close(conn);
+        return NULL;
+    }
+    sqlite3_busy_timeout(conn, 5000);
+    sqlite3_exec(conn, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
+    apply_cache_size(conn);
+    metrics_install_trace(conn);
+    return conn;
+}
+
+/*
+ * Client 'index' runs entries index, index + clients, ... Each command
+ * waits for its scheduled time (log offset / speed); if the client is
+ * still busy, it starts late and the delay is recorded as lag.
+ */
+void replay_client(int index, void *ctx) {
+    replay_t *replay = ctx;
+    sqlite3 *own = NULL;
+    
+    if (replay->clients > 1) {
+        own = open_client_connection(db_file_path);
+        if (!own) {
+            mutex_lock(&replay->lock);
+            replay->failed_clients++;
+            mutex_unlock(&replay->lock);
+            return;
+        }
+        db = own;
     }
     
-    sqlite3_bind_int(stmt, 1, path_id);
-    sqlite3_bind_int(stmt, 2, category_id);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    for (int i = index; i < replay->count; i += replay->clients) {
+        const replay_entry_t *entry = &replay->entries[i];
+        long long due = replay->start_ns;
+        if (replay->speed > 0) {
+            due += (long long)(entry->offset_ms * 1e6 / replay->speed);
+            long long wait = due - monotonic_ns();
+            if (wait > 1000000) sleep_ms((int)(wait / 1000000));
+        }
+        
+        long long start = monotonic_ns();
+        execute_command(entry->line);
+        long long end = monotonic_ns();
+        replay_record(replay, entry->name, end - start, replay->speed > 0 && start > due ? start - due : 0);
+    }
     
-    if (rc == SQLITE_DONE) {
-        printf("Uncategorized: %s [%s]\n", path, category_name);
-        return 0;
+    mutex_lock(&replay->lock);
+    replay->declined += confirmations_declined;
+    mutex_unlock(&replay->lock);
+    if (own) {
+        sqlite3_close(own);
     }
-    return -1;
 }
 
-/* ============================================
- * Tag Operations
- * ============================================ */
+void print_replay_row(const latency_hist_t *h) {
+    out("  %-18s %8lld %10.3f %10.3f %10.3f %10.3f %10.3f\n", h->name, h->count,
+        h->sum_ns / 1e6 / h->count, hist_percentile(h, 0.50) / 1e6, hist_percentile(h, 0.90) / 1e6,
+        hist_percentile(h, 0.99) / 1e6, h->max_ns / 1e6);
+}
 
-int get_tag_id(const char *name) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id FROM tags WHERE name = ? COLLATE NOCASE;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+void replay_workload(const char *path, double speed, int clients, int yes, const char *json_path) {
+    replay_t replay;
+    memset(&replay, 0, sizeof(replay));
+    replay.speed = speed;
+    replay.clients = clients < 1 ? 1 : clients;
+    strcpy(replay.all.name, "all");
+    strcpy(replay.lag.name, "start lag");
+    
+    if (replay.clients > 1 && (shard_mode || in_memory_mode || read_only_mode)) {
+        out("Note: several clients need a plain database file; replaying with 1 client.\n");
+        replay.clients = 1;
+    }
+    if (load_workload(path, &replay) != 0) {
+        return;
+    }
+    if (replay.count == 0) {
+        out("No commands to replay in %s\n", path);
+        free(replay.entries);
+        return;
     }
     
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    long long span = replay.entries[replay.count - 1].offset_ms;
+    out("Replaying %d commands (%.1f s of log) with %d client%s at %s...\n",
+        replay.count, span / 1000.0, replay.clients, replay.clients == 1 ? "" : "s",
+        speed > 0 ? "scaled speed" : "full speed");
+    if (speed > 0) out("  speed %.2fx, expected duration %.1f s\n", speed, span / 1000.0 / speed);
+    fflush(stdout);
     
-    int id = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        id = sqlite3_column_int(stmt, 0);
+    mutex_init(&replay.lock);
+    
+    /*
+     * Nobody can answer prompts in a replay: commands that ask (a tag
+     * close to an existing one, a migration) are declined unless --yes.
+     * Command output goes to the null device.
+     */
+    int saved_non_interactive = non_interactive, saved_assume_yes = assume_yes;
+    non_interactive = 1;
+    assume_yes = yes;
+    confirmations_declined = 0;
+    replay_running = 1;
+    suppress_stdout();
+    replay.start_ns = monotonic_ns();
+    if (replay.clients == 1) {
+        replay_client(0, &replay);
+    } else {
+        run_parallel(replay.clients, replay.clients, replay_client, &replay);
+    }
+    long long wall = monotonic_ns() - replay.start_ns;
+    restore_stdout();
+    replay_running = 0;
+    non_interactive = saved_non_interactive;
+    assume_yes = saved_assume_yes;
+    
+    if (replay.failed_clients) {
+        out("Warning: %d client(s) could not open %s\n", replay.failed_clients, db_file_path);
+    }
+    if (replay.declined) {
+        out("Note: %d confirmation prompt(s) were answered \"no\"; replay --yes accepts them.\n",
+            replay.declined);
+    }
+    out("\nReplayed %lld commands in %.2f s (%.1f commands/s)\n",
+        replay.all.count, wall / 1e9, replay.all.count / (wall / 1e9));
+    out("\n  %-18s %8s %10s %10s %10s %10s %10s\n", "command (ms)", "count", "mean", "p50", "p90", "p99", "max");
+    for (int i = 0; i < replay.hist_count; i++) {
+        print_replay_row(replay.hists[i]);
+    }
+    if (replay.all.count) print_replay_row(&replay.all);
+    if (speed > 0 && replay.lag.count) print_replay_row(&replay.lag);
+    out("\n");
+    
+    if (json_path && json_path[0]) {
+        FILE *fp = fopen(json_path, "w");
+        if (!fp) {
+            fprintf(command_stderr, "Cannot write %s\n", json_path);
+        } else {
+            fprintf(fp, "{\n  \"workload\": ");
+            write_json_string(fp, path, MAX_PATH_LENGTH);
+            fprintf(fp, ",\n  \"commands\": %lld,\n  \"clients\": %d,\n  \"speed\": %.2f,\n  \"wall_s\": %.3f,\n  \"latency\": {\n",
+                    replay.all.count, replay.clients, speed, wall / 1e9);
+            for (int i = 0; i < replay.hist_count; i++) {
+                write_hist_json(fp, replay.hists[i], 0);
+            }
+            write_hist_json(fp, &replay.all, speed <= 0);
+            if (speed > 0) write_hist_json(fp, &replay.lag, 1);
+            fprintf(fp, "  }\n}\n");
+            fclose(fp);
+            out("Results written to %s\n", json_path);
+        }
     }
     
-    sqlite3_finalize(stmt);
-    return id;
+    for (int i = 0; i < replay.count; i++) free(replay.entries[i].line);
+    for (int i = 0; i < replay.hist_count; i++) free(replay.hists[i]);
+    free(replay.entries);
+    free(replay.hists);
+    mutex_destroy(&replay.lock);
 }
 
-int create_tag(const char *name) {
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO tags (name) VALUES (?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
-    }
+void cmd_replay(const char *argument) {
+    char args[MAX_INPUT_LENGTH];
+    char file[MAX_PATH_LENGTH] = "", json_path[MAX_PATH_LENGTH] = "";
+    double speed = 1.0;
+    int clients = 1, yes = 0;
     
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    strncpy(args, argument, sizeof(args) - 1);
+    args[sizeof(args) - 1] = '\0';
     
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    char *token = strtok(args, " ");
+    while (token) {
+        if (strcmp(token, "--speed") == 0 && (token = strtok(NULL, " "))) {
+            speed = strcmp(token, "max") == 0 ? 0 : atof(token);
+        } else if (strcmp(token, "--clients") == 0 && (token = strtok(NULL, " "))) {
+            clients = atoi(token);
+        } else if (strcmp(token, "--json") == 0 && (token = strtok(NULL, " "))) {
+            strncpy(json_path, token, sizeof(json_path) - 1);
+        } else if (strcmp(token, "--yes") == 0) {
+            yes = 1;
+        } else if (!file[0]) {
+            strncpy(file, token, sizeof(file) - 1);
+        }
+        token = strtok(NULL, " ");
+    }
     
-    if (rc == SQLITE_DONE) {
-        return (int)sqlite3_last_insert_rowid(db);
+    if (!file[0] || speed < 0 || clients < 1) {
+        out("Usage: replay <log> [--speed N|max] [--clients C] [--yes] [--json file]\n");
+        return;
     }
-    return -1;
+    replay_workload(file, speed, clients, yes, json_path);
+}
+
+/* ============================================
+ * Interactive CLI
+ * ============================================ */
+
+void print_help() {
+    out("\n");
+    out("Path Commands:\n");
+    out("  add <directory>               - Add directory to database (recursive)\n");
+    out("  remove <path>                 - Remove path from database\n");
+    out("  verify [root]                 - Drop stored paths that no longer exist\n");
+    out("  info <path>                   - Show path details with tags and categories\n");
+    out("\n");
+    out("Search Commands:\n");
+    out("  search <term>                 - Search paths by name (all methods)\n");
+    out("  exact <term>                  - Exact match on path names\n");
+    out("  prefix <term>                 - Prefix match on path names\n");
+    out("  substring <term>              - Substring match on path names\n");
+    out("  fuzzy <term> [n]              - Fuzzy match with max distance n\n");
+    out("  find --category <cat> --tag <tag> --name <term>\n");
+    out("                                - Structured search with filters\n");
+    out("\n");
+    out("Tag Commands:\n");
+    out("  tag <path> <tagname>          - Add tag to path\n");
+    out("  untag <path> <tagname>        - Remove tag from path\n");
+    out("  tags [path]                   - List all tags, or tags on a path\n");
+    out("  tagsearch <term>              - Search existing tags\n");
+    out("\n");
+    out("Category Commands:\n");
+    out("  categorize <path> <category>  - Add category to path\n");
+    out("  uncategorize <path> <category>- Remove category from path\n");
+    out("  categories [path]             - List all categories, or categories on a path\n");
+    out("  create-category <name>        - Create new category\n");
+    out("\n");
+    out("Settings Commands:\n");
+    out("  set <key> <value>             - Modify a setting\n");
+    out("  get <key>                     - View a setting\n");
+    out("  settings                      - List all settings\n");
+    out("\n");
+    out("Utility Commands:\n");
+    out("  stats                         - Show database statistics\n");
+    out("  stats --perf                  - Show latency percentiles and counters\n");
+    out("  mem                           - Show SQLite and in-process memory use\n");
+    out("  maintenance [run <job>]       - Background job status, or run a job now (--serve)\n");
+    out("  metrics prometheus|json <file>\n");
+    out("                                - Write latency metrics for monitoring\n");
+    out("  profile <command...>          - Run a command and show per-statement SQLite counters\n");
+    out("  replay <log> [--speed N|max] [--clients C] [--yes] [--json file]\n");
+    out("                                - Re-run a --log-workload file, report latencies\n");
+    out("  changelog [on|off]            - Record changes for export-changes\n");
+    out("  export-changes <file> [gen]   - Export changes after generation gen\n");
+    out("  import-changes <file> [host]  - Merge a changeset as host:path rows\n");
+    out("  diff <dbA> <dbB>              - Paths added, removed and changed from A to B\n");
+    out("  diff --gen <from> [to]        - The same between change log generations\n");
+    out("  shards                        - List shards (with --shards)\n");
+    out("  drop-shard <root>             - Delete a root's shard (with --shards)\n");
+    out("  generate <count> [seed]       - Generate a synthetic corpus under %s\n", BENCH_ROOT);
+    out("  bench search [n] [json]       - Benchmark each search mode (n queries each)\n");
+    out("  bench scan <dir> [fanout] [depth] [files] [links] [json]\n");
+    out("                                - Benchmark add/refresh on a generated tree\n");
+    out("  bench kernels [rounds] [json] - Benchmark distance kernels by length and k\n");
+    out("  bench fuzz [n] [seed]         - Check distance kernels against reference DP\n");
+    out("  bench shared [queries]        - Compare separate and shared search scans\n");
+    out("  bench output [rows]           - Result formatting rate per output format\n");
+    out("  bench startup [runs] [command]\n");
+    out("                                - Time to first result for a -c launch\n");
+    out("  snapshot [file]               - Publish a read-only snapshot (default <db>%s)\n", SNAPSHOT_SUFFIX);
+    out("  export-index [file]           - Write a binary index for --index (default <db>%s)\n", INDEX_SUFFIX);
+    out("  help                          - Show this help\n");
+    out("  quit / exit                   - Exit the program\n");
+    out("\n");
 }
 
+/* Background jobs of --serve; defined with the query daemon */
+void cmd_maintenance(const char *argument);
+
+/* Nesting level of execute_command(); 'profile' runs its command nested */
+THREAD_LOCAL int command_depth = 0;
+
+/* Unknown commands seen; -c and --batch exit with status 2 if any */
+THREAD_LOCAL int unknown_commands = 0;
+
 /*
- * Find similar tags using both substring and Levenshtein matching.
- * Returns the number of similar tags found.
- * If found, populates similar_name and similar_distance with the closest match.
+ * Parse and run one CLI command line. Returns 1 when the command asks
+ * to quit, 0 otherwise.
  */
-int find_similar_tags(const char *new_tag, char *similar_name, size_t name_size, 
-                      int *similar_distance, int *is_substring) {
-    int threshold = get_int_setting("similarity_threshold", DEFAULT_SIMILARITY_THRESHOLD);
+int execute_command(const char *line) {
+    char input[MAX_INPUT_LENGTH];
+    char command[64];
+    char argument[MAX_INPUT_LENGTH];
+    int quit = 0;
     
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT name FROM tags;";
+    strncpy(input, line, sizeof(input) - 1);
+    input[sizeof(input) - 1] = '\0';
+    trim_whitespace(input);
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    if (strlen(input) == 0) {
         return 0;
     }
+    settings_cache_reset();
+    if (command_depth == 0) {
+        workload_log_command(input);
+    }
     
-    int found_count = 0;
-    int best_distance = threshold + 1;
-    similar_name[0] = '\0';
-    *is_substring = 0;
+    /* Parse command and argument */
+    command[0] = '\0';
+    argument[0] = '\0';
     
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *existing = (const char *)sqlite3_column_text(stmt, 0);
-        
-        /* Check substring match first */
-        if (is_substring_match(new_tag, existing)) {
-            if (found_count == 0 || *is_substring == 0) {
-                strncpy(similar_name, existing, name_size - 1);
-                similar_name[name_size - 1] = '\0';
-                *similar_distance = abs((int)strlen(new_tag) - (int)strlen(existing));
-                *is_substring = 1;
-                found_count++;
-            }
-            continue;
-        }
+    char *space = strchr(input, ' ');
+    if (space) {
+        size_t cmd_len = space - input;
+        if (cmd_len >= sizeof(command)) cmd_len = sizeof(command) - 1;
+        strncpy(command, input, cmd_len);
+        command[cmd_len] = '\0';
         
-        /* Check Levenshtein distance */
-        int dist = levenshtein(new_tag, existing);
-        if (dist > 0 && dist <= threshold && dist < best_distance) {
-            strncpy(similar_name, existing, name_size - 1);
-            similar_name[name_size - 1] = '\0';
-            *similar_distance = dist;
-            *is_substring = 0;
-            best_distance = dist;
-            found_count++;
-        }
+        strcpy(argument, space + 1);
+        trim_whitespace(argument);
+    } else {
+        strncpy(command, input, sizeof(command) - 1);
+        command[sizeof(command) - 1] = '\0';
     }
     
-    sqlite3_finalize(stmt);
-    return found_count;
-}
-
-/*
- * Get or create a tag, with similarity warning.
- * Returns tag ID on success, -1 on failure/cancellation.
- */
-int get_or_create_tag_with_check(const char *tag_name) {
-    /* Check if exact tag exists */
-    int tag_id = get_tag_id(tag_name);
-    if (tag_id >= 0) {
-        return tag_id;
-    }
+    /* Convert command to lowercase */
+    str_to_lower(command);
     
-    /* Check for similar existing tags */
-    char similar_name[MAX_TAG_LENGTH];
-    int similar_distance;
-    int is_substring;
+    /* Keep the persistence thread from copying mid-command */
+    int outermost = (command_depth++ == 0);
+    if (in_memory_mode && outermost) mutex_lock(&persist_lock);
     
-    if (find_similar_tags(tag_name, similar_name, sizeof(similar_name), 
-                          &similar_distance, &is_substring) > 0) {
-        if (is_substring) {
-            printf("Warning: Similar tag exists: '%s' (substring match)\n", similar_name);
+    hw_sample_t hw0;
+    int hw = outermost && hw_sample(&hw0) == 0;
+    long long traced = trace_clock();
+    long long started = monotonic_ns();
+    long long udf_start = levenshtein_udf_calls;
+    int known = 1;
+    if (outermost) memset(&command_counters, 0, sizeof(command_counters));
+    
+    /* In shard mode, searches fan out and path commands are routed */
+    int handled = 0;
+    if (shard_mode && strcmp(command, "quit") != 0 && strcmp(command, "exit") != 0) {
+        handled = execute_shard_command(command, argument);
+    }
+    
+    /* Execute command */
+    if (handled) {
+        /* Already executed across shards */
+    }
+    else if (read_only_mode && is_mutating_command(command, argument)) {
+        out("'%s' is not available on a read-only snapshot.\n", command);
+    }
+    else if (strcmp(command, "quit") == 0 || strcmp(command, "exit") == 0) {
+        if (!batch_mode) out("Goodbye!\n");
+        quit = 1;
+    }
+    else if (strcmp(command, "help") == 0) {
+        print_help();
+    }
+    else if (strcmp(command, "add") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: add <directory>\n");
         } else {
-            printf("Warning: Similar tag exists: '%s' (distance: %d)\n", 
-                   similar_name, similar_distance);
+            add_directory(argument);
         }
-        
-        char prompt[128];
-        snprintf(prompt, sizeof(prompt), "Create new tag '%s' anyway?", tag_name);
-        
-        if (!get_confirmation(prompt)) {
-            snprintf(prompt, sizeof(prompt), "Use '%s' instead?", similar_name);
+    }
+    else if (strcmp(command, "remove") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: remove <path>\n");
+        } else {
+            remove_path_from_db(argument);
+        }
+    }
+    else if (strcmp(command, "verify") == 0) {
+        verify_paths(argument);
+    }
+    else if (strcmp(command, "info") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: info <path>\n");
+        } else {
+            show_path_info(argument);
+        }
+    }
+    else if (strcmp(command, "search") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: search <term>\n");
+        } else {
+            search_paths_all(argument);
+        }
+    }
+    else if (strcmp(command, "exact") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: exact <term>\n");
+        } else {
+            search_paths_exact(argument);
+        }
+    }
+    else if (strcmp(command, "prefix") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: prefix <term>\n");
+        } else {
+            search_paths_prefix(argument);
+        }
+    }
+    else if (strcmp(command, "substring") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: substring <term>\n");
+        } else {
+            search_paths_substring(argument);
+        }
+    }
+    else if (strcmp(command, "fuzzy") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: fuzzy <term> [max_distance]\n");
+        } else {
+            char term[256];
+            int distance = -1;
             
-            if (get_confirmation(prompt)) {
-                return get_tag_id(similar_name);
+            if (sscanf(argument, "%255s %d", term, &distance) < 1) {
+                out("Usage: fuzzy <term> [max_distance]\n");
+            } else {
+                search_paths_fuzzy(term, distance);
+            }
+        }
+    }
+    else if (strcmp(command, "find") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: find --category <cat> --tag <tag> --name <term>\n");
+        } else {
+            char category[256], tag[256], name[256];
+            parse_find_args(argument, category, tag, name, sizeof(category));
+            
+            if (strlen(category) == 0 && strlen(tag) == 0 && strlen(name) == 0) {
+                out("Usage: find --category <cat> --tag <tag> --name <term>\n");
+                out("At least one filter is required.\n");
+            } else {
+                structured_search(category, tag, name);
             }
+        }
+    }
+    else if (strcmp(command, "tag") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: tag <path> <tagname>\n");
+        } else {
+            char path[MAX_PATH_LENGTH], tagname[MAX_TAG_LENGTH];
+            parse_two_args(argument, path, sizeof(path), tagname, sizeof(tagname));
             
-            printf("Cancelled.\n");
-            return -1;
+            if (strlen(path) == 0 || strlen(tagname) == 0) {
+                out("Usage: tag <path> <tagname>\n");
+            } else {
+                tag_path(path, tagname);
+            }
         }
     }
-    
-    /* Create new tag */
-    tag_id = create_tag(tag_name);
-    if (tag_id >= 0) {
-        printf("Created tag: %s\n", tag_name);
+    else if (strcmp(command, "untag") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: untag <path> <tagname>\n");
+        } else {
+            char path[MAX_PATH_LENGTH], tagname[MAX_TAG_LENGTH];
+            parse_two_args(argument, path, sizeof(path), tagname, sizeof(tagname));
+            
+            if (strlen(path) == 0 || strlen(tagname) == 0) {
+                out("Usage: untag <path> <tagname>\n");
+            } else {
+                untag_path(path, tagname);
+            }
+        }
     }
-    return tag_id;
-}
-
-int tag_path(const char *path, const char *tag_name) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return -1;
+    else if (strcmp(command, "tags") == 0) {
+        if (strlen(argument) == 0) {
+            list_all_tags();
+        } else {
+            list_path_tags(argument);
+        }
     }
-    
-    int tag_id = get_or_create_tag_with_check(tag_name);
-    if (tag_id < 0) {
-        return -1;
+    else if (strcmp(command, "tagsearch") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: tagsearch <term>\n");
+        } else {
+            search_tags_fuzzy(argument);
+        }
     }
-    
-    /* Check if already tagged */
-    sqlite3_stmt *check_stmt;
-    const char *check_sql = "SELECT 1 FROM path_tags WHERE path_id = ? AND tag_id = ?;";
-    
-    if (sqlite3_prepare_v2(db, check_sql, -1, &check_stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(check_stmt, 1, path_id);
-        sqlite3_bind_int(check_stmt, 2, tag_id);
-        
-        if (sqlite3_step(check_stmt) == SQLITE_ROW) {
-            sqlite3_finalize(check_stmt);
-            
-            /* Get actual tag name (in case user was redirected to similar tag) */
-            sqlite3_stmt *name_stmt;
-            const char *name_sql = "SELECT name FROM tags WHERE id = ?;";
-            char actual_name[MAX_TAG_LENGTH] = "";
+    else if (strcmp(command, "categorize") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: categorize <path> <category>\n");
+        } else {
+            char path[MAX_PATH_LENGTH], catname[256];
+            parse_two_args(argument, path, sizeof(path), catname, sizeof(catname));
             
-            if (sqlite3_prepare_v2(db, name_sql, -1, &name_stmt, NULL) == SQLITE_OK) {
-                sqlite3_bind_int(name_stmt, 1, tag_id);
-                if (sqlite3_step(name_stmt) == SQLITE_ROW) {
-                    strncpy(actual_name, (const char *)sqlite3_column_text(name_stmt, 0), 
-                            sizeof(actual_name) - 1);
-                }
-                sqlite3_finalize(name_stmt);
+            if (strlen(path) == 0 || strlen(catname) == 0) {
+                out("Usage: categorize <path> <category>\n");
+            } else {
+                categorize_path(path, catname);
             }
+        }
+    }
+    else if (strcmp(command, "uncategorize") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: uncategorize <path> <category>\n");
+        } else {
+            char path[MAX_PATH_LENGTH], catname[256];
+            parse_two_args(argument, path, sizeof(path), catname, sizeof(catname));
             
-            printf("Path already has tag '%s'.\n", actual_name);
-            return 0;
+            if (strlen(path) == 0 || strlen(catname) == 0) {
+                out("Usage: uncategorize <path> <category>\n");
+            } else {
+                uncategorize_path(path, catname);
+            }
         }
-        sqlite3_finalize(check_stmt);
     }
-    
-    /* Create association */
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO path_tags (path_id, tag_id) VALUES (?, ?);";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+    else if (strcmp(command, "categories") == 0) {
+        if (strlen(argument) == 0) {
+            list_all_categories();
+        } else {
+            list_path_categories(argument);
+        }
     }
-    
-    sqlite3_bind_int(stmt, 1, path_id);
-    sqlite3_bind_int(stmt, 2, tag_id);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    if (rc == SQLITE_DONE) {
-        /* Get actual tag name for display */
-        sqlite3_stmt *name_stmt;
-        const char *name_sql = "SELECT name FROM tags WHERE id = ?;";
-        char actual_name[MAX_TAG_LENGTH] = "";
-        
-        if (sqlite3_prepare_v2(db, name_sql, -1, &name_stmt, NULL) == SQLITE_OK) {
-            sqlite3_bind_int(name_stmt, 1, tag_id);
-            if (sqlite3_step(name_stmt) == SQLITE_ROW) {
-                strncpy(actual_name, (const char *)sqlite3_column_text(name_stmt, 0), 
-                        sizeof(actual_name) - 1);
+    else if (strcmp(command, "create-category") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: create-category <name>\n");
+        } else {
+            create_category(argument);
+        }
+    }
+    else if (strcmp(command, "set") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: set <key> <value>\n");
+        } else {
+            char key[64], value[256];
+            if (sscanf(argument, "%63s %255s", key, value) == 2) {
+                cmd_set_setting(key, value);
+                if (is_memory_setting(key)) {
+                    apply_memory_limits();
+                }
+            } else {
+                out("Usage: set <key> <value>\n");
             }
-            sqlite3_finalize(name_stmt);
         }
-        
-        printf("Tagged: %s [%s]\n", path, actual_name);
-        return 0;
     }
-    return -1;
-}
-
-int untag_path(const char *path, const char *tag_name) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return -1;
+    else if (strcmp(command, "get") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: get <key>\n");
+        } else {
+            cmd_get_setting(argument);
+        }
     }
-    
-    int tag_id = get_tag_id(tag_name);
-    if (tag_id < 0) {
-        fprintf(stderr, "Tag not found: %s\n", tag_name);
-        return -1;
+    else if (strcmp(command, "settings") == 0) {
+        show_all_settings();
     }
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "DELETE FROM path_tags WHERE path_id = ? AND tag_id = ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return -1;
+    else if (strcmp(command, "stats") == 0) {
+        if (strcmp(argument, "--perf") == 0) {
+            show_perf_stats();
+        } else {
+            show_stats();
+        }
     }
-    
-    sqlite3_bind_int(stmt, 1, path_id);
-    sqlite3_bind_int(stmt, 2, tag_id);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    if (rc == SQLITE_DONE) {
-        printf("Untagged: %s [%s]\n", path, tag_name);
-        return 0;
+    else if (strcmp(command, "mem") == 0) {
+        show_memory();
     }
-    return -1;
-}
-
-void list_all_tags() {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT name FROM tags ORDER BY name;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+    else if (strcmp(command, "metrics") == 0) {
+        cmd_metrics(argument);
     }
-    
-    printf("\n[All Tags]\n");
-    int count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  %s\n", sqlite3_column_text(stmt, 0));
-        count++;
+    else if (strcmp(command, "maintenance") == 0) {
+        cmd_maintenance(argument);
     }
-    
-    if (count == 0) {
-        printf("  (no tags)\n");
+    else if (strcmp(command, "export-index") == 0) {
+        char target[MAX_PATH_LENGTH];
+        if (strlen(argument) > 0) {
+            strncpy(target, argument, sizeof(target) - 1);
+            target[sizeof(target) - 1] = '\0';
+        } else if (snprintf(target, sizeof(target), "%s%s", db_file_path, INDEX_SUFFIX) >= (int)sizeof(target)) {
+            fprintf(command_stderr, "Index path too long: %s%s\n", db_file_path, INDEX_SUFFIX);
+            target[0] = '\0';
+        }
+        if (target[0]) {
+            long long stage = trace_clock();
+            export_index(target);
+            trace_event("index maintenance", "index", stage, target, -1);
+        }
     }
-    printf("\nTotal: %d tags\n", count);
-    
-    sqlite3_finalize(stmt);
-}
-
-void list_path_tags(const char *path) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return;
+    else if (strcmp(command, "changelog") == 0) {
+        cmd_changelog(argument);
+    }
+    else if (strcmp(command, "diff") == 0) {
+        cmd_diff(argument);
+    }
+    else if (strcmp(command, "export-changes") == 0) {
+        char file[MAX_PATH_LENGTH];
+        int since = 0;
+        if (sscanf(argument, "%4095s %d", file, &since) < 1) {
+            out("Usage: export-changes <file> [since_generation]\n");
+        } else {
+            export_changes(file, since);
+        }
+    }
+    else if (strcmp(command, "import-changes") == 0) {
+        char file[MAX_PATH_LENGTH], host[256] = "";
+        if (sscanf(argument, "%4095s %255s", file, host) < 1) {
+            out("Usage: import-changes <file> [host]\n");
+        } else {
+            import_changes(file, host);
+        }
+    }
+    else if (strcmp(command, "generate") == 0) {
+        long long count = 0;
+        unsigned long long seed = 1;
+        if (sscanf(argument, "%lld %llu", &count, &seed) < 1 || count <= 0) {
+            out("Usage: generate <count> [seed]\n");
+        } else {
+            generate_corpus(count, seed);
+        }
+    }
+    else if (strcmp(command, "bench") == 0) {
+        cmd_bench(argument);
     }
-    
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT t.name FROM tags t "
-        "JOIN path_tags pt ON t.id = pt.tag_id "
-        "WHERE pt.path_id = ? ORDER BY t.name;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+    else if (strcmp(command, "replay") == 0) {
+        cmd_replay(argument);
     }
-    
-    sqlite3_bind_int(stmt, 1, path_id);
-    
-    printf("\n[Tags for %s]\n", path);
-    int count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  %s\n", sqlite3_column_text(stmt, 0));
-        count++;
+    else if (strcmp(command, "profile") == 0) {
+        if (strlen(argument) == 0) {
+            out("Usage: profile <command...>\n");
+        } else if (profile_active) {
+            out("profile cannot be nested.\n");
+        } else {
+            profile_begin();
+            long long start = monotonic_ns();
+            quit = execute_command(argument);
+            profile_end(argument, monotonic_ns() - start);
+        }
+    }
+    else if (strcmp(command, "snapshot") == 0) {
+        char target[MAX_PATH_LENGTH];
+        if (strlen(argument) > 0) {
+            strncpy(target, argument, sizeof(target) - 1);
+            target[sizeof(target) - 1] = '\0';
+            create_snapshot(target);
+        } else if (get_snapshot_path(db_file_path, target, sizeof(target)) == 0) {
+            create_snapshot(target);
+        }
+    }
+    else {
+        fprintf(batch_mode ? command_stderr : command_stdout,
+                "Unknown command: '%s'. Type 'help' for available commands.\n", command);
+        known = 0;
+        unknown_commands++;
     }
     
-    if (count == 0) {
-        printf("  (no tags)\n");
+    /* Fold this command's path changes into the directory hashes */
+    if (outermost && !read_only_mode && is_mutating_command(command, argument)) {
+        update_dir_hashes();
     }
-    printf("\n");
     
-    sqlite3_finalize(stmt);
+    trace_event(command, "command", traced, argument, -1);
+    result_flush();
+    if (hw) hw_record(command, &hw0);
+    if (outermost && known) {
+        metrics_record_command(command, monotonic_ns() - started);
+        
+        int current = 0, highwater = 0;
+        command_counters.udf_calls = levenshtein_udf_calls - udf_start;
+        sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1);
+        command_counters.cache_hits = current;
+        sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1);
+        command_counters.cache_misses = current;
+        metrics_add_counters(&command_counters);
+    }
+    command_depth--;
+    if (in_memory_mode && outermost) mutex_unlock(&persist_lock);
+    if (shard_mode) db = shard_catalog;
+    return quit;
 }
 
-void search_tags_fuzzy(const char *query) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    int fuzzy_dist = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+void run_interactive_cli() {
+    char input[MAX_INPUT_LENGTH];
     
-    /* Exact match */
-    sqlite3_stmt *stmt;
-    const char *sql_exact = "SELECT name FROM tags WHERE name = ? COLLATE NOCASE;";
+    out("\nFileSearch v%d - Interactive CLI\n", 
+        get_int_setting("app_version", DEFAULT_APP_VERSION));
+    out("Type 'help' for available commands.\n\n");
     
-    if (sqlite3_prepare_v2(db, sql_exact, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+    while (1) {
+        out("> ");
+        fflush(stdout);
         
-        printf("\n[Exact Match - Tags]\n");
-        int found = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            printf("  %s\n", sqlite3_column_text(stmt, 0));
-            found++;
-        }
-        if (!found) {
-            printf("  (no exact match)\n");
+        if (!fgets(input, sizeof(input), stdin)) {
+            out("\n");
+            break;
         }
-        sqlite3_finalize(stmt);
-    }
-    
-    /* Substring match */
-    const char *sql_substr = "SELECT name FROM tags WHERE name LIKE '%' || ? || '%' COLLATE NOCASE LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql_substr, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 2, max_results);
         
-        printf("\n[Substring Match - Tags]\n");
-        int found = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            printf("  %s\n", sqlite3_column_text(stmt, 0));
-            found++;
-        }
-        if (!found) {
-            printf("  (no substring matches)\n");
+        if (execute_command(input)) {
+            break;
         }
-        sqlite3_finalize(stmt);
     }
-    
-    /* Fuzzy match */
-    const char *sql_fuzzy = 
-        "SELECT name, levenshtein(name, ?) as dist FROM tags "
-        "WHERE dist <= ? ORDER BY dist, name LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql_fuzzy, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 2, fuzzy_dist);
-        sqlite3_bind_int(stmt, 3, max_results);
-        
-        printf("\n[Fuzzy Match - Tags (distance <= %d)]\n", fuzzy_dist);
-        int found = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *name = (const char *)sqlite3_column_text(stmt, 0);
-            int dist = sqlite3_column_int(stmt, 1);
-            printf("  %s (distance: %d)\n", name, dist);
-            found++;
-        }
-        if (!found) {
-            printf("  (no fuzzy matches)\n");
-        }
-        sqlite3_finalize(stmt);
+}
+
+/*
+ * Non-interactive entry points (-c and --batch). Every command runs
+ * over the one open connection. With --batch and a machine-readable
+ * format each command's output ends with a marker, so a script can
+ * keep one process open and split the replies:
+ *   ndjson  {"end":true,"command":"<line>","results":N}
+ *   tsv     an empty line
+ *   nul     an empty record (a lone NUL)
+ * Output is flushed after every command.
+ */
+void print_end_marker(const char *line, long long results) {
+    result_flush();
+    switch (output_format) {
+    case OUTPUT_NDJSON:
+        out("{\"end\":true,\"command\":");
+        write_json_string(command_stdout, line, MAX_INPUT_LENGTH);
+        out(",\"results\":%lld}\n", results);
+        break;
+    case OUTPUT_TSV:
+        out("\n");
+        break;
+    case OUTPUT_NUL:
+        fputc('\0', command_stdout);
+        break;
+    case OUTPUT_TEXT:
+        break;
     }
+}
+
+int run_batch_command(const char *line, int end_marker) {
+    result_count = 0;
+    int quit = execute_command(line);
     
-    printf("\n");
+    if (end_marker) {
+        print_end_marker(line, result_count);
+    }
+    fflush(stdout);
+    return quit;
 }
 
 /* ============================================
- * Path Info
+ * Group Commit
  * ============================================ */
 
-void show_path_info(const char *path) {
-    int path_id = get_path_id(path);
-    if (path_id < 0) {
-        fprintf(stderr, "Path not found in database: %s\n", path);
-        return;
-    }
-    
-    sqlite3_stmt *stmt;
-    
-    /* Get basic path info */
-    const char *sql = "SELECT path, name, is_directory, size FROM paths WHERE id = ?;";
+/*
+ * In batch and serve modes tag, untag, categorize, uncategorize,
+ * create-category and remove share transactions instead of paying for
+ * a commit each. Replies are held until the COMMIT that covers them
+ * has returned; if it fails the whole group is rolled back and its
+ * commands report the failure instead.
+ *
+ * A group stays open for at most group_commit_ms milliseconds or
+ * group_commit_max commands. --batch closes it early when any other
+ * command comes next. In serve, the thread that opens a group runs the
+ * commands of every connection as they arrive; it closes the group
+ * early once each connected client has a command in it, since none
+ * can send another before its reply, so a lone writer does not wait.
+ * Commands arriving during the COMMIT form the next group.
+ */
+int group_commit_enabled = 0;
+int group_commit_ms = DEFAULT_GROUP_COMMIT_MS;
+int group_commit_max = DEFAULT_GROUP_COMMIT_MAX;
+
+/* Set when a group commit failed; --batch then exits with status 1 */
+int group_commit_failed = 0;
+
+typedef struct commit_request {
+    const char *line;
+    FILE *output;
+    output_format_t format;    /* the submitting connection's */
+    int quit;
+    int unknown;
+    long long results;
+    int failed;
+    int done;
+    struct commit_request *next;
+} commit_request_t;
+
+typedef struct {
+    fs_mutex_t lock;
+    fs_cond_t finished;
+    fs_cond_t arrived;
+    commit_request_t *head;
+    commit_request_t *tail;
+    int committing;
+    int clients;            /* serve connections open */
+} commit_queue_t;
+
+commit_queue_t commit_queue;
+
+int is_group_commit_command(const char *line) {
+    const char *commands[] = { "tag", "untag", "categorize", "uncategorize", "create-category", "remove" };
+    char command[64] = "";
+    sscanf(line, "%63s", command);
+    str_to_lower(command);
     
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return;
+    for (int i = 0; i < (int)(sizeof(commands) / sizeof(commands[0])); i++) {
+        if (strcmp(command, commands[i]) == 0) return 1;
     }
+    return 0;
+}
+
+void group_commit_init() {
+    group_commit_ms = get_int_setting("group_commit_ms", DEFAULT_GROUP_COMMIT_MS);
+    group_commit_max = get_int_setting("group_commit_max", DEFAULT_GROUP_COMMIT_MAX);
+    if (group_commit_ms < 0) group_commit_ms = 0;
+    if (group_commit_max < 1) group_commit_max = 1;
+    mutex_init(&commit_queue.lock);
+    cond_init(&commit_queue.finished);
+    cond_init(&commit_queue.arrived);
+    group_commit_enabled = 1;
+}
+
+/* COMMIT a group of 'count' commands; 0 once it is durable */
+int group_commit_end(int count) {
+    long long traced = trace_clock();
+    int rc = sqlite3_get_autocommit(db) ? SQLITE_ABORT : sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
     
-    sqlite3_bind_int(stmt, 1, path_id);
-    
-    printf("\n[Path Info]\n");
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error: commit of %d command%s failed: %s\n",
+                count, count == 1 ? "" : "s", sqlite3_errmsg(db));
+        if (!sqlite3_get_autocommit(db)) sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        group_commit_failed = 1;
+    }
+    
+    trace_event("group commit", "commit", traced, NULL, count);
+    mutex_lock(&metrics_lock);
+    metrics_counters.group_commits++;
+    metrics_counters.group_commit_commands += count;
+    mutex_unlock(&metrics_lock);
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+/*
+ * --batch: the open group. Replies are spooled to one temporary file
+ * and, in case the commit fails, the commands' end markers alone to
+ * another.
+ */
+typedef struct {
+    int count;
+    long long deadline_ns;
+    FILE *replies;
+    FILE *markers;
+} batch_group_t;
+
+batch_group_t batch_group;
+
+void copy_to_stdout(FILE *fp) {
+    char buffer[8192];
+    size_t n;
+    rewind(fp);
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        fwrite(buffer, 1, n, stdout);
+    }
+}
+
+void batch_group_close(batch_group_t *group) {
+    if (group->count == 0) return;
     
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *full_path = (const char *)sqlite3_column_text(stmt, 0);
-        const char *name = (const char *)sqlite3_column_text(stmt, 1);
-        int is_dir = sqlite3_column_int(stmt, 2);
-        
-        printf("  Path:        %s\n", full_path);
-        printf("  Name:        %s\n", name);
-        printf("  Type:        %s\n", is_dir ? "Directory" : "File");
-        
-        if (!is_dir && sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
-            long long size = sqlite3_column_int64(stmt, 3);
-            printf("  Size:        %lld bytes\n", size);
+    copy_to_stdout(group_commit_end(group->count) == 0 ? group->replies : group->markers);
+    fflush(stdout);
+    fclose(group->replies);
+    fclose(group->markers);
+    memset(group, 0, sizeof(*group));
+}
+
+/* Milliseconds until the open group must be committed; -1 if none is open */
+int batch_group_wait_ms(const batch_group_t *group) {
+    if (group->count == 0) return -1;
+    long long left = group->deadline_ns - monotonic_ns();
+    return left > 0 ? (int)((left + 999999) / 1000000) : 0;
+}
+
+int batch_group_add(batch_group_t *group, const char *line, int end_marker) {
+    if (group->count == 0) {
+        group->replies = tmpfile();
+        group->markers = tmpfile();
+        if (!group->replies || !group->markers ||
+            sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
+            if (group->replies) fclose(group->replies);
+            if (group->markers) fclose(group->markers);
+            memset(group, 0, sizeof(*group));
+            return run_batch_command(line, end_marker);
         }
+        group->deadline_ns = monotonic_ns() + (long long)group_commit_ms * 1000000;
     }
-    sqlite3_finalize(stmt);
     
-    /* Get categories */
-    const char *cat_sql = 
-        "SELECT c.name FROM categories c "
-        "JOIN path_categories pc ON c.id = pc.category_id "
-        "WHERE pc.path_id = ? ORDER BY c.name;";
+    command_output = group->replies;
+    int quit = run_batch_command(line, end_marker);
+    command_output = group->markers;
+    if (end_marker) print_end_marker(line, 0);
+    command_output = NULL;
+    group->count++;
     
-    if (sqlite3_prepare_v2(db, cat_sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, path_id);
+    if (quit || group->count >= group_commit_max || monotonic_ns() >= group->deadline_ns) {
+        batch_group_close(group);
+    }
+    return quit;
+}
+
+/* serve: a client connected (+1) or went away (-1) */
+void group_commit_client(int delta) {
+    if (!group_commit_enabled) return;
+    mutex_lock(&commit_queue.lock);
+    commit_queue.clients += delta;
+    cond_broadcast(&commit_queue.arrived);
+    mutex_unlock(&commit_queue.lock);
+}
+
+/* Run one queued request in the open group; called with commit_queue.lock held, which it drops meanwhile */
+void group_commit_run_next(commit_request_t **last) {
+    commit_request_t *r = commit_queue.head;
+    commit_queue.head = r->next;
+    if (!commit_queue.head) commit_queue.tail = NULL;
+    r->next = NULL;
+    (*last)->next = r;
+    *last = r;
+    mutex_unlock(&commit_queue.lock);
+    
+    /* Each command prints as its own connection would */
+    int unknown_before = unknown_commands;
+    command_output = command_errors = r->output;
+    output_format = r->format;
+    result_count = 0;
+    r->quit = execute_command(r->line);
+    r->results = result_count;
+    r->unknown = unknown_commands != unknown_before;
+    
+    mutex_lock(&commit_queue.lock);
+}
+
+/*
+ * serve: run a request in the next group. The first thread to find no
+ * group open opens one on its own connection and runs what is queued
+ * and what arrives until the group is closed.
+ */
+void group_commit_submit(commit_request_t *request) {
+    request->format = output_format;
+    mutex_lock(&commit_queue.lock);
+    request->next = NULL;
+    if (commit_queue.tail) commit_queue.tail->next = request;
+    else commit_queue.head = request;
+    commit_queue.tail = request;
+    cond_broadcast(&commit_queue.arrived);
+    
+    while (!request->done) {
+        if (commit_queue.committing || !commit_queue.head) {
+            cond_wait(&commit_queue.finished, &commit_queue.lock);
+            continue;
+        }
+        commit_queue.committing = 1;
+        mutex_unlock(&commit_queue.lock);
         
-        char categories[512] = "";
-        int first = 1;
+        FILE *saved_output = command_output, *saved_errors = command_errors;
+        output_format_t saved_format = output_format;
+        long long deadline = monotonic_ns() + (long long)group_commit_ms * 1000000;
+        int in_transaction = sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+        commit_request_t first = { 0 };
+        commit_request_t *last = &first;
+        int count = 0;
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *cat = (const char *)sqlite3_column_text(stmt, 0);
-            if (!first) {
-                strncat(categories, ", ", sizeof(categories) - strlen(categories) - 1);
+        mutex_lock(&commit_queue.lock);
+        for (;;) {
+            while (commit_queue.head && count < group_commit_max && in_transaction) {
+                group_commit_run_next(&last);
+                count++;
             }
-            strncat(categories, cat, sizeof(categories) - strlen(categories) - 1);
-            first = 0;
+            long long left = deadline - monotonic_ns();
+            if (!in_transaction || count >= group_commit_max || count >= commit_queue.clients || left <= 0) break;
+            cond_wait_ms(&commit_queue.arrived, &commit_queue.lock, (int)((left + 999999) / 1000000));
         }
+        /* Without a transaction, run the one request so its thread is not left waiting */
+        if (count == 0) {
+            group_commit_run_next(&last);
+            count++;
+        }
+        mutex_unlock(&commit_queue.lock);
         
-        printf("  Categories:  %s\n", strlen(categories) > 0 ? categories : "(none)");
-        sqlite3_finalize(stmt);
+        command_output = saved_output;
+        command_errors = saved_errors;
+        output_format = saved_format;
+        int failed = in_transaction && group_commit_end(count) != 0;
+        
+        mutex_lock(&commit_queue.lock);
+        for (commit_request_t *r = first.next; r; ) {
+            commit_request_t *next = r->next;
+            r->failed = failed;
+            r->done = 1;
+            r = next;
+        }
+        commit_queue.committing = 0;
+        cond_broadcast(&commit_queue.finished);
     }
+    mutex_unlock(&commit_queue.lock);
+}
+
+/*
+ * Buffered line reader for --batch, so the reader can tell whether a
+ * complete line is already waiting without blocking on a pipe.
+ */
+typedef struct {
+    int fd;
+    char buffer[65536];
+    size_t start;
+    size_t end;
+    int eof;
+    int skipping;    /* dropping the rest of a line longer than the buffer */
+} line_reader_t;
+
+/* Wait up to timeout_ms (-1: forever) for input; 1 if some may be read */
+int reader_wait(line_reader_t *reader, int timeout_ms) {
+#ifdef _WIN32
+    (void)reader;
+    return timeout_ms != 0;
+#else
+    struct pollfd pfd;
+    pfd.fd = reader->fd;
+    pfd.events = POLLIN;
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    return ready != 0;
+#endif
+}
+
+/*
+ * Next line into 'line' (newline removed, long lines cut). Returns 1
+ * for a line, 0 at end of input, -1 if none arrived within timeout_ms.
+ */
+int read_line_timeout(line_reader_t *reader, char *line, size_t size, int timeout_ms) {
+    while (1) {
+        char *newline = memchr(reader->buffer + reader->start, '\n', reader->end - reader->start);
+        if (reader->skipping) {
+            reader->start = newline ? (size_t)(newline - reader->buffer) + 1 : reader->end;
+            reader->skipping = !newline;
+            if (newline) continue;
+        }
+        else if (newline || (reader->eof && reader->end > reader->start) ||
+                 (reader->start == 0 && reader->end == sizeof(reader->buffer))) {
+            size_t length = newline ? (size_t)(newline - (reader->buffer + reader->start))
+                                    : reader->end - reader->start;
+            size_t copy = length < size - 1 ? length : size - 1;
+            memcpy(line, reader->buffer + reader->start, copy);
+            line[copy] = '\0';
+            reader->start += length + (newline ? 1 : 0);
+            reader->skipping = !newline && !reader->eof;
+            return 1;
+        }
+        if (reader->eof) return 0;
+        
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        
+        if (!reader_wait(reader, timeout_ms)) return -1;
+        long n = (long)read(reader->fd, reader->buffer + reader->end, sizeof(reader->buffer) - reader->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) reader->eof = 1;
+        else reader->end += n;
+    }
+}
+
+/*
+ * Run lines in order. Mutations join the open group commit; other
+ * commands close it first. Consecutive searches are answered by one
+ * shared pass prefetched before they run. Returns 1 if a line quit.
+ */
+int run_batch_lines(const char **lines, int count, int end_marker) {
+    shared_query_t scratch[2];
     
-    /* Get tags */
-    const char *tag_sql = 
-        "SELECT t.name FROM tags t "
-        "JOIN path_tags pt ON t.id = pt.tag_id "
-        "WHERE pt.path_id = ? ORDER BY t.name;";
-    
-    if (sqlite3_prepare_v2(db, tag_sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, path_id);
+    for (int i = 0; i < count; ) {
+        if (group_commit_enabled && is_group_commit_command(lines[i])) {
+            if (batch_group_add(&batch_group, lines[i], end_marker)) return 1;
+            i++;
+            continue;
+        }
+        batch_group_close(&batch_group);
         
-        char tags[512] = "";
-        int first = 1;
+        int end = i;
+        while (end < count && end - i < SHARED_SCAN_MAX_BATCH &&
+               shared_queries_for_line(lines[end], scratch) > 0) {
+            end++;
+        }
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *tag = (const char *)sqlite3_column_text(stmt, 0);
-            if (!first) {
-                strncat(tags, ", ", sizeof(tags) - strlen(tags) - 1);
+        if (end - i > 1) {
+            shared_prefetch(lines + i, end - i);
+            for (; i < end; i++) {
+                run_batch_command(lines[i], end_marker);
             }
-            strncat(tags, tag, sizeof(tags) - strlen(tags) - 1);
-            first = 0;
+            shared_prefetch_clear();
+            continue;
         }
-        
-        printf("  Tags:        %s\n", strlen(tags) > 0 ? tags : "(none)");
-        sqlite3_finalize(stmt);
+        if (run_batch_command(lines[i], end_marker)) return 1;
+        i++;
+    }
+    return 0;
+}
+
+void run_batch(const char **commands, int count) {
+    if (count > 0) {
+        run_batch_lines(commands, count, 0);
+        batch_group_close(&batch_group);
+        return;
     }
     
-    printf("\n");
+    line_reader_t *reader = calloc(1, sizeof(line_reader_t));
+    char (*lines)[MAX_INPUT_LENGTH] = malloc(SHARED_SCAN_MAX_BATCH * sizeof(*lines));
+    const char *pointers[SHARED_SCAN_MAX_BATCH];
+    if (!reader || !lines) {
+        free(reader);
+        free(lines);
+        return;
+    }
+    reader->fd = fileno(stdin);
+    
+    /*
+     * Take every line already readable. While input keeps arriving
+     * faster than it is run, wait for more as long as the open group
+     * may stay open; a script that waits for each reply gets its
+     * commit at once.
+     */
+    int quit = 0;
+    int pipelined = 0;
+    while (!quit) {
+        int wait_ms = batch_group_wait_ms(&batch_group);
+        if (!pipelined && wait_ms > 0) wait_ms = 0;
+        int rc = read_line_timeout(reader, lines[0], MAX_INPUT_LENGTH, wait_ms);
+        if (rc < 0) {
+            batch_group_close(&batch_group);
+            continue;
+        }
+        if (rc == 0) break;
+        
+        int n = 0;
+        do {
+            trim_whitespace(lines[n]);
+            if (strlen(lines[n]) == 0 || lines[n][0] == '#') continue;
+            pointers[n] = lines[n];
+            n++;
+        } while (n < SHARED_SCAN_MAX_BATCH && read_line_timeout(reader, lines[n], MAX_INPUT_LENGTH, 0) == 1);
+        
+        pipelined = n > 1;
+        if (n > 0) quit = run_batch_lines(pointers, n, 1);
+    }
+    batch_group_close(&batch_group);
+    free(reader);
+    free(lines);
 }
 
 /* ============================================
- * Search Functions - Paths
+ * Background Maintenance (serve)
  * ============================================ */
 
-void print_path_result(sqlite3_stmt *stmt, int show_distance) {
-    const char *path = (const char *)sqlite3_column_text(stmt, 0);
-    int is_dir = sqlite3_column_int(stmt, 1);
+#ifndef _WIN32
+
+/*
+ * While --serve runs on a database file, a maintenance thread with its
+ * own connection does the periodic jobs that otherwise need a manual
+ * command or cron: refresh indexed directories, drop paths that no
+ * longer exist, ANALYZE/optimize, rebuilding an exported --index
+ * file and checkpointing the WAL of a database put in WAL mode. The scans keep their statistics per thread, so the thread's
+ * refreshes do not race the clients' own 'add' and 'bench scan'.
+ *
+ * It never competes with clients: a job step starts only after no
+ * command has run for maintenance_idle_ms, long jobs (the stale sweep,
+ * the refresh, the index rebuild) resume from a cursor in small steps
+ * that re-check for idle, and every step is charged to a token bucket
+ * of maintenance_budget entries (paths stat'ed, scanned or exported)
+ * per second. When several
+ * jobs are due, the one earlier in maintenance_jobs goes first. On
+ * Linux the thread also runs at the lowest CPU and idle I/O priority.
+ *
+ * Each job's maintenance_<job>_s setting is its interval in seconds (0
+ * turns it off); jobs first run one interval after startup, or right
+ * away with 'maintenance run <job>'.
+ */
+#define MAINTENANCE_TICK_MS 100
+#define MAINTENANCE_STALE_STEP 256
+#define MAINTENANCE_REFRESH_DIRS 64
+#define MAINTENANCE_INDEX_STEP 4096
+#define MAINTENANCE_ANALYSIS_LIMIT 1000
+
+typedef struct maintenance_job maintenance_job_t;
+
+/* Run one step: 1 when the job is finished for this round, 0 if more steps remain, -1 on failure */
+typedef int (*maintenance_step_fn)(maintenance_job_t *job, long long budget, long long *cost);
+
+/* Guarded by maintenance.lock, except the round fields (maintenance thread only) */
+typedef struct {
+    int interval_s;
+    int in_progress;
+    int run_now;
+    long long next_ns;
+    long long last_ns;
+    long long last_duration_ns;
+    long long last_cost;
+    int runs;
+    int failures;
+    char last_result[64];
+    sqlite3_int64 cursor;
+    long long round_start_ns;
+    long long round_cost;
+} maintenance_state_t;
+
+struct maintenance_job {
+    const char *name;
+    const char *setting;
+    int default_interval_s;
+    maintenance_step_fn step;
+    const char *description;
+    maintenance_state_t state;
+};
+
+typedef struct {
+    int running;
+    fs_thread_t thread;
+    fs_mutex_t lock;
+    int active_commands;
+    long long last_command_ns;
+    int idle_ms;
+    int budget;                     /* entries per second */
+    double tokens;
+    long long steps;
+    long long deferred;             /* ticks a due job waited for clients or budget */
+} maintenance_t;
+
+maintenance_t maintenance;
+
+/* Indexed roots that still exist, for the refresh and stale jobs */
+int maintenance_load_roots(string_list_t *roots) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT path FROM paths WHERE parent_path IS NULL AND is_directory = 1 ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *path = (const char *)sqlite3_column_text(stmt, 0);
+        if (directory_exists(path)) string_list_add(roots, path);
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int path_under_root(const char *path, const string_list_t *roots) {
+    for (uint32_t i = 0; i < roots->count; i++) {
+        size_t len = strlen(roots->items[i]);
+        if (strncmp(path, roots->items[i], len) == 0 &&
+            (path[len] == '\0' || path[len] == '/' || path[len] == '\\' || len == 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Walk paths in id order from job->state.cursor, a bounded batch per step,
+ * and delete those whose file is gone. Only paths under a root that
+ * still exists are candidates, so an unmounted disk (or the synthetic
+ * corpus) is never emptied.
+ */
+int maintenance_stale_step(maintenance_job_t *job, long long budget, long long *cost) {
+    string_list_t roots = {0};
+    if (maintenance_load_roots(&roots) != 0) {
+        string_list_free(&roots);
+        return -1;
+    }
     
-    if (is_dir) {
-        printf("  [DIR]  %s", path);
-    } else {
-        long long size = sqlite3_column_int64(stmt, 2);
-        printf("  [FILE] %s (%lld bytes)", path, size);
+    sqlite3_stmt *select, *delete;
+    if (sqlite3_prepare_v2(db, "SELECT id, path FROM paths WHERE id > ? ORDER BY id LIMIT ?;", -1, &select, NULL) != SQLITE_OK) {
+        string_list_free(&roots);
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, "DELETE FROM paths WHERE id = ?;", -1, &delete, NULL) != SQLITE_OK) {
+        sqlite3_finalize(select);
+        string_list_free(&roots);
+        return -1;
     }
+    sqlite3_stmt *queue = NULL;
+    sqlite3_prepare_v2(db, QUEUE_PATH_DELETE_SQL, -1, &queue, NULL);
     
-    if (show_distance) {
-        int dist = sqlite3_column_int(stmt, 3);
-        printf(" (distance: %d)", dist);
+    int limit = budget < MAINTENANCE_STALE_STEP ? (int)budget : MAINTENANCE_STALE_STEP;
+    sqlite3_bind_int64(select, 1, job->state.cursor);
+    sqlite3_bind_int(select, 2, limit);
+    
+    /* Collect first so no read statement is open while deleting */
+    sqlite3_int64 gone[MAINTENANCE_STALE_STEP];
+    int gone_count = 0, seen = 0;
+    struct stat st;
+    while (sqlite3_step(select) == SQLITE_ROW) {
+        job->state.cursor = sqlite3_column_int64(select, 0);
+        const char *path = (const char *)sqlite3_column_text(select, 1);
+        seen++;
+        if (!path_under_root(path, &roots)) continue;
+        (*cost)++;
+        if (stat(path, &st) != 0 && (errno == ENOENT || errno == ENOTDIR)) {
+            gone[gone_count++] = job->state.cursor;
+        }
+    }
+    sqlite3_finalize(select);
+    string_list_free(&roots);
+    
+    int failed = 0;
+    if (gone_count > 0) {
+        sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+        for (int i = 0; i < gone_count && !failed; i++) {
+            queue_path_delete(queue, gone[i]);
+            sqlite3_bind_int64(delete, 1, gone[i]);
+            failed = sqlite3_step(delete) != SQLITE_DONE;
+            sqlite3_reset(delete);
+        }
+        failed = sqlite3_exec(db, failed ? "ROLLBACK;" : "COMMIT;", NULL, NULL, NULL) != SQLITE_OK || failed;
+    }
+    sqlite3_finalize(delete);
+    sqlite3_finalize(queue);
+    if (failed) {
+        return -1;
     }
+    if (gone_count > 0) update_dir_hashes();
     
-    printf("\n");
+    job->state.round_cost += gone_count;     /* reported as paths removed */
+    if (seen < limit) {
+        snprintf(job->state.last_result, sizeof(job->state.last_result), "%lld removed", job->state.round_cost);
+        return 1;
+    }
+    return 0;
 }
 
-void search_paths_exact(const char *query) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT path, is_directory, size FROM paths "
-        "WHERE name = ? COLLATE NOCASE LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+/*
+ * Re-scan indexed directories in id order from job->state.cursor, one
+ * directory's entries at a time (not recursively), until the step's
+ * budget is spent. New and changed entries are written as 'add' writes
+ * them and the directory's hash is queued; subdirectories found this
+ * way get higher ids and are scanned later in the same round. Like
+ * 'add', a refresh leaves entries that are gone from disk to the stale
+ * job.
+ */
+int maintenance_refresh_step(maintenance_job_t *job, long long budget, long long *cost) {
+    string_list_t roots = {0}, dirs = {0};
+    if (maintenance_load_roots(&roots) != 0) {
+        string_list_free(&roots);
+        return -1;
     }
     
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, max_results);
+    sqlite3_stmt *select;
+    const char *sql = "SELECT id, path FROM paths WHERE id > ? AND is_directory = 1 ORDER BY id LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &select, NULL) != SQLITE_OK) {
+        string_list_free(&roots);
+        return -1;
+    }
+    sqlite3_bind_int64(select, 1, job->state.cursor);
+    sqlite3_bind_int(select, 2, MAINTENANCE_REFRESH_DIRS);
     
-    printf("\n[Exact Match - Paths]\n");
-    int found = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        print_path_result(stmt, 0);
-        found++;
+    /* Collect first so no read statement is open while writing */
+    sqlite3_int64 ids[MAINTENANCE_REFRESH_DIRS];
+    while (sqlite3_step(select) == SQLITE_ROW) {
+        ids[dirs.count] = sqlite3_column_int64(select, 0);
+        string_list_add(&dirs, (const char *)sqlite3_column_text(select, 1));
     }
+    sqlite3_finalize(select);
     
-    if (!found) {
-        printf("  (no exact matches)\n");
+    sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+    int failed = 0;
+    uint32_t i;
+    for (i = 0; i < dirs.count && !failed && *cost < budget; i++) {
+        const char *dir_path = dirs.items[i];
+        job->state.cursor = ids[i];
+        if (!path_under_root(dir_path, &roots) || !directory_exists(dir_path)) continue;
+        
+        scan_batch_t batch;
+        memset(&batch, 0, sizeof(batch));
+        if (scan_read_directory(dir_path, &batch) == 0) {
+            int inserted;
+            int changed = scan_insert_batch(&batch, dir_path, &inserted);
+            failed = changed < 0 || (changed > 0 && queue_dir_hash(dir_path) != 0);
+            if (changed > 0) job->state.round_cost++;     /* reported as directories changed */
+        }
+        *cost += batch.count + 1;
+        scan_batch_free(&batch);
     }
+    if (!failed) failed = update_dir_hashes() != 0;
+    failed = sqlite3_exec(db, failed ? "ROLLBACK;" : "COMMIT;", NULL, NULL, NULL) != SQLITE_OK || failed;
     
-    sqlite3_finalize(stmt);
+    int done = i == dirs.count && dirs.count < MAINTENANCE_REFRESH_DIRS;
+    string_list_free(&dirs);
+    string_list_free(&roots);
+    if (failed) {
+        return -1;
+    }
+    if (done) {
+        snprintf(job->state.last_result, sizeof(job->state.last_result), "%lld changed", job->state.round_cost);
+    }
+    return done;
 }
 
-void search_paths_prefix(const char *query) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT path, is_directory, size FROM paths "
-        "WHERE name LIKE ? || '%' COLLATE NOCASE LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+int maintenance_optimize_step(maintenance_job_t *job, long long budget, long long *cost) {
+    (void)budget;
+    char sql[96];
+    snprintf(sql, sizeof(sql), "PRAGMA analysis_limit = %d; PRAGMA optimize = 0x10002;", MAINTENANCE_ANALYSIS_LIMIT);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    *cost += MAINTENANCE_ANALYSIS_LIMIT;
+    snprintf(job->state.last_result, sizeof(job->state.last_result), "ok");
+    return 1;
+}
+
+/* The index job's rebuild in progress, read over several steps */
+index_build_t maintenance_index_build;
+time_t maintenance_index_started;
+time_t maintenance_index_db_mtime;
+
+/*
+ * Re-export <db>.fsidx when it exists and the database was written
+ * since. Rows are read in id order, MAINTENANCE_INDEX_STEP at a time,
+ * and the file is written in a last step. Rows that change between
+ * steps can be missed, so if the database was written during the
+ * rebuild the file keeps the start time as its mtime and the next
+ * round rebuilds it again.
+ */
+int maintenance_index_step(maintenance_job_t *job, long long budget, long long *cost) {
+    index_build_t *build = &maintenance_index_build;
+    char target[MAX_PATH_LENGTH];
+    if (snprintf(target, sizeof(target), "%s%s", db_file_path, INDEX_SUFFIX) >= (int)sizeof(target)) {
+        snprintf(job->state.last_result, sizeof(job->state.last_result), "path too long");
+        return 1;
     }
     
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, max_results);
-    
-    printf("\n[Prefix Match - Paths]\n");
-    int found = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        print_path_result(stmt, 0);
-        found++;
+    /* cursor counts steps; the first decides whether to rebuild */
+    struct stat index_st, db_st;
+    if (job->state.cursor++ == 0) {
+        index_build_free(build);
+        if (stat(target, &index_st) != 0) {
+            snprintf(job->state.last_result, sizeof(job->state.last_result), "no index file");
+            return 1;
+        }
+        if (stat(db_file_path, &db_st) != 0) {
+            return -1;
+        }
+        if (db_st.st_mtime < index_st.st_mtime) {
+            snprintf(job->state.last_result, sizeof(job->state.last_result), "up to date");
+            return 1;
+        }
+        maintenance_index_started = time(NULL);
+        maintenance_index_db_mtime = db_st.st_mtime;
     }
     
-    if (!found) {
-        printf("  (no prefix matches)\n");
+    if (!build->complete) {
+        long long limit = budget < MAINTENANCE_INDEX_STEP ? budget : MAINTENANCE_INDEX_STEP;
+        long long rows = index_build_read(build, limit);
+        if (rows < 0) {
+            index_build_free(build);
+            return -1;
+        }
+        *cost += rows;
+        job->state.round_cost += rows;
+        return 0;
     }
     
-    sqlite3_finalize(stmt);
+    int failed = index_build_write(build, target) != 0;
+    *cost += (long long)(build->count / 64);
+    index_build_free(build);
+    if (failed) {
+        return -1;
+    }
+    if (stat(db_file_path, &db_st) == 0 && db_st.st_mtime != maintenance_index_db_mtime) {
+        struct utimbuf times;
+        times.actime = times.modtime = maintenance_index_started;
+        utime(target, &times);
+    }
+    snprintf(job->state.last_result, sizeof(job->state.last_result), "%lld entries", job->state.round_cost);
+    return 1;
 }
 
-void search_paths_substring(const char *query) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT path, is_directory, size FROM paths "
-        "WHERE name LIKE '%' || ? || '%' COLLATE NOCASE LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+/*
+ * A passive checkpoint copies what it can of the WAL into the database
+ * without waiting for readers or blocking writers, so the WAL of a
+ * database someone put in WAL mode does not grow between SQLite's own
+ * automatic checkpoints. Databases in rollback mode have nothing to do.
+ */
+int maintenance_checkpoint_step(maintenance_job_t *job, long long budget, long long *cost) {
+    (void)budget;
+    int log_frames = 0, checkpointed = 0;
+    if (sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE, &log_frames, &checkpointed) != SQLITE_OK) {
+        return -1;
     }
-    
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, max_results);
-    
-    printf("\n[Substring Match - Paths]\n");
-    int found = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        print_path_result(stmt, 0);
-        found++;
+    if (log_frames < 0) {
+        snprintf(job->state.last_result, sizeof(job->state.last_result), "not in WAL mode");
+        return 1;
     }
-    
-    if (!found) {
-        printf("  (no substring matches)\n");
+    *cost += checkpointed;
+    snprintf(job->state.last_result, sizeof(job->state.last_result), "%d of %d frames", checkpointed, log_frames);
+    return 1;
+}
+
+/* In priority order */
+maintenance_job_t maintenance_jobs[] = {
+    { "stale", "maintenance_stale_s", DEFAULT_MAINTENANCE_STALE_S,
+      maintenance_stale_step, "Remove paths that no longer exist", {0} },
+    { "optimize", "maintenance_optimize_s", DEFAULT_MAINTENANCE_OPTIMIZE_S,
+      maintenance_optimize_step, "ANALYZE and PRAGMA optimize", {0} },
+    { "refresh", "maintenance_refresh_s", DEFAULT_MAINTENANCE_REFRESH_S,
+      maintenance_refresh_step, "Re-scan indexed directories", {0} },
+    { "index", "maintenance_index_s", DEFAULT_MAINTENANCE_INDEX_S,
+      maintenance_index_step, "Rebuild the --index file if stale", {0} },
+    { "checkpoint", "maintenance_checkpoint_s", DEFAULT_MAINTENANCE_CHECKPOINT_S,
+      maintenance_checkpoint_step, "Passive WAL checkpoint", {0} },
+};
+#define MAINTENANCE_JOB_COUNT ((int)(sizeof(maintenance_jobs) / sizeof(maintenance_jobs[0])))
+
+/* Called by serve workers around each command */
+void maintenance_command_begin() {
+    if (!maintenance.running) return;
+    mutex_lock(&maintenance.lock);
+    maintenance.active_commands++;
+    mutex_unlock(&maintenance.lock);
+}
+
+void maintenance_command_end() {
+    if (!maintenance.running) return;
+    mutex_lock(&maintenance.lock);
+    maintenance.active_commands--;
+    maintenance.last_command_ns = monotonic_ns();
+    mutex_unlock(&maintenance.lock);
+}
+
+/* Caller holds maintenance.lock */
+int maintenance_idle(long long now) {
+    return maintenance.active_commands == 0 &&
+           now - maintenance.last_command_ns >= (long long)maintenance.idle_ms * 1000000;
+}
+
+void maintenance_lower_priority() {
+#ifdef __linux__
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+    /* IOPRIO_WHO_PROCESS (a thread id here), IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT */
+    syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+#endif
+#endif
+}
+
+/* Read intervals and limits; settings may change while the daemon runs */
+void maintenance_read_settings(long long now) {
+    settings_cache_reset();
+    int idle_ms = get_int_setting("maintenance_idle_ms", DEFAULT_MAINTENANCE_IDLE_MS);
+    int budget = get_int_setting("maintenance_budget", DEFAULT_MAINTENANCE_BUDGET);
+    int intervals[MAINTENANCE_JOB_COUNT];
+    for (int i = 0; i < MAINTENANCE_JOB_COUNT; i++) {
+        intervals[i] = get_int_setting(maintenance_jobs[i].setting, maintenance_jobs[i].default_interval_s);
+    }
+    
+    mutex_lock(&maintenance.lock);
+    maintenance.idle_ms = idle_ms < 0 ? 0 : idle_ms;
+    maintenance.budget = budget < 1 ? 1 : budget;
+    for (int i = 0; i < MAINTENANCE_JOB_COUNT; i++) {
+        maintenance_job_t *job = &maintenance_jobs[i];
+        if (intervals[i] != job->state.interval_s) {
+            job->state.interval_s = intervals[i];
+            job->state.next_ns = intervals[i] > 0 ? now + (long long)intervals[i] * 1000000000 : 0;
+        }
     }
-    
-    sqlite3_finalize(stmt);
+    mutex_unlock(&maintenance.lock);
 }
 
-void search_paths_fuzzy(const char *query, int max_distance) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    
-    if (max_distance < 0) {
-        max_distance = get_int_setting("fuzzy_default_distance", DEFAULT_FUZZY_DISTANCE);
+void *maintenance_thread_main(void *arg) {
+    (void)arg;
+    maintenance_lower_priority();
+    
+    db = open_client_connection(db_file_path);
+    FILE *null_output = fopen("/dev/null", "w");
+    if (!db || !null_output) {
+        fprintf(stderr, "Warning: maintenance disabled: cannot open %s\n", db ? "/dev/null" : db_file_path);
+        if (null_output) fclose(null_output);
+        sqlite3_close(db);
+        db = NULL;
+        return NULL;
+    }
+    /* The scan helpers print progress and per-file errors; a failed step reports through last_result */
+    command_output = command_errors = null_output;
+    
+    long long last_ns = monotonic_ns();
+    long long settings_ns = 0;
+    maintenance_job_t *current = NULL;
+    
+    while (maintenance.running) {
+        sleep_ms(MAINTENANCE_TICK_MS);
+        long long now = monotonic_ns();
+        if (now - settings_ns >= 1000000000LL) {
+            maintenance_read_settings(now);
+            settings_ns = now;
+        }
+        
+        mutex_lock(&maintenance.lock);
+        maintenance.tokens += maintenance.budget * ((now - last_ns) / 1e9);
+        if (maintenance.tokens > maintenance.budget) maintenance.tokens = maintenance.budget;
+        last_ns = now;
+        
+        /* A job in progress keeps its turn; otherwise take the first one due */
+        if (!current) {
+            for (int i = 0; i < MAINTENANCE_JOB_COUNT && !current; i++) {
+                maintenance_job_t *job = &maintenance_jobs[i];
+                if (job->state.run_now || (job->state.interval_s > 0 && now >= job->state.next_ns)) current = job;
+            }
+        }
+        int go = current && maintenance_idle(now) && maintenance.tokens >= 1;
+        if (current && !go) maintenance.deferred++;
+        if (go && !current->state.in_progress) {
+            current->state.in_progress = 1;
+            current->state.run_now = 0;
+            current->state.cursor = 0;
+            current->state.round_start_ns = now;
+            current->state.round_cost = 0;
+            current->state.last_result[0] = '\0';
+        }
+        long long budget = (long long)maintenance.tokens;
+        mutex_unlock(&maintenance.lock);
+        if (!go) continue;
+        
+        long long cost = 0;
+        long long stage = trace_clock();
+        int rc = current->step(current, budget, &cost);
+        trace_event(current->name, "maintenance", stage, db_file_path, cost);
+        result_flush();
+        
+        mutex_lock(&maintenance.lock);
+        maintenance.tokens -= cost;
+        maintenance.steps++;
+        if (rc != 0) {
+            long long end = monotonic_ns();
+            current->state.in_progress = 0;
+            current->state.runs++;
+            current->state.last_ns = end;
+            current->state.last_duration_ns = end - current->state.round_start_ns;
+            current->state.last_cost = current->state.round_cost;
+            if (rc < 0) {
+                current->state.failures++;
+                snprintf(current->state.last_result, sizeof(current->state.last_result), "failed: %.48s", sqlite3_errmsg(db));
+            }
+            current->state.next_ns = current->state.interval_s > 0 ? end + (long long)current->state.interval_s * 1000000000 : 0;
+            current = NULL;
+        }
+        mutex_unlock(&maintenance.lock);
     }
     
-    sqlite3_stmt *stmt;
-    const char *sql = 
-        "SELECT path, is_directory, size, levenshtein(name, ?) as dist "
-        "FROM paths WHERE dist <= ? ORDER BY dist, name LIMIT ?;";
-    
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
+    index_build_free(&maintenance_index_build);
+    command_output = command_errors = NULL;
+    fclose(null_output);
+    sqlite3_close(db);
+    db = NULL;
+    return NULL;
+}
+
+void start_maintenance() {
+    memset(&maintenance, 0, sizeof(maintenance));
+    mutex_init(&maintenance.lock);
+    maintenance.last_command_ns = monotonic_ns();
+    maintenance.running = 1;
+    if (thread_start(&maintenance.thread, maintenance_thread_main, NULL) != 0) {
+        fprintf(stderr, "Warning: Could not start the maintenance thread.\n");
+        maintenance.running = 0;
+        mutex_destroy(&maintenance.lock);
+    }
+}
+
+void stop_maintenance() {
+    if (!maintenance.running) {
         return;
     }
-    
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, max_distance);
-    sqlite3_bind_int(stmt, 3, max_results);
-    
-    printf("\n[Fuzzy Match - Paths (distance <= %d)]\n", max_distance);
-    int found = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        print_path_result(stmt, 1);
-        found++;
+    maintenance.running = 0;
+    thread_join(maintenance.thread);
+    mutex_destroy(&maintenance.lock);
+}
+
+void cmd_maintenance(const char *argument) {
+    if (!maintenance.running) {
+        out("Maintenance runs in --serve on a database file (not --in-memory, --snapshot or --shards).\n");
+        return;
     }
     
-    if (!found) {
-        printf("  (no fuzzy matches within distance %d)\n", max_distance);
+    char action[16] = "", name[32] = "";
+    sscanf(argument, "%15s %31s", action, name);
+    if (strcmp(action, "run") == 0) {
+        maintenance_job_t *job = NULL;
+        for (int i = 0; i < MAINTENANCE_JOB_COUNT; i++) {
+            if (strcmp(maintenance_jobs[i].name, name) == 0) job = &maintenance_jobs[i];
+        }
+        if (!job) {
+            out("Usage: maintenance run stale|optimize|refresh|index\n");
+            return;
+        }
+        mutex_lock(&maintenance.lock);
+        job->state.run_now = 1;
+        mutex_unlock(&maintenance.lock);
+        out("Queued '%s'; it runs once clients have been idle for %d ms.\n", job->name, maintenance.idle_ms);
+        return;
+    }
+    if (action[0]) {
+        out("Usage: maintenance [run <job>]\n");
+        return;
     }
     
-    sqlite3_finalize(stmt);
+    long long now = monotonic_ns();
+    mutex_lock(&maintenance.lock);
+    out("\n[Maintenance - idle after %d ms, budget %d entries/s]\n", maintenance.idle_ms, maintenance.budget);
+    out("  %-11s %9s %6s %10s %9s %9s  %s\n", "job", "every s", "runs", "last s ago", "last ms", "next s", "result");
+    for (int i = 0; i < MAINTENANCE_JOB_COUNT; i++) {
+        const maintenance_job_t *job = &maintenance_jobs[i];
+        char ago[16] = "-", next[16] = "off";
+        if (job->state.runs > 0) snprintf(ago, sizeof(ago), "%.0f", (now - job->state.last_ns) / 1e9);
+        if (job->state.in_progress) snprintf(next, sizeof(next), "running");
+        else if (job->state.run_now) snprintf(next, sizeof(next), "queued");
+        else if (job->state.interval_s > 0) snprintf(next, sizeof(next), "%.0f", job->state.next_ns > now ? (job->state.next_ns - now) / 1e9 : 0);
+        out("  %-11s %9d %6d %10s %9.1f %9s  %s%s\n", job->name, job->state.interval_s, job->state.runs, ago,
+            job->state.last_duration_ns / 1e6, next, job->state.last_result,
+            job->state.failures ? " (has failed)" : "");
+    }
+    out("  %lld steps run, %lld ticks deferred for clients or budget\n\n", maintenance.steps, maintenance.deferred);
+    mutex_unlock(&maintenance.lock);
 }
 
-void search_paths_all(const char *query) {
-    search_paths_exact(query);
-    search_paths_prefix(query);
-    search_paths_substring(query);
-    search_paths_fuzzy(query, -1);
+#else
+
+void cmd_maintenance(const char *argument) {
+    (void)argument;
+    out("Maintenance runs with --serve, which needs Unix domain sockets.\n");
 }
 
+#endif
+
 /* ============================================
- * Structured Search (find command)
+ * Query Daemon (serve)
  * ============================================ */
 
-void structured_search(const char *category, const char *tag, const char *name) {
-    int max_results = get_int_setting("max_results", DEFAULT_MAX_RESULTS);
-    
-    /* Build dynamic SQL based on provided filters */
-    char sql[2048];
-    int has_where = 0;
-    
-    strcpy(sql, "SELECT DISTINCT p.path, p.is_directory, p.size FROM paths p ");
-    
-    if (category && strlen(category) > 0) {
-        strcat(sql, "JOIN path_categories pc ON p.id = pc.path_id ");
-        strcat(sql, "JOIN categories c ON pc.category_id = c.id ");
+/*
+ * --serve <socket> keeps the database open and answers commands from
+ * clients over a Unix domain socket. Each of --workers threads has its
+ * own connection (one shared connection with --in-memory, --snapshot
+ * or --shards) and serves one client connection at a time; further
+ * clients wait in the listen backlog.
+ *
+ * Frames (integers are 32-bit big-endian):
+ *   request   length | command
+ *   response  length | status | results | output
+ * status is SERVE_OK, SERVE_UNKNOWN, SERVE_REJECTED or SERVE_FAILED (a
+ * group commit failed and the command was rolled back); results is the
+ * number of path results printed. 'format <fmt>' sets the output
+ * format for the rest of the connection, 'quit' closes it.
+ */
+#define SERVE_OK 0
+#define SERVE_UNKNOWN 1
+#define SERVE_REJECTED 2
+#define SERVE_FAILED 3
+#define SERVE_DEFAULT_WORKERS 4
+#define SERVE_POLL_MS 250
+
+#ifndef _WIN32
+
+volatile sig_atomic_t serve_stopping = 0;
+
+typedef struct {
+    int listen_fd;
+    sqlite3 *shared;    /* non-NULL: every worker uses this connection */
+    fs_mutex_t lock;
+    int failed_workers;
+} serve_t;
+
+/* Commands that touch process-wide state or stdout directly */
+int serve_rejects(const char *command) {
+    return strcmp(command, "replay") == 0 || strcmp(command, "bench") == 0 ||
+           strcmp(command, "profile") == 0;
+}
+
+void serve_handle_signal(int sig) {
+    (void)sig;
+    serve_stopping = 1;
+}
+
+void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+uint32_t get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int read_full(int fd, void *buffer, size_t size) {
+    char *p = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
     }
-    
-    if (tag && strlen(tag) > 0) {
-        strcat(sql, "JOIN path_tags pt ON p.id = pt.path_id ");
-        strcat(sql, "JOIN tags t ON pt.tag_id = t.id ");
+    return 0;
+}
+
+int write_full(int fd, const void *buffer, size_t size) {
+    const char *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
     }
-    
-    if (category && strlen(category) > 0) {
-        strcat(sql, has_where ? "AND " : "WHERE ");
-        strcat(sql, "c.name = ? COLLATE NOCASE ");
-        has_where = 1;
+    return 0;
+}
+
+int write_response(int fd, uint32_t status, uint32_t results, const char *output, size_t length) {
+    unsigned char header[12];
+    put_u32(header, (uint32_t)length);
+    put_u32(header + 4, status);
+    put_u32(header + 8, results);
+    if (write_full(fd, header, sizeof(header)) != 0) return -1;
+    return length > 0 ? write_full(fd, output, length) : 0;
+}
+
+/* Wait until fd is readable; -1 if the server is stopping */
+int serve_wait(int fd) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!serve_stopping) {
+        int ready = poll(&pfd, 1, SERVE_POLL_MS);
+        if (ready > 0) return 0;
+        if (ready < 0 && errno != EINTR) return -1;
     }
-    
-    if (tag && strlen(tag) > 0) {
-        strcat(sql, has_where ? "AND " : "WHERE ");
-        strcat(sql, "t.name = ? COLLATE NOCASE ");
-        has_where = 1;
+    return -1;
+}
+
+/* Run one command with its output captured; returns 1 to close the connection */
+int serve_command(int fd, const char *line) {
+    char command[64] = "";
+    sscanf(line, "%63s", command);
+    str_to_lower(command);
+    
+    if (strcmp(command, "format") == 0) {
+        char name[16] = "";
+        sscanf(line, "%*s %15s", name);
+        if (parse_output_format(name, &output_format) != 0) {
+            const char *message = "Usage: format text|ndjson|tsv|nul\n";
+            return write_response(fd, SERVE_REJECTED, 0, message, strlen(message)) != 0;
+        }
+        return write_response(fd, SERVE_OK, 0, NULL, 0) != 0;
     }
-    
-    if (name && strlen(name) > 0) {
-        strcat(sql, has_where ? "AND " : "WHERE ");
-        strcat(sql, "p.name LIKE '%' || ? || '%' COLLATE NOCASE ");
-        has_where = 1;
+    if (serve_rejects(command)) {
+        char message[128];
+        snprintf(message, sizeof(message), "'%s' is not available over serve.\n", command);
+        return write_response(fd, SERVE_REJECTED, 0, message, strlen(message)) != 0;
     }
     
-    strcat(sql, "ORDER BY p.path LIMIT ?;");
-    
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Query error: %s\n", sqlite3_errmsg(db));
-        return;
+    char *output = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&output, &length);
+    if (!stream) {
+        return 1;
     }
     
-    int param = 1;
-    if (category && strlen(category) > 0) {
-        sqlite3_bind_text(stmt, param++, category, -1, SQLITE_STATIC);
-    }
-    if (tag && strlen(tag) > 0) {
-        sqlite3_bind_text(stmt, param++, tag, -1, SQLITE_STATIC);
-    }
-    if (name && strlen(name) > 0) {
-        sqlite3_bind_text(stmt, param++, name, -1, SQLITE_STATIC);
+    int quit, unknown;
+    long long results;
+    if (group_commit_enabled && is_group_commit_command(line)) {
+        commit_request_t request;
+        memset(&request, 0, sizeof(request));
+        request.line = line;
+        request.output = stream;
+        group_commit_submit(&request);
+        quit = request.quit;
+        unknown = request.unknown;
+        results = request.results;
+        
+        if (request.failed) {
+            fclose(stream);
+            free(output);
+            const char *message = "Commit failed; the command was rolled back.\n";
+            return write_response(fd, SERVE_FAILED, 0, message, strlen(message)) != 0 || quit;
+        }
+    } else {
+        int unknown_before = unknown_commands;
+        command_output = command_errors = stream;
+        result_count = 0;
+        quit = execute_command(line);
+        command_output = command_errors = NULL;
+        unknown = unknown_commands != unknown_before;
+        results = result_count;
+    }
+    fclose(stream);
+    
+    uint32_t status = unknown ? SERVE_UNKNOWN : SERVE_OK;
+    int failed = write_response(fd, status, (uint32_t)results, output, length);
+    free(output);
+    return quit || failed;
+}
+
+void serve_connection(int fd) {
+    char line[MAX_INPUT_LENGTH];
+    unsigned char header[4];
+    
+    output_format = OUTPUT_TEXT;
+    while (serve_wait(fd) == 0) {
+        if (read_full(fd, header, sizeof(header)) != 0) break;
+        uint32_t length = get_u32(header);
+        if (length >= sizeof(line)) {
+            break;
+        }
+        if (read_full(fd, line, length) != 0) break;
+        line[length] = '\0';
+        
+        maintenance_command_begin();
+        int done = serve_command(fd, line);
+        maintenance_command_end();
+        if (done) break;
     }
-    sqlite3_bind_int(stmt, param, max_results);
+    close(fd);
+}
+
+void *serve_worker(void *arg) {
+    serve_t *serve = arg;
     
-    printf("\n[Search Results]\n");
-    int found = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        print_path_result(stmt, 0);
-        found++;
+    if (serve->shared) {
+        db = serve->shared;
+    } else {
+        db = open_client_connection(db_file_path);
+        if (!db) {
+            mutex_lock(&serve->lock);
+            serve->failed_workers++;
+            mutex_unlock(&serve->lock);
+            return NULL;
+        }
     }
     
-    if (!found) {
-        printf("  (no matches)\n");
+    while (serve_wait(serve->listen_fd) == 0) {
+        int fd = accept(serve->listen_fd, NULL, NULL);
+        if (fd < 0) continue;    /* another worker took it */
+        
+        /* Client sockets block; only the listening socket is non-blocking */
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        group_commit_client(1);
+        serve_connection(fd);
+        group_commit_client(-1);
     }
     
-    printf("\n");
-    sqlite3_finalize(stmt);
+    if (!serve->shared) {
+        sqlite3_close(db);
+    }
+    db = NULL;
+    return NULL;
 }
 
-/* ============================================
- * Statistics
- * ============================================ */
-
-void show_stats() {
-    sqlite3_stmt *stmt;
-    
-    printf("\n[Database Statistics]\n");
-    
-    /* Count paths */
-    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  Total paths:  %d\n", sqlite3_column_int(stmt, 0));
+int fill_socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: socket path is too long: %s\n", path);
+        return -1;
     }
-    sqlite3_finalize(stmt);
-    
-    /* Count directories */
-    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths WHERE is_directory = 1;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  Directories:  %d\n", sqlite3_column_int(stmt, 0));
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* Runs until SIGINT or SIGTERM */
+int run_server(const char *socket_path, int workers) {
+    struct sockaddr_un addr;
+    if (fill_socket_address(&addr, socket_path) != 0) {
+        return -1;
     }
-    sqlite3_finalize(stmt);
     
-    /* Count files */
-    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM paths WHERE is_directory = 0;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  Files:        %d\n", sqlite3_column_int(stmt, 0));
+    /* A socket file nobody answers on is left over from a previous run */
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "Error: a server is already listening on %s\n", socket_path);
+        close(probe);
+        return -1;
     }
-    sqlite3_finalize(stmt);
+    if (probe >= 0) close(probe);
+    unlink(socket_path);
     
-    /* Count tags */
-    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM tags;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        printf("  Tags:         %d\n", sqlite3_column_int(stmt, 0));
-    }
-    sqlite3_finalize(stmt);
+    serve_t serve;
+    memset(&serve, 0, sizeof(serve));
+    serve.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     
-    /* Count categories (total and in use) */
-    int total_cats = 0, used_cats = 0;
-    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM categories;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        total_cats = sqlite3_column_int(stmt, 0);
+    /* Owner-only from the moment the socket file exists */
+    mode_t saved_umask = umask(077);
+    int bound = serve.listen_fd >= 0 && bind(serve.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(saved_umask);
+    if (!bound || listen(serve.listen_fd, 64) != 0) {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (serve.listen_fd >= 0) close(serve.listen_fd);
+        return -1;
     }
-    sqlite3_finalize(stmt);
+    fcntl(serve.listen_fd, F_SETFL, fcntl(serve.listen_fd, F_GETFL) | O_NONBLOCK);
     
-    sqlite3_prepare_v2(db, "SELECT COUNT(DISTINCT category_id) FROM path_categories;", -1, &stmt, NULL);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        used_cats = sqlite3_column_int(stmt, 0);
+    if (in_memory_mode || read_only_mode || shard_mode) {
+        serve.shared = db;
+        workers = 1;
     }
-    sqlite3_finalize(stmt);
+    if (workers < 1) workers = 1;
+    mutex_init(&serve.lock);
+    
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, serve_handle_signal);
+    signal(SIGTERM, serve_handle_signal);
+    
+    fs_thread_t *threads = malloc(workers * sizeof(fs_thread_t));
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        if (thread_start(&threads[started], serve_worker, &serve) == 0) started++;
+    }
+    if (!serve.shared) {
+        start_maintenance();
+    }
+    fflush(stdout);
+    fprintf(stderr, "Serving %s on %s with %d worker%s\n",
+            db_file_path, socket_path, started, started == 1 ? "" : "s");
     
-    printf("  Categories:   %d (%d in use)\n", total_cats, used_cats);
+    for (int i = 0; i < started; i++) {
+        thread_join(threads[i]);
+    }
+    stop_maintenance();
+    if (serve.failed_workers > 0) {
+        fprintf(stderr, "%d worker%s could not open the database\n",
+                serve.failed_workers, serve.failed_workers == 1 ? "" : "s");
+    }
     
-    printf("\n");
+    free(threads);
+    mutex_destroy(&serve.lock);
+    close(serve.listen_fd);
+    unlink(socket_path);
+    return 0;
 }
 
-/* ============================================
- * CLI Parsing Helpers
- * ============================================ */
-
-/*
- * Parse arguments for 'find' command.
- * Format: find --category X --tag Y --name Z
- */
-void parse_find_args(const char *args, char *category, char *tag, char *name, size_t size) {
-    category[0] = '\0';
-    tag[0] = '\0';
-    name[0] = '\0';
-    
-    char args_copy[MAX_INPUT_LENGTH];
-    strncpy(args_copy, args, sizeof(args_copy) - 1);
-    args_copy[sizeof(args_copy) - 1] = '\0';
+/* Send one command and read the reply into *output; -1 if the connection failed */
+int client_request(int fd, const char *line, uint32_t *status, uint32_t *results,
+                   char **output, size_t *capacity, uint32_t *size) {
+    unsigned char header[12];
+    size_t length = strlen(line);
+    put_u32(header, (uint32_t)length);
+    if (write_full(fd, header, 4) != 0 || write_full(fd, line, length) != 0 ||
+        read_full(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
     
-    char *token = strtok(args_copy, " ");
-    while (token) {
-        if (strcmp(token, "--category") == 0 || strcmp(token, "-c") == 0) {
-            token = strtok(NULL, " ");
-            if (token) {
-                strncpy(category, token, size - 1);
-                category[size - 1] = '\0';
-            }
-        } else if (strcmp(token, "--tag") == 0 || strcmp(token, "-t") == 0) {
-            token = strtok(NULL, " ");
-            if (token) {
-                strncpy(tag, token, size - 1);
-                tag[size - 1] = '\0';
-            }
-        } else if (strcmp(token, "--name") == 0 || strcmp(token, "-n") == 0) {
-            token = strtok(NULL, " ");
-            if (token) {
-                strncpy(name, token, size - 1);
-                name[size - 1] = '\0';
-            }
-        }
-        token = strtok(NULL, " ");
+    *size = get_u32(header);
+    *status = get_u32(header + 4);
+    *results = get_u32(header + 8);
+    if (*size == UINT32_MAX) {
+        return -1;    /* no room for the terminator */
     }
+    if ((size_t)*size + 1 > *capacity) {
+        char *grown = realloc(*output, (size_t)*size + 1);
+        if (!grown) return -1;
+        *output = grown;
+        *capacity = (size_t)*size + 1;
+    }
+    return read_full(fd, *output, *size);
 }
 
 /*
- * Parse two space-separated arguments.
+ * Thin client (--connect): sends the -c commands, or stdin lines with
+ * --batch, and prints the replies as the local modes would.
  */
-void parse_two_args(const char *input, char *arg1, size_t size1, char *arg2, size_t size2) {
-    arg1[0] = '\0';
-    arg2[0] = '\0';
-    
-    /* Find last space - everything before is path, after is tag/category */
-    const char *last_space = strrchr(input, ' ');
+int run_client(const char *socket_path, const char **commands, int count) {
+    static const char *format_names[] = { "text", "ndjson", "tsv", "nul" };
+    struct sockaddr_un addr;
+    if (fill_socket_address(&addr, socket_path) != 0) {
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: cannot connect to %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
     
-    if (last_space) {
-        size_t path_len = last_space - input;
-        if (path_len >= size1) path_len = size1 - 1;
-        strncpy(arg1, input, path_len);
-        arg1[path_len] = '\0';
-        trim_whitespace(arg1);
+    char input[MAX_INPUT_LENGTH];
+    char *output = NULL;
+    size_t capacity = 0;
+    uint32_t status, results, size;
+    int unknown = 0;
+    int rolled_back = 0;
+    int failed = 0;
+    
+    if (output_format != OUTPUT_TEXT) {
+        snprintf(input, sizeof(input), "format %s", format_names[output_format]);
+        failed = client_request(fd, input, &status, &results, &output, &capacity, &size) != 0;
+    }
+    
+    for (int i = 0; !failed; i++) {
+        const char *line;
+        if (count > 0) {
+            if (i >= count) break;
+            line = commands[i];
+        } else {
+            if (!fgets(input, sizeof(input), stdin)) break;
+            trim_whitespace(input);
+            if (strlen(input) == 0 || input[0] == '#') continue;
+            line = input;
+        }
         
-        strncpy(arg2, last_space + 1, size2 - 1);
-        arg2[size2 - 1] = '\0';
-        trim_whitespace(arg2);
+        if (client_request(fd, line, &status, &results, &output, &capacity, &size) != 0) {
+            failed = 1;
+            break;
+        }
+        fwrite(output, 1, size, status == SERVE_OK ? stdout : stderr);
+        if (status == SERVE_UNKNOWN) unknown++;
+        if (status == SERVE_FAILED) rolled_back++;
+        if (count == 0) print_end_marker(line, results);
+        fflush(stdout);
+        
+        char command[16] = "";
+        sscanf(line, "%15s", command);
+        str_to_lower(command);
+        if (strcmp(command, "quit") == 0 || strcmp(command, "exit") == 0) break;
+    }
+    
+    free(output);
+    close(fd);
+    if (failed) {
+        fprintf(stderr, "Error: connection to %s closed\n", socket_path);
+        return 1;
     }
+    return rolled_back > 0 ? 1 : unknown > 0 ? 2 : 0;
 }
 
-/* ============================================
- * Interactive CLI
- * ============================================ */
+#endif
 
-void print_help() {
-    printf("\n");
-    printf("Path Commands:\n");
-    printf("  add <directory>               - Add directory to database (recursive)\n");
-    printf("  remove <path>                 - Remove path from database\n");
-    printf("  info <path>                   - Show path details with tags and categories\n");
-    printf("\n");
-    printf("Search Commands:\n");
-    printf("  search <term>                 - Search paths by name (all methods)\n");
-    printf("  exact <term>                  - Exact match on path names\n");
-    printf("  prefix <term>                 - Prefix match on path names\n");
-    printf("  substring <term>              - Substring match on path names\n");
-    printf("  fuzzy <term> [n]              - Fuzzy match with max distance n\n");
-    printf("  find --category <cat> --tag <tag> --name <term>\n");
-    printf("                                - Structured search with filters\n");
-    printf("\n");
-    printf("Tag Commands:\n");
-    printf("  tag <path> <tagname>          - Add tag to path\n");
-    printf("  untag <path> <tagname>        - Remove tag from path\n");
-    printf("  tags [path]                   - List all tags, or tags on a path\n");
-    printf("  tagsearch <term>              - Search existing tags\n");
-    printf("\n");
-    printf("Category Commands:\n");
-    printf("  categorize <path> <category>  - Add category to path\n");
-    printf("  uncategorize <path> <category>- Remove category from path\n");
-    printf("  categories [path]             - List all categories, or categories on a path\n");
-    printf("  create-category <name>        - Create new category\n");
-    printf("\n");
-    printf("Settings Commands:\n");
-    printf("  set <key> <value>             - Modify a setting\n");
-    printf("  get <key>                     - View a setting\n");
-    printf("  settings                      - List all settings\n");
-    printf("\n");
-    printf("Utility Commands:\n");
-    printf("  stats                         - Show database statistics\n");
-    printf("  help                          - Show this help\n");
-    printf("  quit / exit                   - Exit the program\n");
-    printf("\n");
+/* 'mem' in index mode: the mapping and how much of it is resident */
+void show_index_memory(const mapped_index_t *idx) {
+    out("\n[Index Memory]\n");
+    print_memory_line("Mapped index:", (long long)idx->size);
+#ifndef _WIN32
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (idx->size + page - 1) / page;
+    unsigned char *vec = malloc(pages ? pages : 1);
+    if (vec && mincore((void *)idx->base, idx->size, (void *)vec) == 0) {
+        long long resident = 0;
+        for (size_t i = 0; i < pages; i++) {
+            if (vec[i] & 1) resident += page;
+        }
+        if (resident > (long long)idx->size) resident = (long long)idx->size;
+        print_memory_line("Resident in page cache:", resident);
+    }
+    free(vec);
+#endif
+    print_sqlite_status("SQLite heap in use:", SQLITE_STATUS_MEMORY_USED);
+    out("\n");
 }
 
-void run_interactive_cli() {
+/*
+ * Search-only CLI over a mapped index file (--index). No SQLite
+ * connection is opened in this mode.
+ */
+void run_index_cli(const mapped_index_t *idx) {
     char input[MAX_INPUT_LENGTH];
-    char command[64];
-    char argument[MAX_INPUT_LENGTH];
     
-    printf("\nFileSearch v%d - Interactive CLI\n", 
-           get_int_setting("app_version", DEFAULT_APP_VERSION));
-    printf("Type 'help' for available commands.\n\n");
+    out("\nFileSearch index mode - %llu entries\n", (unsigned long long)idx->header->entry_count);
+    out("Commands: search, exact, prefix, substring, fuzzy <term> [n], stats, mem, check-index, quit\n\n");
     
     while (1) {
-        printf("> ");
+        out("> ");
         fflush(stdout);
         
         if (!fgets(input, sizeof(input), stdin)) {
-            printf("\n");
+            out("\n");
             break;
         }
         
         trim_whitespace(input);
-        
         if (strlen(input) == 0) {
             continue;
         }
         
-        /* Parse command and argument */
-        command[0] = '\0';
-        argument[0] = '\0';
-        
+        char command[64] = "";
+        char argument[MAX_INPUT_LENGTH] = "";
         char *space = strchr(input, ' ');
         if (space) {
             size_t cmd_len = space - input;
             if (cmd_len >= sizeof(command)) cmd_len = sizeof(command) - 1;
             strncpy(command, input, cmd_len);
             command[cmd_len] = '\0';
-            
             strcpy(argument, space + 1);
             trim_whitespace(argument);
         } else {
-            strncpy(command, input, sizeof(command) - 1);
-            command[sizeof(command) - 1] = '\0';
+            size_t cmd_len = strlen(input);
+            if (cmd_len >= sizeof(command)) cmd_len = sizeof(command) - 1;
+            memcpy(command, input, cmd_len);
+            command[cmd_len] = '\0';
         }
-        
-        /* Convert command to lowercase */
         str_to_lower(command);
         
-        /* Execute command */
         if (strcmp(command, "quit") == 0 || strcmp(command, "exit") == 0) {
-            printf("Goodbye!\n");
+            out("Goodbye!\n");
             break;
         }
-        else if (strcmp(command, "help") == 0) {
-            print_help();
+        else if (strcmp(command, "stats") == 0) {
+            show_index_stats(idx);
         }
-        else if (strcmp(command, "add") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: add <directory>\n");
-            } else {
-                add_directory(argument);
-            }
+        else if (strcmp(command, "mem") == 0) {
+            show_index_memory(idx);
         }
-        else if (strcmp(command, "remove") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: remove <path>\n");
-            } else {
-                remove_path_from_db(argument);
-            }
+        else if (strcmp(command, "check-index") == 0) {
+            check_index(idx);
         }
-        else if (strcmp(command, "info") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: info <path>\n");
-            } else {
-                show_path_info(argument);
-            }
+        else if (strlen(argument) == 0 &&
+                 (strcmp(command, "search") == 0 || strcmp(command, "exact") == 0 ||
+                  strcmp(command, "prefix") == 0 || strcmp(command, "substring") == 0 ||
+                  strcmp(command, "fuzzy") == 0)) {
+            out("Usage: %s <term>\n", command);
         }
         else if (strcmp(command, "search") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: search <term>\n");
-            } else {
-                search_paths_all(argument);
-            }
+            index_search_all(idx, argument);
         }
         else if (strcmp(command, "exact") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: exact <term>\n");
-            } else {
-                search_paths_exact(argument);
-            }
+            index_search_exact(idx, argument);
         }
         else if (strcmp(command, "prefix") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: prefix <term>\n");
-            } else {
-                search_paths_prefix(argument);
-            }
+            index_search_prefix(idx, argument);
         }
         else if (strcmp(command, "substring") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: substring <term>\n");
-            } else {
-                search_paths_substring(argument);
-            }
+            index_search_substring(idx, argument);
         }
         else if (strcmp(command, "fuzzy") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: fuzzy <term> [max_distance]\n");
-            } else {
-                char term[256];
-                int distance = -1;
-                
-                if (sscanf(argument, "%255s %d", term, &distance) < 1) {
-                    printf("Usage: fuzzy <term> [max_distance]\n");
-                } else {
-                    search_paths_fuzzy(term, distance);
-                }
-            }
-        }
-        else if (strcmp(command, "find") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: find --category <cat> --tag <tag> --name <term>\n");
-            } else {
-                char category[256], tag[256], name[256];
-                parse_find_args(argument, category, tag, name, sizeof(category));
-                
-                if (strlen(category) == 0 && strlen(tag) == 0 && strlen(name) == 0) {
-                    printf("Usage: find --category <cat> --tag <tag> --name <term>\n");
-                    printf("At least one filter is required.\n");
-                } else {
-                    structured_search(category, tag, name);
-                }
-            }
-        }
-        else if (strcmp(command, "tag") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: tag <path> <tagname>\n");
-            } else {
-                char path[MAX_PATH_LENGTH], tagname[MAX_TAG_LENGTH];
-                parse_two_args(argument, path, sizeof(path), tagname, sizeof(tagname));
-                
-                if (strlen(path) == 0 || strlen(tagname) == 0) {
-                    printf("Usage: tag <path> <tagname>\n");
-                } else {
-                    tag_path(path, tagname);
-                }
-            }
-        }
-        else if (strcmp(command, "untag") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: untag <path> <tagname>\n");
-            } else {
-                char path[MAX_PATH_LENGTH], tagname[MAX_TAG_LENGTH];
-                parse_two_args(argument, path, sizeof(path), tagname, sizeof(tagname));
-                
-                if (strlen(path) == 0 || strlen(tagname) == 0) {
-                    printf("Usage: untag <path> <tagname>\n");
-                } else {
-                    untag_path(path, tagname);
-                }
-            }
-        }
-        else if (strcmp(command, "tags") == 0) {
-            if (strlen(argument) == 0) {
-                list_all_tags();
-            } else {
-                list_path_tags(argument);
-            }
-        }
-        else if (strcmp(command, "tagsearch") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: tagsearch <term>\n");
-            } else {
-                search_tags_fuzzy(argument);
-            }
-        }
-        else if (strcmp(command, "categorize") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: categorize <path> <category>\n");
-            } else {
-                char path[MAX_PATH_LENGTH], catname[256];
-                parse_two_args(argument, path, sizeof(path), catname, sizeof(catname));
-                
-                if (strlen(path) == 0 || strlen(catname) == 0) {
-                    printf("Usage: categorize <path> <category>\n");
-                } else {
-                    categorize_path(path, catname);
-                }
-            }
-        }
-        else if (strcmp(command, "uncategorize") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: uncategorize <path> <category>\n");
-            } else {
-                char path[MAX_PATH_LENGTH], catname[256];
-                parse_two_args(argument, path, sizeof(path), catname, sizeof(catname));
-                
-                if (strlen(path) == 0 || strlen(catname) == 0) {
-                    printf("Usage: uncategorize <path> <category>\n");
-                } else {
-                    uncategorize_path(path, catname);
-                }
-            }
-        }
-        else if (strcmp(command, "categories") == 0) {
-            if (strlen(argument) == 0) {
-                list_all_categories();
-            } else {
-                list_path_categories(argument);
-            }
-        }
-        else if (strcmp(command, "create-category") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: create-category <name>\n");
-            } else {
-                create_category(argument);
-            }
-        }
-        else if (strcmp(command, "set") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: set <key> <value>\n");
-            } else {
-                char key[64], value[256];
-                if (sscanf(argument, "%63s %255s", key, value) == 2) {
-                    cmd_set_setting(key, value);
-                } else {
-                    printf("Usage: set <key> <value>\n");
-                }
-            }
-        }
-        else if (strcmp(command, "get") == 0) {
-            if (strlen(argument) == 0) {
-                printf("Usage: get <key>\n");
-            } else {
-                cmd_get_setting(argument);
+            char term[256];
+            int distance = -1;
+            if (sscanf(argument, "%255s %d", term, &distance) >= 1) {
+                index_search_fuzzy(idx, term, distance);
             }
         }
-        else if (strcmp(command, "settings") == 0) {
-            show_all_settings();
-        }
-        else if (strcmp(command, "stats") == 0) {
-            show_stats();
-        }
         else {
-            printf("Unknown command: '%s'. Type 'help' for available commands.\n", command);
+            out("Unknown command: '%s'. Index mode is search-only.\n", command);
         }
+        result_flush();
     }
 }
 
@@ -2046,26 +11574,68 @@ void run_interactive_cli() {
  * ============================================ */
 
 void print_usage(const char *program_name) {
-    printf("Usage: %s [options]\n", program_name);
-    printf("\n");
-    printf("Options:\n");
-    printf("  --db <path>    Use specified database file\n");
-    printf("  --help         Show this help message\n");
-    printf("\n");
-    printf("Default database location:\n");
+    out("Usage: %s [options]\n", program_name);
+    out("\n");
+    out("Options:\n");
+    out("  --db <path>    Use specified database file\n");
+    out("  --in-memory    Serve queries from an in-memory copy of the database,\n");
+    out("                 writing changes back periodically and on exit\n");
+    out("  --snapshot     Open the published snapshot (<db>%s) read-only,\n", SNAPSHOT_SUFFIX);
+    out("                 without locking, for many concurrent readers\n");
+    out("  --index <file> Search a file written by export-index, without SQLite\n");
+    out("  --shards <dir> Keep each added root in its own database under <dir>\n");
+    out("                 and search all of them in parallel\n");
+    out("  --hw-counters  Count cycles, instructions, cache and branch misses\n");
+    out("                 per command, scan phase and kernel (Linux)\n");
+    out("  --metrics      Keep statement counters and scan phase histograms\n");
+    out("                 for stats --perf and metrics\n");
+    out("  --trace <file> Write Chrome trace events (scan stages, commands,\n");
+    out("                 slow statements) to <file>\n");
+    out("  --log-workload <file>\n");
+    out("                 Append every command with its timestamp to <file>,\n");
+    out("                 for the replay command\n");
+    out("  -c <command>   Run <command> and exit (repeat for several)\n");
+    out("  --batch        Run commands read from stdin, one per line, and exit\n");
+    out("  --format <fmt> Path results for -c/--batch as text, ndjson, tsv or nul\n");
+    out("  --yes          Answer \"yes\" to confirmation prompts in -c, --batch\n");
+    out("                 and --serve (otherwise they are answered \"no\")\n");
+    out("  --serve <socket>\n");
+    out("                 Answer commands from clients on a Unix socket until\n");
+    out("                 SIGINT or SIGTERM\n");
+    out("  --workers <n>  Worker threads for --serve (default %d)\n", SERVE_DEFAULT_WORKERS);
+    out("  --connect <socket>\n");
+    out("                 Send -c or --batch commands to a --serve process\n");
+    out("  --help         Show this help message\n");
+    out("\n");
+    out("Default database location:\n");
     
     char default_path[MAX_PATH_LENGTH];
     if (get_default_db_path(default_path, sizeof(default_path)) == 0) {
-        printf("  %s\n", default_path);
+        out("  %s\n", default_path);
     } else {
-        printf("  (could not determine default path)\n");
+        out("  (could not determine default path)\n");
     }
-    printf("\n");
+    out("\n");
 }
 
 int main(int argc, char *argv[]) {
     char db_path[MAX_PATH_LENGTH];
     int custom_db = 0;
+    int use_in_memory = 0;
+    int use_snapshot = 0;
+    int use_hw_counters = 0;
+    const char *trace_path = NULL;
+    const char *workload_path = NULL;
+    const char *index_path = NULL;
+    const char *shards_path = NULL;
+    const char **batch_commands = calloc(argc, sizeof(const char *));
+    int batch_count = 0;
+    int use_batch = 0;
+    const char *serve_path = NULL;
+    const char *connect_path = NULL;
+    int serve_workers = SERVE_DEFAULT_WORKERS;
+    
+    program_path = argv[0];
     
     /* Parse command line arguments */
     for (int i = 1; i < argc; i++) {
@@ -2083,6 +11653,87 @@ int main(int argc, char *argv[]) {
             custom_db = 1;
             i++;
         }
+        else if (strcmp(argv[i], "--in-memory") == 0) {
+            use_in_memory = 1;
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0) {
+            use_snapshot = 1;
+        }
+        else if (strcmp(argv[i], "--hw-counters") == 0) {
+            use_hw_counters = 1;
+        }
+        else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics_enabled = 1;
+        }
+        else if (strcmp(argv[i], "--yes") == 0) {
+            assume_yes = 1;
+        }
+        else if (strcmp(argv[i], "--log-workload") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --log-workload requires a file argument\n");
+                return 1;
+            }
+            workload_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --trace requires a file argument\n");
+                return 1;
+            }
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -c requires a command argument\n");
+                return 1;
+            }
+            batch_commands[batch_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            use_batch = 1;
+        }
+        else if (strcmp(argv[i], "--format") == 0) {
+            if (i + 1 >= argc || parse_output_format(argv[i + 1], &output_format) != 0) {
+                fprintf(stderr, "Error: --format requires text, ndjson, tsv or nul\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --serve requires a socket path\n");
+                return 1;
+            }
+            serve_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--workers") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                fprintf(stderr, "Error: --workers requires a positive number\n");
+                return 1;
+            }
+            serve_workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--connect") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --connect requires a socket path\n");
+                return 1;
+            }
+            connect_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--index") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --index requires a file argument\n");
+                return 1;
+            }
+            index_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shards") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --shards requires a directory argument\n");
+                return 1;
+            }
+            shards_path = argv[++i];
+        }
         else {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             print_usage(argv[0]);
@@ -2090,6 +11741,63 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (batch_count > 0 && use_batch) {
+        fprintf(stderr, "Error: -c and --batch cannot be combined\n");
+        return 1;
+    }
+    batch_mode = batch_count > 0 || use_batch;
+    if (output_format != OUTPUT_TEXT && !batch_mode) {
+        fprintf(stderr, "Error: --format needs -c or --batch\n");
+        return 1;
+    }
+    if (batch_mode && (index_path || serve_path)) {
+        fprintf(stderr, "Error: -c and --batch are not available with --index or --serve\n");
+        return 1;
+    }
+    if (connect_path && !batch_mode) {
+        fprintf(stderr, "Error: --connect needs -c or --batch\n");
+        return 1;
+    }
+    non_interactive = batch_mode || serve_path;
+    if ((batch_mode || serve_path) && !shards_path) {
+        shared_scan_init();
+    }
+    
+#ifdef _WIN32
+    if (serve_path || connect_path) {
+        fprintf(stderr, "Error: --serve and --connect need Unix domain sockets\n");
+        return 1;
+    }
+#else
+    /* The client never opens the database */
+    if (connect_path) {
+        int status = run_client(connect_path, batch_commands, batch_count);
+        free(batch_commands);
+        return status;
+    }
+#endif
+    
+    metrics_init();
+    if (trace_path && trace_open(trace_path) != 0) {
+        return 1;
+    }
+    if (workload_path && workload_open(workload_path) != 0) {
+        return 1;
+    }
+    if (use_hw_counters) {
+        hw_counters_init();
+    }
+    
+    /* Index mode never touches the database */
+    if (index_path) {
+        if (open_index(index_path, &mapped_index) != 0) {
+            return 1;
+        }
+        run_index_cli(&mapped_index);
+        close_index(&mapped_index);
+        return 0;
+    }
+    
     /* Use default path if not specified */
     if (!custom_db) {
         if (get_default_db_path(db_path, sizeof(db_path)) != 0) {
@@ -2098,15 +11806,74 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (use_in_memory + use_snapshot + (shards_path != NULL) > 1) {
+        fprintf(stderr, "Error: --in-memory, --snapshot and --shards cannot be combined\n");
+        return 1;
+    }
+    
+    strncpy(db_file_path, db_path, sizeof(db_file_path) - 1);
+    db_file_path[sizeof(db_file_path) - 1] = '\0';
+    
+    if (shards_path) {
+        if (open_shards(shards_path) != 0) {
+            close_shards();
+            return 1;
+        }
+    }
+    else if (use_snapshot) {
+        char snapshot_path[MAX_PATH_LENGTH];
+        if (get_snapshot_path(db_path, snapshot_path, sizeof(snapshot_path)) != 0 ||
+            open_snapshot(snapshot_path) != 0) {
+            sqlite3_close(db);
+            return 1;
+        }
+    }
     /* Initialize database */
-    if (init_database(db_path) != 0) {
+    else if (init_database(db_path) != 0) {
         return 1;
     }
+    /* Sessions that stay up warm the file while they wait for input; -c does not */
+    else if (!use_in_memory && batch_count == 0) {
+        prefetch_file(db_path);
+    }
+    
+    if (use_in_memory) {
+        if (load_database_into_memory(db_path) != 0) {
+            sqlite3_close(db);
+            return 1;
+        }
+        start_persist_thread();
+    }
+    
+    apply_memory_limits();
+    metrics_install_trace(db);
+    /* In memory a COMMIT is not durable, so replies would not wait for anything */
+    if ((batch_mode || serve_path) && !shards_path && !use_snapshot && !use_in_memory) {
+        group_commit_init();
+    }
     
-    /* Run interactive CLI */
-    run_interactive_cli();
+    /* Run the commands given, the daemon, or the interactive CLI */
+    int status = 0;
+    if (batch_mode) {
+        run_batch(batch_commands, batch_count);
+    }
+#ifndef _WIN32
+    else if (serve_path) {
+        status = run_server(serve_path, serve_workers) == 0 ? 0 : 1;
+    }
+#endif
+    else {
+        run_interactive_cli();
+    }
+    free(batch_commands);
     
     /* Cleanup */
+    workload_close();
+    trace_close();
+    stop_in_memory_mode();
+    close_shards();
     sqlite3_close(db);
-    return 0;
+    if (batch_mode && unknown_commands > 0) status = 2;
+    if (batch_mode && group_commit_failed) status = 1;
+    return status;
 }
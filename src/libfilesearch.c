@@ -0,0 +1,532 @@
+/*
+ * FileSearch library: searching and tagging without the CLI.
+ * See filesearch.h for the API. The CLI (filesearch_v3.c) runs its
+ * path searches through these functions on its own connection.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../deps/sqlite3.h"
+#include "filesearch.h"
+
+struct fs_db {
+    sqlite3 *conn;
+    int owns_conn;
+    char errmsg[256];
+};
+
+typedef struct {
+    char *path;
+    char *name;
+    int is_directory;
+    long long size;
+    int distance;
+} fs_match_row;
+
+struct fs_iter {
+    fs_db *fs;
+    sqlite3_stmt *stmt;        /* rows are read as the caller asks for them */
+    fs_match_row *rows;        /* fuzzy: the matches kept, sorted up front */
+    int count;
+    int capacity;
+    int next;
+};
+
+/* ============================================
+ * Helpers
+ * ============================================ */
+
+static int set_error(fs_db *fs, const char *message) {
+    snprintf(fs->errmsg, sizeof(fs->errmsg), "%s", message);
+    return FS_ERROR;
+}
+
+static int set_sqlite_error(fs_db *fs) {
+    return set_error(fs, sqlite3_errmsg(fs->conn));
+}
+
+static int has_text(const char *s) {
+    return s && s[0] != '\0';
+}
+
+static int min3(int a, int b, int c) {
+    int min = a;
+    if (b < min) min = b;
+    if (c < min) min = c;
+    return min;
+}
+
+int fs_levenshtein_bounded(const char *s1, int len1, const char *s2, int len2, int max_distance) {
+    int over = max_distance + 1;
+    
+    if (len1 > len2) {
+        const char *temp = s1;
+        s1 = s2;
+        s2 = temp;
+        int t = len1;
+        len1 = len2;
+        len2 = t;
+    }
+    
+    if (len2 - len1 > max_distance) return over;
+    if (len1 == 0) return len2;
+    
+    int stack_rows[2 * 128];
+    int *prev = stack_rows;
+    int *curr = stack_rows + 128;
+    int *heap = NULL;
+    
+    if (len1 + 1 > 128) {
+        heap = malloc(2 * (len1 + 1) * sizeof(int));
+        if (!heap) return -1;
+        prev = heap;
+        curr = heap + len1 + 1;
+    }
+    
+    for (int i = 0; i <= len1; i++) {
+        prev[i] = (i <= max_distance) ? i : over;
+    }
+    
+    for (int j = 1; j <= len2; j++) {
+        int lo = j - max_distance;
+        int hi = j + max_distance;
+        if (lo < 1) lo = 1;
+        if (hi > len1) hi = len1;
+    
+        curr[lo - 1] = (lo == 1) ? j : over;
+        int row_min = curr[lo - 1];
+    
+        for (int i = lo; i <= hi; i++) {
+            int cost = (tolower(s1[i-1]) == tolower(s2[j-1])) ? 0 : 1;
+            int d = min3(prev[i] + 1, curr[i-1] + 1, prev[i-1] + cost);
+            if (d > over) d = over;
+            curr[i] = d;
+            if (d < row_min) row_min = d;
+        }
+        if (hi < len1) {
+            curr[hi + 1] = over;
+        }
+    
+        if (row_min > max_distance) {
+            free(heap);
+            return over;
+        }
+    
+        int *temp = prev;
+        prev = curr;
+        curr = temp;
+    }
+    
+    int result = prev[len1];
+    free(heap);
+    return result > max_distance ? over : result;
+}
+
+/* ============================================
+ * Opening and Closing
+ * ============================================ */
+
+int fs_open(const char *db_path, int flags, fs_db **out) {
+    *out = NULL;
+    fs_db *fs = calloc(1, sizeof(fs_db));
+    if (!fs) return FS_ERROR;
+    
+    int open_flags = (flags & FS_OPEN_READONLY) ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
+    if (sqlite3_open_v2(db_path, &fs->conn, open_flags, NULL) != SQLITE_OK) {
+        set_sqlite_error(fs);
+        fs->owns_conn = 1;
+        *out = fs;
+        return FS_ERROR;
+    }
+    fs->owns_conn = 1;
+    *out = fs;
+    sqlite3_busy_timeout(fs->conn, 5000);
+    
+    /* Refuse files the CLI did not create, before any search fails on them */
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(fs->conn, "SELECT 1 FROM paths LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) {
+        return set_error(fs, "not a filesearch database");
+    }
+    sqlite3_finalize(stmt);
+    return FS_OK;
+}
+
+int fs_attach(struct sqlite3 *conn, fs_db **out) {
+    *out = calloc(1, sizeof(fs_db));
+    if (!*out) return FS_ERROR;
+    (*out)->conn = conn;
+    return FS_OK;
+}
+
+void fs_close(fs_db *fs) {
+    if (!fs) return;
+    if (fs->owns_conn) sqlite3_close(fs->conn);
+    free(fs);
+}
+
+const char *fs_errmsg(fs_db *fs) {
+    if (!fs) return "out of memory";
+    return fs->errmsg;
+}
+
+/* ============================================
+ * Searching
+ * ============================================ */
+
+void fs_search_options_init(fs_search_options *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->match = FS_MATCH_SUBSTRING;
+    opts->max_distance = 3;
+    opts->sort = FS_SORT_NONE;
+}
+
+/*
+ * Build the SQL for a search. Parameters are bound by bind_search in
+ * the same order. Fuzzy searches read every row the filters allow and
+ * compute distances in fs_search; the others filter and limit in SQL.
+ */
+static void build_search_sql(const fs_search_options *opts, char *sql, size_t size) {
+    int joins = has_text(opts->category) || has_text(opts->tag);
+    int has_where = 0;
+    
+    snprintf(sql, size, "SELECT %sp.path, p.is_directory, p.size, p.name FROM paths p ",
+             joins ? "DISTINCT " : "");
+    
+    if (has_text(opts->category)) {
+        strncat(sql, "JOIN path_categories pc ON p.id = pc.path_id ", size - strlen(sql) - 1);
+        strncat(sql, "JOIN categories c ON pc.category_id = c.id ", size - strlen(sql) - 1);
+    }
+    
+    if (has_text(opts->tag)) {
+        strncat(sql, "JOIN path_tags pt ON p.id = pt.path_id ", size - strlen(sql) - 1);
+        strncat(sql, "JOIN tags t ON pt.tag_id = t.id ", size - strlen(sql) - 1);
+    }
+    
+    if (has_text(opts->category)) {
+        strncat(sql, "WHERE c.name = ? COLLATE NOCASE ", size - strlen(sql) - 1);
+        has_where = 1;
+    }
+    
+    if (has_text(opts->tag)) {
+        strncat(sql, has_where ? "AND " : "WHERE ", size - strlen(sql) - 1);
+        strncat(sql, "t.name = ? COLLATE NOCASE ", size - strlen(sql) - 1);
+        has_where = 1;
+    }
+    
+    if (has_text(opts->query) && opts->match != FS_MATCH_FUZZY) {
+        const char *condition =
+            opts->match == FS_MATCH_EXACT  ? "p.name = ? COLLATE NOCASE " :
+            opts->match == FS_MATCH_PREFIX ? "p.name LIKE ? || '%' COLLATE NOCASE " :
+                                             "p.name LIKE '%' || ? || '%' COLLATE NOCASE ";
+        strncat(sql, has_where ? "AND " : "WHERE ", size - strlen(sql) - 1);
+        strncat(sql, condition, size - strlen(sql) - 1);
+    }
+    
+    if (opts->sort == FS_SORT_PATH && opts->match != FS_MATCH_FUZZY) {
+        strncat(sql, "ORDER BY p.path ", size - strlen(sql) - 1);
+    }
+    
+    strncat(sql, opts->match == FS_MATCH_FUZZY ? ";" : "LIMIT ?;", size - strlen(sql) - 1);
+}
+
+static void bind_search(sqlite3_stmt *stmt, const fs_search_options *opts) {
+    int param = 1;
+    if (has_text(opts->category)) {
+        sqlite3_bind_text(stmt, param++, opts->category, -1, SQLITE_STATIC);
+    }
+    if (has_text(opts->tag)) {
+        sqlite3_bind_text(stmt, param++, opts->tag, -1, SQLITE_STATIC);
+    }
+    if (opts->match == FS_MATCH_FUZZY) {
+        return;
+    }
+    if (has_text(opts->query)) {
+        sqlite3_bind_text(stmt, param++, opts->query, -1, SQLITE_STATIC);
+    }
+    /* A negative LIMIT is no limit */
+    sqlite3_bind_int(stmt, param, opts->limit > 0 ? opts->limit : -1);
+}
+
+static int add_match(fs_iter *it, sqlite3_stmt *stmt, int distance) {
+    if (it->count == it->capacity) {
+        int capacity = it->capacity ? it->capacity * 2 : 16;
+        fs_match_row *grown = realloc(it->rows, capacity * sizeof(fs_match_row));
+        if (!grown) return -1;
+        it->rows = grown;
+        it->capacity = capacity;
+    }
+    fs_match_row *m = &it->rows[it->count];
+    m->path = strdup((const char *)sqlite3_column_text(stmt, 0));
+    m->name = strdup((const char *)sqlite3_column_text(stmt, 3));
+    m->is_directory = sqlite3_column_int(stmt, 1);
+    m->size = sqlite3_column_int64(stmt, 2);
+    m->distance = distance;
+    if (!m->path || !m->name) {
+        free(m->path);
+        free(m->name);
+        return -1;
+    }
+    it->count++;
+    return 0;
+}
+
+static int compare_by_distance(const void *a, const void *b) {
+    const fs_match_row *x = a, *y = b;
+    if (x->distance != y->distance) return x->distance - y->distance;
+    int cmp = strcmp(x->name, y->name);
+    return cmp ? cmp : strcmp(x->path, y->path);
+}
+
+static int compare_by_path(const void *a, const void *b) {
+    const fs_match_row *x = a, *y = b;
+    return strcmp(x->path, y->path);
+}
+
+/* ---- Top-k heap (worst row at index 0) ---- */
+
+typedef int (*compare_fn)(const void *, const void *);
+
+static void heap_swap(fs_match_row *rows, int i, int j) {
+    fs_match_row swap = rows[i];
+    rows[i] = rows[j];
+    rows[j] = swap;
+}
+
+static void heap_sift_up(fs_match_row *rows, int i, compare_fn compare) {
+    while (i > 0 && compare(&rows[(i - 1) / 2], &rows[i]) < 0) {
+        heap_swap(rows, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_sift_down(fs_match_row *rows, int count, int i, compare_fn compare) {
+    for (;;) {
+        int worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && compare(&rows[left], &rows[worst]) > 0) worst = left;
+        if (right < count && compare(&rows[right], &rows[worst]) > 0) worst = right;
+        if (worst == i) return;
+        heap_swap(rows, i, worst);
+        i = worst;
+    }
+}
+
+/* Replace the worst kept row with the statement's row if it sorts before it */
+static int replace_worst(fs_iter *it, sqlite3_stmt *stmt, int distance, compare_fn compare) {
+    fs_match_row candidate;
+    candidate.path = (char *)sqlite3_column_text(stmt, 0);
+    candidate.name = (char *)sqlite3_column_text(stmt, 3);
+    candidate.distance = distance;
+    if (compare(&candidate, &it->rows[0]) >= 0) return 0;
+    
+    char *path = strdup(candidate.path);
+    char *name = strdup(candidate.name);
+    if (!path || !name) {
+        free(path);
+        free(name);
+        return -1;
+    }
+    fs_match_row *worst = &it->rows[0];
+    free(worst->path);
+    free(worst->name);
+    worst->path = path;
+    worst->name = name;
+    worst->is_directory = sqlite3_column_int(stmt, 1);
+    worst->size = sqlite3_column_int64(stmt, 2);
+    worst->distance = distance;
+    heap_sift_down(it->rows, it->count, 0, compare);
+    return 0;
+}
+
+/*
+ * Read every candidate row and keep those within max_distance. With a
+ * limit, only the best 'limit' rows in the requested order are kept (a
+ * max-heap evicting the worst), so memory follows the limit rather
+ * than the number of matches; sorted by distance, rows worse than the
+ * worst kept one are cut off early by the bounded distance.
+ */
+static int collect_fuzzy(fs_iter *it, const fs_search_options *opts) {
+    const char *query = opts->query ? opts->query : "";
+    int query_length = (int)strlen(query);
+    compare_fn compare = opts->sort == FS_SORT_PATH ? compare_by_path : compare_by_distance;
+    int rc;
+    
+    while ((rc = sqlite3_step(it->stmt)) == SQLITE_ROW) {
+        int full = opts->limit > 0 && it->count >= opts->limit;
+        int bound = full && compare == compare_by_distance ? it->rows[0].distance : opts->max_distance;
+        const char *name = (const char *)sqlite3_column_text(it->stmt, 3);
+        int name_length = sqlite3_column_bytes(it->stmt, 3);
+        int distance = fs_levenshtein_bounded(query, query_length, name, name_length, bound);
+        if (distance < 0) return set_error(it->fs, "out of memory");
+        if (distance > bound) continue;
+        
+        if (full) {
+            if (replace_worst(it, it->stmt, distance, compare) != 0) return set_error(it->fs, "out of memory");
+            continue;
+        }
+        if (add_match(it, it->stmt, distance) != 0) return set_error(it->fs, "out of memory");
+        if (opts->limit > 0) heap_sift_up(it->rows, it->count - 1, compare);
+    }
+    if (rc != SQLITE_DONE) return set_sqlite_error(it->fs);
+    
+    sqlite3_finalize(it->stmt);
+    it->stmt = NULL;
+    
+    qsort(it->rows, it->count, sizeof(fs_match_row), compare);
+    return FS_OK;
+}
+
+int fs_search(fs_db *fs, const fs_search_options *opts, fs_iter **out) {
+    *out = NULL;
+    if (opts->match == FS_MATCH_FUZZY && opts->max_distance < 0) {
+        return set_error(fs, "max_distance must not be negative");
+    }
+    
+    fs_iter *it = calloc(1, sizeof(fs_iter));
+    if (!it) return set_error(fs, "out of memory");
+    it->fs = fs;
+    
+    char sql[1024];
+    build_search_sql(opts, sql, sizeof(sql));
+    if (sqlite3_prepare_v2(fs->conn, sql, -1, &it->stmt, NULL) != SQLITE_OK) {
+        set_sqlite_error(fs);
+        fs_iter_free(it);
+        return FS_ERROR;
+    }
+    bind_search(it->stmt, opts);
+    
+    if (opts->match == FS_MATCH_FUZZY && collect_fuzzy(it, opts) != FS_OK) {
+        fs_iter_free(it);
+        return FS_ERROR;
+    }
+    
+    *out = it;
+    return FS_OK;
+}
+
+int fs_iter_next(fs_iter *it, fs_result *result) {
+    if (!it->stmt) {
+        if (it->next >= it->count) return FS_DONE;
+        fs_match_row *m = &it->rows[it->next++];
+        result->path = m->path;
+        result->name = m->name;
+        result->is_directory = m->is_directory;
+        result->size = m->size;
+        result->distance = m->distance;
+        return FS_ROW;
+    }
+    
+    int rc = sqlite3_step(it->stmt);
+    if (rc == SQLITE_DONE) return FS_DONE;
+    if (rc != SQLITE_ROW) return set_sqlite_error(it->fs);
+    
+    result->path = (const char *)sqlite3_column_text(it->stmt, 0);
+    result->is_directory = sqlite3_column_int(it->stmt, 1);
+    result->size = sqlite3_column_int64(it->stmt, 2);
+    result->name = (const char *)sqlite3_column_text(it->stmt, 3);
+    result->distance = 0;
+    return FS_ROW;
+}
+
+void fs_iter_free(fs_iter *it) {
+    if (!it) return;
+    sqlite3_finalize(it->stmt);
+    for (int i = 0; i < it->count; i++) {
+        free(it->rows[i].path);
+        free(it->rows[i].name);
+    }
+    free(it->rows);
+    free(it);
+}
+
+/* ============================================
+ * Tagging
+ * ============================================ */
+
+/* Run a one-value lookup; the id, 0 if there is no row, or -1 on error */
+static sqlite3_int64 lookup_id(fs_db *fs, const char *sql, const char *value) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(fs->conn, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        set_sqlite_error(fs);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, value, -1, SQLITE_STATIC);
+    
+    sqlite3_int64 id = 0;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        id = sqlite3_column_int64(stmt, 0);
+    } else if (rc != SQLITE_DONE) {
+        set_sqlite_error(fs);
+        id = -1;
+    }
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+static int run_link(fs_db *fs, const char *sql, sqlite3_int64 a, sqlite3_int64 b) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(fs->conn, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return set_sqlite_error(fs);
+    }
+    sqlite3_bind_int64(stmt, 1, a);
+    sqlite3_bind_int64(stmt, 2, b);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? FS_OK : set_sqlite_error(fs);
+}
+
+#define PATH_ID_SQL "SELECT id FROM paths WHERE path = ?;"
+#define TAG_ID_SQL  "SELECT id FROM tags WHERE name = ? COLLATE NOCASE;"
+
+int fs_tag(fs_db *fs, const char *path, const char *tag) {
+    if (!has_text(tag)) return set_error(fs, "empty tag name");
+    
+    sqlite3_int64 path_id = lookup_id(fs, PATH_ID_SQL, path);
+    if (path_id < 0) return FS_ERROR;
+    if (path_id == 0) {
+        set_error(fs, "path not found in database");
+        return FS_NOT_FOUND;
+    }
+    
+    /* A savepoint works both on its own and inside the caller's transaction */
+    if (sqlite3_exec(fs->conn, "SAVEPOINT fs_tag;", NULL, NULL, NULL) != SQLITE_OK) {
+        return set_sqlite_error(fs);
+    }
+    
+    int rc = FS_ERROR;
+    sqlite3_int64 tag_id = lookup_id(fs, TAG_ID_SQL, tag);
+    if (tag_id == 0) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(fs->conn, "INSERT INTO tags (name) VALUES (?);", -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_STATIC);
+            tag_id = (sqlite3_step(stmt) == SQLITE_DONE) ? sqlite3_last_insert_rowid(fs->conn) : -1;
+            sqlite3_finalize(stmt);
+        } else {
+            tag_id = -1;
+        }
+        if (tag_id < 0) set_sqlite_error(fs);
+    }
+    if (tag_id > 0) {
+        rc = run_link(fs, "INSERT OR IGNORE INTO path_tags (path_id, tag_id) VALUES (?, ?);", path_id, tag_id);
+    }
+    
+    if (rc != FS_OK) {
+        sqlite3_exec(fs->conn, "ROLLBACK TO fs_tag;", NULL, NULL, NULL);
+    }
+    sqlite3_exec(fs->conn, "RELEASE fs_tag;", NULL, NULL, NULL);
+    return rc;
+}
+
+int fs_untag(fs_db *fs, const char *path, const char *tag) {
+    sqlite3_int64 path_id = lookup_id(fs, PATH_ID_SQL, path);
+    if (path_id < 0) return FS_ERROR;
+    sqlite3_int64 tag_id = path_id ? lookup_id(fs, TAG_ID_SQL, tag) : 0;
+    if (tag_id < 0) return FS_ERROR;
+    if (path_id == 0 || tag_id == 0) {
+        set_error(fs, path_id ? "tag not found" : "path not found in database");
+        return FS_NOT_FOUND;
+    }
+    return run_link(fs, "DELETE FROM path_tags WHERE path_id = ? AND tag_id = ?;", path_id, tag_id);
+}